@@ -0,0 +1,224 @@
+#pragma once
+#ifndef FS_BLOCK_CACHE_HPP
+#define FS_BLOCK_CACHE_HPP
+
+#include <hw/writable_blkdev.hpp>
+#include <timers>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs {
+
+  /**
+   * Shared cache of device blocks, keyed by (device id, block)
+   *
+   * Sits between file systems and hw::Block_device. Blocks are evicted
+   * using the CLOCK (second chance) algorithm, and sequential access
+   * patterns on a device grow a read-ahead window, so that streaming
+   * a file turns into a few large device reads instead of many small ones.
+   *
+   * Reads larger than a quarter of the cache bypass it entirely, so that
+   * a single big file read does not flush out hot metadata blocks.
+   * Memory-backed devices (see Block_device::read_view) are never cached.
+   *
+   * Writes are write-back: they only dirty cached blocks, which reach the
+   * device when flushed (explicitly, periodically or on eviction). Adjacent
+   * dirty blocks are merged into one device write. Blocks stay dirty until
+   * the device reports them written, so failed writes are retried by the
+   * next flush, and a dirty block that can't be written back is not evicted.
+  **/
+  class Block_cache {
+  public:
+    using block_t       = hw::Block_device::block_t;
+    using buffer_t      = hw::Block_device::buffer_t;
+    using on_read_func  = hw::Block_device::on_read_func;
+    using on_flush_func = delegate<void(bool error)>;
+
+    /** Default number of blocks held by the shared cache */
+    static constexpr size_t DEFAULT_CAPACITY  = 2048;
+    /** Default upper bound on the read-ahead window, in blocks */
+    static constexpr size_t DEFAULT_READAHEAD = 64;
+    /** Initial read-ahead window when a sequential stream is detected */
+    static constexpr size_t INITIAL_READAHEAD = 4;
+
+    /** Retrieve the cache shared by all file systems */
+    static Block_cache& get();
+
+    /**
+     * Construct a cache
+     *
+     * @param capacity  Maximum number of blocks held
+     * @param name      Prefix for the Statman counters
+     */
+    explicit Block_cache(size_t capacity = DEFAULT_CAPACITY,
+                         const std::string& name = "blkcache");
+
+    /**
+     * Read @count blocks starting at @blk from @dev through the cache.
+     * The reader is called immediately when every block is cached,
+     * otherwise once the device has delivered the missing range.
+     *
+     * @note A nullptr is passed to the reader if an error occurred
+     */
+    void read(hw::Block_device& dev, block_t blk, size_t count, on_read_func reader);
+
+    /** Synchronous version of read(), returns nullptr on error */
+    buffer_t read_sync(hw::Block_device& dev, block_t blk, size_t count = 1);
+
+    /**
+     * Read @count blocks ahead of time, without returning them.
+     * Useful for pinning down metadata such as the file allocation table.
+     */
+    void prefetch(hw::Block_device& dev, block_t blk, size_t count);
+
+    /**
+     * Write @count blocks from @data to the cache, marking them dirty.
+     * The device is not touched until the blocks are flushed, unless every
+     * cached block is dirty and can't be written back, in which case the
+     * blocks are written through.
+     * Returns true on error, like Writable_Block_device::write_sync.
+     */
+    bool write(hw::Writable_Block_device& dev, block_t blk,
+               const uint8_t* data, size_t count);
+
+    /**
+     * Write back all dirty blocks of a device asynchronously,
+     * merging adjacent blocks into single device writes.
+     * @on_flush is called once every write has completed.
+     */
+    void flush(int device_id, on_flush_func on_flush);
+
+    /** Write back all dirty blocks of a device synchronously.
+        Returns true on error, like Writable_Block_device::write_sync. */
+    bool flush_sync(int device_id);
+
+    /** Write back the dirty blocks of every device synchronously */
+    bool flush_sync();
+
+    /** Periodically flush every device with dirty blocks (0 disables) */
+    void set_writeback_interval(Timers::duration_t interval);
+
+    /** Number of dirty blocks belonging to a device */
+    size_t dirty(int device_id) const noexcept;
+
+    /** Returns true if the given block is currently cached */
+    bool contains(int device_id, block_t blk) const noexcept;
+
+    /** Drop every cached block belonging to a device, dirty blocks included */
+    void invalidate(int device_id);
+
+    /** Drop a range of cached blocks belonging to a device */
+    void invalidate(int device_id, block_t blk, size_t count = 1);
+
+    /** Drop everything */
+    void clear();
+
+    /** Set the upper bound on the read-ahead window (0 disables read-ahead) */
+    void set_readahead(size_t max_blocks) noexcept
+    { max_readahead_ = std::min(max_blocks, capacity_ / 4); }
+
+    size_t readahead() const noexcept
+    { return max_readahead_; }
+
+    /** Maximum number of blocks held */
+    size_t capacity() const noexcept
+    { return capacity_; }
+
+    /** Number of blocks currently held */
+    size_t size() const noexcept
+    { return index_.size(); }
+
+    uint64_t hits() const noexcept       { return stat_hits_; }
+    uint64_t misses() const noexcept     { return stat_misses_; }
+    uint64_t readaheads() const noexcept { return stat_readahead_; }
+    uint64_t evictions() const noexcept  { return stat_evictions_; }
+    uint64_t writebacks() const noexcept { return stat_writebacks_; }
+    uint64_t write_errors() const noexcept { return stat_write_errors_; }
+
+  private:
+    struct Key {
+      int     dev;
+      block_t blk;
+      bool operator== (const Key& other) const noexcept
+      { return dev == other.dev && blk == other.blk; }
+    };
+    struct Key_hash {
+      size_t operator() (const Key& k) const noexcept
+      { return std::hash<uint64_t>{}(k.blk * 31 + k.dev); }
+    };
+
+    struct Page {
+      Key      key {-1, 0};
+      bool     referenced = false;
+      bool     dirty      = false;
+      // bumped on every write, to tell if a block was written to
+      // while being written back
+      uint32_t version    = 0;
+      std::vector<uint8_t> data;
+    };
+
+    /** Adjacent dirty blocks, to be written back as one */
+    struct Run {
+      block_t  blk;
+      buffer_t data;
+      std::vector<uint32_t> versions;
+    };
+
+    /** Per-device sequential stream detection */
+    struct Stream {
+      block_t next   = 0;
+      size_t  window = 0;
+    };
+
+    struct Plan {
+      bool    bypass = false;
+      size_t  first_miss = 0; // relative to requested blk
+      size_t  last_miss  = 0; // relative to requested blk (inclusive)
+      size_t  fill_count = 0; // blocks to read from device, from first_miss
+      // the result, with the blocks that were cached copied in already,
+      // as they may be evicted while the device reads the rest
+      buffer_t          result;
+      std::vector<bool> cached;
+    };
+
+    Plan      plan(hw::Block_device& dev, block_t blk, size_t count);
+    buffer_t  complete(hw::Block_device& dev, block_t blk, size_t count,
+                       const Plan& p, const buffer_t& fill);
+    Page*     lookup(int dev, block_t blk) noexcept;
+    // nullptr if there is no room
+    Page*     insert(int dev, block_t blk, const uint8_t* data, size_t len);
+    // the slot of an evicted page, or NO_SLOT
+    size_t    evict();
+    static constexpr size_t NO_SLOT = SIZE_MAX;
+    void      drop(Page&);
+    void      overlay_dirty(int dev, block_t blk, size_t count, buffer_t& data);
+    // contiguous runs of dirty blocks, ready to be written
+    std::vector<Run> dirty_runs(int dev);
+    // clean the blocks of a run that haven't been written to since
+    void written(int dev, const Run&);
+
+    size_t capacity_;
+    size_t max_readahead_ = DEFAULT_READAHEAD;
+    size_t hand_ = 0;
+    std::vector<Page> pages_;
+    std::unordered_map<Key, size_t, Key_hash> index_;
+    std::unordered_map<int, Stream> streams_;
+    // devices that have been written to through the cache
+    std::unordered_map<int, hw::Writable_Block_device*> writers_;
+    std::unordered_map<int, size_t> dirty_;
+    Timers::id_t writeback_timer_ = Timers::UNUSED_ID;
+
+    uint64_t& stat_hits_;
+    uint64_t& stat_misses_;
+    uint64_t& stat_readahead_;
+    uint64_t& stat_evictions_;
+    uint64_t& stat_writebacks_;
+    uint64_t& stat_write_errors_;
+  }; //< class Block_cache
+
+} //< namespace fs
+
+#endif //< FS_BLOCK_CACHE_HPP
@@ -22,6 +22,11 @@ namespace fs {
    */
   using buffer_t = os::mem::buf_ptr;
 
+  /**
+   * @brief Non-owning view into memory-backed file data
+   */
+  using view_t = hw::Block_device::view_t;
+
   /** Construct a shared vector **/
   template <typename... Args>
   buffer_t construct_buffer(Args&&... args) {
@@ -57,7 +62,11 @@ namespace fs {
 
       E_NOENT,
       E_NOTDIR,
-      E_NOTFILE
+      E_NOTFILE,
+
+      E_EXIST,
+      E_NOSPC,
+      E_ROFS
     }; //< enum token_t
 
     /**
@@ -78,6 +87,12 @@ namespace fs {
      */
     const std::string& token() const noexcept;
 
+    /**
+     * @brief Get the error token
+     */
+    token_t code() const noexcept
+    { return token_; }
+
     /**
      * @brief Get an explanation for error
      */
@@ -183,6 +198,7 @@ namespace fs {
   using on_ls_func    = delegate<void(error_t, Dirvec_ptr)>;
   using on_read_func  = delegate<void(error_t, buffer_t)>;
   using on_stat_func  = delegate<void(error_t, Dirent)>;
+  using on_sync_func  = delegate<void(error_t)>;
 
   struct List
   {
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef FS_DENTRY_CACHE_HPP
+#define FS_DENTRY_CACHE_HPP
+
+#include <fs/dirent.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace fs {
+
+  /**
+   * Hashed cache of resolved directory entries
+   *
+   * Entries are found either by full path or by (parent directory, name).
+   * Full paths are resolved within a namespace: the VFS tree (VFS_NS)
+   * or the file system of a device (its device id). Parent+name keys are
+   * used by file systems to skip directory reads while walking a path.
+   *
+   * Lookups that failed are cached as well (negative entries), holding
+   * an invalid Dirent. Everything belonging to a device is dropped when it
+   * is (re)mounted or modified, and all VFS paths when the tree changes.
+  **/
+  class Dentry_cache {
+  public:
+    /** Namespace of absolute VFS paths */
+    static constexpr int VFS_NS = -1;
+    /** Default maximum number of entries, per key type */
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+    /** Retrieve the cache shared by VFS and all file systems */
+    static Dentry_cache& get();
+
+    explicit Dentry_cache(size_t capacity = DEFAULT_CAPACITY,
+                          const std::string& name = "dcache");
+
+    /**
+     * Look up a full path in a namespace
+     * @return nullptr on miss, otherwise the cached entry,
+     *         which is invalid when the path is known not to exist
+     */
+    const Dirent* lookup(int ns, const std::string& path);
+
+    /** Cache the result of resolving @path (invalid dirent = negative entry) */
+    void insert(int ns, const std::string& path, const Dirent& ent);
+
+    /** Look up @name in the directory starting at block @dir of a device */
+    const Dirent* lookup(int dev, uint64_t dir, const std::string& name);
+
+    /** Cache @name in the directory starting at block @dir of a device */
+    void insert(int dev, uint64_t dir, const std::string& name, const Dirent& ent);
+
+    /** Drop everything belonging to a device, and every negative VFS path */
+    void invalidate(int dev);
+
+    /** Drop every full path in a namespace */
+    void invalidate_paths(int ns);
+
+    /** Drop everything */
+    void clear();
+
+    size_t size() const noexcept
+    { return paths_.size() + names_.size(); }
+
+    size_t capacity() const noexcept
+    { return capacity_; }
+
+    uint64_t hits() const noexcept     { return stat_hits_; }
+    uint64_t misses() const noexcept   { return stat_misses_; }
+    uint64_t negatives() const noexcept { return stat_negative_; }
+
+  private:
+    struct Path_key {
+      int         ns;
+      std::string path;
+      bool operator== (const Path_key& other) const noexcept
+      { return ns == other.ns && path == other.path; }
+    };
+    struct Name_key {
+      int         dev;
+      uint64_t    dir;
+      std::string name;
+      bool operator== (const Name_key& other) const noexcept
+      { return dev == other.dev && dir == other.dir && name == other.name; }
+    };
+    struct Key_hash {
+      size_t operator() (const Path_key& k) const noexcept
+      { return std::hash<std::string>{}(k.path) * 31 + k.ns; }
+      size_t operator() (const Name_key& k) const noexcept
+      { return (std::hash<std::string>{}(k.name) * 31 + k.dir) * 31 + k.dev; }
+    };
+    struct Entry {
+      // device the entry belongs to, for invalidation
+      int    dev;
+      Dirent dirent;
+    };
+
+    template <typename Map, typename Key>
+    const Dirent* find(Map&, const Key&);
+    template <typename Map, typename Key>
+    void store(Map&, Key&&, int dev, const Dirent&);
+
+    size_t capacity_;
+    std::unordered_map<Path_key, Entry, Key_hash> paths_;
+    std::unordered_map<Name_key, Entry, Key_hash> names_;
+
+    uint64_t& stat_hits_;
+    uint64_t& stat_misses_;
+    uint64_t& stat_negative_;
+  }; //< class Dentry_cache
+
+} //< namespace fs
+
+#endif //< FS_DENTRY_CACHE_HPP
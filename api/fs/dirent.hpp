@@ -25,6 +25,7 @@ namespace fs {
         modif {modt}
     {}
     Dirent(const Dirent&) noexcept;
+    Dirent& operator=(const Dirent&) noexcept = default;
 
     Enttype type() const noexcept
     { return this->ftype; }
@@ -97,6 +98,12 @@ namespace fs {
     /** Read the whole file, sync, to string **/
     inline std::string read();
 
+    /** Zero-copy view of @n bytes from @pos, empty if not memory-backed **/
+    inline view_t view(uint64_t pos, uint64_t n) const;
+
+    /** Zero-copy view of the whole file **/
+    inline view_t view() const;
+
     /** List contents async **/
     inline void ls(on_ls_func fn) const;
 
@@ -111,6 +118,24 @@ namespace fs {
     template <typename P = std::initializer_list<std::string> >
     inline Dirent stat_sync(P path);
 
+    /** Write @n bytes at @pos, growing the file as needed - sync **/
+    inline error_t write(uint64_t pos, const void* data, uint64_t n);
+
+    /** Resize the file to @size bytes - sync **/
+    inline error_t truncate(uint64_t size);
+
+    /** Create an empty file by path, relative to here - sync **/
+    template <typename P = std::initializer_list<std::string> >
+    inline error_t create(P path) const;
+
+    /** Remove a file by path, relative to here - sync **/
+    template <typename P = std::initializer_list<std::string> >
+    inline error_t unlink(P path) const;
+
+    /** Called by the owning filesystem after modifying the entry **/
+    void update(uint64_t blk, uint64_t sz) noexcept
+    { block_ = blk; size_ = sz; }
+
   private:
     const File_system* fs_;
     Enttype     ftype;
@@ -152,6 +177,16 @@ namespace fs {
     return read(0, size_).to_string();
   }
 
+  /** Zero-copy view **/
+  view_t Dirent::view(uint64_t pos, uint64_t n) const {
+    return fs_->read_view(*this, pos, n);
+  }
+
+  /** Zero-copy view of the whole file **/
+  view_t Dirent::view() const {
+    return view(0, size_);
+  }
+
 
   /** List contents async **/
   void Dirent::ls(on_ls_func fn) const {
@@ -173,6 +208,24 @@ namespace fs {
     return fs_->stat(Path{path}, this);
   };
 
+  error_t Dirent::write(uint64_t pos, const void* data, uint64_t n) {
+    return fs_->write(*this, pos, data, n);
+  }
+
+  error_t Dirent::truncate(uint64_t size) {
+    return fs_->truncate(*this, size);
+  }
+
+  template <typename P>
+  error_t Dirent::create(P path) const {
+    return fs_->create(Path{path}, this);
+  };
+
+  template <typename P>
+  error_t Dirent::unlink(P path) const {
+    return fs_->unlink(Path{path}, this);
+  };
+
 } //< namespace fs
 
 
@@ -4,8 +4,10 @@
 #define FS_FAT_HPP
 
 #include <fs/filesystem.hpp>
+#include <fs/block_cache.hpp>
+#include <fs/dentry_cache.hpp>
 #include <fs/dirent.hpp>
-#include <hw/block_device.hpp>
+#include <hw/writable_blkdev.hpp>
 #include <functional>
 #include <cstdint>
 #include <memory>
@@ -33,6 +35,8 @@ namespace fs
     /** Read @n bytes from file pointed by @entry starting at position @pos */
     void   read(const Dirent&, uint64_t pos, uint64_t n, on_read_func) const override;
     Buffer read(const Dirent&, uint64_t pos, uint64_t n) const override;
+    /** Zero-copy read, only possible on memory-backed devices */
+    view_t read_view(const Dirent&, uint64_t pos, uint64_t n) const override;
 
     // return information about a filesystem entity
     void   stat(Path_ptr, on_stat_func, const Dirent* const start) const override;
@@ -40,6 +44,15 @@ namespace fs
     // async cached stat
     void cstat(const std::string&, on_stat_func) override;
 
+    // modifying the filesystem requires FAT16 or FAT32 on a writable device
+    error_t create(Path, const Dirent* const start) const override;
+    error_t unlink(Path, const Dirent* const start) const override;
+    error_t write(Dirent&, uint64_t pos, const void*, uint64_t n) const override;
+    error_t truncate(Dirent&, uint64_t size) const override;
+    // write back dirty blocks held in the block cache
+    void    sync(on_sync_func) const override;
+    error_t sync() const override;
+
     // returns the name of the filesystem
     std::string name() const override
     {
@@ -78,6 +91,12 @@ namespace fs
         return lba_base + data_index + (cl - 2) * sectors_per_cluster;
     }
 
+    // cl_to_sector() without the root directory special case
+    uint32_t data_sector(uint32_t const cl) const
+    {
+      return lba_base + data_index + (cl - 2) * sectors_per_cluster;
+    }
+
     uint16_t cl_to_entry_offset(uint32_t cl) const
     {
       if (fat_type == T_FAT16)
@@ -85,7 +104,7 @@ namespace fs
       else // T_FAT32
         return (cl * 4) % sector_size;
     }
-    uint16_t cl_to_entry_sector(uint32_t cl) const
+    uint32_t cl_to_entry_sector(uint32_t cl) const
     {
       if (fat_type == T_FAT16)
         return reserved + (cl * 2 / sector_size);
@@ -98,7 +117,20 @@ namespace fs
     // return a list of entries from directory entries at @sector
     typedef delegate<void(error_t, Dirvec_ptr)> on_internal_ls_func;
     void int_ls(uint32_t sector, Dirvec_ptr, on_internal_ls_func) const;
-    bool int_dirent(uint32_t sector, const void* data, dirvector&) const;
+    // @slots, when given, receives the index of each entry within the sector
+    bool int_dirent(uint32_t sector, const void* data, dirvector&,
+                    std::vector<int>* slots = nullptr) const;
+    // next sector of a directory, following the cluster chain (0 at the end)
+    uint32_t next_dir_sector(uint32_t sector) const;
+
+    // device sector runs holding sectors [sector, sector+nsect) of a file
+    struct extent_t {
+      uint32_t lba;
+      uint32_t count;
+    };
+    std::vector<extent_t> file_extents(const Dirent&, uint32_t sector, uint32_t nsect) const;
+    // async read of several runs into one buffer of @nsect sectors
+    void read_extents(std::vector<extent_t>, uint32_t nsect, on_read_func) const;
 
     // tree traversal
     typedef delegate<void(error_t, Dirvec_ptr)> cluster_func;
@@ -107,9 +139,47 @@ namespace fs
     // sync version
     error_t traverse(Path path, dirvector&, const Dirent* const = nullptr) const;
     error_t int_ls(uint32_t sector, dirvector&) const;
+    // find @name in a directory, listing it into the dentry cache on a miss
+    Dirent dir_lookup(uint32_t cluster, const std::string& name) const;
+    // resolve @path using only the dentry cache, returns false on a miss
+    bool cached_stat(Path path, const Dirent* const start, Dirent& result) const;
+
+    /// write support (fat_write.cpp) ///
+    bool is_writable() const noexcept
+    { return writer != nullptr && fat_type != T_FAT12; }
+    uint32_t cl_eoc() const noexcept
+    { return (fat_type == T_FAT16) ? 0xFFFF : 0x0FFFFFFF; }
+    bool cl_is_end(uint32_t val) const noexcept
+    { return val < 2 || val >= ((fat_type == T_FAT16) ? 0xFFF8 : 0x0FFFFFF8); }
+
+    uint32_t fat_entry(uint32_t cl) const;
+    void     set_fat_entry(uint32_t cl, uint32_t val) const;
+    std::vector<uint32_t> chain(uint32_t first) const;
+    // allocate a cluster and append it to @prev (when non-zero)
+    uint32_t alloc_cluster(uint32_t prev) const;
+    void     free_chain(uint32_t first) const;
+
+    // the on-disk directory entry of a dirent
+    struct entry_ref_t {
+      uint32_t sector;
+      int      slot;
+      buffer_t data;
+    };
+    error_t locate(const Dirent&, entry_ref_t&) const;
+    void    write_sector(uint32_t sector, const uint8_t* data) const;
+    // write @n bytes at @pos into the cluster chain (nullptr writes zeros)
+    void    write_range(const std::vector<uint32_t>& clusters, uint64_t size,
+                        uint64_t pos, const uint8_t* data, uint64_t n) const;
+    error_t write_file(Dirent&, uint64_t pos, const uint8_t* data, uint64_t n) const;
 
     // device we can read and write sectors to
     hw::Block_device& device;
+    // set when the device supports writing
+    hw::Writable_Block_device* const writer;
+    // all sector reads go through the shared block cache
+    Block_cache& cache;
+    // resolved names, shared with the VFS
+    Dentry_cache& dcache;
 
     /// private members ///
     // the location of this partition
@@ -123,6 +193,7 @@ namespace fs
 
     uint8_t  fat_type;  // T_FAT12, T_FAT16 or T_FAT32
     uint16_t reserved;  // number of reserved sectors
+    uint8_t  num_fats;  // copies of the allocation table
 
     uint32_t sectors_per_fat;
     uint16_t sectors_per_cluster;
@@ -132,8 +203,8 @@ namespace fs
     uint32_t data_index;    // index of first data sector (relative to partition)
     uint32_t data_sectors;  // number of data sectors
 
-    // simplistic cache for stat results
-    std::map<std::string, Dirent> stat_cache;
+    // where to start looking for free clusters
+    mutable uint32_t alloc_hint = 3;
   };
 
 } // fs
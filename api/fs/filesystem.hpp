@@ -35,6 +35,16 @@ namespace fs {
     /** Read - sync */
     virtual Buffer read(const Dirent&, uint64_t pos, uint64_t n) const = 0;
 
+    /**
+     * Zero-copy read of @n bytes from direntry from position @pos - sync
+     * Returns an empty view if the underlying device is not memory-backed
+     */
+    virtual view_t read_view(const Dirent&, uint64_t /*pos*/, uint64_t /*n*/) const
+    { return {}; }
+
+    /** Zero-copy view of an entire file - sync */
+    view_t read_file_view(const std::string& path) const;
+
     /** Return information about a file or directory - async */
     virtual void stat(Path_ptr, on_stat_func fn, const Dirent* const = nullptr) const = 0;
 
@@ -52,6 +62,34 @@ namespace fs {
     /** Cached async stat */
     virtual void cstat(const std::string& pathstr, on_stat_func) = 0;
 
+    /** Create an empty file relative to dirent - sync */
+    virtual error_t create(Path, const Dirent* const = nullptr) const
+    { return { error_t::E_ROFS, name() + " is read-only" }; }
+
+    /** Remove a file relative to dirent - sync */
+    virtual error_t unlink(Path, const Dirent* const = nullptr) const
+    { return { error_t::E_ROFS, name() + " is read-only" }; }
+
+    /**
+     * Write @n bytes to direntry at position @pos, growing the file
+     * as needed - sync. On success the dirent reflects the new size.
+     * Writes are buffered, and reach the device on sync().
+     */
+    virtual error_t write(Dirent&, uint64_t /*pos*/, const void*, uint64_t /*n*/) const
+    { return { error_t::E_ROFS, name() + " is read-only" }; }
+
+    /** Shrink or grow direntry to @size bytes - sync */
+    virtual error_t truncate(Dirent&, uint64_t /*size*/) const
+    { return { error_t::E_ROFS, name() + " is read-only" }; }
+
+    /** Write back everything buffered by this filesystem - async */
+    virtual void sync(on_sync_func fn) const
+    { fn(no_error); }
+
+    /** Write back everything buffered by this filesystem - sync */
+    virtual error_t sync() const
+    { return no_error; }
+
     /** Returns the name of this filesystem */
     virtual std::string name() const = 0;
 
@@ -36,6 +36,9 @@ namespace fs {
 
     buffer_t read_sync(block_t blk, size_t cnt) override;
 
+    /** Zero-copy view straight into the disk image */
+    view_t read_view(block_t blk, size_t cnt = 1) const noexcept override;
+
     explicit MemDisk() noexcept;
     explicit MemDisk(const char* start, const char* end) noexcept;
 
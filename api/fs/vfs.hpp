@@ -3,6 +3,7 @@
 #define FS_VFS_HPP
 
 #include <fs/disk.hpp>
+#include <fs/dentry_cache.hpp>
 #include <fs/filesystem.hpp>
 #include <fs/path.hpp>
 #include <algorithm>
@@ -261,6 +262,29 @@ namespace fs {
       parent->template insert<T>(token, obj, desc);
     }
 
+    /** Remove a leaf from this subtree, returning the object it held **/
+    void* umount(Path path) {
+
+      Expects(not path.empty());
+
+      auto token = path.back();
+      path.pop_back();
+
+      VFS_entry* parent = (path.empty()) ? this : walk(path);
+      if (not parent)
+        throw Err_not_found(path.to_string() + " doesn't exist");
+
+      auto it = std::find_if(parent->children_.begin(), parent->children_.end(),
+        [&token] (const Own_ptr& child) { return child->name() == token; });
+
+      if (it == parent->children_.end() or not (*it)->obj_)
+        throw Err_not_leaf(token + " is not a mount point");
+
+      void* obj = (*it)->obj_;
+      parent->children_.erase(it);
+      return obj;
+    }
+
     Obs_ptr get_child(const std::string& name) const {
       for (auto&& child : children_)
         if (child.get()->name() == name) return child.get();
@@ -306,6 +330,24 @@ namespace fs {
     static void mount(Path path, T& obj, std::string desc) {
       INFO("VFS", "Mounting %s on %s", type_name(typeid(obj)).c_str(), path.to_string().c_str());;
       mutable_root().mount<create_path, T>(path, obj, desc);
+      // cached paths may now resolve differently
+      Dentry_cache::get().invalidate_paths(Dentry_cache::VFS_NS);
+    }
+
+    /** Remove the object mounted on path **/
+    static void umount(Path path) {
+      INFO("VFS", "Unmounting %s", path.to_string().c_str());
+      void* obj = mutable_root().umount(path);
+
+      // forget mounted dirents, and everything cached for their device
+      for (auto it = dirent_map().begin(); it != dirent_map().end(); ++it)
+      {
+        if (&it->second != obj) continue;
+        Dentry_cache::get().invalidate(it->first.first);
+        dirent_map().erase(it);
+        break;
+      }
+      Dentry_cache::get().invalidate_paths(Dentry_cache::VFS_NS);
     }
 
     /** Mount a path local to a disk, on a VFS path - async **/
@@ -373,6 +415,11 @@ namespace fs {
     template<typename P = Path>
     static Dirent stat_sync(P path) {
 
+      // repeated lookups skip tokenizing and walking the tree
+      const std::string key = path_key(path);
+      if (const auto* ent = Dentry_cache::get().lookup(Dentry_cache::VFS_NS, key))
+        return *ent;
+
       Path p{path};
       auto item = VFS::mutable_root().walk(p, true);
 
@@ -381,7 +428,37 @@ namespace fs {
 
       auto&& obj = item->obj<Dirent>();
 
-      return obj.stat_sync(p);
+      auto result = obj.stat_sync(p);
+      Dentry_cache::get().insert(Dentry_cache::VFS_NS, key, result);
+      return result;
+    }
+
+    template<typename P = Path>
+    static error_t create(P path) {
+
+      Path p{path};
+      auto item = VFS::mutable_root().walk(p, true);
+
+      if (not item)
+        throw Err_not_found(std::string("Path ") + p.to_string() + " does not exist (create)");
+
+      auto&& obj = item->obj<Dirent>();
+
+      return obj.create(p);
+    }
+
+    template<typename P = Path>
+    static error_t unlink(P path) {
+
+      Path p{path};
+      auto item = VFS::mutable_root().walk(p, true);
+
+      if (not item)
+        throw Err_not_found(std::string("Path ") + p.to_string() + " does not exist (unlink)");
+
+      auto&& obj = item->obj<Dirent>();
+
+      return obj.unlink(p);
     }
 
 
@@ -433,6 +510,15 @@ namespace fs {
 
   private:
 
+    static const std::string& path_key(const std::string& path)
+    { return path; }
+
+    static std::string path_key(const char* path)
+    { return path; }
+
+    static std::string path_key(const Path& path)
+    { return path.to_string(); }
+
     static Dirent& invalid_dirent() {
       static Dirent dir{nullptr};
       return dir;
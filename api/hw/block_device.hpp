@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <delegate>
+#include <gsl/span>
 #include <memory>
 #include <pmr>
 #include <vector>
@@ -21,6 +22,7 @@ public:
   using buffer_t      = os::mem::buf_ptr;
   using on_read_func  = delegate<void(buffer_t)>;
   using on_write_func = delegate<void(bool error)>;
+  using view_t        = gsl::span<const uint8_t>;
 
   /**
    * Method to get the type of device
@@ -122,6 +124,23 @@ public:
    */
   virtual buffer_t read_sync(block_t blk, size_t count=1) = 0;
 
+  /**
+   * Get a non-owning view of blocks on devices whose contents
+   * already live in memory. No data is copied.
+   *
+   * @param blk
+   *   The starting block of the view
+   *
+   * @param count
+   *   The number of blocks in the view
+   *
+   * @return A view of the blocks, or an empty view if the device
+   *   is not memory-backed or the range is out of bounds
+   */
+  virtual view_t read_view(block_t, size_t = 1) const noexcept {
+    return {};
+  }
+
   /**
    * Method to deactivate the block device
    */
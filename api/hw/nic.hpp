@@ -91,6 +91,15 @@ namespace hw {
     /** Check for completed rx and pass rx packets up the stack */
     virtual void poll() = 0;
 
+    /**
+     * Pass at most @budget received packets up the stack,
+     * returning how many were passed. Used by Busy_poll.
+     */
+    virtual int poll_rx(int /*budget*/) { poll(); return 0; }
+
+    /** Mask or unmask receive interrupts, for drivers supporting Busy_poll */
+    virtual void set_rx_interrupts(bool /*enabled*/) {}
+
     /** Overridable MTU detection function per-network **/
     static uint16_t MTU_detection_override(int idx, uint16_t default_MTU);
 
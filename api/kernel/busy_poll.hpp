@@ -0,0 +1,92 @@
+
+#pragma once
+#ifndef KERNEL_BUSY_POLL_HPP
+#define KERNEL_BUSY_POLL_HPP
+
+#include <cstdint>
+#include <vector>
+#include <smp>
+
+namespace hw { class Nic; }
+
+/**
+ * Adaptive busy-polling of network devices (NAPI-style)
+ *
+ * A driver that supports it hands its RX interrupt to schedule(), which
+ * masks the device's RX interrupts and adds it to this CPU's poll list.
+ * The event loop then polls every listed device with a packet budget
+ * instead of halting, for as long as packets keep arriving. A device that
+ * comes up empty for IDLE_ROUNDS polls in a row gets its interrupts back.
+ *
+ * Disabled by default, in which case schedule() returns false and drivers
+ * process packets from the interrupt as usual.
+ *
+ * Drivers register their devices with add_device() when constructed, which
+ * creates the <device>.busypoll.{polls,interrupts,packets} Statman counters.
+**/
+class alignas(SMP_ALIGN) Busy_poll {
+public:
+  /** Max packets taken from one device per poll */
+  static constexpr int DEFAULT_BUDGET = 64;
+  /** Empty polls in a row before returning to interrupts */
+  static constexpr int IDLE_ROUNDS = 16;
+
+  /** Per-CPU instance */
+  static Busy_poll& get();
+
+  /** Register a device supporting busy-polling, creating its counters */
+  static void add_device(hw::Nic&);
+
+  /** Turn adaptive polling on or off, for all CPUs */
+  static void enable(bool on) noexcept;
+  static bool is_enabled() noexcept;
+
+  /**
+   * Called from a driver's RX interrupt handler.
+   * Returns true if the device is now being polled (with its RX interrupts
+   * masked), false if the driver should process the interrupt itself,
+   * as it should for devices that were never added.
+   */
+  bool schedule(hw::Nic&);
+
+  /** Poll every listed device once. Called by the event loop. */
+  void poll();
+
+  /** True while devices are being polled, so the CPU should not halt */
+  bool active() const noexcept
+  { return not list_.empty(); }
+
+  void set_budget(int budget) noexcept
+  { budget_ = budget; }
+  int budget() const noexcept
+  { return budget_; }
+
+  /** Totals for the devices handled by this CPU */
+  uint64_t polls() const noexcept      { return polls_; }
+  uint64_t interrupts() const noexcept { return irqs_; }
+  uint64_t packets() const noexcept    { return packets_; }
+
+  struct Device_stats {
+    hw::Nic*  nic;
+    uint64_t& polls;
+    uint64_t& interrupts;
+    uint64_t& packets;
+  };
+
+private:
+  struct Entry {
+    hw::Nic*      nic;
+    Device_stats* stats;
+    int           idle;
+  };
+  static Device_stats* stats(hw::Nic&) noexcept;
+
+  std::vector<Entry> list_;
+  int budget_ = DEFAULT_BUDGET;
+
+  uint64_t polls_   = 0;
+  uint64_t irqs_    = 0;
+  uint64_t packets_ = 0;
+};
+
+#endif
@@ -22,6 +22,10 @@ struct Elf
   static safe_func_offset
     safe_resolve_symbol(const void* addr, char* buffer, size_t length);
 
+  // build a sorted index of the symbol table, making address lookups
+  // a binary search instead of a scan (needs the heap)
+  static void build_symbol_index();
+
   //returns the address of a symbol, or 0
   static uintptr_t
     resolve_name(const std::string& name);
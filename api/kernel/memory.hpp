@@ -48,6 +48,15 @@ namespace os::mem {
   /** String representation of supported page sizes */
   std::string page_sizes_str(size_t bits);
 
+  /**
+   * Largest page size backing the heap, packet buffer pools and large
+   * buffers, 0 when huge pages aren't asked for. The heap is set up before
+   * the service starts, so a service asks for them by defining
+   *   size_t __huge_page_size = 2_MiB;  // or 1_GiB
+   * 2 MiB is used when 1 GiB pages aren't supported.
+   */
+  size_t huge_page_size() noexcept;
+
   /**
    * Virtual to physical memory mapping.
    * For interfacing with the virtual memory API, e.g. mem::map / mem::protect.
@@ -109,6 +118,28 @@ namespace os::mem {
    **/
   Map unmap(uintptr_t addr);
 
+  /**
+   * Back an identity mapped, readable and writable range (e.g. the heap)
+   * with pages of 2 MiB up to max_psize.
+   * The range is shrunk to whole 2 MiB pages, and isn't added to vmmap().
+   * 2 MiB areas already split into 4 KiB pages are left as they are.
+   * @return bytes mapped with huge pages
+   **/
+  size_t map_huge(uintptr_t linear, size_t len, size_t max_psize);
+
+  /** Number of pages of each size mapping a range, i.e. the TLB entries to cover it */
+  struct Page_stats {
+    size_t pages_4k = 0;
+    size_t pages_2m = 0;
+    size_t pages_1g = 0;
+    size_t unmapped = 0;  // bytes
+
+    size_t pages() const noexcept
+    { return pages_4k + pages_2m + pages_1g; }
+  };
+
+  Page_stats page_stats(uintptr_t linear, size_t len);
+
   /** Get protection flags for page enclosing a given address */
   Access flags(uintptr_t addr);
 
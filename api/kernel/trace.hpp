@@ -0,0 +1,136 @@
+
+#pragma once
+#ifndef KERNEL_TRACE_HPP
+#define KERNEL_TRACE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <common>
+
+namespace net { class TCP; }
+
+/**
+ * Static tracepoints
+ *
+ * Tracepoints compiled into the hot paths (event loop, timers, NIC drivers,
+ * IP4 and TCP) write fixed-size binary records into a ring buffer per CPU,
+ * keeping the latest ones when it is full. A CPU only writes to its own ring,
+ * so no locks are taken. When tracing is disabled, which it is by default,
+ * a tracepoint costs a load and a not-taken branch.
+ * Build with NO_TRACEPOINTS to compile them out completely.
+ *
+ * The records are exported in the Chrome trace event format, which can be
+ * opened in chrome://tracing, Perfetto or speedscope, or as raw records.
+ * Exporting consumes the records.
+ *
+ * Usage example:
+ * @code
+ *   Trace::enable();
+ *   ...
+ *   Trace::print();          // over serial
+ *   Trace::serve(tcp, 6000); // or curl http://host:6000/trace.json
+ * @endcode
+**/
+class Trace {
+public:
+  enum event_t : uint16_t {
+    EVENT_BEGIN,  // Events handler, a = interrupt
+    EVENT_END,
+    TIMER_BEGIN,  // Timer callback, b = timer id
+    TIMER_END,
+    NIC_RX_BEGIN, // Driver RX processing
+    NIC_RX_END,   // b = packets received
+    NIC_TX,       // Packet handed to the device, b = bytes
+    IP4_RX,       // a = protocol, b = bytes
+    TCP_STATE,    // a = old state << 8 | new state, b = local port << 16 | remote port
+    USER,         // for services, a and b are free
+    EVENT_TYPES
+  };
+
+  /** TCP_STATE numbering, as in RFC 793 */
+  enum tcp_state_t : uint8_t {
+    TCP_CLOSED, TCP_LISTEN, TCP_SYN_SENT, TCP_SYN_RECEIVED, TCP_ESTABLISHED,
+    TCP_FIN_WAIT_1, TCP_FIN_WAIT_2, TCP_CLOSE_WAIT, TCP_CLOSING, TCP_LAST_ACK,
+    TCP_TIME_WAIT
+  };
+
+  struct Record {
+    uint64_t time;  // nanoseconds since boot
+    uint16_t event;
+    uint16_t a;
+    uint32_t b;
+  };
+  static_assert(sizeof(Record) == 16, "Records are 16 bytes");
+
+  /** Bytes of records kept per CPU */
+  static constexpr int DEFAULT_SIZE = 64 * 1024;
+
+  /** Start tracing on all CPUs, (re)allocating the rings */
+  static void enable(int bytes_per_cpu = DEFAULT_SIZE);
+  /** Stop tracing. The records are kept until exported or cleared. */
+  static void disable() noexcept;
+
+  static bool is_enabled() noexcept
+  { return enabled_; }
+
+  /** Write a record into this CPU's ring */
+  static void record(event_t, uint16_t a = 0, uint32_t b = 0) noexcept;
+
+  /** Records waiting to be exported, on all CPUs */
+  static size_t records() noexcept;
+  /** Records overwritten while a ring was full, or dropped by a nested tracepoint */
+  static uint64_t lost() noexcept;
+  /** Throw away all records */
+  static void clear() noexcept;
+
+  /**
+   * @brief      Take all records, in the Chrome trace event format (JSON),
+   *             with one thread per CPU
+   */
+  static std::string chrome_json();
+
+  /**
+   * @brief      Take all records as binary: the header below, then for each
+   *             CPU its id and number of records (uint32_t each) followed by
+   *             the records, oldest first. Little endian.
+   */
+  static std::vector<uint8_t> binary();
+
+  struct Binary_header {
+    char     magic[8];     // "IOSTRACE"
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t cpus;
+    uint32_t event_types;
+  };
+
+  /** Print all records to stdout in the Chrome trace format */
+  static void print();
+
+  /**
+   * Serve the records on a TCP port: "GET /trace.bin" returns them binary,
+   * any other request (HTTP or not) in the Chrome trace format
+   */
+  static void serve(net::TCP&, uint16_t port);
+
+  /** Name of an event type, as exported */
+  static const char* name(event_t) noexcept;
+
+private:
+  static bool enabled_;
+  // disable and wait for the writers on all CPUs, returns if enabled before
+  static bool pause() noexcept;
+};
+
+#ifndef NO_TRACEPOINTS
+#define TRACEPOINT(event, ...)                                    \
+  do {                                                            \
+    if (UNLIKELY(Trace::is_enabled()))                            \
+      Trace::record(Trace::event, ##__VA_ARGS__);                 \
+  } while (0)
+#else
+#define TRACEPOINT(event, ...) /* event */
+#endif
+
+#endif
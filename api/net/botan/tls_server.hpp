@@ -3,6 +3,7 @@
 #ifndef NET_TLS_SERVER_STREAM_HPP
 #define NET_TLS_SERVER_STREAM_HPP
 
+#include <algorithm>
 #include <botan/credentials_manager.h>
 #include <botan/rng.h>
 #include <botan/tls_server.h>
@@ -17,10 +18,15 @@ namespace botan
 class Server : public Botan::TLS::Callbacks, public net::Stream
 {
 public:
+  /**
+   * @param      app_protocols  ALPN protocols offered, in order of preference
+   */
   Server(net::Stream_ptr remote,
          Botan::RandomNumberGenerator& rng,
-         Botan::Credentials_Manager& credman)
-  : m_creds{credman},
+         Botan::Credentials_Manager& credman,
+         std::vector<std::string> app_protocols = {})
+  : m_app_protocols{std::move(app_protocols)},
+    m_creds{credman},
     m_session_manager{},
     m_tls{*this, m_session_manager, m_creds, m_policy, rng},
     m_transport{std::move(remote)}
@@ -186,6 +192,14 @@ protected:
     }
   }
 
+  std::string tls_server_choose_app_protocol(const std::vector<std::string>& client_protos) override
+  {
+    for (const auto& proto : m_app_protocols)
+      if (std::find(client_protos.begin(), client_protos.end(), proto) != client_protos.end())
+        return proto;
+    return "";
+  }
+
   void tls_session_activated() override
   {
     if (m_on_connect) m_on_connect(*this);
@@ -198,6 +212,7 @@ private:
   Stream::CloseCallback   m_on_close = nullptr;
   bool m_busy = false;
   bool m_deferred_close = false;
+  std::vector<std::string> m_app_protocols;
 
   Botan::Credentials_Manager&   m_creds;
   Botan::TLS::Strict_Policy     m_policy;
@@ -8,6 +8,7 @@
 #include <util/timer.hpp>
 #include <map>
 #include <unordered_map>
+#include <vector>
 #include "query.hpp"
 #include "response.hpp"
 
@@ -20,8 +21,17 @@ namespace net::dns {
    * @brief      A simple DNS client which is able to resolve hostnames
    *             and locally cache them.
    *
-   * @note       A entry can stay longer than TTL due to flush timer granularity.
-   *             Max_TTL = TTL + FLUSH_INTERVAL (90s default)
+   *             Answers are cached for as long as their records allow
+   *             (the lowest TTL), bounded by cache_ttl(). Negative answers
+   *             (no such name, or no address of the wanted type) are cached
+   *             for the SOA minimum TTL (RFC 2308), bounded by negative_ttl().
+   *             Resolving a name which is already being resolved waits for
+   *             the query in flight instead of sending another one, and
+   *             entries in use are refreshed in the background shortly
+   *             before they expire (see enable_prefetch()).
+   *
+   * @note       Expired entries are not returned, but stay in memory
+   *             until the next flush (FLUSH_INTERVAL, 30s default)
    */
   class Client
   {
@@ -39,16 +49,38 @@ namespace net::dns {
     {
       Address     address;
       timestamp_t expires;
-
-      Cache_entry(Address addr, const timestamp_t exp) noexcept
-        : address{std::move(addr)}, expires{exp}
+      /** The answer records */
+      std::vector<Record> answers;
+      Response_code rcode;
+      Record_type rtype;
+      /** The TTL the entry was cached with, in seconds */
+      uint32_t    ttl;
+      /** The server that answered, used when refreshing */
+      Address     server;
+      /** Lookups since the entry was cached */
+      uint32_t    hits = 0;
+
+      Cache_entry(const Response& res, Record_type type, uint32_t ttl,
+                  Address serv, const timestamp_t exp)
+        : address{res.get_first_addr()}, expires{exp},
+          answers{res.answers}, rcode{res.rcode}, rtype{type},
+          ttl{ttl}, server{std::move(serv)}
       {}
+
+      /** No such name, or no address for it */
+      bool is_negative() const noexcept
+      {
+        for (auto& rec : answers)
+          if (rec.is_addr()) return false;
+        return true;
+      }
     };
     using Cache           = std::unordered_map<Hostname, Cache_entry>;
 
     static Timer::duration_t DEFAULT_RESOLVE_TIMEOUT; // 5s, client.cpp
-    static Timer::duration_t DEFAULT_FLUSH_INTERVAL; // 60s, client.cpp
-    static std::chrono::seconds DEFAULT_CACHE_TTL; // 60s, client.cpp
+    static Timer::duration_t DEFAULT_FLUSH_INTERVAL; // 30s, client.cpp
+    static std::chrono::seconds DEFAULT_CACHE_TTL; // 1h, client.cpp
+    static std::chrono::seconds DEFAULT_NEGATIVE_TTL; // 5m, client.cpp
 
     /**
      * @brief      Construct a DNS client on a given interface (stack),
@@ -71,6 +103,9 @@ namespace net::dns {
      * @param[in]  handler     The resolve handler
      * @param[in]  timeout     The time before the request times out
      * @param[in]  force       Wether to force the resolve, ignoring the cache
+     *
+     * @note       If the name is already being resolved, the handler is
+     *             called when that query finishes, and @timeout is ignored.
      */
     void resolve(Address            dns_server,
                  Hostname           hostname,
@@ -103,7 +138,7 @@ namespace net::dns {
     { return cache_; }
 
     /**
-     * @brief      Returns the time to live value of an entry in the cache.
+     * @brief      Returns the longest time an entry stays in the cache.
      *
      * @return     Time to live in seconds
      */
@@ -111,7 +146,8 @@ namespace net::dns {
     { return cache_ttl_; }
 
     /**
-     * @brief      Sets the time to live for a cache entry
+     * @brief      Sets the longest time to live for a cache entry,
+     *             which is otherwise given by the records' TTL.
      *             A value of zero means caching is disabled.
      *
      * @param[in]  ttl   The ttl in seconds
@@ -119,6 +155,32 @@ namespace net::dns {
     void set_cache_ttl(std::chrono::seconds ttl)
     { cache_ttl_ = ttl; }
 
+    /**
+     * @brief      Returns the longest time a negative answer is cached.
+     */
+    auto negative_ttl()
+    { return negative_ttl_; }
+
+    /**
+     * @brief      Sets the longest time a negative answer is cached.
+     *             A value of zero means negative answers are not cached.
+     *
+     * @param[in]  ttl   The ttl in seconds
+     */
+    void set_negative_ttl(std::chrono::seconds ttl)
+    { negative_ttl_ = ttl; }
+
+    /**
+     * @brief      Refresh entries which have been used at least @min_hits
+     *             times when they are looked up during the last tenth of
+     *             their TTL, so they don't expire while in use.
+     *             A @min_hits of zero disables prefetching.
+     *
+     * @param[in]  min_hits  Lookups needed before an entry is refreshed
+     */
+    void enable_prefetch(uint32_t min_hits = 2)
+    { prefetch_hits_ = min_hits; }
+
     /**
      * @brief      Disables caching
      */
@@ -140,8 +202,15 @@ namespace net::dns {
     Stack&                stack_;
     Cache                 cache_;
     std::chrono::seconds  cache_ttl_;
+    std::chrono::seconds  negative_ttl_;
+    uint32_t              prefetch_hits_ = 2;
     Timer                 flush_timer_;
 
+    uint32_t&             cache_hits_;
+    uint32_t&             cache_misses_;
+    uint32_t&             coalesced_;
+    uint32_t&             prefetches_;
+
     /**
      * @brief      Receive a UDP message with a (hopefully) DNS response
      *             to one of our requests.
@@ -154,13 +223,30 @@ namespace net::dns {
     void receive_response(Address, udp::port_t, const char* data, size_t);
 
     /**
-     * @brief      Adds a cache entry.
+     * @brief      Adds (or replaces) a cache entry for a response,
+     *             unless the response may not be cached.
      *
      * @param[in]  hostname  The hostname
-     * @param[in]  addr      The address
-     * @param[in]  ttl       The ttl
+     * @param[in]  rtype     The record type asked for
+     * @param[in]  res       The response
+     * @param[in]  server    The server which answered
+     */
+    void add_cache_entry(const Hostname& hostname, Record_type rtype,
+                         const Response& res, Address server);
+
+    /**
+     * @brief      Look up a usable cache entry, starting a prefetch if
+     *             it's about to expire.
+     *
+     * @return     A response built from the entry, or nullptr
+     */
+    Response_ptr lookup_cache(const Hostname& hostname, Record_type rtype);
+
+    /**
+     * @brief      Send a query, or join one in flight for the same name.
      */
-    void add_cache_entry(const Hostname& hostname, Address addr, std::chrono::seconds ttl);
+    void send_query(Address server, Hostname hostname, Record_type rtype,
+                    Resolve_handler handler, Timer::duration_t timeout);
 
     /**
      * @brief      Flush all expired cache entries.
@@ -190,8 +276,10 @@ namespace net::dns {
       Response_ptr    response;
 
       udp::Socket&    socket;
+      Address         server;
 
-      Resolve_handler callback;
+      /** Everyone waiting for this query, empty for a prefetch */
+      std::vector<Resolve_handler> callbacks;
       Timer           timer;
 
       Request(Client& cli, udp::Socket& sock, dns::Query q, Resolve_handler cb);
@@ -219,6 +307,8 @@ namespace net::dns {
     using Requests = std::unordered_map<dns::id_t, Request>;
     /** Pending requests (not yet resolved) */
     Requests requests_;
+    /** The pending request for a hostname, to coalesce queries */
+    std::unordered_map<Hostname, dns::id_t> in_flight_;
   };
 }
 
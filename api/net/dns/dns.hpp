@@ -36,6 +36,7 @@
 #include <net/ip4/addr.hpp> // ip4::Addr
 #include <delegate>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #define DNS_QR_QUERY     0
@@ -71,7 +72,12 @@ namespace net::dns {
     A     = 1,
     NS    = 2,
     ALIAS = 5,
-    AAAA  = 28
+    SOA   = 6,
+    PTR   = 12,
+    MX    = 15,
+    TXT   = 16,
+    AAAA  = 28,
+    OPT   = 41
   };
 
   enum class Class : uint16_t
@@ -126,6 +132,9 @@ namespace net::dns {
 
   // convert www.google.com to 3www6google3com
   int encode_name(std::string name, char* dst);
+  // same, in lowercase, accepting a trailing dot and the root name (empty).
+  // returns an empty string if the name is invalid
+  std::string encode_name(std::string_view name);
   // convert 3www6google3com to www.google.com
   //int decode_name(...);
 
@@ -27,6 +27,14 @@ namespace net::dns {
     ip6::Addr get_ipv6() const;
     net::Addr get_addr() const;
 
+    /**
+     * @brief      The MINIMUM field of a SOA record, which bounds
+     *             how long a negative answer may be cached (RFC 2308)
+     *
+     * @return     The minimum TTL, or 0 if this is not a SOA record
+     */
+    uint32_t get_soa_minimum() const;
+
     bool is_addr() const
     { return rtype == Record_type::A or rtype == Record_type::AAAA; }
   };
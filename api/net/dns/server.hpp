@@ -0,0 +1,124 @@
+#pragma once
+#ifndef NET_DNS_SERVER_HPP
+#define NET_DNS_SERVER_HPP
+
+#include "zone.hpp"
+#include <net/tcp/listener.hpp>
+#include <net/udp/socket.hpp>
+#include <vector>
+
+namespace net {
+  class Inet;
+}
+namespace net::dns {
+
+  /**
+   * @brief      An authoritative DNS server, answering over UDP and TCP
+   *             from the zones it has been given.
+   *
+   *             When zones are added, every answer the server can give is
+   *             encoded up front: one for each name and record type, one
+   *             for names without the asked type (NODATA) and one for names
+   *             that don't exist in each zone (NXDOMAIN). They are kept in
+   *             one buffer, indexed by an open addressing hash table of the
+   *             lowercase names, so a query is answered by one lookup and
+   *             copying the template after the query's ID and question.
+   *             UDP queries are received and answered in batches.
+   *
+   * @note       Delegations and wildcards are not supported, and CNAMEs
+   *             are only followed within a zone, one step.
+   */
+  class Server
+  {
+  public:
+    using Stack = Inet;
+
+    /** The UDP payload size offered with EDNS(0) */
+    static const uint16_t EDNS_UDP_SIZE = 1232;
+    /** Queries received together, answered in one batch */
+    static const size_t   UDP_BATCH = 64;
+
+    Server(Stack& stack);
+    ~Server();
+
+    /**
+     * @brief      Serve a zone, replacing any zone with the same origin.
+     */
+    void add_zone(Zone zone);
+
+    /**
+     * @brief      Stop serving the zone with @origin.
+     */
+    void remove_zone(const std::string& origin);
+
+    const std::vector<Zone>& zones() const noexcept
+    { return zones_; }
+
+    /**
+     * @brief      Start answering queries over UDP and TCP on @port.
+     */
+    void listen(uint16_t port = SERVICE_PORT);
+
+    /**
+     * @brief      Stop answering queries, closing the sockets and
+     *             the TCP connections.
+     */
+    void close();
+
+    /**
+     * @brief      Answer a DNS query
+     *
+     * @param[in]  query     The query
+     * @param[in]  len       The query length
+     * @param      out       Buffer for the response
+     * @param[in]  out_size  Size of the buffer
+     * @param[in]  stream    Whether the query came over TCP, which has no
+     *                       UDP size limit (the length prefix is not included)
+     *
+     * @return     The response length, or 0 if the query should be ignored
+     */
+    size_t answer(const uint8_t* query, size_t len,
+                  uint8_t* out, size_t out_size, bool stream = false) const;
+
+    /** The number of (name, type) answers encoded */
+    size_t answers() const noexcept
+    { return count_; }
+
+  private:
+    struct Slot {
+      uint32_t hash;
+      uint32_t key;       // offset of the key (name and type) in the arena
+      uint32_t tmpl;      // offset of the answer template
+      uint16_t key_len;   // 0 for an empty slot
+      uint16_t tmpl_len;
+    };
+
+    Stack&              stack_;
+    std::vector<Zone>   zones_;
+    std::vector<Slot>   slots_;
+    std::vector<uint8_t> arena_;
+    uint32_t            mask_ = 0;
+    size_t              count_ = 0;
+    size_t              max_tmpl_ = 0;
+
+    udp::Socket*        udp_ = nullptr;
+    tcp::Listener*      tcp_ = nullptr;
+    std::vector<tcp::Connection_ptr> clients_;
+
+    uint64_t&           queries_udp_;
+    uint64_t&           queries_tcp_;
+    uint32_t&           nxdomain_;
+    uint32_t&           refused_;
+    uint32_t&           errors_;
+
+    void build();
+    void insert(const std::string& key, const std::string& tmpl);
+    const Slot* find(const uint8_t* key, size_t key_len) const noexcept;
+
+    void receive_batch(udp::Socket::Packet_batch batch);
+    void receive_connection(tcp::Connection_ptr conn);
+  };
+
+} // net::dns
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef NET_DNS_ZONE_HPP
+#define NET_DNS_ZONE_HPP
+
+#include "record.hpp"
+#include <net/ip6/addr.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace net::dns {
+
+  class Zone_error : public std::runtime_error {
+    using runtime_error::runtime_error;
+  };
+
+  /**
+   * @brief      The records a DNS server is authoritative for, below
+   *             an origin (eg. example.com).
+   *
+   *             Names are stored in lowercase without the trailing dot.
+   *             Names given without a trailing dot are relative to the
+   *             origin, and "@" is the origin itself.
+   *             Record data is stored the way it's sent, except names
+   *             (NS, CNAME and PTR targets), which are kept as text.
+   */
+  class Zone {
+  public:
+    static const uint32_t DEFAULT_TTL = 3600;
+
+    /**
+     * @brief      Create a zone with its SOA record
+     *
+     * @param[in]  origin   The origin, eg. example.com
+     * @param[in]  mname    The primary name server
+     * @param[in]  rname    The mailbox of the person responsible (as a name)
+     * @param[in]  serial   The serial number
+     * @param[in]  minimum  The TTL of negative answers
+     * @param[in]  ttl      The default TTL of records
+     */
+    Zone(const std::string& origin, const std::string& mname,
+         const std::string& rname, uint32_t serial = 1,
+         uint32_t minimum = 300, uint32_t ttl = DEFAULT_TTL);
+
+    /**
+     * @brief      Load a zone from a master file (RFC 1035 section 5),
+     *             with $ORIGIN, $TTL, parentheses and comments, and the
+     *             record types SOA, NS, A, AAAA, CNAME, PTR, MX and TXT.
+     *
+     * @param[in]  text    The zone file
+     * @param[in]  origin  The origin, unless given by $ORIGIN
+     *
+     * @throws     Zone_error  If the zone file is invalid or has no SOA
+     */
+    static Zone parse(std::string_view text, const std::string& origin = "");
+
+    Zone& add(const std::string& name, Record_type type, std::string rdata,
+              uint32_t ttl = DEFAULT_TTL);
+
+    Zone& add_a(const std::string& name, ip4::Addr addr, uint32_t ttl = DEFAULT_TTL);
+    Zone& add_aaaa(const std::string& name, const ip6::Addr& addr, uint32_t ttl = DEFAULT_TTL);
+    Zone& add_alias(const std::string& name, const std::string& target, uint32_t ttl = DEFAULT_TTL);
+    Zone& add_ns(const std::string& name, const std::string& target, uint32_t ttl = DEFAULT_TTL);
+    Zone& add_mx(const std::string& name, uint16_t preference,
+                 const std::string& exchange, uint32_t ttl = DEFAULT_TTL);
+    Zone& add_txt(const std::string& name, const std::string& text, uint32_t ttl = DEFAULT_TTL);
+
+    const std::string& origin() const noexcept
+    { return origin_; }
+
+    /** The SOA record, with its data encoded */
+    const Record& soa() const noexcept
+    { return soa_; }
+
+    /** The TTL of negative answers (RFC 2308) */
+    uint32_t negative_ttl() const noexcept
+    { return std::min(soa_.ttl, minimum_); }
+
+    const std::vector<Record>& records() const noexcept
+    { return records_; }
+
+    /**
+     * @brief      The full, lowercase name of @name in this zone
+     *
+     * @throws     Zone_error  If the name is not in this zone
+     */
+    std::string absolute(std::string_view name) const;
+
+  private:
+    std::string origin_;
+    Record      soa_;
+    uint32_t    minimum_;
+    uint32_t    ttl_;
+    std::vector<Record> records_;
+
+    Zone() = default;
+  };
+
+} // net::dns
+
+#endif
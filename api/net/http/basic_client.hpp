@@ -9,6 +9,7 @@
 #include <net/tcp/tcp.hpp>
 #include <net/inet>
 #include <vector>
+#include <deque>
 #include <map>
 
 namespace http {
@@ -29,7 +30,6 @@ namespace http {
     using Request_handler     = delegate<void(Request&, Options&, const Host)>;
 
     using Connection_set      = std::vector<std::unique_ptr<Client_connection>>;
-    using Connection_mapset   = std::map<Host, Connection_set>;
 
     using timeout_duration    = Client_connection::timeout_duration;
 
@@ -47,6 +47,21 @@ namespace http {
 
     };
 
+    /* Connection pool options, per host */
+    struct Pool_options {
+      // connections open at the same time
+      size_t            max_per_host{6};
+      // requests written on a connection before their responses are read (1 = no pipelining)
+      size_t            pipeline_depth{1};
+      // requests waiting for a connection before failing with QUEUE_FULL
+      size_t            max_queued{1024};
+      // how long an unused keep-alive connection is kept open
+      timeout_duration  idle_timeout{std::chrono::seconds(30)};
+
+      Pool_options() noexcept {}
+
+    };
+
   private:
     using ResolveCallback = net::Inet::resolve_func;
 
@@ -175,18 +190,79 @@ namespace http {
     std::string origin() const
     { return tcp_.stack().ip_addr().to_string(); }
 
+    /**
+     * @brief      Set the limits of the connection pool. Applies to
+     *             connections and requests from now on.
+     *
+     * @param[in]  options  The pool options
+     */
+    void set_pool_options(Pool_options options)
+    { pool_options_ = std::move(options); }
+
+    const Pool_options& pool_options() const noexcept
+    { return pool_options_; }
+
+    /**
+     * @brief      Whether connections are kept open and reused after a response
+     *             (Connection: keep-alive). Default is off, every request
+     *             then gets a connection of its own.
+     *
+     * @param[in]  keep_alive  Keep alive
+     */
+    void set_keep_alive(const bool keep_alive) noexcept
+    { keep_alive_ = keep_alive; }
+
+    bool keep_alive() const noexcept
+    { return keep_alive_; }
+
+    /**
+     * @brief      Number of open connections to a host
+     */
+    size_t connection_count(const Host host, const bool secure = false) const;
+
+    /**
+     * @brief      Number of requests waiting for a connection to a host
+     */
+    size_t queued_count(const Host host, const bool secure = false) const;
+
     virtual ~Basic_client() = default;
 
   protected:
     TCP&              tcp_;
-    Connection_mapset conns_;
 
     explicit Basic_client(TCP& tcp, Request_handler on_send, const bool https_supported);
 
-    virtual Client_connection& get_secure_connection(const Host host);
+    /** Create the stream of a new secured connection to host */
+    virtual Connection::Stream_ptr create_secure_stream(const Host host);
 
   private:
     friend class Client_connection;
+
+    /** A request waiting for a connection */
+    struct Queued {
+      Request_ptr       req;
+      Response_handler  cb;
+      Options           options;
+      bool              retried;
+    };
+
+    /** Requests share connections with the same scheme, host and port */
+    struct Pool_key {
+      Host host;
+      bool secure;
+
+      bool operator<(const Pool_key& other) const noexcept
+      { return (secure != other.secure) ? secure < other.secure : host < other.host; }
+    };
+
+    /** The connections to a host, and the requests waiting for one */
+    struct Host_pool {
+      Connection_set      connections;
+      std::deque<Queued>  queue;
+    };
+
+    std::map<Pool_key, Host_pool> pools_;
+    Pool_options      pool_options_;
     Request_handler   on_send_;
     bool              keep_alive_ = false;
     const bool        supports_https;
@@ -205,7 +281,24 @@ namespace http {
     /** Add data and content length */
     void add_data(Request&, const std::string& data);
 
-    Client_connection& get_connection(const Host host);
+    /** Send on a connection, or queue the request if there is none */
+    void dispatch(const Pool_key& key, Host_pool&, Queued);
+
+    /**
+     * @brief      Find a connection for a request: an idle one, a new one if
+     *             below the limit, or one to pipeline on. nullptr if none.
+     */
+    Client_connection* get_connection(const Pool_key& key, Host_pool&, const Method method);
+
+    /** Send as many waiting requests as there are connections for */
+    void process_queue(const Pool_key& key);
+
+    /** A connection has room for more requests */
+    void on_available(Client_connection& conn)
+    { process_queue({conn.peer(), conn.secure()}); }
+
+    /** Requests lost with a connection, sent again in order before anything waiting */
+    void retry(const Client_connection& conn, std::deque<Queued> requests);
 
     void close(Client_connection&);
 
@@ -15,7 +15,7 @@ namespace http {
   private:
     SSL_CTX* ssl_context;
 
-    virtual Client_connection& get_secure_connection(const Host host) override;
+    virtual Connection::Stream_ptr create_secure_stream(const Host host) override;
 
   }; // < class Client
 
@@ -9,6 +9,7 @@
 #include "error.hpp"
 
 #include <util/timer.hpp>
+#include <deque>
 
 namespace http {
 
@@ -20,37 +21,81 @@ namespace http {
     using timeout_duration  = std::chrono::milliseconds;
 
   public:
-    explicit Client_connection(Basic_client&, Stream_ptr);
+    explicit Client_connection(Basic_client&, Stream_ptr, bool secure = false);
 
+    /** Whether this is a secured (https) connection */
+    bool secure() const noexcept
+    { return secure_; }
+
+    /** No requests in flight, and the connection can be reused */
     bool available() const
-    { return on_response_ == nullptr && keep_alive_; }
+    { return inflight_.empty() && keep_alive_; }
 
     bool occupied() const
     { return !available(); }
 
-    void send(Request_ptr, Response_handler, int redirects, timeout_duration = timeout_duration::zero());
+    /**
+     * @brief      Whether a request can be written behind the ones in flight,
+     *             without waiting for their responses (pipelining).
+     *             Only safe methods are pipelined.
+     *
+     * @param[in]  method  The method of the request
+     * @param[in]  depth   Max number of requests in flight
+     */
+    bool can_pipeline(Method method, size_t depth) const;
 
-  private:
-    Basic_client&     client_;
-    Request_ptr       req_;
-    Response_ptr      res_;
-    Response_handler  on_response_;
-    Timer             timer_;
-    timeout_duration  timeout_dur_;
-    int               redirect_;
+    /** Number of requests sent and waiting for a response */
+    size_t inflight() const noexcept
+    { return inflight_.size(); }
 
-    void send_request();
+    void send(Request_ptr, Response_handler, int redirects,
+              timeout_duration = timeout_duration::zero(), bool retried = false);
+
+  private:
+    struct Pending {
+      Request_ptr       req;
+      Response_handler  on_response;
+      timeout_duration  timeout;
+      int               redirects;
+      bool              retried;
+    };
+
+    /** How the end of the response body is found */
+    enum class Framing : uint8_t {
+      LENGTH,       // Content-Length, or no body
+      CHUNKED,      // chunked transfer coding
+      TRAILER,      // after the last chunk
+      UNTIL_CLOSE   // the body ends when the connection is closed
+    };
+
+    Basic_client&       client_;
+    // requests in the order they were written, the first one is being answered
+    std::deque<Pending> inflight_;
+    Response_ptr        res_;
+    // received data not yet parsed into a response
+    std::string         buffer_;
+    size_t              body_left_;
+    Framing             framing_;
+    Timer               timer_;
+    const bool          secure_;
+
+    void on_connected();
 
     void recv_response(buffer_t buf);
 
+    bool parse_response();
+
+    void parse_framing();
+
     void end_response(Error err = Error::NONE);
 
-    void timeout_request()
-    { end_response(Error::TIMEOUT); }
+    void restart_timer();
+
+    void on_timeout();
 
-    bool can_redirect(const Response_ptr&) const;
+    bool can_redirect(const Response_ptr&, int redirects) const;
 
-    void redirect(uri::URI url);
+    void redirect(Pending&, uri::URI url);
 
     void close() override;
 
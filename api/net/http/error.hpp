@@ -15,7 +15,8 @@ namespace http {
       NO_REPLY,
       INVALID,
       TIMEOUT,
-      CLOSING
+      CLOSING,
+      QUEUE_FULL
     };
 
     Error(Code code = NONE)
@@ -45,6 +46,8 @@ namespace http {
           return "Request timed out";
         case CLOSING:
           return "Connection closing";
+        case QUEUE_FULL:
+          return "Too many requests queued";
         default:
           return "General error";
       } // < switch code_
@@ -0,0 +1,200 @@
+
+#pragma once
+#ifndef HTTP_H2_CONNECTION_HPP
+#define HTTP_H2_CONNECTION_HPP
+
+// http
+#include "connection.hpp"
+#include "h2_frame.hpp"
+#include "hpack.hpp"
+
+#include <map>
+
+namespace http {
+
+  class Server;
+  class H2_connection;
+
+  /**
+   * @brief      One HTTP/2 stream, seen as a net::Stream so a Response_writer
+   *             can write to it like to any other connection.
+   *             The response head written to it is sent as a HEADERS frame,
+   *             everything after as DATA frames, within the flow control windows.
+   */
+  class H2_stream : public net::Stream {
+  public:
+    H2_stream(H2_connection& conn, uint32_t id);
+
+    uint32_t id() const noexcept
+    { return id_; }
+
+    void on_connect(ConnectCallback) override {}
+    void on_read(size_t, ReadCallback) override {}
+    void on_data(DataCallback) override {}
+
+    // the request is delivered with its body, there is nothing to read
+    size_t next_size() override
+    { return 0; }
+
+    buffer_t read_next() override
+    { return construct_buffer(); }
+
+    void on_close(CloseCallback cb) override
+    { on_close_ = std::move(cb); }
+
+    void on_write(WriteCallback cb) override
+    { on_write_ = std::move(cb); }
+
+    void write(const void* buf, size_t n) override;
+
+    void write(buffer_t buf) override
+    { write(buf->data(), buf->size()); }
+
+    void write(const std::string& str) override
+    { write(str.data(), str.size()); }
+
+    /**
+     * @brief      End the response. The stream is removed (and this deleted)
+     *             when the data still waiting for the peer's window is sent.
+     */
+    void close() override;
+
+    void reset_callbacks() override
+    {
+      on_close_ = nullptr;
+      on_write_ = nullptr;
+    }
+
+    net::Socket local() const override;
+    net::Socket remote() const override;
+    std::string to_string() const override;
+
+    bool is_connected() const noexcept override
+    { return not reset_ and not closed_; }
+
+    bool is_writable() const noexcept override
+    { return is_connected(); }
+
+    bool is_readable() const noexcept override
+    { return not remote_end_; }
+
+    bool is_closing() const noexcept override
+    { return closed_; }
+
+    bool is_closed() const noexcept override
+    { return closed_; }
+
+    int get_cpuid() const noexcept override;
+
+    Stream* transport() noexcept override;
+
+  private:
+    friend class H2_connection;
+
+    H2_connection&  conn_;
+    const uint32_t  id_;
+    Request_ptr     req_;
+    std::string     head_;          // the response head, until complete
+    std::string     out_;           // data waiting for the peer's window
+    int64_t         send_window_;
+    int64_t         recv_window_;
+    int64_t         content_left_ = -1;   // body left to send, -1 when unknown
+    bool            head_request_ = false;
+    bool            head_sent_    = false;
+    bool            remote_end_   = false;  // END_STREAM received
+    bool            local_end_    = false;  // END_STREAM sent
+    bool            closed_       = false;  // closed by the user
+    bool            reset_        = false;  // reset by the peer
+    CloseCallback   on_close_;
+    WriteCallback   on_write_;
+  };
+
+  /**
+   * @brief      The HTTP/2 side of a server connection (RFC 7540).
+   *             Requests on concurrent streams are handed to the server
+   *             as they complete, each with its own connection to respond on.
+   *             Server push is not used, and stream priorities are ignored.
+   */
+  class H2_connection {
+  public:
+    H2_connection(Server& server, Connection& parent, const h2::Settings& settings);
+
+    /**
+     * @brief      Data read from the transport, starting with the client preface
+     */
+    void receive(const uint8_t* data, size_t len);
+
+    /**
+     * @brief      Continue an HTTP/1.1 connection upgraded to h2c (RFC 7540 3.2).
+     *             Answers 101, and the request becomes stream 1.
+     *
+     * @param      req   The request asking for the upgrade
+     *
+     * @return     false (and nothing written) if HTTP2-Settings is invalid
+     */
+    bool upgrade(Request_ptr& req);
+
+    /** Streams not yet closed */
+    size_t open_streams() const noexcept
+    { return streams_.size(); }
+
+    /** Whether data read may be the start of the client preface */
+    static bool is_preface(const char* data, size_t len) noexcept;
+
+    /** Whether a request asks for an upgrade to h2c */
+    static bool is_upgrade(const Request& req);
+
+  private:
+    friend class H2_stream;
+    using Stream_set = std::map<uint32_t, std::unique_ptr<Connection>>;
+
+    Server&             server_;
+    Connection&         parent_;
+    const h2::Settings  settings_;
+    hpack::Decoder      decoder_;
+    hpack::Encoder      encoder_;
+    Stream_set          streams_;
+    std::string         in_;
+    size_t              preface_left_;
+    uint32_t            last_stream_  = 0;
+    uint32_t            continuation_ = 0;    // stream of an unfinished header block
+    uint8_t             block_flags_  = 0;
+    std::string         header_block_;
+    int64_t             send_window_;
+    int64_t             recv_window_;
+    int64_t             initial_send_window_;
+    uint32_t            peer_max_frame_;
+    bool                started_ = false;
+    bool                goaway_  = false;
+
+    void start();
+    void handle_frame(const h2::Frame_header&, const uint8_t* payload);
+
+    void on_headers(const h2::Frame_header&, const uint8_t* payload);
+    void on_data(const h2::Frame_header&, const uint8_t* payload);
+    void on_settings(const h2::Frame_header&, const uint8_t* payload);
+    void on_window_update(const h2::Frame_header&, const uint8_t* payload);
+    void on_rst_stream(const h2::Frame_header&, const uint8_t* payload);
+
+    void apply_settings(const uint8_t* data, size_t len);
+    void end_headers(uint32_t id);
+    Request_ptr build_request(const hpack::Field_list& fields) const;
+    H2_stream& open(uint32_t id);
+    void dispatch(H2_stream&);
+
+    void send_head(H2_stream&);
+    void flush(H2_stream&);
+    void flush_all();
+    void remove(uint32_t id);
+
+    void reset_stream(uint32_t id, h2::Error_code);
+    void send_window_update(uint32_t id, uint32_t increment);
+    void goaway(h2::Error_code);
+    void send(const std::string& data);
+
+    H2_stream* find(uint32_t id) const;
+  };
+
+} // < namespace http
+
+#endif // < HTTP_H2_CONNECTION_HPP
@@ -0,0 +1,148 @@
+
+#pragma once
+#ifndef HTTP_H2_FRAME_HPP
+#define HTTP_H2_FRAME_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace http {
+
+/**
+ * HTTP/2 framing (RFC 7540 4, 6)
+ */
+namespace h2 {
+
+  /** What a client sends first on an HTTP/2 connection (RFC 7540 3.5) */
+  static constexpr char   PREFACE[]         = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+  static constexpr size_t PREFACE_LEN       = sizeof(PREFACE) - 1;
+
+  static constexpr size_t FRAME_HEADER_LEN  = 9;
+
+  static constexpr uint32_t DEFAULT_WINDOW_SIZE     = 65535;
+  static constexpr uint32_t MAX_WINDOW_SIZE         = 0x7fffffff;
+  static constexpr uint32_t DEFAULT_MAX_FRAME_SIZE  = 16384;
+  static constexpr uint32_t FRAME_SIZE_LIMIT        = 16777215;
+
+  enum class Frame_type : uint8_t {
+    DATA,
+    HEADERS,
+    PRIORITY,
+    RST_STREAM,
+    SETTINGS,
+    PUSH_PROMISE,
+    PING,
+    GOAWAY,
+    WINDOW_UPDATE,
+    CONTINUATION
+  };
+
+  namespace flag {
+    static constexpr uint8_t END_STREAM   = 0x1;
+    static constexpr uint8_t ACK          = 0x1;
+    static constexpr uint8_t END_HEADERS  = 0x4;
+    static constexpr uint8_t PADDED       = 0x8;
+    static constexpr uint8_t PRIORITY     = 0x20;
+  }
+
+  enum class Error_code : uint32_t {
+    NO_ERROR,
+    PROTOCOL_ERROR,
+    INTERNAL_ERROR,
+    FLOW_CONTROL_ERROR,
+    SETTINGS_TIMEOUT,
+    STREAM_CLOSED,
+    FRAME_SIZE_ERROR,
+    REFUSED_STREAM,
+    CANCEL,
+    COMPRESSION_ERROR,
+    CONNECT_ERROR,
+    ENHANCE_YOUR_CALM,
+    INADEQUATE_SECURITY,
+    HTTP_1_1_REQUIRED
+  };
+
+  enum class Setting : uint16_t {
+    HEADER_TABLE_SIZE       = 0x1,
+    ENABLE_PUSH             = 0x2,
+    MAX_CONCURRENT_STREAMS  = 0x3,
+    INITIAL_WINDOW_SIZE     = 0x4,
+    MAX_FRAME_SIZE          = 0x5,
+    MAX_HEADER_LIST_SIZE    = 0x6
+  };
+
+  /** The settings a server announces to its clients */
+  struct Settings {
+    uint32_t header_table_size{4096};
+    uint32_t max_concurrent_streams{100};
+    uint32_t initial_window_size{DEFAULT_WINDOW_SIZE};
+    uint32_t max_frame_size{DEFAULT_MAX_FRAME_SIZE};
+    uint32_t max_header_list_size{16384};
+
+    Settings() noexcept {}
+  };
+
+  /** An error that ends the connection with GOAWAY (RFC 7540 5.4.1) */
+  struct Connection_error : public std::runtime_error {
+    Connection_error(Error_code code, const char* what)
+      : runtime_error{what}, code{code}
+    {}
+
+    const Error_code code;
+  };
+
+  struct Frame_header {
+    uint32_t    length;
+    Frame_type  type;
+    uint8_t     flags;
+    uint32_t    stream;
+
+    static Frame_header parse(const uint8_t* data) noexcept
+    {
+      return {
+        (uint32_t(data[0]) << 16) | (uint32_t(data[1]) << 8) | data[2],
+        static_cast<Frame_type>(data[3]),
+        data[4],
+        read_u32(data + 5) & MAX_WINDOW_SIZE
+      };
+    }
+
+    static uint32_t read_u32(const uint8_t* data) noexcept
+    {
+      return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16)
+           | (uint32_t(data[2]) << 8)  | data[3];
+    }
+  };
+
+  inline void append_u32(std::string& out, uint32_t value)
+  {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+  }
+
+  /** Append a frame header, the payload follows */
+  inline void append_frame_header(std::string& out, size_t length, Frame_type type,
+                                  uint8_t flags, uint32_t stream)
+  {
+    out.push_back(length >> 16);
+    out.push_back(length >> 8);
+    out.push_back(length);
+    out.push_back(static_cast<uint8_t>(type));
+    out.push_back(flags);
+    append_u32(out, stream & MAX_WINDOW_SIZE);
+  }
+
+  inline void append_frame(std::string& out, Frame_type type, uint8_t flags,
+                           uint32_t stream, const char* payload, size_t length)
+  {
+    append_frame_header(out, length, type, flags, stream);
+    out.append(payload, length);
+  }
+
+} // < namespace h2
+} // < namespace http
+
+#endif // < HTTP_H2_FRAME_HPP
@@ -0,0 +1,186 @@
+
+#pragma once
+#ifndef HTTP_HPACK_HPP
+#define HTTP_HPACK_HPP
+
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace http {
+
+/**
+ * HPACK, header compression for HTTP/2 (RFC 7541)
+ */
+namespace hpack {
+
+  /** Thrown when a header block can't be decoded (COMPRESSION_ERROR) */
+  struct Error : public std::runtime_error {
+    using runtime_error::runtime_error;
+  };
+
+  using Field       = std::pair<std::string, std::string>;
+  using Field_list  = std::vector<Field>;
+
+  static constexpr size_t DEFAULT_TABLE_SIZE = 4096;
+
+  /**
+   * @brief      Append an integer with an N-bit prefix (RFC 7541 5.1)
+   *
+   * @param      out     Where to append
+   * @param[in]  prefix  Number of bits in the prefix (1-8)
+   * @param[in]  flags   The bits above the prefix in the first byte
+   * @param[in]  value   The value
+   */
+  void encode_integer(std::string& out, uint8_t prefix, uint8_t flags, uint64_t value);
+
+  /**
+   * @brief      Read an integer with an N-bit prefix, advancing pos
+   *
+   * @throws     Error if the data ends or the value is too large
+   */
+  uint64_t decode_integer(const uint8_t*& pos, const uint8_t* end, uint8_t prefix);
+
+  /** Length of str when Huffman coded */
+  size_t huffman_length(const std::string& str) noexcept;
+
+  /** Append str Huffman coded (RFC 7541 Appendix B) */
+  void huffman_encode(std::string& out, const std::string& str);
+
+  /**
+   * @brief      Decode a Huffman coded string
+   *
+   * @throws     Error on invalid padding or the EOS symbol
+   */
+  std::string huffman_decode(const uint8_t* data, size_t len);
+
+  /**
+   * @brief      The static table followed by the dynamic table, as one
+   *             index space (RFC 7541 2.3.3)
+   */
+  class Table {
+  public:
+    static constexpr size_t STATIC_SIZE = 61;
+    // the size of an entry is its name and value plus 32 (RFC 7541 4.1)
+    static constexpr size_t ENTRY_OVERHEAD = 32;
+
+    explicit Table(size_t max_size = DEFAULT_TABLE_SIZE)
+      : max_size_{max_size}
+    {}
+
+    /** The entry at index (1 and up), nullptr if there is none */
+    const Field* get(size_t index) const noexcept;
+
+    /** Insert in front of the dynamic table, evicting what doesn't fit */
+    void add(Field field);
+
+    /**
+     * @brief      Find a field
+     *
+     * @param      exact  Set if both name and value matched
+     *
+     * @return     The index of a matching entry, or 0 if there is none
+     */
+    size_t find(const std::string& name, const std::string& value, bool& exact) const noexcept;
+
+    void set_max_size(size_t max_size);
+
+    size_t max_size() const noexcept
+    { return max_size_; }
+
+    /** The size of the dynamic table */
+    size_t size() const noexcept
+    { return size_; }
+
+    /** Entries in the dynamic table */
+    size_t count() const noexcept
+    { return entries_.size(); }
+
+  private:
+    std::deque<Field> entries_;
+    size_t            size_ = 0;
+    size_t            max_size_;
+
+    void evict(size_t max);
+  };
+
+  /**
+   * @brief      Decodes the header blocks of one direction of a connection
+   */
+  class Decoder {
+  public:
+    /**
+     * @param[in]  max_table_size  The limit the encoder may set the table to
+     *                             (our SETTINGS_HEADER_TABLE_SIZE)
+     */
+    explicit Decoder(size_t max_table_size = DEFAULT_TABLE_SIZE)
+      : table_{max_table_size}, limit_{max_table_size}
+    {}
+
+    /**
+     * @brief      Decode a complete header block
+     *
+     * @param[in]  max_list_size  Max total size of the fields (0 = no limit)
+     *
+     * @throws     Error if the block is invalid
+     */
+    Field_list decode(const uint8_t* data, size_t len, size_t max_list_size = 0);
+
+    const Table& table() const noexcept
+    { return table_; }
+
+  private:
+    Table   table_;
+    size_t  limit_;
+
+    std::string read_string(const uint8_t*& pos, const uint8_t* end);
+  };
+
+  /**
+   * @brief      Encodes the header blocks of one direction of a connection
+   */
+  class Encoder {
+  public:
+    explicit Encoder(size_t table_size = DEFAULT_TABLE_SIZE)
+      : table_{table_size}
+    {}
+
+    /**
+     * @brief      Append a field to a header block. Fields are indexed
+     *             when seen before, and added to the table otherwise,
+     *             except for credentials which are never indexed.
+     *
+     * @param[in]  name   The name (lower case)
+     * @param[in]  value  The value
+     */
+    void encode(std::string& out, const std::string& name, const std::string& value);
+
+    void encode(std::string& out, const Field_list& fields)
+    {
+      for (const auto& field : fields)
+        encode(out, field.first, field.second);
+    }
+
+    /**
+     * @brief      Apply the peer's SETTINGS_HEADER_TABLE_SIZE. A size update
+     *             is sent at the start of the next header block.
+     */
+    void set_max_table_size(size_t size);
+
+    const Table& table() const noexcept
+    { return table_; }
+
+  private:
+    Table   table_;
+    bool    size_update_ = false;
+
+    static void write_string(std::string& out, const std::string& str);
+  };
+
+} // < namespace hpack
+} // < namespace http
+
+#endif // < HTTP_HPACK_HPP
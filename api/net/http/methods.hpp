@@ -93,6 +93,25 @@ namespace http {
       return (method == POST) or (method == PUT);
     }
 
+    ///
+    /// Test if the HTTP method is safe (RFC 7231 4.2.1), which
+    /// makes it fit for pipelining
+    ///
+    template<typename = void>
+    inline bool is_safe(const Method method) noexcept {
+      return (method == GET) or (method == HEAD)
+          or (method == OPTIONS) or (method == TRACE);
+    }
+
+    ///
+    /// Test if the HTTP method is idempotent (RFC 7231 4.2.2), which
+    /// makes it safe to retry on a new connection
+    ///
+    template<typename = void>
+    inline bool is_idempotent(const Method method) noexcept {
+      return is_safe(method) or (method == PUT) or (method == DELETE);
+    }
+
   } //< namespace method
 
   ///
@@ -5,6 +5,7 @@
 
 // http
 #include "common.hpp"
+#include "h2_frame.hpp"
 #include "server_connection.hpp"
 #include "response_writer.hpp"
 
@@ -78,6 +79,25 @@ namespace http {
      */
     Response_ptr create_response(status_t code = http::OK) const;
 
+    /**
+     * @brief      Accept HTTP/2: with prior knowledge or an h2c upgrade over
+     *             cleartext, and when negotiated with ALPN over TLS.
+     *             Must be called before listen().
+     *
+     * @param[in]  settings  The settings announced to clients
+     */
+    void enable_http2(h2::Settings settings = {})
+    {
+      http2_          = true;
+      http2_settings_ = settings;
+    }
+
+    bool http2_enabled() const noexcept
+    { return http2_; }
+
+    const h2::Settings& http2_settings() const noexcept
+    { return http2_settings_; }
+
     /**
      * Return CPU server is hosted on
     **/
@@ -115,11 +135,14 @@ namespace http {
 
   private:
     friend class Server_connection;
+    friend class H2_connection;
 
     Request_handler on_request_;
     Connection_set  connections_;
     Index_set       free_idx_;
     bool            keep_alive_;
+    bool            http2_;
+    h2::Settings    http2_settings_;
     Timers::id_t    timer_id_;
 
     const idle_duration idle_timeout_;
@@ -128,6 +151,7 @@ namespace http {
     Stat& stat_req_rx_;
     Stat& stat_req_bad_;
     Stat& stat_timeouts_;
+    Stat& stat_h2_conns_;
 
     /**
      * @brief      Close the given Server_connection
@@ -148,9 +172,9 @@ namespace http {
      *
      * @param[in]  <unnamed>  The HTTP reuqest
      * @param[in]  code       The HTTP status code
-     * @param      <unnamed>  The server connection which the req arrived from
+     * @param      <unnamed>  The connection (or HTTP/2 stream) which the req arrived from
      */
-    void receive(Request_ptr, status_t code, Server_connection&);
+    void receive(Request_ptr, status_t code, Connection&);
 
   }; // < class Server
 
@@ -11,6 +11,7 @@
 namespace http {
 
   class Server;
+  class H2_connection;
 
   class Server_connection : public Connection {
   public:
@@ -19,6 +20,8 @@ namespace http {
   public:
     explicit Server_connection(Server&, Stream_ptr, size_t idx, const size_t bufsize = DEFAULT_BUFSIZE);
 
+    ~Server_connection();
+
     void send(Response_ptr res);
 
     size_t idx() const noexcept
@@ -27,14 +30,21 @@ namespace http {
     auto idle_since() const noexcept
     { return idle_since_; }
 
+    /** Whether the connection speaks HTTP/2 */
+    bool is_http2() const noexcept
+    { return h2_ != nullptr; }
+
   private:
     Server&           server_;
     Request_ptr       req_;
     size_t            idx_;
     RTC::timestamp_t  idle_since_;
+    std::unique_ptr<H2_connection> h2_;
 
     void recv_request(buffer_t);
 
+    void start_http2();
+
     void end_request(status_t code = http::OK);
 
     void close() override;
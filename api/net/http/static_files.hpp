@@ -0,0 +1,149 @@
+
+#pragma once
+#ifndef HTTP_STATIC_FILES_HPP
+#define HTTP_STATIC_FILES_HPP
+
+// http
+#include "request.hpp"
+#include "response_writer.hpp"
+
+#include <fs/filesystem.hpp>
+#include <chrono>
+#include <ctime>
+#include <list>
+#include <unordered_map>
+
+namespace http {
+
+  /**
+   * @brief      Serves the files of a filesystem to GET and HEAD requests.
+   *
+   *             Files are kept in an LRU cache together with their ETag and
+   *             Last-Modified, so repeated requests don't touch the disk and
+   *             conditional requests are answered with 304. A single byte
+   *             range may be requested. Clients accepting gzip or br get the
+   *             .gz or .br file next to the requested one when there is one,
+   *             otherwise compressible files are gzipped once and cached.
+   *
+   *             Files too large to cache are read and written a chunk at a
+   *             time, as the connection sends them.
+   *
+   *             A cached file is checked against the size and modification
+   *             time on disk at most every Options::revalidate, and loaded
+   *             again when it changed. With Options::immutable it is served
+   *             until invalidate() or clear() purges it.
+   *
+   * Usage example:
+   * @code
+   *   http::Static_files files{disk->fs()};
+   *   server->on_request({&files, &http::Static_files::serve});
+   * @endcode
+   */
+  class Static_files {
+  public:
+    using buffer_t = net::tcp::buffer_t;
+
+    struct Options {
+      // directory served as "/"
+      std::string root{"/"};
+      // file served for a directory
+      std::string index{"index.html"};
+      // bytes of file content kept in memory
+      size_t cache_size{16 << 20};
+      // larger files are read from disk for every request
+      size_t max_cached_file{1 << 20};
+      // bytes read at a time for files that aren't cached
+      size_t read_chunk{64 << 10};
+      // how often cached files are checked against the disk, 0 for every request
+      std::chrono::seconds revalidate{1};
+      // never check cached files, the content only changes when purged
+      bool immutable{false};
+      // gzip compressible files without a .gz next to them
+      bool compress{true};
+      size_t min_compress_size{256};
+      // Cache-Control: max-age, not sent when 0
+      std::chrono::seconds max_age{0};
+
+      Options() noexcept {}
+    };
+
+    explicit Static_files(const fs::File_system& fs, Options options = {});
+
+    /**
+     * @brief      Answer a request (a Request_handler)
+     */
+    void serve(Request_ptr req, Response_writer_ptr writer);
+
+    /**
+     * @brief      Purge a cached file, to serve it from disk again
+     *
+     * @param[in]  path  The path as requested (e.g. "/index.html")
+     */
+    void invalidate(const std::string& path);
+
+    /** Purge all cached files */
+    void clear();
+
+    /** Bytes of file content in memory */
+    size_t cache_used() const noexcept
+    { return used_; }
+
+    size_t cached_files() const noexcept
+    { return index_.size(); }
+
+    uint64_t hits() const noexcept
+    { return hits_; }
+
+    uint64_t misses() const noexcept
+    { return misses_; }
+
+  private:
+    // one representation of a file
+    struct Variant {
+      fs::Dirent  file{nullptr};
+      buffer_t    data;     // in memory, or read from file
+      uint64_t    size = 0;
+      std::string etag;
+
+      bool exists() const noexcept
+      { return data != nullptr or file.is_valid(); }
+    };
+
+    struct Entry {
+      std::string   path;
+      std::string   name;     // on disk
+      util::sview   mime;
+      uint64_t      stamp = 0;  // modification time as on disk
+      std::time_t   modified = 0;
+      uint64_t      validated = 0;
+      std::string   last_modified;
+      Variant       identity;
+      Variant       gzip;
+      Variant       br;
+      size_t        memory = 0;
+    };
+
+    using Entry_list = std::list<Entry>;
+
+    const fs::File_system&  fs_;
+    const Options           options_;
+    Entry_list              lru_;
+    std::unordered_map<std::string, Entry_list::iterator> index_;
+    size_t                  used_ = 0;
+    uint64_t                hits_ = 0;
+    uint64_t                misses_ = 0;
+
+    Entry* lookup(const std::string& path);
+    bool is_current(Entry& entry) const;
+    Variant load(fs::Dirent file, std::string etag) const;
+    void insert(Entry entry);
+    void erase(Entry_list::iterator it);
+
+    buffer_t content(Variant& variant, uint64_t offset, uint64_t length) const;
+    void send_file(Response_writer& writer, buffer_t first, const fs::Dirent& file,
+                   uint64_t offset, uint64_t length) const;
+  };
+
+} // < namespace http
+
+#endif // < HTTP_STATIC_FILES_HPP
@@ -121,6 +121,9 @@ namespace net {
     /** Get the ICMP-object belonging to this stack */
     ICMPv4& icmp() { return icmp_; }
 
+    /** Get the DNS client (resolver cache) belonging to this stack */
+    dns::Client& dns() { return dns_; }
+
     /** Get the ICMP-object belonging to this stack */
     ICMPv6& icmp6() { return icmp6_; }
 
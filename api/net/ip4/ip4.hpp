@@ -6,6 +6,7 @@
 #include "addr.hpp"
 #include "header.hpp"
 #include "packet_ip4.hpp"
+#include "reassembly.hpp"
 #include <common>
 #include <net/netfilter.hpp>
 #include <net/port_util.hpp>
@@ -212,6 +213,9 @@ namespace net {
     /**  Reassemble fragments into a coherent heap-allocated packet **/
     IP_packet_ptr reassemble(IP_packet_ptr packet);
 
+    ip4::Reassembly& reassembly() noexcept
+    { return reassembly_; }
+
     /**
      *  Path MTU Discovery (and Packetization Layered Path MTU Discovery) related methods
      */
@@ -492,6 +496,9 @@ namespace net {
     uint32_t& input_dropped_;
     uint32_t& output_dropped_;
 
+    /** Fragments of incoming datagrams */
+    ip4::Reassembly reassembly_;
+
     /** All dropped packets go here */
     drop_handler drop_handler_;
 
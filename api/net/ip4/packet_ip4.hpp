@@ -147,15 +147,16 @@ namespace net {
     /** Set flags field */
     void set_ip_flags(ip4::Flags f)
     {
-      ip_header().frag_off_flags |= static_cast<uint16_t>(f) << 13;
-      ip_header().frag_off_flags = htons(ip_header().frag_off_flags);
+      const uint16_t offs = ntohs(ip_header().frag_off_flags) & 0x1fff;
+      ip_header().frag_off_flags = htons(static_cast<uint16_t>(f) << 13 | offs);
     }
 
     /** Set fragment offset header field */
     void set_ip_frag_offs(uint16_t offs)
     {
       Expects(offs < 0x2000);
-      ip_header().frag_off_flags |= htons(offs) >> 3;
+      const uint16_t flags = ntohs(ip_header().frag_off_flags) & 0xe000;
+      ip_header().frag_off_flags = htons(flags | offs);
     }
 
     /** Set total length header field */
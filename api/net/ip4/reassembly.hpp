@@ -0,0 +1,121 @@
+#pragma once
+#ifndef NET_IP4_REASSEMBLY_HPP
+#define NET_IP4_REASSEMBLY_HPP
+
+#include "packet_ip4.hpp"
+#include <rtc>
+#include <util/timer.hpp>
+#include <list>
+#include <unordered_map>
+
+namespace net {
+  class Inet;
+}
+
+namespace net::ip4 {
+
+  /**
+   * @brief      Reassembly of IPv4 fragments (RFC 791, RFC 815)
+   *
+   *             Fragments are kept as they were received, chained in offset
+   *             order, in a table keyed by source, destination, protocol and
+   *             ID. They are only copied together once the datagram is
+   *             complete - into the first fragment's buffer when it has room,
+   *             otherwise into one buffer of the datagram's size.
+   *
+   *             Overlapping fragments drop the datagram. Incomplete datagrams
+   *             expire after TIMEOUT seconds, and the oldest are dropped when
+   *             the fragments held exceed the memory limit.
+   */
+  class Reassembly {
+  public:
+    using Stack         = Inet;
+    using IP_packet_ptr = std::unique_ptr<PacketIP4>;
+
+    /** Seconds to wait for the rest of a datagram */
+    static constexpr int      TIMEOUT        = 15;
+    /** Default limit on the buffers held by incomplete datagrams */
+    static constexpr size_t   MEMORY_LIMIT   = 4 * 1024 * 1024;
+    static constexpr size_t   MAX_DATAGRAMS  = 1024;
+    static constexpr unsigned MAX_FRAGMENTS  = 64;
+    static constexpr uint32_t MAX_DATAGRAM   = 65515;
+
+    explicit Reassembly(Stack& stack);
+
+    /**
+     * @brief      Add a fragment
+     *
+     * @return     The reassembled datagram, when this was the last fragment
+     *             missing, otherwise nullptr
+     */
+    IP_packet_ptr process(IP_packet_ptr packet);
+
+    /** Drop all incomplete datagrams */
+    void flush();
+
+    void set_memory_limit(size_t bytes) noexcept
+    { limit_ = bytes; }
+
+    size_t memory_limit() const noexcept
+    { return limit_; }
+
+    /** Bytes of buffers held by incomplete datagrams */
+    size_t memory_used() const noexcept
+    { return memory_; }
+
+    /** Number of incomplete datagrams */
+    size_t pending() const noexcept
+    { return table_.size(); }
+
+  private:
+    struct Key {
+      ip4::Addr src;
+      ip4::Addr dst;
+      uint16_t  id;
+      Protocol  proto;
+
+      bool operator==(const Key& other) const noexcept
+      { return src == other.src and dst == other.dst
+           and id == other.id and proto == other.proto; }
+    };
+    struct Key_hash {
+      size_t operator()(const Key& key) const noexcept;
+    };
+    using Expiry_list = std::list<Key>;
+
+    struct Datagram {
+      IP_packet_ptr  head;          // fragments, chained in offset order
+      uint32_t       received  = 0; // data bytes
+      uint32_t       total     = 0; // data length, once the last fragment is in
+      uint32_t       end       = 0; // end of the furthest fragment
+      unsigned       fragments = 0;
+      size_t         memory    = 0;
+      RTC::timestamp_t expires;
+      Expiry_list::iterator expiry;
+    };
+    using Table = std::unordered_map<Key, Datagram, Key_hash>;
+
+    enum class Insert { Ok, Duplicate, Invalid };
+
+    Stack&      stack_;
+    Table       table_;
+    // datagrams in the order they expire, which is the order they arrived
+    Expiry_list expiry_;
+    Timer       timer_;
+    size_t      memory_ = 0;
+    size_t      limit_  = MEMORY_LIMIT;
+
+    uint64_t&   reassembled_;
+    uint32_t&   timeouts_;
+    uint32_t&   dropped_;
+
+    Insert insert(Datagram&, IP_packet_ptr&, uint32_t offset, uint32_t len, bool last);
+    IP_packet_ptr linearize(Datagram&);
+    void remove(Table::iterator);
+    void expire(RTC::timestamp_t now);
+    void on_timeout();
+  };
+
+} // net::ip4
+
+#endif
@@ -4,7 +4,10 @@
 #define NET_PORT_UTIL_HPP
 
 #include "inet_common.hpp"
+#include "socket.hpp"
 #include <util/fixed_bitmap.hpp>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace net {
 
@@ -17,20 +20,20 @@ struct Port_error : public std::runtime_error {
  * @brief      Class for handling a full range of network ports.
  *             Generates ephemeral ports and track what ports are bound or not.
  *             1 means free, 0 means bound (occupied)
+ *
+ *             Ephemeral ports are picked from a random point in the dynamic
+ *             range, taking the first free one after it (RFC 6056 3.3.1).
+ *             A port bound towards a remote socket is only taken for that
+ *             4-tuple, so when no port is free it can be bound again towards
+ *             other remotes.
  */
 class Port_util {
 public:
   /**
-   * @brief      Construct a port util with a new generated ephemeral port
-   *             and a empty port list.
+   * @brief      Construct a port util with a empty port list.
    */
   Port_util()
     : ports(),
-      eph_view{ // set the ephemeral view to be between 49152-65535
-        ports.data() + port_ranges::DYNAMIC_START / 8,
-        size() / sizeof(MemBitmap::word)
-      },
-      ephemeral_(net::new_ephemeral_port()),
       eph_count(0)
   {
     // all ports are free
@@ -42,15 +45,46 @@ public:
   }
 
   /**
-   * @brief      Gets the next ephemeral port.
-   *             increment_ephemeral may throw
+   * @brief      Gets a free ephemeral port.
+   *             Throws if there are no free ephemeral ports.
    *
-   * @return     The next ephemeral port.
+   * @return     The ephemeral port.
    */
   uint16_t get_next_ephemeral()
   {
-    increment_ephemeral();
-    return ephemeral_;
+    if(UNLIKELY( not has_free_ephemeral() ))
+      throw Port_error{"All ephemeral ports are taken"};
+
+    const auto port = find_free(net::new_ephemeral_port());
+    Ensures(port != 0 && "Did not found a free ephemeral even tho has_free_ephemeral() == true...");
+    return port;
+  }
+
+  /**
+   * @brief      Gets an ephemeral port not used towards a remote socket,
+   *             to be bound with bind(port, remote).
+   *             A free port is preferred. When there are none, a port bound
+   *             towards other remotes is reused.
+   *             Throws if every ephemeral port is used towards the remote.
+   *
+   * @param[in]  remote  The remote socket
+   *
+   * @return     The ephemeral port.
+   */
+  uint16_t get_next_ephemeral(const Socket& remote)
+  {
+    if(LIKELY( has_free_ephemeral() ))
+      return get_next_ephemeral();
+
+    // every port is bound, look for one shared with other remotes
+    const int start = rand() % size();
+    for(int i = 0; i < size(); ++i)
+    {
+      const uint16_t port = port_ranges::DYNAMIC_START + (start + i) % size();
+      if(shared.count(port) and not tuples.count({port, remote}))
+        return port;
+    }
+    throw Port_error{"All ephemeral ports are taken towards " + remote.to_string()};
   }
 
   /**
@@ -65,6 +99,22 @@ public:
     if(port_ranges::is_dynamic(port)) ++eph_count;
   }
 
+  /**
+   * @brief      Bind a port towards a remote socket only.
+   *             The port can't be bound alone until unbound from all remotes.
+   *
+   * @param[in]  port    The port
+   * @param[in]  remote  The remote socket
+   */
+  void bind(const uint16_t port, const Socket& remote)
+  {
+    if(not tuples.insert({port, remote}).second)
+      return;
+
+    if(shared[port]++ == 0)
+      bind(port);
+  }
+
   /**
    * @brief      Unbind a port, making it available.
    *
@@ -78,7 +128,26 @@ public:
   }
 
   /**
-   * @brief      Determines if the port is bound.
+   * @brief      Unbind a port bound towards a remote socket.
+   *
+   * @param[in]  port    The port
+   * @param[in]  remote  The remote socket
+   */
+  void unbind(const uint16_t port, const Socket& remote)
+  {
+    if(tuples.erase({port, remote}) == 0)
+      return;
+
+    auto it = shared.find(port);
+    if(--it->second == 0)
+    {
+      shared.erase(it);
+      unbind(port);
+    }
+  }
+
+  /**
+   * @brief      Determines if the port is bound, alone or towards any remote.
    *
    * @param[in]  port  The port
    *
@@ -89,6 +158,19 @@ public:
     return !ports[port];
   }
 
+  /**
+   * @brief      Determines if the port is bound towards a remote socket.
+   *
+   * @param[in]  port    The port
+   * @param[in]  remote  The remote socket
+   *
+   * @return     True if bound, False otherwise.
+   */
+  bool is_bound(const uint16_t port, const Socket& remote) const
+  {
+    return tuples.count({port, remote}) != 0;
+  }
+
   /**
    * @brief      Determines if it has any free ephemeral ports.
    *
@@ -97,39 +179,58 @@ public:
   bool has_free_ephemeral() const noexcept
   { return eph_count < size(); }
 
+  /** Number of ports bound towards remotes */
+  size_t shared_ports() const noexcept
+  { return shared.size(); }
+
 private:
+  struct Tuple {
+    uint16_t port;
+    Socket   remote;
+
+    bool operator==(const Tuple& other) const noexcept
+    { return port == other.port and remote == other.remote; }
+  };
+
+  struct Tuple_hash {
+    size_t operator()(const Tuple& t) const noexcept
+    { return std::hash<Socket>{}(t.remote) * 31 + t.port; }
+  };
+
+  static constexpr int WORD_BITS = MemBitmap::CHUNK_SIZE;
+  static constexpr int EPH_FIRST = port_ranges::DYNAMIC_START / WORD_BITS;
+  static constexpr int EPH_WORDS = (port_ranges::DYNAMIC_END + 1 - port_ranges::DYNAMIC_START) / WORD_BITS;
+
   Fixed_bitmap<65536> ports;
-  MemBitmap           eph_view;
-  uint16_t            ephemeral_;
   uint16_t            eph_count;
+  // ports bound towards remotes, with the number of them
+  std::unordered_map<uint16_t, uint32_t>  shared;
+  std::unordered_set<Tuple, Tuple_hash>   tuples;
 
   /**
-   * @brief      Increment the ephemeral port by one.
-   *             Throws if there are no more free ephemeral ports available.
+   * @brief      The first free ephemeral port from start, wrapping around,
+   *             looking at a word of the bitmap at a time.
+   *
+   * @return     The port, or 0 if none are free
    */
-  void increment_ephemeral()
+  uint16_t find_free(const uint16_t start) const noexcept
   {
-    if(UNLIKELY( not has_free_ephemeral() ))
-      throw Port_error{"All ephemeral ports are taken"};
-
-    ephemeral_++;
-
-    // wrap around to dynamic start if end
-    if(UNLIKELY(ephemeral_ == 0))
-      ephemeral_ = port_ranges::DYNAMIC_START;
-
-    if(UNLIKELY( is_bound(ephemeral_) ))
+    const int first = start / WORD_BITS - EPH_FIRST;
+    for(int i = 0; i <= EPH_WORDS; ++i)
     {
-      auto i = eph_view.first_set();
-      Ensures(i != -1 && "Did not found a free ephemeral even tho has_free_ephemeral() == true...");
-      ephemeral_ = port_ranges::DYNAMIC_START + i;
+      const int w = (first + i) % EPH_WORDS;
+      auto word = ports.get_chunk(EPH_FIRST + w);
+      // the bits before start in its own word are looked at last
+      if(i == 0)
+        word &= MemBitmap::WORD_MAX << (start % WORD_BITS);
+      if(word)
+        return (EPH_FIRST + w) * WORD_BITS + __builtin_ctz(word);
     }
-
-    Expects(not is_bound(ephemeral_) && "Generated ephemeral port is already bound. Please fix me!");
+    return 0;
   }
 }; // < class Port_util
-static_assert((port_ranges::DYNAMIC_START / 8) % sizeof(MemBitmap::word) == 0, "Must be word-sized multiple");
-static_assert(Port_util::size() % sizeof(MemBitmap::word) == 0, "Must be word-sized multiple");
+static_assert(port_ranges::DYNAMIC_START % MemBitmap::CHUNK_SIZE == 0, "Must be word aligned");
+static_assert(Port_util::size() % MemBitmap::CHUNK_SIZE == 0, "Must be word-sized multiple");
 
 } // < namespace net
 
@@ -658,6 +658,19 @@ namespace net {
      */
     Socket bind(const tcp::Address& addr);
 
+    /**
+     * @brief      Bind to an ephemeral port for a connection to remote.
+     *             When no port is free, a port connected to other remotes
+     *             is used again, as the connection tuple is still unique.
+     *             Throws if there are no more ports to use.
+     *
+     * @param[in]  addr    The address
+     * @param[in]  remote  The remote socket
+     *
+     * @return     The socket that got bound.
+     */
+    Socket bind(const tcp::Address& addr, const Socket& remote);
+
     /**
      * @brief      Determines if the source address is valid.
      *
@@ -716,7 +729,11 @@ namespace net {
      */
     void close_connection(const tcp::Connection* conn)
     {
-      unbind(conn->local());
+      auto it = ports_.find(conn->local().address());
+      if(it != ports_.end() and it->second.is_bound(conn->local().port(), conn->remote()))
+        it->second.unbind(conn->local().port(), conn->remote());
+      else
+        unbind(conn->local());
       connections_.erase(conn->tuple());
     }
 
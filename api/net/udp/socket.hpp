@@ -10,6 +10,7 @@
 #include <net/socket.hpp>
 
 #include <string>
+#include <vector>
 
 namespace net {
   class UDP;
@@ -23,6 +24,17 @@ namespace net::udp
 
     using recvfrom_handler  = delegate<void(addr_t, port_t, const char*, size_t)>;
 
+    /** A datagram to be copied into a packet by send_batch() */
+    struct Datagram {
+      addr_t      addr;
+      port_t      port;
+      const void* data;
+      size_t      length;
+    };
+    using Packet_batch      = std::vector<Packet_view_ptr>;
+    // receives the datagrams that arrived together, and owns the packets
+    using recv_batch_handler = delegate<void(Packet_batch)>;
+
     // constructors
     Socket(UDP&, net::Socket socket);
     Socket(const Socket&) = delete;
@@ -35,6 +47,49 @@ namespace net::udp
     void on_read(recvfrom_handler callback)
     { on_read_handler = callback; }
 
+    /**
+     * @brief      Receive datagrams in batches (recvmmsg-style) instead of
+     *             one on_read() call each. Datagrams arriving in the same
+     *             burst from the NIC are collected and delivered together,
+     *             once the burst has been processed or when @max_batch
+     *             datagrams are waiting. Broadcasts still go to on_read().
+     *
+     * @param[in]  callback   The batch handler, nullptr to stop batching
+     * @param[in]  max_batch  The largest batch to deliver
+     */
+    void on_read_batch(recv_batch_handler callback, size_t max_batch = 64);
+
+    /**
+     * @brief      Send many datagrams at once (sendmmsg-style). Each one is
+     *             copied straight into a packet, and as many as the transmit
+     *             queue has room for are sent right away. The rest are queued
+     *             like sendto() does.
+     *
+     * @return     The number of datagrams transmitted immediately
+     */
+    size_t send_batch(const Datagram* datagrams, size_t count);
+
+    size_t send_batch(const std::vector<Datagram>& datagrams)
+    { return send_batch(datagrams.data(), datagrams.size()); }
+
+    /**
+     * @brief      Create a datagram from this socket to @dest, to be filled
+     *             in by the caller (with fill()) and sent with send_batch().
+     *
+     * @return     The packet, or nullptr if out of buffers
+     */
+    Packet_view_ptr create_datagram(addr_t dest, port_t port);
+
+    /**
+     * @brief      Transmit datagrams made by create_datagram(), without
+     *             copying them, as many as the transmit queue has room for.
+     *             The rest are queued as they are, behind what sendto()
+     *             has queued.
+     *
+     * @return     The number of datagrams transmitted immediately
+     */
+    size_t send_batch(Packet_batch batch);
+
     void sendto(addr_t destIP, port_t port,
                 const void* buffer, size_t length,
                 sendto_handler cb = nullptr,
@@ -62,11 +117,16 @@ namespace net::udp
 
   private:
     void internal_read(const Packet_view&);
+    void batch_read(Packet_view_ptr);
+    void deliver_batch();
 
     UDP&    udp_;
     net::Socket  socket_;
     recvfrom_handler on_read_handler =
       [] (addr_t, port_t, const char*, size_t) {};
+    recv_batch_handler on_batch_handler = nullptr;
+    Packet_batch rx_batch;
+    size_t       rx_batch_max = 64;
 
     const bool is_ipv6_;
     bool reuse_addr;
@@ -46,6 +46,8 @@ namespace net {
       WriteBuffer(UDP& udp, net::Socket src, net::Socket dst,
                   const uint8_t* data, size_t length,
                   sendto_handler cb, error_handler ecb);
+      // a datagram that is already a packet, sent as it is
+      WriteBuffer(UDP& udp, net::Socket src, udp::Packet_view_ptr packet);
 
       int remaining() const
       { return len - offset; }
@@ -64,6 +66,7 @@ namespace net {
       const net::Socket dst;
       // buffer, total length and current write offset
       std::shared_ptr<uint8_t> buf;
+      udp::Packet_view_ptr packet;
       size_t len;
       size_t offset;
       // the callback for when this buffer is written
@@ -159,6 +162,13 @@ namespace net {
     // the async send queue
     std::deque<WriteBuffer> sendq;
 
+    // sockets with received datagrams waiting to be delivered as a batch
+    std::vector<net::Socket> batch_pending_;
+    bool batch_scheduled_ = false;
+
+    void schedule_batch(const net::Socket&);
+    void deliver_batches();
+
     Sockets::iterator find(const Socket& socket)
     {
       Sockets::iterator it = sockets_.find(socket);
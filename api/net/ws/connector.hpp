@@ -54,6 +54,14 @@ public:
   operator Request_handler()
   { return create_request_handler(); }
 
+  /**
+   * @brief      Accept permessage-deflate when clients offer it.
+   *
+   * @param[in]  opts  The compression settings
+   */
+  void set_compression(WS_deflate_options opts)
+  { deflate_ = std::move(opts); }
+
   /**
    * @brief      Handles a HTTP Request by trying to upgrade it to a WebSocket.
    *             Calls "on_connect" with the WS, nullptr if failed.
@@ -74,7 +82,7 @@ public:
         return;
       }
     }
-    auto ws = WebSocket::upgrade(*req, *writer);
+    auto ws = WebSocket::upgrade(*req, *writer, deflate_);
     if (ws == nullptr) return;
 
     assert(ws->get_cpuid() == SMP::cpu_id());
@@ -83,6 +91,7 @@ public:
 
 private:
   AcceptCallback  on_accept_;
+  WS_deflate_options deflate_;
 
 }; // < WS_server_connector
 
@@ -110,12 +119,14 @@ public:
    * @brief      Creates a HTTP Response handler by allocating a client connector
    *             with restricted lifetime to the response handler itself.
    *
-   * @param[in]  cb    A connect callback
-   * @param[in]  key   The WS key
+   * @param[in]  cb       A connect callback
+   * @param[in]  key      The WS key
+   * @param[in]  deflate  The permessage-deflate settings that were offered
    *
    * @return     Returns a Response handler with a captured client connector.
    */
-  static Response_handler create_response_handler(ConnectCallback cb, std::string key)
+  static Response_handler create_response_handler(ConnectCallback cb, std::string key,
+                                                  WS_deflate_options deflate = {})
   {
     // @todo Try replace with unique_ptr
     // create a new instance of a client connector
@@ -123,6 +134,7 @@ public:
     //  new WS_client_connector(std::move(cb), std::move(key))
     //};
     auto ptr = std::make_shared<WS_client_connector>(std::move(cb), std::move(key));
+    ptr->deflate_ = std::move(deflate);
 
     return [ ptr{std::move(ptr)} ]
            (auto err, auto res, auto& conn)
@@ -154,7 +166,7 @@ public:
    */
   void on_response(http::Error err, http::Response_ptr res, http::Connection& conn)
   {
-    auto ws = WebSocket::upgrade(err, *res, conn, key_);
+    auto ws = WebSocket::upgrade(err, *res, conn, key_, deflate_);
 
     if(ws == nullptr) {
     } // not ok
@@ -189,6 +201,7 @@ public:
 
 private:
   std::string key_;
+  WS_deflate_options deflate_;
 
 }; // < WS_client_connector
 
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef NET_WS_DEFLATE_HPP
+#define NET_WS_DEFLATE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace net {
+
+/**
+ * permessage-deflate (RFC 7692) parameters, used both as local
+ * configuration and as the result of the negotiation.
+ */
+struct WS_deflate_options
+{
+  using Dictionary = std::shared_ptr<const std::vector<uint8_t>>;
+
+  bool    enabled = false;
+  // LZ77 window of each side's compressor, 8-15
+  uint8_t server_max_window_bits = 15;
+  uint8_t client_max_window_bits = 15;
+  // reset the compressor after every message
+  bool    server_no_context_takeover = false;
+  bool    client_no_context_takeover = false;
+  // messages smaller than this are sent uncompressed
+  uint32_t min_size = 64;
+  /**
+   * Preset dictionary loaded into the window whenever a context starts.
+   * This is not part of RFC 7692: both ends must be configured with the
+   * same dictionary, so only use it between peers you control. The
+   * dictionary is shared (not copied) by every connection using it.
+   */
+  Dictionary dictionary = nullptr;
+
+  /** The Sec-WebSocket-Extensions value a client offers */
+  std::string offer() const;
+
+  /**
+   * Server side: pick the first acceptable permessage-deflate offer from
+   * a Sec-WebSocket-Extensions header.
+   *
+   * @return     Options to use, with enabled set to false if none fit
+   */
+  WS_deflate_options accept(std::string_view extensions) const;
+
+  /** The Sec-WebSocket-Extensions value a server responds with */
+  std::string response() const;
+
+  /**
+   * Client side: validate the server's response to our offer.
+   *
+   * @return     false if the response is not valid for the offer
+   */
+  bool agree(std::string_view extensions, WS_deflate_options& agreed) const;
+};
+
+/**
+ * Per-connection compressor and decompressor state for permessage-deflate.
+ * Messages are compressed as raw DEFLATE with the trailing empty stored
+ * block (00 00 ff ff) removed, as required by the RFC.
+ */
+class WS_deflate {
+public:
+  WS_deflate(const WS_deflate_options& agreed, bool client);
+  ~WS_deflate();
+
+  /**
+   * Compress a whole message.
+   *
+   * @return     The compressed payload, valid until the next call
+   */
+  const std::vector<uint8_t>& compress(const uint8_t* data, size_t len);
+
+  /**
+   * Decompress a whole message into @out.
+   *
+   * @param[in]  limit  Maximum decompressed size, 0 for no limit
+   *
+   * @return     false if the data is corrupt or exceeds the limit
+   */
+  bool decompress(const uint8_t* data, size_t len,
+                  std::vector<uint8_t>& out, size_t limit = 0);
+
+  bool should_compress(size_t len) const noexcept
+  { return len >= min_size_; }
+
+  struct Deflater;
+  struct Inflater;
+private:
+  std::unique_ptr<Deflater> deflater_;
+  std::unique_ptr<Inflater> inflater_;
+  uint32_t min_size_;
+};
+
+} // net
+
+#endif
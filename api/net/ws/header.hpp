@@ -3,12 +3,21 @@
 #ifndef NET_WS_HEADER_HPP
 #define NET_WS_HEADER_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <cassert>
 
 namespace net {
 
+  /**
+   * XOR @len bytes at @data with a WebSocket masking key, in place.
+   * @key is the 4 key bytes as they appear in the frame, and @offset
+   * the position of @data within the payload, for unmasking in pieces.
+   * Vectorized with SSE2, or AVX2 when the CPU has it.
+   */
+  void ws_mask(char* data, size_t len, uint32_t key, size_t offset = 0) noexcept;
+
   enum class op_code : uint8_t {
     CONTINUE  = 0,
     TEXT      = 1,
@@ -29,6 +38,13 @@ namespace net {
       bits |= 0x80;
       assert(is_final() == true);
     }
+    // RSV1: the message is compressed (permessage-deflate)
+    bool is_compressed() const noexcept {
+      return bits & 0x40;
+    }
+    void set_compressed() noexcept {
+      bits |= 0x40;
+    }
     uint16_t payload() const noexcept {
       return (bits >> 8) & 0x7f;
     }
@@ -114,13 +130,14 @@ namespace net {
     char* data() noexcept {
       return &vla[data_offset()];
     }
+    uint32_t mask_key() const noexcept {
+      uint32_t key;
+      memcpy(&key, &vla[data_offset() - mask_length()], sizeof(key));
+      return key;
+    }
     void masking_algorithm(char* ptr)
     {
-      const char* mask = keymask();
-      for (size_t i = 0; i < data_length(); i++)
-      {
-        ptr[i] = ptr[i] xor mask[i & 3];
-      }
+      ws_mask(ptr, data_length(), mask_key());
     }
 
     char vla[0];
@@ -4,6 +4,7 @@
 #define NET_WS_WEBSOCKET_HPP
 
 #include "header.hpp"
+#include "deflate.hpp"
 
 #include <net/http/server.hpp>
 #include <net/http/basic_client.hpp>
@@ -20,64 +21,82 @@ struct WS_error : public std::runtime_error {
 
 class WebSocket {
 public:
+  /**
+   * A received frame. When the whole frame arrived in one TCP buffer,
+   * the message refers to the payload inside that buffer (unmasked in
+   * place) instead of copying it out.
+   */
   class Message {
   public:
     using Data     = std::vector<uint8_t>;
-    using Data_it  = Data::iterator;
-    using Data_cit = Data::const_iterator;
+    using Data_it  = uint8_t*;
+    using Data_cit = const uint8_t*;
 
-    auto extract_vector() noexcept {
+    auto extract_vector() {
+      if (view_ != nullptr) return Data(cbegin(), cend());
       return std::move(data_);
     }
     auto extract_shared_vector() {
-      return std::make_shared<std::vector<uint8_t>> (std::move(data_));
+      return std::make_shared<std::vector<uint8_t>> (extract_vector());
     }
 
     std::string to_string() const
     { return std::string(data(), size()); }
 
     size_t size() const noexcept
-    { return data_.size(); }
+    { return (view_ != nullptr) ? header().data_length() : data_.size(); }
 
     Data_it begin() noexcept
-    { return data_.begin(); }
+    { return (uint8_t*) data(); }
 
     Data_it end() noexcept
-    { return data_.end(); }
+    { return begin() + size(); }
 
     Data_cit cbegin() const noexcept
-    { return data_.begin(); }
+    { return (const uint8_t*) data(); }
 
     Data_cit cend() const noexcept
-    { return data_.end(); }
+    { return cbegin() + size(); }
 
     const char* data() const noexcept
-    { return (const char*) data_.data(); }
+    { return (view_ != nullptr) ? (const char*) view_ : (const char*) data_.data(); }
 
     char* data() noexcept
-    { return (char*) data_.data(); }
+    { return (view_ != nullptr) ? (char*) view_ : (char*) data_.data(); }
 
+    /** Start a message from (part of) a frame, copying it */
     Message(const uint8_t* data, size_t len)
     {
-      const auto* wsh = (ws_header*) data;
-      // setup initial header
-      const size_t hdr_bytes = std::min((size_t) wsh->header_length(), len);
-      std::memcpy(header_.data(), data, hdr_bytes);
-      this->header_length = hdr_bytes;
-      // move forward in buffer
-      data += hdr_bytes; len -= hdr_bytes;
-      // if the header became complete, reserve data
-      if (this->header_complete()) {
-        data_.reserve(header().data_length());
-      }
-      // append any remaining data
       this->append(data, len);
     }
 
+    /** Refer to a complete frame inside @buffer */
+    Message(Stream::buffer_t buffer, uint8_t* frame)
+      : buffer_{std::move(buffer)}
+    {
+      const auto* wsh = (ws_header*) frame;
+      this->header_length = wsh->header_length();
+      std::memcpy(header_.data(), frame, this->header_length);
+      this->view_ = frame + this->header_length;
+    }
+
+    /** Replace the payload, e.g. with its decompressed form */
+    void set_data(Data data)
+    {
+      data_   = std::move(data);
+      view_   = nullptr;
+      buffer_ = nullptr;
+    }
+
+    /** Returns the number of bytes consumed from @data */
     size_t append(const uint8_t* data, size_t len);
 
     bool is_complete() const noexcept
-    { return header_complete() && data_.size() == header().data_length(); }
+    { return header_complete() && size() == header().data_length(); }
+
+    /** True if the payload is referenced in the received TCP buffer */
+    bool is_view() const noexcept
+    { return view_ != nullptr; }
 
     const ws_header& header() const noexcept
     { return *(ws_header*) header_.data(); }
@@ -88,11 +107,14 @@ public:
     void unmask() noexcept
     {
       if (header().is_masked())
-          writable_header().masking_algorithm(this->data());
+          ws_mask(this->data(), size(), header().mask_key());
     }
 
   private:
     Data data_;
+    // keeps the buffer that view_ points into alive
+    Stream::buffer_t buffer_ = nullptr;
+    uint8_t* view_ = nullptr;
     std::array<uint8_t, 15> header_;
     uint8_t header_length = 0;
 
@@ -100,9 +122,6 @@ public:
       return header_length >= 2 && header_length >= header().header_length();
     }
 
-    ws_header& writable_header()
-    { return *(ws_header*) header_.data(); }
-
   }; // < class Message
 
   using Message_ptr     = std::unique_ptr<Message>;
@@ -128,12 +147,14 @@ public:
   /**
    * @brief      Upgrade a HTTP Request to a WebSocket connection.
    *
-   * @param      req     The HTTP request
-   * @param      writer  The HTTP response writer
+   * @param      req      The HTTP request
+   * @param      writer   The HTTP response writer
+   * @param[in]  deflate  permessage-deflate settings, if the client offers it
    *
    * @return     A WebSocket_ptr, or nullptr if upgrade fails.
    */
-  static WebSocket_ptr upgrade(http::Request& req, http::Response_writer& writer);
+  static WebSocket_ptr upgrade(http::Request& req, http::Response_writer& writer,
+                               const WS_deflate_options& deflate = {});
 
   /**
    * @brief      Upgrade a HTTP Response to a WebSocket connection.
@@ -142,11 +163,13 @@ public:
    * @param      res   The HTTP response
    * @param      conn  The HTTP connection
    * @param      key   The WS key sent in the HTTP request
+   * @param[in]  deflate  The permessage-deflate settings that were offered
    *
    * @return     A WebSocket_ptr, or nullptr if upgrade fails.
    */
   static WebSocket_ptr upgrade(http::Error err, http::Response& res,
-                               http::Connection& conn, const std::string& key);
+                               http::Connection& conn, const std::string& key,
+                               const WS_deflate_options& deflate = {});
 
   /**
    * @brief      Generate a random WebSocket key
@@ -161,33 +184,39 @@ public:
    * @param      client    The HTTP client
    * @param[in]  dest      The destination
    * @param[in]  callback  The connect callback
+   * @param[in]  deflate   permessage-deflate settings to offer, if enabled
    */
   static void connect(http::Basic_client&   client,
                       uri::URI        dest,
-                      Connect_handler callback);
+                      Connect_handler callback,
+                      const WS_deflate_options& deflate = {});
 
   /**
    * @brief      Creates a request handler on heap.
    *
    * @param[in]  on_connect  On connect handler
    * @param[in]  on_accept   On accept (optional)
+   * @param[in]  deflate     permessage-deflate settings (optional)
    *
    * @return     A Request handler for a http::Server
    */
   static http::Server::Request_handler
   create_request_handler(Connect_handler on_connect,
-                         Accept_handler  on_accept = nullptr);
+                         Accept_handler  on_accept = nullptr,
+                         WS_deflate_options deflate = {});
 
   /**
    * @brief      Creates a response handler on heap.
    *
    * @param[in]  on_connect  On connect handler
    * @param[in]  key         The WebSocket key sent in outgoing HTTP header
+   * @param[in]  deflate     The permessage-deflate settings that were offered
    *
    * @return     A Response handler for a http::Client
    */
   static http::Basic_client::Response_handler
-  create_response_handler(Connect_handler on_connect, std::string key);
+  create_response_handler(Connect_handler on_connect, std::string key,
+                          WS_deflate_options deflate = {});
 
   void write(const char* buffer, size_t len, op_code = op_code::TEXT);
   void write(Stream::buffer_t, op_code = op_code::TEXT);
@@ -202,6 +231,34 @@ public:
     write((char *)data->data(),data->size());
   }
 
+  /**
+   * @brief      Send the same message to many WebSockets. The frame is
+   *             encoded once and the buffer is shared by every server-side
+   *             socket. Client-side sockets have to mask each frame with
+   *             their own key, and compressed sockets have their own
+   *             compression context, so they get a frame of their own.
+   *
+   * @param[in]  first, last  Range of WebSocket pointers (raw or smart)
+   *
+   * @return     The number of sockets written to
+   */
+  template <typename It>
+  static size_t broadcast(It first, It last, const char* data, size_t len,
+                          op_code code = op_code::TEXT);
+
+  /**
+   * @brief      Encode an unmasked (server-side) frame holding a copy of data
+   */
+  static Stream::buffer_t encode_frame(const char* data, size_t len,
+                                       op_code code = op_code::TEXT);
+
+  /**
+   * @brief      Write a frame made by encode_frame as it is. Server-side only.
+   *
+   * @return     false if the frame could not be written
+   */
+  bool write_frame(Stream::buffer_t frame);
+
   bool ping(const char* buffer, size_t len, Timer::duration_t timeout)
   {
     ping_timer.start(timeout);
@@ -235,6 +292,16 @@ public:
     return this->stream;
   }
 
+  /**
+   * @brief      Use permessage-deflate with the negotiated parameters.
+   *             Done by upgrade() when both sides agree on it.
+   */
+  void set_compression(const WS_deflate_options& agreed);
+
+  bool is_compressed() const noexcept {
+    return this->deflate != nullptr;
+  }
+
   // op code to string
   const char* to_string(op_code code);
 
@@ -267,6 +334,7 @@ private:
   net::Stream_ptr stream;
   Timer ping_timer{{this, &WebSocket::pong_timeout}};
   Message_ptr message;
+  std::unique_ptr<WS_deflate> deflate = nullptr;
   uint32_t max_msg_size;
   bool     clientside;
   bool     m_busy = false;
@@ -280,7 +348,7 @@ private:
   bool write_opcode(op_code code, const char*, size_t);
   void failure(const std::string&);
   void close_callback_once();
-  size_t create_message(const uint8_t*, size_t len);
+  size_t create_message(const Stream::buffer_t&, uint8_t*, size_t len);
   void finalize_message();
 
   bool default_on_ping(const char*, size_t)
@@ -296,6 +364,27 @@ private:
 };
 using WebSocket_ptr = WebSocket::WebSocket_ptr;
 
+template <typename It>
+inline size_t WebSocket::broadcast(It first, It last, const char* data, size_t len,
+                                   op_code code)
+{
+  Stream::buffer_t frame = nullptr;
+  size_t count = 0;
+  for (; first != last; ++first)
+  {
+    auto& ws = *first;
+    if (ws == nullptr or not ws->is_alive()) continue;
+    if (ws->is_client() or ws->is_compressed()) {
+      ws->write(data, len, code);
+      count++;
+      continue;
+    }
+    if (frame == nullptr) frame = encode_frame(data, len, code);
+    if (ws->write_frame(frame)) count++;
+  }
+  return count;
+}
+
 } // http
 
 #endif
@@ -57,6 +57,8 @@ public:
   virtual int   mkfifoat(const char *, mode_t) { return -1; }
   virtual int   mknodat(const char *, mode_t, dev_t) { return -1; }
   virtual off_t lseek(off_t, int) { return -DEFAULT_ERR; }
+  virtual int   ftruncate(off_t) { return -EINVAL; }
+  virtual int   fsync() { return -EINVAL; }
 
   // linux specific
   virtual long getdents(struct dirent*, unsigned int) { return -1; }
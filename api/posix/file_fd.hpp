@@ -17,6 +17,8 @@ public:
   int write(const void*, size_t) override;
   int close() override;
   off_t lseek(off_t, int) override;
+  int ftruncate(off_t) override;
+  int fsync() override;
 
   long getdents(struct dirent *dirp, unsigned int count) override;
 
@@ -29,4 +31,7 @@ private:
   fs::Dirvec_ptr dir_;
 };
 
+/** Map a filesystem error to a negative errno (0 when no error) */
+int fs_errno(const fs::error_t&);
+
 #endif
@@ -68,12 +68,19 @@ static uint32_t crc_32_tab[] =
 #undef UPDC32
 }
 
+/** Ethernet/ZIP, continued from @partial, with PCLMULQDQ support **/
+extern uint32_t crc32_update(uint32_t partial, const void* buf, size_t len);
+
 /** Ethernet/ZIP **/
 inline uint32_t crc32(const void* buf, size_t len)
 {
-  return ~crc32(0xFFFFFFFF, (const char*) buf, len);
+  return ~crc32_update(0xFFFFFFFF, buf, len);
 }
 
+/** Intel (iSCSI) aka CRC32-C, continued from @partial, with SSE4.2 and
+    PCLMULQDQ support **/
+extern uint32_t crc32c_update(uint32_t partial, const void* buf, size_t len);
+
 /** Intel (iSCSI) aka CRC32-C with hardware support **/
 extern uint32_t crc32_fast(const void* buf, size_t len);
 
@@ -84,4 +91,43 @@ inline uint32_t crc32c(const void* buf, size_t len)
   return ~crc32c_sw(0xFFFFFFFF, (const char*) buf, len);
 }
 
+namespace util {
+
+/**
+ * CRC over a stream of buffers, as if they were one, eg.
+ *   util::CRC32C crc;
+ *   crc.update(header, sizeof(header)).update(payload.begin(), payload.end());
+ *   uint32_t value = crc.value();
+ */
+template <uint32_t (*Update)(uint32_t, const void*, size_t)>
+class Basic_crc32 {
+public:
+  Basic_crc32& update(const void* buf, size_t len) noexcept {
+    state_ = Update(state_, buf, len);
+    return *this;
+  }
+  /** Any contiguous buffer, eg. std::string or std::vector<uint8_t> */
+  template <typename Buffer>
+  Basic_crc32& update(const Buffer& buf) noexcept {
+    return update(buf.data(), buf.size() * sizeof(*buf.data()));
+  }
+  /** A range of buffers, eg. a gather list */
+  template <typename It>
+  Basic_crc32& update(It first, It last) noexcept {
+    for (; first != last; ++first) update(*first);
+    return *this;
+  }
+
+  uint32_t value() const noexcept { return CRC32_VALUE(state_); }
+  void reset() noexcept { state_ = CRC32_BEGIN(); }
+
+private:
+  uint32_t state_ = CRC32_BEGIN();
+};
+
+using CRC32  = Basic_crc32<crc32_update>;
+using CRC32C = Basic_crc32<crc32c_update>;
+
+} // util
+
 #endif
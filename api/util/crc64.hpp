@@ -8,22 +8,68 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <util/detail/crc_fold.hpp>
 
 namespace util {
 
+namespace detail {
+using crc64_table_t = std::array<std::array<uint64_t, 256>, 8>;
+
+template<uint64_t POLY>
+constexpr const std::array<uint64_t, 256> crc64_init_table() noexcept {
+  std::array<uint64_t, 256> data {{}};
+
+  for (uint64_t i {0}; i < 256; ++i) {
+    uint64_t crc {i};
+
+    for (uint64_t j {0}; j < 8; ++j) {
+      crc = (crc & 1) ? ((crc >> 1) ^ POLY) : (crc >> 1);
+    }
+
+    data[i] = crc;
+  }
+
+  return data;
+}
+
+// slicing-by-8 tables
+template<uint64_t POLY>
+constexpr const crc64_table_t crc64_make_table() noexcept {
+  auto crc64_itable = crc64_init_table<POLY>();
+
+  crc64_table_t crc64_table {{}};
+  crc64_table[0] = crc64_itable;
+
+  for (uint64_t i = 0; i < 256; ++i) {
+    auto crc_accumulator = crc64_itable[i];
+
+    for (uint64_t j = 1; j < 8; ++j) {
+      crc_accumulator = crc64_itable[crc_accumulator & 0xff] ^ (crc_accumulator >> 8);
+      crc64_table[j][i] = crc_accumulator;
+    }
+  }
+
+  return crc64_table;
+}
+
+// computed once at compile time, instead of on every checksum
+template<uint64_t POLY>
+inline constexpr crc64_table_t crc64_table = crc64_make_table<POLY>();
+} //< namespace detail
+
 template<uint64_t POLY>
 struct crc64 {
   explicit crc64(const std::string& data) noexcept
-    : crc64(data.data(), data.size())
+    : crc_register_{fast_checksum(0, data.data(), data.size())}
   {}
 
   explicit crc64(const std::vector<char>& data) noexcept
-    : crc64(data.data(), data.size())
+    : crc_register_{fast_checksum(0, data.data(), data.size())}
   {}
 
   template<size_t N>
   explicit crc64(const std::array<char, N>& data) noexcept
-    : crc64(data.data(), data.size())
+    : crc_register_{fast_checksum(0, data.data(), data.size())}
   {}
 
   constexpr explicit crc64(const char* data, size_t data_len) noexcept {
@@ -32,15 +78,15 @@ struct crc64 {
 
 
   static constexpr uint64_t checksum(uint64_t crc_accumulator, const char* data, size_t data_len) noexcept {
-    auto crc64_table = get_table();
+    const auto& crc64_table = table_;
 
     crc_accumulator = ~crc_accumulator;
 
     while (data_len > 8) {
-      crc_accumulator ^= static_cast<uint64_t>(data[0])       | static_cast<uint64_t>(data[1]) << 8  |
-                         static_cast<uint64_t>(data[2]) << 16 | static_cast<uint64_t>(data[3]) << 24 |
-                         static_cast<uint64_t>(data[4]) << 32 | static_cast<uint64_t>(data[5]) << 40 |
-                         static_cast<uint64_t>(data[6]) << 48 | static_cast<uint64_t>(data[7]) << 56;
+      crc_accumulator ^= byte(data[0])       | byte(data[1]) << 8  |
+                         byte(data[2]) << 16 | byte(data[3]) << 24 |
+                         byte(data[4]) << 32 | byte(data[5]) << 40 |
+                         byte(data[6]) << 48 | byte(data[7]) << 56;
 
       crc_accumulator = crc64_table[7][crc_accumulator & 0xff]         ^
                         crc64_table[6][(crc_accumulator >> 8)  & 0xff] ^
@@ -51,57 +97,50 @@ struct crc64 {
                         crc64_table[1][(crc_accumulator >> 48) & 0xff] ^
                         crc64_table[0][crc_accumulator  >> 56];
 
+      data += 8;
       data_len -= 8;
     }
 
     for (size_t i = 0; i < data_len; ++i) {
-      crc_accumulator = crc64_table[0][static_cast<uint8_t>(crc_accumulator) ^ data[i]] ^ (crc_accumulator >> 8);
+      crc_accumulator = crc64_table[0][(crc_accumulator ^ byte(data[i])) & 0xff] ^ (crc_accumulator >> 8);
     }
 
     return ~crc_accumulator;
   }
 
+  /**
+   * Same as checksum(), and can be continued the same way, but folds
+   * larger inputs with PCLMULQDQ when the CPU has it
+   */
+  static uint64_t fast_checksum(uint64_t crc_accumulator, const char* data, size_t data_len) noexcept {
+    if (data_len >= 256 && detail::crc_fold_available())
+    {
+      static const auto keys = detail::crc_fold_keys_for(POLY, 64);
+      char folded[16];
+      const size_t bulk = data_len & ~static_cast<size_t>(15);
+      detail::crc_fold(keys, ~crc_accumulator,
+                       reinterpret_cast<const uint8_t*>(data), bulk,
+                       reinterpret_cast<uint8_t*>(folded));
+      // the folded block has the same remainder, from a zero register
+      crc_accumulator = checksum(~uint64_t{0}, folded, sizeof(folded));
+      data += bulk;
+      data_len -= bulk;
+    }
+    return checksum(crc_accumulator, data, data_len);
+  }
+
   constexpr operator uint64_t() const noexcept
   { return crc_register_; }
 
 private:
   uint64_t crc_register_ {0};
 
-  using CRC64_table_t = std::array<std::array<uint64_t, 256>, 8>;
+  using CRC64_table_t = detail::crc64_table_t;
 
-  static constexpr const CRC64_table_t get_table() noexcept {
-    auto crc64_itable = get_init_table();
-
-    CRC64_table_t crc64_table {{}};
-    crc64_table[0] = crc64_itable;
-
-    for (uint64_t i = 0; i < 256; ++i) {
-      auto crc_accumulator = crc64_itable[i];
-
-      for (uint64_t j = 1; j < 8; ++j) {
-        crc_accumulator = crc64_itable[crc_accumulator & 0xff] ^ (crc_accumulator >> 8);
-        crc64_table[j][i] = crc_accumulator;
-      }
-    }
+  static constexpr uint64_t byte(char c) noexcept
+  { return static_cast<uint8_t>(c); }
 
-    return crc64_table;
-  }
-
-  static constexpr const std::array<uint64_t, 256> get_init_table() noexcept {
-    std::array<uint64_t, 256> data {{}};
-
-    for (uint64_t i {0}; i < 256; ++i) {
-      uint64_t crc {i};
-
-      for (uint64_t j {0}; j < 8; ++j) {
-        crc = (crc & 1) ? ((crc >> 1) ^ POLY) : (crc >> 1);
-      }
-
-      data[i] = crc;
-    }
-
-    return data;
-  }
+  static constexpr const CRC64_table_t& table_ = detail::crc64_table<POLY>;
 }; //< struct crc64
 
 using crc64_iso_checksum  = crc64<0xD800000000000000>; //< Specified in ISO 3309
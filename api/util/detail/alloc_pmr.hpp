@@ -6,6 +6,7 @@
 #include <deque>
 #include <delegate>
 #include <util/units.hpp>
+#include <kernel/memory.hpp>
 
 namespace os::mem::detail {
 
@@ -29,6 +30,11 @@ namespace os::mem::detail {
       if (size < sizeof(void*))
         size = sizeof(void*);
 
+      // large buffers, e.g. TCP read buffers, start on a huge page
+      using namespace util::literals;
+      if (size >= 2_MiB and os::mem::huge_page_size() != 0)
+        align = 2_MiB;
+
       void* buf = aligned_alloc(align, size);
 
       if (buf == nullptr) {
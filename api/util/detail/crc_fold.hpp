@@ -0,0 +1,35 @@
+// -*- C++ -*-
+
+#pragma once
+#ifndef UTIL_DETAIL_CRC_FOLD_HPP
+#define UTIL_DETAIL_CRC_FOLD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace util::detail {
+
+/** Folding constants for a reflected CRC polynomial (PCLMULQDQ) */
+struct crc_fold_keys {
+  uint64_t fold4[2]; // 512 bits ahead: low, high qword
+  uint64_t fold1[2]; // 128 bits ahead
+};
+
+/** Keys for @poly in reflected form, eg. 0xEDB88320 for CRC32, of @width bits */
+crc_fold_keys crc_fold_keys_for(uint64_t poly, int width);
+
+/** True when the CPU has carry-less multiplication */
+bool crc_fold_available() noexcept;
+
+/**
+ * Fold @len bytes (a multiple of 16, at least 64) into the 16 bytes
+ * in @out, starting from the (non-inverted) CRC register @crc.
+ * The CRC of @out from a zero register equals that of the input,
+ * so finish it with any table-driven or hardware CRC.
+ */
+void crc_fold(const crc_fold_keys&, uint64_t crc,
+              const uint8_t* data, size_t len, uint8_t out[16]) noexcept;
+
+} // util::detail
+
+#endif
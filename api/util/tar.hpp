@@ -6,6 +6,7 @@
 #include <tar.h>
 #include <tinf.h>             // From uzlib (mod)
 #include <util/crc32.hpp>
+#include <gsl/span>
 #include <info>
 
 #include <string>
@@ -86,6 +87,8 @@ public:
   void set_header(const Tar_header& header) { header_ = header; }
 
   const uint8_t* content() const { return content_start_; }
+  // non-owning view of the content, pointing into the tarball
+  gsl::span<const uint8_t> view() const { return { content_start_, content_start_ ? size() : 0 }; }
   void set_content_start(const uint8_t* content_start) { content_start_ = content_start; }
 
   std::string name() const { return std::string{header_.name}; }
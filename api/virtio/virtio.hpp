@@ -205,6 +205,15 @@ public:
     */
     int enqueue(gsl::span<Virtio::Token> buffers);
 
+    /** Push data tokens onto the queue using an indirect descriptor table,
+        consuming only one descriptor in the ring.
+        Requires VIRTIO_F_RING_INDIRECT_DESC to be negotiated.
+        @param buffers : A span of tokens
+        @param table   : Storage for buffers.size() descriptors, which must
+                         stay alive until the chain is dequeued
+    */
+    int enqueue_indirect(gsl::span<Virtio::Token> buffers, virtq_desc* table);
+
     /** Dequeue a received packet */
     Token dequeue();
 
@@ -331,6 +340,10 @@ public:
 
   void move_to_this_cpu();
 
+  /** Route MSI-X vector @index to @cpu, subscribing a new event there.
+      The event number is updated in get_irqs()[index]. */
+  void move_vector_to_cpu(size_t index, int cpu);
+
   /** Virtio device constructor.
 
       Should conform to Virtio std. §3.1.1, steps 1-6
@@ -358,6 +371,8 @@ private:
 
   uint8_t current_cpu;
   std::vector<uint8_t> irqs;
+  // the CPU each IRQ is currently subscribed on
+  std::vector<uint8_t> irq_cpus;
 };
 
 #endif
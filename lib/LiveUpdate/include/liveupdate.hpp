@@ -41,6 +41,25 @@ struct LiveUpdate
   // the same @key value during the resume process
   static void register_partition(std::string key, storage_func);
 
+  // Same as above, but the partition can be serialized ahead of time with
+  // precopy() while the service is still running. exec() and store() then
+  // only serialize it again if mark_dirty(@key) was called since, and use
+  // the pre-copied data otherwise
+  static void register_incremental_partition(std::string key, storage_func);
+
+  // Tell that an incremental partition has changed since it was serialized
+  static void mark_dirty(const std::string& key);
+
+  // Serialize all incremental partitions that are dirty, or were never
+  // serialized, ahead of an update. Can be called repeatedly: returns the
+  // number of bytes serialized, which shrinks as fewer partitions change
+  // between rounds, and exec() can be called once it is small enough
+  static size_t precopy();
+
+  // Serialize partitions in parallel, one partition at a time on each CPU.
+  // All storage functions must be safe to run concurrently when enabled
+  static void enable_parallel_writers(bool) noexcept;
+
   // Start a live update process, storing all user-defined data
   // If no storage functions are registered no state will be saved
   // The default storage area is managed by the OS and is recommended
@@ -105,8 +105,12 @@ struct storage_header
   storage_header(const size_t);
   int  create_partition(std::string key);
   int  find_partition(const char*) const;
-  void finish_partition(int);
+  // staged partitions are written to the heap, and always checksummed
+  void finish_partition(int, bool staged = false);
   void zero_partition(int);
+  // append partition @p of another storage area, which must hold
+  // nothing else (see finish_partition)
+  int  import_partition(const storage_header& other, int p);
 
   void add_marker(uint16_t id);
   void add_int   (uint16_t id, int value);
@@ -116,7 +120,7 @@ struct storage_header
   storage_entry& add_struct(int16_t type, uint16_t id, construct_func);
   void add_vector(uint16_t, const void*, size_t cnt, size_t esize);
   void add_string_vector(uint16_t id, const std::vector<std::string>& vec);
-  void add_end();
+  void add_end(bool staged = false);
 
   storage_entry* begin(int p);
   storage_entry* next(storage_entry*);
@@ -49,18 +49,39 @@ int storage_header::find_partition(const char* key) const
   }
   return -1;
 }
-void storage_header::finish_partition(int p)
+void storage_header::finish_partition(int p, bool staged)
 {
   // make sure partition ends properly
-  this->add_end();
+  this->add_end(staged);
   // write length and crc
   auto& part = ptable.at(p);
   part.length = this->length - part.offset;
-  if (LIVEUPDATE_EXTRA_CHECKS) {
+  // staged partitions are checksummed by their (possibly parallel) writer,
+  // ahead of the update when pre-copied
+  if (LIVEUPDATE_EXTRA_CHECKS || staged) {
     part.crc = part.generate_checksum(this->vla);
   }
   else part.crc = 0;
 }
+int storage_header::import_partition(const storage_header& other, int p)
+{
+  if (partitions >= ptable.size())
+      throw std::out_of_range("Partition table is full");
+  const auto& src = other.ptable.at(p);
+  if (this->length + src.length > end_bytes()) {
+    this->end_reached();
+  }
+  // entries only refer to each other by length, so the partition
+  // (including its end entry) can be copied as-is, crc included
+  memcpy(&this->vla[this->length], &other.vla[src.offset], src.length);
+  auto& part = ptable.at(partitions);
+  part = src;
+  part.offset = this->length;
+  this->length  += src.length;
+  this->entries += other.entries;
+  this->append_eof();
+  return partitions++;
+}
 void storage_header::zero_partition(int p)
 {
   auto& part = ptable.at(p);
@@ -93,14 +93,14 @@ void storage_header::add_string_vector(uint16_t id, const std::vector<std::strin
     return total_len;
   });
 }
-void storage_header::add_end()
+void storage_header::add_end(bool staged)
 {
   auto& ent = create_entry(TYPE_END, 0, 0);
 
 #if !defined(PLATFORM_UNITTEST) && !defined(USERSPACE_KERNEL)
   // test against heap max
   const auto storage_end = os::mem::virt_to_phys((uintptr_t) ent.vla);
-  if (storage_end <= kernel::heap_max())
+  if (storage_end <= kernel::heap_max() && !staged)
   {
     printf("ERROR:\n"
           "Storage end inside heap: %#lx > %#lx by %ld bytes\n",
@@ -7,6 +7,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -14,6 +15,7 @@
 #include "storage.hpp"
 #include <kernel.hpp>
 #include <os.hpp>
+#include <smp>
 #include <hw/nic.hpp> // for flushing
 #include <profile>
 
@@ -33,34 +35,182 @@ extern uint8_t _end;
 bool LIVEUPDATE_EXTRA_CHECKS    = false;
 // turn this om to zero-initialize all memory between new kernel and heap end
 bool LIVEUPDATE_ZERO_OLD_MEMORY = false;
+// serialize partitions on all CPUs
+static bool LIVEUPDATE_PARALLEL_WRITERS = false;
 
 using namespace liu;
 
 static size_t update_store_data(location_t location);
 
+struct partition_t
+{
+  LiveUpdate::storage_func func;
+  // serialized ahead of time, and again only when dirty
+  bool incremental = false;
+  bool dirty = true;
+  // staging area: a storage header holding only this partition
+  std::unique_ptr<char[]> staged = nullptr;
+  size_t staged_size = 0;
+
+  storage_header& staged_header() const noexcept {
+    return *(storage_header*) staged.get();
+  }
+};
+// initial staging area size, doubled until the partition fits
+static const size_t STAGING_MIN = 64 * 1024;
+static const size_t STAGING_MAX = 1ull << 30;
+
 // serialization callbacks
-static std::unordered_map<std::string, LiveUpdate::storage_func> storage_callbacks;
+static std::unordered_map<std::string, partition_t> storage_callbacks;
 static const uint8_t* liveupdate_blob_data = nullptr;
 static size_t         liveupdate_blob_size = 0;
 
-void LiveUpdate::register_partition(std::string key, storage_func callback)
+static void add_partition(std::string key, LiveUpdate::storage_func callback, bool incremental)
 {
 #if defined(USERSPACE_KERNEL)
   // on linux we cant make the jump, so the tracking wont reset
-  storage_callbacks[key] = std::move(callback);
+  auto& part = storage_callbacks[key];
+  part.func = std::move(callback);
+  part.incremental = incremental;
+  part.dirty = true;
 #else
   auto it = storage_callbacks.find(key);
   if (it == storage_callbacks.end())
   {
-    storage_callbacks.emplace(std::piecewise_construct,
-              std::forward_as_tuple(std::move(key)),
-              std::forward_as_tuple(std::move(callback)));
+    auto& part = storage_callbacks[std::move(key)];
+    part.func = std::move(callback);
+    part.incremental = incremental;
   }
   else {
     throw std::runtime_error("Storage key '" + key + "' already used");
   }
 #endif
 }
+void LiveUpdate::register_partition(std::string key, storage_func callback)
+{
+  add_partition(std::move(key), std::move(callback), false);
+}
+void LiveUpdate::register_incremental_partition(std::string key, storage_func callback)
+{
+  add_partition(std::move(key), std::move(callback), true);
+}
+void LiveUpdate::mark_dirty(const std::string& key)
+{
+  auto it = storage_callbacks.find(key);
+  if (it != storage_callbacks.end()) it->second.dirty = true;
+}
+void LiveUpdate::enable_parallel_writers(bool en) noexcept
+{
+  LIVEUPDATE_PARALLEL_WRITERS = en;
+}
+
+/// partition writers
+
+using work_list = std::vector<std::pair<const std::string*, partition_t*>>;
+
+// serialize a partition into its staging area, returns false if it didn't fit
+static bool write_staged(const std::string& key, partition_t& part)
+{
+  auto* hdr = new (part.staged.get())
+      storage_header(part.staged_size - sizeof(storage_header));
+  try {
+    Storage wrapper(*hdr);
+    int p = hdr->create_partition(key);
+    part.func(wrapper);
+    hdr->finish_partition(p, true);
+  }
+  catch (const liu::liveupdate_end_reached&) {
+    return false;
+  }
+  part.dirty = false;
+  return true;
+}
+// same as above, growing the staging area until the partition fits
+static void stage_partition(const std::string& key, partition_t& part)
+{
+  if (part.staged == nullptr) {
+    part.staged.reset(new char[STAGING_MIN]);
+    part.staged_size = STAGING_MIN;
+  }
+  while (write_staged(key, part) == false)
+  {
+    if (part.staged_size >= STAGING_MAX) throw liu::liveupdate_end_reached();
+    part.staged_size *= 2;
+    part.staged.reset(new char[part.staged_size]);
+  }
+}
+
+struct writer_job
+{
+  work_list work;
+  volatile int next = 0;
+  // counts finished partitions
+  smp_barrier finished;
+};
+static void run_writers(writer_job& job)
+{
+  while (true)
+  {
+    const int i = __sync_fetch_and_add(&job.next, 1);
+    if (i >= (int) job.work.size()) return;
+    auto& w = job.work[i];
+    // growing the staging area is left to the main CPU,
+    // and a partition that didn't fit is still dirty afterwards
+    try {
+      write_staged(*w.first, *w.second);
+    }
+    catch (...) {}
+    job.finished.increment();
+  }
+}
+
+// bring the staging areas of @work up to date, returns bytes serialized
+static size_t write_partitions(work_list work)
+{
+  if (work.empty()) return 0;
+
+  if (LIVEUPDATE_PARALLEL_WRITERS && SMP::cpu_count() > 1 && work.size() > 1)
+  {
+    for (auto& w : work) {
+      if (w.second->staged == nullptr) {
+        w.second->staged.reset(new char[STAGING_MIN]);
+        w.second->staged_size = STAGING_MIN;
+      }
+      w.second->dirty = true;
+    }
+    // the job outlives this call, in case a CPU picks up its task late
+    auto job = std::make_shared<writer_job>();
+    job->work = std::move(work);
+    for (int cpu = 1; cpu < SMP::cpu_count(); cpu++) {
+      SMP::add_task([job] () { run_writers(*job); }, cpu);
+    }
+    SMP::signal();
+    // the main CPU works too, so a busy CPU can't stall the update
+    run_writers(*job);
+    job->finished.spin_wait(job->work.size());
+    work = std::move(job->work);
+  }
+  size_t total = 0;
+  for (auto& w : work)
+  {
+    // serially: everything, in parallel: the partitions that didn't fit
+    if (w.second->dirty) stage_partition(*w.first, *w.second);
+    total += w.second->staged_header().get_length();
+  }
+  return total;
+}
+
+size_t LiveUpdate::precopy()
+{
+  PROFILE("LiveUpdate: Pre-copy");
+  work_list work;
+  for (auto& pair : storage_callbacks)
+  {
+    if (pair.second.incremental && pair.second.dirty)
+        work.emplace_back(&pair.first, &pair.second);
+  }
+  return write_partitions(std::move(work));
+}
 
 template <typename Class>
 inline bool validate_header(const Class* hdr)
@@ -332,14 +482,31 @@ size_t update_store_data(location_t location)
   new (location.first) storage_header(location.second);
   auto* storage = (storage_header*) location.first;
 
+  // partitions that go through a staging area: incremental ones, and
+  // everything when writing in parallel
+  auto is_staged = [] (const partition_t& part) {
+    return part.incremental || LIVEUPDATE_PARALLEL_WRITERS;
+  };
+  work_list work;
+  for (auto& pair : storage_callbacks)
+  {
+    if (is_staged(pair.second) && (pair.second.dirty || !pair.second.incremental))
+        work.emplace_back(&pair.first, &pair.second);
+  }
+  write_partitions(std::move(work));
+
   Storage wrapper(*storage);
   /// callback for storing stuff, if provided
-  for (const auto& pair : storage_callbacks)
+  for (auto& pair : storage_callbacks)
   {
+    if (is_staged(pair.second)) {
+      storage->import_partition(pair.second.staged_header(), 0);
+      continue;
+    }
     // create partition
     int p = storage->create_partition(pair.first);
     // run serialization process
-    pair.second(wrapper);
+    pair.second.func(wrapper);
     // add end for partition
     storage->finish_partition(p);
   }
@@ -0,0 +1,93 @@
+#include "balancer.hpp"
+#include <config>
+#include <net/interfaces>
+#include <rapidjson/document.h>
+
+namespace microLB
+{
+  Balancer* Balancer::from_config()
+  {
+    rapidjson::Document doc;
+    doc.Parse(Config::get().data());
+
+    if (doc.IsObject() == false || doc.HasMember("load_balancer") == false)
+        throw std::runtime_error("Missing load balancer configuration");
+    auto& cfg = doc["load_balancer"];
+
+    auto& clients = cfg["clients"];
+    // client network interface
+    const int CLIENT_NET = clients["iface"].GetInt();
+    auto& netinc = net::Interfaces::get(CLIENT_NET);
+    // client port
+    const int CLIENT_PORT = clients["port"].GetUint();
+    assert(CLIENT_PORT > 0 && CLIENT_PORT < 65536);
+    // client wait queue limit
+    const int CLIENT_WAITQ = clients["waitq_limit"].GetUint();
+    // client session limit
+    const int CLIENT_SLIMIT = clients["session_limit"].GetUint();
+
+    auto& nodes = cfg["nodes"];
+    const int NODE_NET = nodes["iface"].GetInt();
+    auto& netout = net::Interfaces::get(NODE_NET);
+    netout.tcp().set_MSL(std::chrono::seconds(3));
+
+    const bool use_active_check =
+        nodes.HasMember("active_check") && nodes["active_check"].GetBool();
+
+    auto* balancer = new Balancer(use_active_check);
+    balancer->max_queued   = CLIENT_WAITQ;
+    balancer->max_sessions = CLIENT_SLIMIT;
+
+    if (nodes.HasMember("algo"))
+    {
+      const std::string algo = nodes["algo"].GetString();
+      if (algo == "round_robin")
+          balancer->nodes.set_algorithm(Algorithm::ROUND_ROBIN);
+      else if (algo == "maglev")
+          balancer->nodes.set_algorithm(Algorithm::MAGLEV);
+      else
+          throw std::runtime_error("Unknown load balancing algorithm: " + algo);
+    }
+    if (nodes.HasMember("pool_size"))
+        balancer->nodes.pool_max = nodes["pool_size"].GetInt();
+    if (nodes.HasMember("session_timeout"))
+        balancer->set_session_timeout(nodes["session_timeout"].GetInt());
+
+    // [["10.0.0.1", 6001, weight?], ...]
+    auto& nodelist = nodes["list"];
+    assert(nodelist.IsArray());
+    for (auto& node : nodelist.GetArray())
+    {
+      // nodes contain an array of [addr, port] and an optional weight
+      assert(node.IsArray());
+      const auto addr = node.GetArray();
+      assert(addr.Size() == 2 || addr.Size() == 3);
+      // port must be valid
+      unsigned port = addr[1].GetUint();
+      assert(port > 0 && port < 65536 && "Port is a number between 1 and 65535");
+      const unsigned weight = (addr.Size() == 3) ? addr[2].GetUint() : 1;
+      // try to construct socket from string
+      net::Socket socket{
+        net::ip4::Addr{addr[0].GetString()}, (uint16_t) port
+      };
+      balancer->nodes.add_node(socket,
+            Balancer::connect_with_tcp(netout, socket), weight);
+    }
+
+    if (clients.HasMember("certificate"))
+    {
+      assert(clients.HasMember("key") && "TLS-enabled microLB must also have key");
+      // open for load balancing over TLS
+      balancer->open_for_ossl(netinc, CLIENT_PORT,
+            clients["certificate"].GetString(),
+            clients["key"].GetString());
+    }
+    else {
+      // open for TCP connections
+      balancer->open_for_tcp(netinc, CLIENT_PORT);
+    }
+    // resume sessions across a live update
+    balancer->init_liveupdate(netout);
+    return balancer;
+  }
+}
@@ -0,0 +1,576 @@
+#include "balancer.hpp"
+#include <rtc>
+#include <timers>
+
+#define READ_BUFFER_SIZE        (64 * 1024)
+#define CONNECT_TIMEOUT         10s
+#define INITIAL_ACTIVE_CHECK    250ms
+#define ACTIVE_CHECK_PERIOD     5s
+#define TIMEOUT_CHECK_PERIOD    5s
+#define WAIT_TIMEOUT            30
+
+#define LB_VERBOSE 0
+#if LB_VERBOSE
+#define LBOUT(fmt, ...) printf("MicroLB: "); printf(fmt, ##__VA_ARGS__)
+#else
+#define LBOUT(fmt, ...) /** **/
+#endif
+
+using namespace std::chrono;
+
+namespace microLB
+{
+  // run @task on @cpu, right away when it is this one
+  static void run_on(int cpu, SMP::task_func task)
+  {
+    if (cpu == SMP::cpu_id()) {
+      task();
+      return;
+    }
+    if (cpu == 0) {
+      SMP::add_bsp_task(std::move(task));
+      return;
+    }
+    SMP::add_task(std::move(task), cpu);
+    SMP::signal(cpu);
+  }
+
+  Balancer::Balancer(bool active_check)
+    : nodes{active_check}
+  {
+    nodes.on_available = {this, &Balancer::handle_queue};
+  }
+  Balancer::~Balancer()
+  {
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+    {
+      const int timer = nodes.shard(cpu).timeout_timer;
+      if (timer != Timers::UNUSED_ID)
+          run_on(cpu, [timer] () { Timers::stop(timer); });
+    }
+    // streams only reset their callbacks when they go away
+    nodes.close_sessions();
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+    {
+      auto& shard = nodes.shard(cpu);
+      while (not shard.queue.empty())
+          this->drop_waiting(shard, shard.queue.begin()->first);
+    }
+    if (tls_free) tls_free();
+  }
+  int Balancer::wait_queue() const {
+    int waiting = 0;
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+        waiting += nodes.shard(cpu).waiting;
+    return waiting;
+  }
+  void Balancer::set_session_timeout(int seconds) {
+    this->session_timeout = seconds;
+  }
+
+  void Balancer::incoming(net::Stream_ptr conn, queue_vector_t readq)
+  {
+    auto& shard = nodes.shard();
+    if ((int) shard.queue.size() >= max_queued) {
+      LBOUT("Queue full, dropping %s\n", conn->to_string().c_str());
+      conn->close();
+      return;
+    }
+    // each CPU checks its own waiting clients and sessions
+    if (shard.timeout_timer == Timers::UNUSED_ID)
+        shard.timeout_timer = Timers::periodic(TIMEOUT_CHECK_PERIOD,
+                                               {this, &Balancer::handle_timeouts});
+    const uint32_t id = shard.next_waiting++;
+    auto& client = shard.queue.emplace(std::piecewise_construct,
+                                       std::forward_as_tuple(id),
+                                       std::forward_as_tuple(std::move(conn))).first->second;
+    shard.waiting++;
+    LBOUT("Incoming %s (%u waiting)\n", client.conn->to_string().c_str(), id);
+    for (const auto& buffer : readq) client.total += buffer->size();
+    client.readq = std::move(readq);
+
+    // buffer what the client sends until a node is ready
+    client.conn->on_read(READ_BUFFER_SIZE,
+      [this, &shard, id] (auto buf) {
+        auto it = shard.queue.find(id);
+        assert(it != shard.queue.end());
+        auto& client = it->second;
+        client.total += buf->size();
+        if (client.total > max_readq) {
+          this->drop_waiting(shard, id);
+          return;
+        }
+        client.readq.push_back(std::move(buf));
+      });
+    client.conn->on_close(
+      [&shard, id] () {
+        shard.waiting -= (int) shard.queue.erase(id);
+      });
+
+    this->dispatch(id);
+  }
+
+  void Balancer::dispatch(uint32_t id)
+  {
+    auto& shard = nodes.shard();
+    auto it = shard.queue.find(id);
+    if (it == shard.queue.end()) return;
+    auto& client = it->second;
+    if (client.connecting) return;
+    if (shard.table.open >= max_sessions) return;
+
+    const int idx = nodes.select(client.conn->remote());
+    // no active nodes, wait for one
+    if (idx < 0) return;
+    client.connecting = true;
+    client.attempt++;
+
+    nodes.get_connection(idx, node_connect_result_t::make_packed(
+      [this, &shard, id, idx] (net::Stream_ptr outgoing)
+      {
+        auto it = shard.queue.find(id);
+        if (outgoing == nullptr)
+        {
+          nodes.failed(idx);
+          if (it == shard.queue.end()) return;
+          it->second.connecting = false;
+          // try the other nodes, then wait for one to come back
+          if (it->second.attempt < (int) nodes.size())
+              this->dispatch(id);
+          else
+              it->second.attempt = 0;
+          return;
+        }
+        if (it == shard.queue.end()) {
+          // the client went away, keep the connection for someone else
+          nodes.pool_connection(idx, std::move(outgoing));
+          return;
+        }
+        auto incoming = std::move(it->second.conn);
+        auto readq = std::move(it->second.readq);
+        shard.queue.erase(it);
+        shard.waiting--;
+        nodes.create_session(std::move(incoming), std::move(outgoing),
+                             idx, std::move(readq));
+      }));
+  }
+
+  void Balancer::handle_queue()
+  {
+    auto& shard = nodes.shard();
+    // in order of arrival, as long as there is room
+    for (auto it = shard.queue.begin(); it != shard.queue.end(); )
+    {
+      if (shard.m_active == 0) return;
+      if (shard.table.open >= max_sessions) return;
+      const uint32_t id = it->first;
+      ++it;
+      this->dispatch(id);
+    }
+  }
+
+  void Balancer::drop_waiting(Shard& shard, uint32_t id)
+  {
+    auto it = shard.queue.find(id);
+    if (it == shard.queue.end()) return;
+    auto conn = std::move(it->second.conn);
+    shard.queue.erase(it);
+    shard.waiting--;
+    conn->on_close(nullptr);
+    conn->close();
+  }
+
+  void Balancer::handle_timeouts(int)
+  {
+    auto& shard = nodes.shard();
+    const auto now = RTC::now();
+    // the queue is in order of arrival
+    while (not shard.queue.empty())
+    {
+      auto& client = shard.queue.begin()->second;
+      if (now - client.since < WAIT_TIMEOUT) break;
+      LBOUT("Waited too long: %s\n", client.conn->to_string().c_str());
+      this->drop_waiting(shard, shard.queue.begin()->first);
+    }
+    if (this->session_timeout > 0)
+        nodes.timeout_sessions(this->session_timeout);
+  }
+
+  Waiting::Waiting(net::Stream_ptr incoming)
+    : conn(std::move(incoming)), since(RTC::now()) {}
+
+  Nodes::Nodes(bool ac) : active_check(ac), home_cpu(SMP::cpu_id()) {}
+  Nodes::~Nodes()
+  {
+    this->close_sessions();
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+    {
+      auto& shard = shards[cpu];
+      for (size_t idx = 0; idx < shard.pools.size(); idx++)
+          this->close_pool(shard, idx);
+    }
+  }
+
+  Node& Nodes::add_node(net::Socket addr, node_connect_function_t func,
+                        unsigned weight)
+  {
+    assert(SMP::cpu_id() == home_cpu);
+    const int idx = nodes.size();
+    auto& node = nodes.emplace_back(*this, idx, addr, std::move(func),
+                                    weight, not this->active_check);
+    this->node_state_changed();
+    return node;
+  }
+
+  void Nodes::set_algorithm(Algorithm algo)
+  {
+    this->m_algo = algo;
+    this->node_state_changed();
+  }
+
+  void Nodes::node_state_changed()
+  {
+    std::vector<bool> active;
+    this->m_active = 0;
+    for (const auto& node : nodes)
+    {
+      active.push_back(node.is_active());
+      if (node.is_active()) this->m_active++;
+    }
+    // every CPU builds its own Maglev table from the new health
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+    {
+      run_on(cpu, SMP::task_func::make_packed(
+        [this, cpu, active] () {
+          this->update_shard(shards[cpu], std::move(active));
+        }));
+    }
+  }
+
+  void Nodes::update_shard(Shard& shard, std::vector<bool> active)
+  {
+    bool available = false;
+    std::vector<Maglev::Backend> backends;
+    for (const auto& node : nodes)
+    {
+      const int idx = node.index();
+      if (idx >= (int) active.size()) break;
+      const bool was_active = idx < (int) shard.active.size() && shard.active[idx];
+      if (active[idx] && not was_active) available = true;
+      // the pool of a node that went down is probably just as dead
+      if (was_active && not active[idx]) this->close_pool(shard, idx);
+      if (active[idx])
+        backends.push_back({node.address().to_string(), idx, node.weight()});
+    }
+    shard.active = std::move(active);
+    shard.pools.resize(shard.active.size());
+    shard.m_active = backends.size();
+    if (m_algo == Algorithm::MAGLEV)
+        shard.maglev.populate(backends);
+    else
+        shard.maglev.populate({});
+
+    if (available && on_available) on_available();
+  }
+
+  int Nodes::select(const net::Socket& client)
+  {
+    auto& shard = this->shard();
+    if (shard.m_active == 0) return -1;
+    if (m_algo == Algorithm::MAGLEV)
+    {
+      // the same client goes to the same node, as long as it is up
+      const auto& addr = client.address().v6();
+      return shard.maglev.lookup(Maglev::hash(&addr, sizeof(addr)));
+    }
+    const int count = shard.active.size();
+    for (int i = 0; i < count; i++)
+    {
+      const int idx = shard.rr_next;
+      shard.rr_next = (shard.rr_next + 1) % count;
+      if (shard.active[idx]) return idx;
+    }
+    return -1;
+  }
+
+  int64_t Nodes::total_sessions() const
+  {
+    int64_t total = 0;
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+        total += shards[cpu].table.total;
+    return total;
+  }
+  int Nodes::open_sessions() const
+  {
+    int open = 0;
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+        open += shards[cpu].table.open;
+    return open;
+  }
+  int Nodes::timed_out_sessions() const
+  {
+    int timeouts = 0;
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+        timeouts += shards[cpu].table.timeouts;
+    return timeouts;
+  }
+  int Nodes::pool_size() const
+  {
+    int size = 0;
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+        size += shards[cpu].pooled;
+    return size;
+  }
+
+  void Nodes::get_connection(int idx, node_connect_result_t callback)
+  {
+    auto& shard = this->shard();
+    auto& pool = shard.pools.at(idx);
+    while (not pool.empty())
+    {
+      auto conn = std::move(pool.front());
+      pool.pop_front();
+      shard.pooled--;
+      if (conn->is_connected()) {
+        callback(std::move(conn));
+        return;
+      }
+    }
+    nodes.at(idx).connect(std::move(callback));
+  }
+
+  void Nodes::pool_connection(int idx, net::Stream_ptr conn)
+  {
+    auto& shard = this->shard();
+    if (shard.pools.size() <= (size_t) idx) shard.pools.resize(idx + 1);
+    auto& pool = shard.pools[idx];
+    if ((int) pool.size() >= this->pool_max or not conn->is_connected())
+        return;
+    // an idle node has nothing to say, and is forgotten when it closes
+    net::Stream* ptr = conn.get();
+    conn->on_read(64, [this, idx, ptr] (auto) { this->remove_pooled(idx, ptr); });
+    conn->on_close([this, idx, ptr] () { this->remove_pooled(idx, ptr); });
+    pool.push_back(std::move(conn));
+    shard.pooled++;
+  }
+
+  void Nodes::remove_pooled(int idx, net::Stream* ptr)
+  {
+    auto& shard = this->shard();
+    auto& pool = shard.pools.at(idx);
+    for (auto it = pool.begin(); it != pool.end(); ++it)
+    {
+      if (it->get() == ptr) {
+        auto conn = std::move(*it);
+        pool.erase(it);
+        shard.pooled--;
+        conn->on_close(nullptr);
+        conn->close();
+        return;
+      }
+    }
+  }
+
+  void Nodes::close_pool(Shard& shard, int idx)
+  {
+    if (idx >= (int) shard.pools.size()) return;
+    auto conns = std::move(shard.pools[idx]);
+    shard.pools[idx].clear();
+    shard.pooled -= (int) conns.size();
+    for (auto& conn : conns)
+    {
+      conn->on_close(nullptr);
+      conn->close();
+    }
+  }
+
+  void Nodes::failed(int idx)
+  {
+    auto& shard = this->shard();
+    // stop picking the node here right away, and let its CPU probe it
+    if (shard.active.at(idx))
+    {
+      auto active = shard.active;
+      active[idx] = false;
+      this->update_shard(shard, std::move(active));
+    }
+    run_on(home_cpu, [this, idx] () { nodes.at(idx).failed(); });
+  }
+
+  Session& Nodes::create_session(net::Stream_ptr inc, net::Stream_ptr out,
+                                 int node, queue_vector_t readq)
+  {
+    auto& table = this->shard().table;
+    int idx;
+    if (not table.free_sessions.empty()) {
+      idx = table.free_sessions.back();
+      table.free_sessions.pop_back();
+    }
+    else {
+      idx = table.sessions.size();
+      table.sessions.emplace_back();
+    }
+    // references into a deque stay valid as it grows
+    auto& session = table.get(idx);
+    session.self = (SMP::cpu_id() << 24) | idx;
+    session.node = node;
+    session.last_active = RTC::now();
+    session.incoming = std::move(inc);
+    session.outgoing = std::move(out);
+    table.open++;
+    table.total++;
+    LBOUT("New session %d: %s -> %s\n", session.self,
+          session.incoming->to_string().c_str(), session.outgoing->to_string().c_str());
+
+    // what the client sent while waiting goes first
+    for (auto& buffer : readq)
+      session.outgoing->write(std::move(buffer));
+
+    // splice the streams, passing on the buffers as they are
+    Session* s = &session;
+    net::Stream* outgoing = session.outgoing.get();
+    net::Stream* incoming = session.incoming.get();
+    incoming->on_read(READ_BUFFER_SIZE,
+      [s, outgoing] (auto buf) {
+        s->last_active = RTC::now();
+        outgoing->write(std::move(buf));
+      });
+    outgoing->on_read(READ_BUFFER_SIZE,
+      [s, incoming] (auto buf) {
+        s->last_active = RTC::now();
+        incoming->write(std::move(buf));
+      });
+    const int self = session.self;
+    incoming->on_close(
+      [this, self] () {
+        this->close_session(self);
+      });
+    outgoing->on_close(
+      [this, self] () {
+        this->close_session(self);
+      });
+    return session;
+  }
+
+  Session& Nodes::get_session(int self)
+  {
+    return shards.at(self >> 24).table.get(self & 0xffffff);
+  }
+
+  void Nodes::close_session(int self)
+  {
+    auto& table   = shards.at(self >> 24).table;
+    auto& session = table.get(self & 0xffffff);
+    if (not session.is_alive()) return;
+    LBOUT("Closing session %d\n", self);
+
+    auto incoming = std::move(session.incoming);
+    auto outgoing = std::move(session.outgoing);
+    incoming->on_close(nullptr);
+    outgoing->on_close(nullptr);
+    incoming->close();
+    outgoing->close();
+    table.free_sessions.push_back(self & 0xffffff);
+    table.open--;
+
+    if (on_session_close)
+        on_session_close(self, open_sessions(), total_sessions());
+    // waiting clients may now have room
+    if (on_available) on_available();
+  }
+
+  void Nodes::close_sessions()
+  {
+    on_session_close = nullptr;
+    on_available = nullptr;
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+    for (const auto& session : shards[cpu].table.sessions)
+    {
+      if (session.is_alive()) this->close_session(session.self);
+    }
+  }
+
+  void Nodes::timeout_sessions(RTC::timestamp_t timeout)
+  {
+    auto& table = this->shard().table;
+    const auto now = RTC::now();
+    // closing a session can start new ones
+    std::vector<int> expired;
+    for (const auto& session : table.sessions)
+    {
+      if (session.is_alive() && now - session.last_active >= timeout)
+        expired.push_back(session.self);
+    }
+    for (int self : expired)
+    {
+      table.timeouts++;
+      this->close_session(self);
+    }
+  }
+
+  Node::Node(Nodes& n, int idx, net::Socket a, node_connect_function_t func,
+             unsigned w, bool act)
+    : parent(n), m_idx(idx), addr(a), do_connect(std::move(func)),
+      m_weight(w), active(act), active_timer(Timers::UNUSED_ID)
+  {
+    assert(this->do_connect != nullptr);
+    if (not this->active) this->start_active_check();
+  }
+  Node::~Node()
+  {
+    this->stop_active_check();
+  }
+
+  void Node::connect(node_connect_result_t callback) const
+  {
+    this->do_connect(CONNECT_TIMEOUT, std::move(callback));
+  }
+
+  void Node::failed()
+  {
+    if (not this->active) return;
+    LBOUT("Node %s failed\n", addr.to_string().c_str());
+    this->set_active(false);
+  }
+
+  void Node::set_active(bool act)
+  {
+    assert(SMP::cpu_id() == parent.home_cpu);
+    if (this->active == act) return;
+    this->active = act;
+    if (act)
+        this->stop_active_check();
+    else
+        this->start_active_check();
+    parent.node_state_changed();
+  }
+
+  void Node::start_active_check()
+  {
+    if (this->active_timer != Timers::UNUSED_ID) return;
+    this->active_timer = Timers::periodic(INITIAL_ACTIVE_CHECK, ACTIVE_CHECK_PERIOD,
+                                          {this, &Node::perform_active_check});
+  }
+  void Node::stop_active_check()
+  {
+    if (this->active_timer == Timers::UNUSED_ID) return;
+    Timers::stop(this->active_timer);
+    this->active_timer = Timers::UNUSED_ID;
+  }
+
+  void Node::perform_active_check(int)
+  {
+    // one probe at a time
+    if (this->probing > 0) return;
+    this->probing++;
+    this->do_connect(CONNECT_TIMEOUT,
+      [this] (net::Stream_ptr stream) {
+        this->probing--;
+        if (stream == nullptr) return;
+        LBOUT("Node %s is up\n", addr.to_string().c_str());
+        // the probe becomes the first pooled connection
+        parent.pool_connection(m_idx, std::move(stream));
+        this->set_active(true);
+      });
+  }
+}
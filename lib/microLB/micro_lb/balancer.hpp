@@ -0,0 +1,243 @@
+#pragma once
+#include "maglev.hpp"
+#include <net/inet>
+#include <net/stream.hpp>
+#include <rtc>
+#include <smp>
+#include <timers>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <map>
+
+namespace liu {
+  struct Storage;
+  struct Restore;
+}
+
+namespace microLB
+{
+  typedef net::Inet netstack_t;
+  typedef std::vector<net::Stream::buffer_t> queue_vector_t;
+  typedef std::chrono::milliseconds timeout_t;
+  typedef delegate<void(net::Stream_ptr)> node_connect_result_t;
+  typedef delegate<void(timeout_t, node_connect_result_t)> node_connect_function_t;
+
+  enum class Algorithm {
+    MAGLEV,       // consistent hashing on the client address
+    ROUND_ROBIN
+  };
+
+  struct Waiting {
+    Waiting(net::Stream_ptr);
+
+    net::Stream_ptr  conn;
+    // data from the client, until a node is ready
+    queue_vector_t   readq;
+    size_t           total = 0;
+    RTC::timestamp_t since;
+    int              attempt = 0;
+    bool             connecting = false;
+  };
+
+  struct Nodes;
+  struct Session {
+    bool is_alive() const noexcept { return incoming != nullptr; }
+
+    int             self;
+    int             node;
+    RTC::timestamp_t last_active;
+    net::Stream_ptr incoming;
+    net::Stream_ptr outgoing;
+  };
+
+  struct Session_table {
+    Session& get(int idx) { return sessions.at(idx); }
+
+    std::deque<Session> sessions;
+    std::vector<int>    free_sessions;
+    // the other CPUs only read these, for the totals
+    std::atomic<int>     open {0};
+    std::atomic<int64_t> total {0};
+    std::atomic<int>     timeouts {0};
+  };
+
+  // what the CPU accepting a client owns, the others only read its counters
+  struct alignas(SMP_ALIGN) Shard {
+    Session_table table;
+    // clients waiting for a node, by order of arrival
+    std::map<uint32_t, Waiting> queue;
+    uint32_t next_waiting = 0;
+    std::atomic<int> waiting {0};
+    // this CPU's copy of the node health, as last pushed to it
+    std::vector<bool> active;
+    Maglev   maglev;
+    int      m_active = 0;
+    int      rr_next  = 0;
+    // idle connections to each node
+    std::vector<std::deque<net::Stream_ptr>> pools;
+    std::atomic<int> pooled {0};
+    int      timeout_timer = Timers::UNUSED_ID;
+  };
+
+  struct Node {
+    Node(Nodes&, int idx, net::Socket, node_connect_function_t,
+         unsigned weight, bool active);
+    Node(const Node&) = delete;
+    ~Node();
+
+    bool is_active() const noexcept { return active; }
+    int  index() const noexcept { return m_idx; }
+    const net::Socket& address() const noexcept { return addr; }
+    unsigned weight() const noexcept { return m_weight; }
+
+    /** Connect to the node from the calling CPU */
+    void connect(node_connect_result_t) const;
+
+    /**
+     * The health of the node is kept by the CPU that added it, and pushed
+     * to the other CPUs when it changes.
+    **/
+    void failed();
+    void set_active(bool);
+
+  private:
+    void start_active_check();
+    void stop_active_check();
+    void perform_active_check(int);
+
+    Nodes&      parent;
+    const int   m_idx;
+    net::Socket addr;
+    node_connect_function_t do_connect;
+    unsigned    m_weight;
+    bool        active;
+    int         probing = 0;
+    int         active_timer;
+  };
+
+  struct Nodes {
+    typedef std::deque<Node> nodevec_t;
+    typedef delegate<void(int idx, int current, int total)> session_func_t;
+
+    Nodes(bool active_check);
+    ~Nodes();
+
+    size_t   size() const noexcept { return nodes.size(); }
+    auto     begin() const { return nodes.cbegin(); }
+    auto     end()   const { return nodes.cend(); }
+    Node&    get(int idx) { return nodes.at(idx); }
+
+    Node&    add_node(net::Socket, node_connect_function_t, unsigned weight = 1);
+    /** Pick a node for a client on this CPU, or -1 when none are active */
+    int      select(const net::Socket& client);
+    int      active_nodes() const noexcept { return m_active; }
+    void     set_algorithm(Algorithm);
+    Algorithm algorithm() const noexcept { return m_algo; }
+
+    // summed over the CPUs
+    int64_t  total_sessions() const;
+    int      open_sessions() const;
+    int      timed_out_sessions() const;
+    int      pool_size() const;
+
+    Shard&   shard() { return PER_CPU(shards); }
+    Shard&   shard(int cpu) { return shards.at(cpu); }
+    const Shard& shard(int cpu) const { return shards.at(cpu); }
+
+    /** Hand out a pooled connection to node @idx, or connect to it */
+    void     get_connection(int idx, node_connect_result_t);
+    /** Keep an established connection for a later session */
+    void     pool_connection(int idx, net::Stream_ptr);
+    /** A session could not connect - take node @idx out of rotation */
+    void     failed(int idx);
+
+    Session& create_session(net::Stream_ptr inc, net::Stream_ptr out,
+                            int node, queue_vector_t readq);
+    void     close_session(int);
+    /** Close every session when shutting down, without calling back */
+    void     close_sessions();
+    Session& get_session(int);
+    /** Close sessions on this CPU idle for longer than @timeout seconds */
+    void     timeout_sessions(RTC::timestamp_t timeout);
+
+    void     serialize(liu::Storage&, bool sessions);
+    void     deserialize(netstack_t& in, netstack_t& out, liu::Restore&,
+                         void* tls_context);
+
+    // the maximum number of idle connections kept per node and CPU
+    int  pool_max = 2;
+    // when a node becomes active or a session closes, so waiting clients can proceed
+    delegate<void()> on_available = nullptr;
+    session_func_t on_session_close = nullptr;
+
+  private:
+    friend struct Node;
+    void node_state_changed();
+    void update_shard(Shard&, std::vector<bool> active);
+    void remove_pooled(int idx, net::Stream*);
+    void close_pool(Shard&, int idx);
+
+    nodevec_t nodes;
+    Algorithm m_algo = Algorithm::MAGLEV;
+    int       m_active = 0;
+    const bool active_check;
+    // the CPU keeping the node health
+    const int home_cpu;
+    std::array<Shard, SMP_MAX_CORES> shards;
+  };
+
+  struct Balancer {
+    /**
+     * With @active_check, nodes start out of rotation and are probed until
+     * they accept a connection, and so do nodes that fail later on.
+     * Each CPU accepting clients keeps its own sessions and waiting queue,
+     * and the limits below apply to each of them.
+    **/
+    Balancer(bool active_check);
+    ~Balancer();
+    static Balancer* from_config();
+
+    // Frontend/Client-side of the load balancer
+    void open_for_tcp(netstack_t& interface, uint16_t port);
+    void open_for_s2n(netstack_t& interface, uint16_t port,
+                      const std::string& cert, const std::string& key);
+    void open_for_ossl(netstack_t& interface, uint16_t port,
+                       const std::string& cert, const std::string& key);
+    // Backend/Application side of the load balancer
+    static node_connect_function_t connect_with_tcp(netstack_t& interface,
+                                                    net::Socket);
+
+    /** Take a connected client, and pass it on to a node */
+    void incoming(net::Stream_ptr, queue_vector_t readq = {});
+
+    int  wait_queue() const;
+    /** Close sessions that have been idle for @seconds, 0 to disable */
+    void set_session_timeout(int seconds);
+
+    // serialization of all connections to and from the load balancer
+    void init_liveupdate(netstack_t& nodes_iface);
+    void serialize(liu::Storage&);
+    void resume_callback(liu::Restore&);
+
+    Nodes nodes;
+    int   max_queued  = 1000;
+    int   max_sessions = 10000;
+    // bytes buffered per waiting client
+    size_t max_readq  = 64 * 1024;
+
+  private:
+    void handle_queue();
+    void dispatch(uint32_t id);
+    void drop_waiting(Shard&, uint32_t id);
+    void handle_timeouts(int);
+
+    netstack_t* clients_iface = nullptr;
+    netstack_t* nodes_iface   = nullptr;
+    int      session_timeout = 0;
+    // the context TLS streams are created (and restored) with
+    void*    tls_context = nullptr;
+    delegate<void()> tls_free = nullptr;
+    bool     tls_serializable = true;
+  };
+}
@@ -0,0 +1,52 @@
+#include "balancer.hpp"
+#include <net/tcp/stream.hpp>
+#include <timers>
+
+namespace microLB
+{
+  // default method for opening a TCP port for clients
+  void Balancer::open_for_tcp(
+        netstack_t&    interface,
+        const uint16_t client_port)
+  {
+    this->clients_iface = &interface;
+    interface.tcp().listen(client_port,
+    [this] (net::tcp::Connection_ptr conn) {
+      assert(conn != nullptr && "TCP sanity check");
+      this->incoming(std::make_unique<net::tcp::Stream> (conn));
+    });
+  }
+
+  // default method for TCP nodes
+  node_connect_function_t Balancer::connect_with_tcp(
+        netstack_t&  interface,
+        net::Socket  socket)
+  {
+    return node_connect_function_t::make_packed(
+    [&interface, socket] (timeout_t timeout, node_connect_result_t callback)
+    {
+      // the timeout and the connection race to call back first
+      auto done = std::make_shared<bool> (false);
+      auto conn = interface.tcp().connect(socket);
+      const auto timer = Timers::oneshot(timeout,
+        Timers::handler_t::make_packed(
+        [done, conn, callback] (int) {
+          if (*done) return;
+          *done = true;
+          conn->abort();
+          callback(nullptr);
+        }));
+      conn->on_connect(net::tcp::Connection::ConnectCallback::make_packed(
+        [done, timer, callback] (net::tcp::Connection_ptr conn) {
+          if (*done) return;
+          *done = true;
+          Timers::stop(timer);
+          if (conn == nullptr) {
+            callback(nullptr);
+            return;
+          }
+          callback(std::make_unique<net::tcp::Stream>(conn));
+        }));
+    });
+  }
+}
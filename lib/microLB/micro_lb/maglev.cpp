@@ -0,0 +1,72 @@
+#include "maglev.hpp"
+#include <cassert>
+
+namespace microLB
+{
+  Maglev::Maglev(uint32_t size)
+    : size_{size}
+  {
+    assert(size > 1);
+  }
+
+  uint64_t Maglev::hash(const void* data, size_t len, uint64_t seed) noexcept
+  {
+    // FNV-1a, with the MurmurHash3 finalizer to spread the bits
+    uint64_t h = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+    auto* bytes = (const uint8_t*) data;
+    for (size_t i = 0; i < len; i++)
+      h = (h ^ bytes[i]) * 1099511628211ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  void Maglev::populate(const std::vector<Backend>& backends)
+  {
+    struct Permutation {
+      uint32_t offset;
+      uint32_t skip;
+      uint32_t next = 0;
+      int      index;
+      unsigned weight;
+    };
+    std::vector<Permutation> perms;
+    for (const auto& be : backends)
+    {
+      if (be.weight == 0) continue;
+      const auto& name = be.name;
+      Permutation perm;
+      perm.offset = hash(name.data(), name.size(), 0) % size_;
+      perm.skip   = hash(name.data(), name.size(), 1) % (size_ - 1) + 1;
+      perm.index  = be.index;
+      perm.weight = be.weight;
+      perms.push_back(perm);
+    }
+    table_.clear();
+    if (perms.empty()) return;
+
+    // with a prime size, every permutation visits every slot
+    table_.assign(size_, -1);
+    uint32_t filled = 0;
+    for (;;)
+    {
+      for (auto& perm : perms)
+      {
+        for (unsigned w = 0; w < perm.weight; w++)
+        {
+          uint32_t slot;
+          do {
+            slot = (perm.offset + (uint64_t) perm.next * perm.skip) % size_;
+            perm.next++;
+          } while (table_[slot] >= 0);
+
+          table_[slot] = perm.index;
+          if (++filled == size_) return;
+        }
+      }
+    }
+  }
+}
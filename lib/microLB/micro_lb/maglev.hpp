@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace microLB
+{
+  /**
+   * Maglev consistent hashing (Eisenbud et al., NSDI 2016)
+   *
+   * Each backend walks its own permutation of a lookup table, derived from
+   * its name, and the backends take turns claiming their next free slot.
+   * Every backend ends up with an equal share of the table (times its
+   * weight), and when a backend is removed only the flows that went to it
+   * move elsewhere, while lookups stay a single array access.
+  **/
+  class Maglev {
+  public:
+    /** A prime, much larger than the number of backends */
+    static const uint32_t DEFAULT_SIZE = 65537;
+
+    struct Backend {
+      std::string name;   // stable across restarts, eg. the address
+      int         index;  // returned by lookup()
+      unsigned    weight = 1;
+    };
+
+    explicit Maglev(uint32_t size = DEFAULT_SIZE);
+
+    /** Fill the table with @backends, or empty it when there are none */
+    void populate(const std::vector<Backend>& backends);
+
+    /** The index of the backend for a flow, or -1 when there are none */
+    int lookup(uint64_t hash) const noexcept {
+      return table_.empty() ? -1 : table_[hash % size_];
+    }
+
+    uint32_t size() const noexcept { return size_; }
+    bool     empty() const noexcept { return table_.empty(); }
+
+    static uint64_t hash(const void* data, size_t len, uint64_t seed = 0) noexcept;
+
+  private:
+    uint32_t size_;
+    std::vector<int> table_;
+  };
+}
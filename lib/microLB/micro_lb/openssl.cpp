@@ -0,0 +1,43 @@
+#include "balancer.hpp"
+#include <net/tcp/stream.hpp>
+#include <net/openssl/init.hpp>
+#include <net/openssl/tls_stream.hpp>
+#include <openssl/ssl.h>
+#include <memdisk>
+
+namespace microLB
+{
+  void Balancer::open_for_ossl(
+        netstack_t&        interface,
+        const uint16_t     client_port,
+        const std::string& tls_cert,
+        const std::string& tls_key)
+  {
+    fs::memdisk().init_fs(
+    [] (fs::error_t err, fs::File_system&) {
+      assert(!err);
+    });
+
+    openssl::init();
+    openssl::verify_rng();
+
+    this->tls_context = openssl::create_server(tls_cert, tls_key);
+    this->tls_free = [this] () {
+      SSL_CTX_free((SSL_CTX*) this->tls_context);
+    };
+    // OpenSSL streams can not be serialized
+    this->tls_serializable = false;
+
+    this->clients_iface = &interface;
+    interface.tcp().listen(client_port,
+      [this] (net::tcp::Connection_ptr conn) {
+        if (conn != nullptr)
+        {
+          // the handshake is completed before any data is passed on
+          this->incoming(std::make_unique<openssl::TLS_stream> (
+              (SSL_CTX*) this->tls_context,
+              std::make_unique<net::tcp::Stream>(conn)));
+        }
+      });
+  } // open_ossl(...)
+}
@@ -0,0 +1,69 @@
+#include "balancer.hpp"
+#include <net/tcp/stream.hpp>
+#include <net/s2n/stream.hpp>
+#include <memdisk>
+
+// allow all clients
+static uint8_t verify_host_passthrough(const char*, size_t, void* /*data*/) {
+  return 1;
+}
+
+namespace microLB
+{
+  static s2n_config* create_config(const std::string& cert, const std::string& key)
+  {
+#ifdef __includeos__
+    setenv("S2N_DONT_MLOCK", "0", 1);
+#endif
+    if (s2n_init() < 0) {
+      s2n::print_s2n_error("Error running s2n_init()");
+      throw std::runtime_error("s2n_init() failed");
+    }
+    auto* config = s2n_config_new();
+    assert(config != nullptr);
+
+    if (s2n_config_add_cert_chain_and_key(config, cert.c_str(), key.c_str()) < 0) {
+      s2n::print_s2n_error("Error getting certificate/key");
+      throw std::runtime_error("Invalid certificate or key");
+    }
+    if (s2n_config_set_verify_host_callback(config, verify_host_passthrough, nullptr) < 0) {
+      s2n::print_s2n_error("Error setting verify-host callback");
+      throw std::runtime_error("s2n_config_set_verify_host_callback() failed");
+    }
+    return config;
+  }
+
+  void Balancer::open_for_s2n(
+        netstack_t&        interface,
+        const uint16_t     client_port,
+        const std::string& tls_cert,
+        const std::string& tls_key)
+  {
+    fs::memdisk().init_fs(
+    [] (fs::error_t err, fs::File_system&) {
+      assert(!err);
+    });
+    auto& filesys = fs::memdisk().fs();
+    auto cert = filesys.read_file(tls_cert);
+    auto key  = filesys.read_file(tls_key);
+    if (not cert.is_valid() or not key.is_valid())
+      throw std::runtime_error("Could not read " + tls_cert + " and " + tls_key);
+
+    this->tls_context = create_config(cert.to_string(), key.to_string());
+    this->tls_free = [this] () {
+      s2n_config_free((s2n_config*) this->tls_context);
+    };
+
+    this->clients_iface = &interface;
+    interface.tcp().listen(client_port,
+      [this] (net::tcp::Connection_ptr conn) {
+        if (conn != nullptr)
+        {
+          // the handshake is completed before any data is passed on
+          this->incoming(std::make_unique<s2n::TLS_stream> (
+              (s2n_config*) this->tls_context,
+              std::make_unique<net::tcp::Stream>(conn)));
+        }
+      });
+  } // open_s2n(...)
+}
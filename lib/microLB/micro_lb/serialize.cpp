@@ -0,0 +1,145 @@
+#include "balancer.hpp"
+#include <liveupdate>
+
+#define LB_VERBOSE 0
+#if LB_VERBOSE
+#define LBOUT(fmt, ...) printf("MicroLB: "); printf(fmt, ##__VA_ARGS__)
+#else
+#define LBOUT(fmt, ...) /** **/
+#endif
+
+namespace microLB
+{
+  enum {
+    UID_NODE = 100,
+    UID_NODES_END,
+    UID_SESSION_NODE,
+    UID_SESSION,
+    UID_SESSIONS_END,
+    UID_READQ,
+    UID_WAITING,
+  };
+
+  static void serialize_stream(liu::Storage& store, net::Stream& stream)
+  {
+    // the transport goes first, so that it can be restored first
+    if (stream.transport() != nullptr)
+        store.add_stream(*stream.transport());
+    store.add_stream(stream);
+  }
+
+  static net::Stream_ptr
+  deserialize_stream(liu::Restore& thing, netstack_t& stack, void* tls_context)
+  {
+    auto stream = thing.as_tcp_stream(stack.tcp());
+    thing.go_next();
+    // a TLS stream on top of the TCP stream
+    if (thing.is_stream())
+    {
+      stream = thing.as_tls_stream(tls_context, false, std::move(stream));
+      thing.go_next();
+    }
+    return stream;
+  }
+
+  void Nodes::serialize(liu::Storage& store, bool with_sessions)
+  {
+    for (const auto& node : nodes)
+        store.add_int(UID_NODE, node.is_active());
+    store.put_marker(UID_NODES_END);
+
+    if (with_sessions)
+    {
+      for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+      for (auto& session : shards[cpu].table.sessions)
+      {
+        if (not session.is_alive()) continue;
+        serialize_stream(store, *session.incoming);
+        store.add_int(UID_SESSION_NODE, session.node);
+        store.add_stream(*session.outgoing);
+        store.put_marker(UID_SESSION);
+      }
+    }
+    store.put_marker(UID_SESSIONS_END);
+  }
+
+  void Nodes::deserialize(netstack_t& in, netstack_t& out,
+                          liu::Restore& thing, void* tls_context)
+  {
+    // nodes are restored by index, as long as they are the same ones
+    for (size_t idx = 0; thing.is_int(); idx++)
+    {
+      const bool active = thing.as_int();
+      if (idx < nodes.size()) nodes[idx].set_active(active);
+      thing.go_next();
+    }
+    thing.pop_marker(UID_NODES_END);
+
+    // the sessions of every CPU end up on this one, with the stacks
+    int restored = 0;
+    while (thing.is_stream())
+    {
+      auto incoming = deserialize_stream(thing, in, tls_context);
+      const int node = thing.as_int();
+      thing.go_next();
+      auto outgoing = thing.as_tcp_stream(out.tcp());
+      thing.go_next();
+      thing.pop_marker(UID_SESSION);
+
+      if (node >= (int) nodes.size()) continue;
+      this->create_session(std::move(incoming), std::move(outgoing), node, {});
+      restored++;
+    }
+    thing.pop_marker(UID_SESSIONS_END);
+    LBOUT("Restored %d sessions\n", restored);
+    (void) restored;
+  }
+
+  void Balancer::serialize(liu::Storage& store)
+  {
+    nodes.serialize(store, tls_serializable);
+    if (not tls_serializable) return;
+
+    // clients still waiting for a node, and what they have sent so far
+    for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+    for (auto& it : nodes.shard(cpu).queue)
+    {
+      auto& client = it.second;
+      serialize_stream(store, *client.conn);
+      for (auto& buffer : client.readq)
+          store.add_buffer(UID_READQ, buffer->data(), buffer->size());
+      store.put_marker(UID_WAITING);
+    }
+  }
+
+  void Balancer::resume_callback(liu::Restore& thing)
+  {
+    assert(clients_iface != nullptr && nodes_iface != nullptr);
+    nodes.deserialize(*clients_iface, *nodes_iface, thing, tls_context);
+
+    while (thing.is_stream())
+    {
+      auto conn = deserialize_stream(thing, *clients_iface, tls_context);
+      queue_vector_t readq;
+      while (thing.is_buffer())
+      {
+        auto buffer = thing.as_buffer();
+        readq.push_back(net::Stream::construct_buffer(buffer.begin(), buffer.end()));
+        thing.go_next();
+      }
+      thing.pop_marker(UID_WAITING);
+
+      this->incoming(std::move(conn), std::move(readq));
+    }
+  }
+
+  void Balancer::init_liveupdate(netstack_t& iface)
+  {
+    this->nodes_iface = &iface;
+    liu::LiveUpdate::register_partition("microlb", {this, &Balancer::serialize});
+    if (liu::LiveUpdate::is_resumable() && clients_iface != nullptr)
+    {
+      liu::LiveUpdate::resume("microlb", {this, &Balancer::resume_callback});
+    }
+  }
+}
@@ -26,6 +26,7 @@ using Pml4  = x86::paging::Pml4;
 
 static void allow_executable();
 static void protect_pagetables_once();
+extern void __x86_init_paging(void*);
 
 // must be public symbols because of a unittest
 #ifndef PLATFORM_UNITTEST
@@ -355,6 +356,65 @@ uintptr_t mem::active_page_size(uintptr_t addr){
   return __pml4->active_page_size(addr);
 }
 
+size_t mem::map_huge(uintptr_t linear, size_t len, size_t max_psize)
+{
+  using namespace x86::paging;
+  const uintptr_t begin = bits::roundto<2_MiB>(linear);
+  const uintptr_t end   = (linear + len) & ~(2_MiB - 1);
+  const size_t psizes   = supported_page_sizes() & ~(2_MiB - 1) & ((max_psize << 1) - 1);
+  if (begin >= end or psizes == 0)
+    return 0;
+
+  const auto flags = Flags::present | Flags::writable | Flags::no_exec;
+  size_t mapped = 0;
+  uintptr_t run = begin;
+
+  // 2 MiB pages split for finer mappings (e.g. protected areas) are kept
+  for (uintptr_t addr = begin; addr <= end; addr += 2_MiB)
+  {
+    if (addr < end and __pml4->active_page_size(addr) >= 2_MiB)
+      continue;
+
+    if (addr > run)
+    {
+      MEM_PRINT("::map_huge 0x%lx -> 0x%lx\n", run, addr);
+      auto res = __pml4->map_r({run, run, flags, addr - run, psizes});
+      Ensures(res.size == addr - run);
+      mapped += res.size;
+    }
+    run = addr + 2_MiB;
+  }
+
+  // entries may have changed size
+  __x86_init_paging(__pml4->data());
+  return mapped;
+}
+
+mem::Page_stats mem::page_stats(uintptr_t linear, size_t len)
+{
+  Page_stats stats;
+  const uintptr_t end = linear + len;
+
+  for (uintptr_t addr = linear & ~(4_KiB - 1); addr < end; )
+  {
+    const auto psize = __pml4->active_page_size(addr);
+    if (psize == 0 or flags(addr) == Access::none) {
+      const auto skip = psize ? psize : 4_KiB;
+      stats.unmapped += std::min<uintptr_t>(skip, end - addr);
+      addr = (addr & ~(skip - 1)) + skip;
+      continue;
+    }
+
+    switch (psize) {
+    case 4_KiB: stats.pages_4k++; break;
+    case 2_MiB: stats.pages_2m++; break;
+    case 1_GiB: stats.pages_1g++; break;
+    }
+    addr = (addr & ~(psize - 1)) + psize;
+  }
+  return stats;
+}
+
 
 
 void allow_executable()
@@ -2,10 +2,14 @@
 #include "e1000.hpp"
 #include "e1000_defs.hpp"
 #include <kernel/events.hpp>
+#include <kernel/busy_poll.hpp>
 #include <kernel/timers.hpp>
+#include <kernel/trace.hpp>
 #include <os.hpp>
 #include <hw/ioport.hpp>
 #include <info>
+#include <statman>
+#include <algorithm>
 #include <cassert>
 //#define E1000_ENABLE_STATS
 //#define E1000_FAKE_EVENT_HANDLER
@@ -26,6 +30,8 @@ static const uint32_t RXO  = 1 << 6; // receiver (rx) overrun
 static const uint32_t RXTO = 1 << 7; // receive timer interrupt
 #define LEGACY_INTR_MASK() (TXDW | TXQE | LSC | RXDMTO | RXO | RXTO)
 #define MSIX_INTR_MASK() (LSC | RXO | (1 << 20) | (1 << 22) | (1 << 24))
+// RXO too, as the overrun is handled by receiving
+#define RX_INTR_MASK() (this->use_msix ? ((1 << 20) | RXO) : (RXDMTO | RXTO | RXO))
 
 static int deferred_event = 0;
 static std::vector<e1000*> deferred_devices;
@@ -48,14 +54,34 @@ static inline uint16_t buffer_size_for_mtu(const uint16_t mtu)
 
 #define NUM_PACKET_BUFFERS (NUM_TX_DESC + NUM_RX_DESC + NUM_TX_QUEUE + 8)
 
+// default moderation: at most 20k interrupts per second,
+// delivering RX as soon as the throttle allows
+static const uint32_t DEFAULT_ITR_USEC  = 50;
+static const uint32_t DEFAULT_RDTR_USEC = 0;
+static const uint32_t DEFAULT_RADV_USEC = 0;
+
 e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
     Link(Link_protocol{{this, &e1000::transmit}, mac()}),
-    m_pcidev(d), m_mtu(mtu), bufstore_{NUM_PACKET_BUFFERS, buffer_size_for_mtu(mtu)}
+    m_pcidev(d), m_mtu(mtu),
+    stat_rx_packets{Statman::get().create(Stat::UINT64, device_name() + ".rx_packets").get_uint64()},
+    stat_rx_bytes{Statman::get().create(Stat::UINT64, device_name() + ".rx_bytes").get_uint64()},
+    stat_rx_dropped{Statman::get().create(Stat::UINT64, device_name() + ".rx_dropped").get_uint64()},
+    stat_rx_refills{Statman::get().create(Stat::UINT64, device_name() + ".rx_refills").get_uint64()},
+    stat_rx_refill_dropped{Statman::get().create(Stat::UINT64, device_name() + ".rx_refill_dropped").get_uint64()},
+    stat_tx_packets{Statman::get().create(Stat::UINT64, device_name() + ".tx_packets").get_uint64()},
+    stat_tx_bytes{Statman::get().create(Stat::UINT64, device_name() + ".tx_bytes").get_uint64()},
+    stat_tx_kicks{Statman::get().create(Stat::UINT64, device_name() + ".tx_kicks").get_uint64()},
+    stat_interrupts{Statman::get().create(Stat::UINT64, device_name() + ".interrupts").get_uint64()},
+    stat_itr{Statman::get().create(Stat::UINT32, device_name() + ".itr_usec").get_uint32()},
+    stat_rdtr{Statman::get().create(Stat::UINT32, device_name() + ".rdtr_usec").get_uint32()},
+    stat_radv{Statman::get().create(Stat::UINT32, device_name() + ".radv_usec").get_uint32()},
+    bufstore_{NUM_PACKET_BUFFERS, buffer_size_for_mtu(mtu)}
 {
   static_assert((NUM_RX_DESC * sizeof(rx_desc)) % 128 == 0, "Ring length must be 128-byte aligned");
   static_assert((NUM_TX_DESC * sizeof(tx_desc)) % 128 == 0, "Ring length must be 128-byte aligned");
 
   INFO("e1000", "Intel Pro/1000 Ethernet Adapter (rev=%#x)", d.rev_id());
+  Busy_poll::add_device(*this);
   // find and store capabilities
   d.parse_capabilities();
   // find BARs etc.
@@ -212,11 +238,11 @@ e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
   }
   else
   {
-    write_cmd(REG_ITR, 100);
     //write_cmd(REG_IAM, 0x0);
     // CTRL_EXT = IAME
     //write_cmd(REG_CTRL_EXT, (1 << 27));
   }
+  this->set_interrupt_moderation(DEFAULT_ITR_USEC, DEFAULT_RDTR_USEC, DEFAULT_RADV_USEC);
 
   // remove master disable bit
   write_cmd(REG_CTRL, read_cmd(REG_CTRL) & ~(1 << 2));
@@ -265,7 +291,7 @@ e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
 #ifdef E1000E_FAKE_EVENT_HANDLER
   Timers::periodic(std::chrono::milliseconds(1),
     [this] (int) {
-      this->receive_handler();
+      this->receive_handler(NUM_RX_DESC);
       this->transmit_handler();
       this->event_handler();
     });
@@ -277,7 +303,7 @@ void e1000::config_msix()
   #define IVAR_INT_ALLOC_VALID 0x8 // 10.2.4.9 p.328
   uint32_t ivar = 0;
   // rx queue 0 2:0
-  uint8_t vec0 = Events::get().subscribe({this, &e1000::receive_handler});
+  uint8_t vec0 = Events::get().subscribe({this, &e1000::rx_interrupt_handler});
   int m0 = m_pcidev.setup_msix_vector(SMP::cpu_id(), IRQ_BASE + vec0);
   ivar |= (IVAR_INT_ALLOC_VALID | m0);
 
@@ -427,6 +453,26 @@ void e1000::intr_disable()
   else
     write_cmd(REG_IMC, LEGACY_INTR_MASK());
 }
+void e1000::set_interrupt_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv)
+{
+  // ITR counts in 256ns units, the RX timers in 1.024us units
+  const uint32_t itr_val = (itr * 1000) / 256;
+  write_cmd(REG_ITR, itr_val);
+  if (this->use_msix) {
+    for (size_t i = 0; i < irqs.size(); i++)
+        write_cmd(REG_EITR(i), itr_val);
+  }
+  write_cmd(REG_RDTR, std::min((rdtr * 1000) / 1024, 0xFFFFu));
+  // RADV only applies while RDTR is in use
+  write_cmd(REG_RADV, rdtr ? std::min((radv * 1000) / 1024, 0xFFFFu) : 0);
+  stat_itr  = itr;
+  stat_rdtr = rdtr;
+  stat_radv = radv;
+}
+void e1000::set_rx_interrupts(bool enabled)
+{
+  write_cmd(enabled ? REG_IMS : REG_IMC, RX_INTR_MASK());
+}
 void e1000::intr_cause_clear()
 {
   write_cmd(REG_ICRR, 0xFFFFFFFF);
@@ -469,6 +515,7 @@ void e1000::event_handler()
   }
   // see: e1000_regs.h
   PRINT("[e1000] event %x received\n", status);
+  stat_interrupts++;
 
   // empty tx queue or tx desc written back
   if (status & TXQE || status & TXDW)
@@ -482,65 +529,96 @@ void e1000::event_handler()
     PRINT("[e1000] link state changed\n");
     this->link_up();
   }
-  if (status & RXDMTO)
-  {
-    PRINT("[e1000] rx descriptor minimum treshold hit!\n");
-    this->receive_handler();
-  }
   if (status & RXO)
   {
     fprintf(stderr, "[e1000] rx overrun!\n");
   }
-  // rx timer interrupt
-  if (status & RXTO)
+  // rx timer interrupt, rx descriptor minimum treshold hit,
+  // or overrun because the ring could not be refilled
+  if (status & (RXTO | RXDMTO | RXO))
   {
-    this->receive_handler();
+    this->rx_interrupt_handler();
   }
 
   // ready to handle more events
   this->intr_cause_clear();
 }
 
-void e1000::receive_handler()
+void e1000::rx_interrupt_handler()
 {
-  uint16_t old_idx = 0;
-  uint32_t received = 0;
+  if (this->use_msix) stat_interrupts++;
+  if (Busy_poll::get().schedule(*this)) return;
+  this->receive_handler(NUM_RX_DESC);
+}
+
+int e1000::receive_handler(int budget)
+{
+  TRACEPOINT(NIC_RX_BEGIN);
+  int received = 0;
   std::array<net::Packet_ptr, NUM_RX_DESC> recv_array;
 
-  while (true)
+  while (received < budget && rx.empty < NUM_RX_DESC)
   {
     auto& tk = rx.desc[rx.current];
     if ((tk.status & 1) == 0) break;
 
-    // must be complete packet
-    if ((tk.status & 2) == 0) {
-      PRINT("[e1000] dropping incomplete buffer %u bytes\n", tk.length);
-      continue;
-    }
-
+    const uint8_t status = tk.status;
     auto* buf = (uint8_t*) tk.addr;
     assert(buf != nullptr);
     PRINT("[e1000] recv %p -> %u bytes\n", buf, tk.length);
+    auto pckt = recv_packet(buf, tk.length);
 
-    recv_array[received] = recv_packet(buf, tk.length);
-    received++;
-
-    // give new buffer
-    tk.addr = (uint64_t) this->new_rx_packet();
+    // descriptor waits for refill
+    tk.addr   = 0;
     tk.status = 0;
-    // go to next index
-    old_idx = rx.current;
     rx.current = (rx.current + 1) % NUM_RX_DESC;
+    rx.empty++;
+
+    // must be complete packet
+    if (UNLIKELY((status & 2) == 0)) {
+      PRINT("[e1000] dropping incomplete buffer %u bytes\n", pckt->size());
+      stat_rx_dropped++;
+      continue;
+    }
+    recv_array[received++] = std::move(pckt);
   }
 
-  if (received > 0)
+  // give back buffers in batches, with a single tail write
+  if (rx.empty >= RX_REFILL_BATCH || rx.empty == NUM_RX_DESC)
+      this->refill_rx();
+
+  // process rx packets
+  for (int i = 0; i < received; i++) {
+    stat_rx_packets++;
+    stat_rx_bytes += recv_array[i]->size();
+    Link_layer::receive(std::move(recv_array[i]));
+  }
+  TRACEPOINT(NIC_RX_END, 0, received);
+  return received;
+}
+
+void e1000::refill_rx()
+{
+  int refilled = 0;
+  while (rx.empty > 0)
   {
-    // acknowledge all rx packets
-    write_cmd(REG_RXDESCTAIL, old_idx);
-    // process rx packets
-    for (uint32_t i = 0; i < received; i++) {
-      Link_layer::receive(std::move(recv_array[i]));
+    // leave descriptors empty rather than exhausting the buffer store
+    if (not Nic::buffers_still_available(bufstore().buffers_in_use())) {
+      stat_rx_refill_dropped++;
+      break;
     }
+    auto& tk = rx.desc[rx.refill];
+    tk.addr   = (uint64_t) this->new_rx_packet();
+    tk.status = 0;
+    rx.refill = (rx.refill + 1) % NUM_RX_DESC;
+    rx.empty--;
+    refilled++;
+  }
+  if (refilled > 0)
+  {
+    // the device owns everything up to, but not including, the tail
+    write_cmd(REG_RXDESCTAIL, (rx.refill + NUM_RX_DESC - 1) % NUM_RX_DESC);
+    stat_rx_refills++;
   }
 }
 
@@ -590,8 +668,8 @@ void e1000::transmit(net::Packet_ptr pckt)
     // decrement send queue size
     assert(sendq_size > 0);
     sendq_size--;
-    // force kick if tx queue is exactly quarter full
-    if (this->free_transmit_descr() == NUM_TX_DESC / 4) {
+    // kick every batch, so the device starts on a long burst early
+    if (tx.pending >= TX_KICK_BATCH) {
       this->xmit_kick();
     }
     // next is the new sendq
@@ -630,6 +708,10 @@ void e1000::transmit_data(uint8_t* data, uint16_t length)
   tk.vlan_tag = 0;
   // next tx position
   tx.current = (tx.current + 1) % NUM_TX_DESC;
+  tx.pending++;
+  stat_tx_packets++;
+  stat_tx_bytes += length;
+  TRACEPOINT(NIC_TX, 0, length);
 
   if (tx.deferred == false)
   {
@@ -640,15 +722,19 @@ void e1000::transmit_data(uint8_t* data, uint16_t length)
 }
 void e1000::xmit_kick()
 {
-  if (tx.deferred) {
-    tx.deferred = false;
+  // one tail write for every descriptor written since the last kick
+  if (tx.pending > 0) {
+    tx.pending = 0;
     write_cmd(REG_TXDESCTAIL, tx.current);
+    stat_tx_kicks++;
   }
 }
 void e1000::do_deferred_xmit()
 {
-  for (auto& dev : deferred_devices)
+  for (auto& dev : deferred_devices) {
+      dev->tx.deferred = false;
       dev->xmit_kick();
+  }
   deferred_devices.clear();
 }
 
@@ -658,7 +744,11 @@ void e1000::flush()
 }
 void e1000::poll()
 {
-  this->receive_handler();
+  this->receive_handler(NUM_RX_DESC);
+}
+int e1000::poll_rx(int budget)
+{
+  return this->receive_handler(std::min(budget, NUM_RX_DESC));
 }
 void e1000::deactivate()
 {
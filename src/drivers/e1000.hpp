@@ -14,6 +14,10 @@ public:
   static const int NUM_TX_DESC   = 64;
   static const int NUM_TX_QUEUE  = 64;
   static const int NUM_RX_DESC   = 64;
+  /** Refill the RX ring once this many descriptors are empty */
+  static const int RX_REFILL_BATCH = 16;
+  /** Kick TX once this many descriptors are waiting */
+  static const int TX_KICK_BATCH   = NUM_TX_DESC / 4;
 
   static std::unique_ptr<Nic> new_instance(hw::PCI_Device& d, const uint16_t MTU)
   { return std::make_unique<e1000>(d, MTU); }
@@ -61,6 +65,17 @@ public:
 
   void poll() override;
 
+  int  poll_rx(int budget) override;
+  void set_rx_interrupts(bool enabled) override;
+
+  /**
+   * Interrupt moderation, all in microseconds (0 disables)
+   * @param itr   minimum interval between interrupts (ITR/EITR)
+   * @param rdtr  RX delay timer, restarted by every received packet
+   * @param radv  RX absolute delay, caps the delay added by rdtr
+   */
+  void set_interrupt_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv);
+
 private:
   void intr_enable();
   void intr_disable();
@@ -70,6 +85,7 @@ private:
   void config_msix();
 
   void wait_millis(int);
+  void refill_rx();
 
   void init_filters();
   void set_filter(int, MAC::Addr);
@@ -84,7 +100,8 @@ private:
   net::Packet_ptr recv_packet(uint8_t*, uint16_t);
   uintptr_t       new_rx_packet();
   void event_handler();
-  void receive_handler();
+  void rx_interrupt_handler();
+  int  receive_handler(int budget);
   void transmit_handler();
   uint16_t free_transmit_descr() const noexcept;
   bool can_transmit() const noexcept;
@@ -127,6 +144,9 @@ private:
   struct rx_t {
     rx_desc desc[NUM_RX_DESC];
     uint16_t current = 0;
+    // next descriptor waiting for a buffer, trails current
+    uint16_t refill  = 0;
+    uint16_t empty   = 0;
   } rx;
 
   struct tx_t {
@@ -134,9 +154,24 @@ private:
     std::deque<net::Packet*> sent;
     uint16_t current = 0;
     uint16_t sent_id = 0;
+    uint16_t pending = 0;
     bool deferred = false;
   } tx;
 
+  /** Stats */
+  uint64_t& stat_rx_packets;
+  uint64_t& stat_rx_bytes;
+  uint64_t& stat_rx_dropped;
+  uint64_t& stat_rx_refills;
+  uint64_t& stat_rx_refill_dropped;
+  uint64_t& stat_tx_packets;
+  uint64_t& stat_tx_bytes;
+  uint64_t& stat_tx_kicks;
+  uint64_t& stat_interrupts;
+  uint32_t& stat_itr;
+  uint32_t& stat_rdtr;
+  uint32_t& stat_radv;
+
   // sendq as packet chain
   net::Packet_ptr  sendq = nullptr;
   size_t           sendq_size = 0;
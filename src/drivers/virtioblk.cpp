@@ -14,6 +14,7 @@
 #define VIRTIO_BLK_F_BLK_SIZE  6
 #define VIRTIO_BLK_F_SCSI      7
 #define VIRTIO_BLK_F_FLUSH     9
+#define VIRTIO_BLK_F_MQ        12
 
 #define VIRTIO_BLK_T_IN         0
 #define VIRTIO_BLK_T_OUT        1
@@ -27,13 +28,15 @@
 
 #define FEAT(x)  (1 << x)
 
-// a deleter that does nothing
-void null_deleter(uint8_t*) {};
+// largest single data segment when the device doesn't tell us
+static const uint32_t DEFAULT_PART_SECTORS = 256;
+// most data segments merged into one request when the device doesn't tell us
+static const uint32_t DEFAULT_SEGMENTS = 64;
 
 #include <statman>
 
 VirtioBlk::VirtioBlk(hw::PCI_Device& d)
-  : Virtio(d), hw::Block_device(), req(device_name() + ".req0", queue_size(0), 0, iobase()), inflight(0)
+  : Virtio(d), hw::Block_device()
 {
   INFO("VirtioBlk", "Initializing");
   {
@@ -46,11 +49,26 @@ VirtioBlk::VirtioBlk(hw::PCI_Device& d)
       Stat::UINT32, device_name() + ".errors");
     this->errors = &err.get_uint32();
     *this->errors = 0;
+
+    auto& mrg = Statman::get().create(
+      Stat::UINT32, device_name() + ".merged");
+    this->merged = &mrg.get_uint32();
+    *this->merged = 0;
+
+    auto& pol = Statman::get().create(
+      Stat::UINT32, device_name() + ".polled");
+    this->polled = &pol.get_uint32();
+    *this->polled = 0;
   }
 
   uint32_t needed_features =
     FEAT(VIRTIO_BLK_F_BLK_SIZE);
-  negotiate_features(needed_features);
+  uint32_t wanted_features = needed_features
+    | FEAT(VIRTIO_BLK_F_SIZE_MAX) | FEAT(VIRTIO_BLK_F_SEG_MAX)
+    | FEAT(VIRTIO_BLK_F_MQ) | FEAT(VIRTIO_F_RING_INDIRECT_DESC);
+  negotiate_features(wanted_features);
+  // features() holds the host features, we only use the ones we asked for
+  const uint32_t enabled = features() & wanted_features;
 
   CHECK(features() & FEAT(VIRTIO_BLK_F_BARRIER),
         "Barrier is enabled");
@@ -68,22 +86,52 @@ VirtioBlk::VirtioBlk(hw::PCI_Device& d)
         "SCSI is enabled :(");
   CHECK(features() & FEAT(VIRTIO_BLK_F_FLUSH),
         "Flush enabled");
+  CHECK(features() & FEAT(VIRTIO_BLK_F_MQ),
+        "Multiple queues");
+  CHECK(features() & FEAT(VIRTIO_F_RING_INDIRECT_DESC),
+        "Indirect descriptors");
 
   CHECK ((features() & needed_features) == needed_features,
          "Negotiated needed features");
 
-  // Step 1 - Initialize REQ queue
-  auto success = assign_queue(0, req.queue_desc());
-  CHECK(success, "Request queue assigned (%p) to device",
-        req.queue_desc());
+  // Get device configuration (needed to know the number of queues)
+  get_config();
 
-  // Step 3 - Fill receive queue with buffers
-  // DEBUG: Disable
-  INFO("VirtioBlk", "Queue size: %i\tRequest size: %zu\n",
-       req.size(), sizeof(request_t));
+  // merging and scatter-gather limits
+  this->use_indirect = enabled & FEAT(VIRTIO_F_RING_INDIRECT_DESC);
+  this->max_part_sectors = DEFAULT_PART_SECTORS;
+  if ((enabled & FEAT(VIRTIO_BLK_F_SIZE_MAX)) && config.size_max >= SECTOR_SIZE)
+    this->max_part_sectors = std::min<uint32_t>(config.size_max / SECTOR_SIZE, DEFAULT_PART_SECTORS);
+  this->max_segments = DEFAULT_SEGMENTS;
+  if ((enabled & FEAT(VIRTIO_BLK_F_SEG_MAX)) && config.seg_max > 0)
+    this->max_segments = std::min<uint32_t>(config.seg_max, DEFAULT_SEGMENTS);
+
+  // one request queue per CPU, as long as there are vectors for them
+  size_t nqueues = 1;
+  if ((enabled & FEAT(VIRTIO_BLK_F_MQ)) && has_msix())
+  {
+    nqueues = std::min<size_t>(config.num_queues, SMP::early_cpu_total());
+    // the last vector is reserved for configuration changes
+    nqueues = std::min<size_t>(nqueues, get_msix_vectors() - 1);
+    nqueues = std::max<size_t>(nqueues, 1);
+  }
 
-  // Get device configuration
-  get_config();
+  // Step 1 - Initialize REQ queues
+  for (size_t i = 0; i < nqueues; i++)
+  {
+    queues.push_back(std::make_unique<Blk_queue>(
+        device_name() + ".req" + std::to_string(i), queue_size(i), i, iobase()));
+    auto success = assign_queue(i, queues.back()->q.queue_desc());
+    CHECK(success, "Request queue %zu assigned (%p) to device",
+          i, queues.back()->q.queue_desc());
+  }
+  // without indirect descriptors a request must fit in the ring
+  if (not use_indirect)
+    this->max_segments = std::min<uint32_t>(max_segments, queues[0]->q.size() - 2);
+
+  INFO("VirtioBlk", "Queues: %zu  Queue size: %i  Segments: %u x %u sectors%s",
+       queues.size(), queues[0]->q.size(), max_segments, max_part_sectors,
+       use_indirect ? " (indirect)" : "");
 
   // Signal setup complete.
   setup_complete((features() & needed_features) == needed_features);
@@ -92,11 +140,20 @@ VirtioBlk::VirtioBlk(hw::PCI_Device& d)
   // Hook up IRQ handler (inherited from Virtio)
   if (has_msix())
   {
-    assert(get_msix_vectors() >= 2);
+    assert(get_msix_vectors() >= queues.size() + 1);
+    // route each queue's vector to the CPU that owns the queue
+    for (size_t i = 1; i < queues.size(); i++)
+        this->move_vector_to_cpu(i, i);
+
     auto& irqs = this->get_irqs();
     // update IRQ subscriptions
-    Events::get().subscribe(irqs[0], {this, &VirtioBlk::service_RX});
-    Events::get().subscribe(irqs[1], {this, &VirtioBlk::msix_conf_handler});
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+      auto* bq = queues[i].get();
+      auto& events = (i == 0) ? Events::get() : Events::get(i);
+      events.subscribe(irqs[i], {[this, bq] () { service_queue(*bq); }});
+    }
+    Events::get().subscribe(irqs[queues.size()], {this, &VirtioBlk::msix_conf_handler});
   }
   else
   {
@@ -130,158 +187,172 @@ void VirtioBlk::irq_handler() {
 
   // Step 2. A) - one of the queues have changed
   if (isr & 1) {
-    // This now means service RX & TX interchangeably
-    service_RX();
+    for (auto& bq : queues) service_queue(*bq);
   }
 
   // Step 2. B)
   if (isr & 2) {
     debug("\t <VirtioBlk> Configuration change:\n");
-
-    // Getting the MAC + status
-    //debug("\t             Old status: 0x%x\n", config.status);
     get_config();
-    //debug("\t             New status: 0x%x \n", config.status);
   }
 }
 
-void VirtioBlk::handle(request_t* hdr)
+void VirtioBlk::handle(request_t* vbr)
 {
-  // check request response
-  blk_resp_t& resp = hdr->resp;
-  // only call handler with data when the request was fullfilled
-  //printf("response: status %u blk %llu  func %p  buff %p\n",
-  //      resp.status, hdr->hdr.sector, resp.handler.get_ptr(), hdr->io.sector);
-
-  if (resp.status == 0) {
-    // packaged as buffer, but deleted as request
-    resp.handler(hdr->io.sector);
-  }
-  else {
-    // return empty shared ptr
-    resp.handler(nullptr);
-  }
+  // only call handlers with data when the request was fullfilled
+  const bool ok = (vbr->status == VIRTIO_BLK_S_OK);
+  if (UNLIKELY(!ok)) (*this->errors)++;
+
+  for (auto& part : vbr->parts)
+    part.handler(ok);
 
   // delete request
-  delete hdr;
+  delete vbr;
 }
 
-void VirtioBlk::service_RX()
+void VirtioBlk::service_queue(Blk_queue& bq, bool polling)
 {
-  req.disable_interrupts();
-  while (req.new_incoming())
+  bq.q.disable_interrupts();
+  while (bq.q.new_incoming())
   {
-    auto tok = req.dequeue();
+    auto tok = bq.q.dequeue();
     if (!tok.size()) break;
 
-    // only handle the main header of each request
-    auto* hdr = (request_t*) tok.data();
-    received.emplace_back(hdr);
+    // the first buffer of each request is the header
+    auto* vbr = (request_t*) tok.data();
+    bq.received.emplace_back(vbr);
   };
 
   // if we have free space and jobs, start shipping
-  bool shipped = false;
-  while (free_space() && !jobs.empty()) {
-    shipit(jobs.front());
-    jobs.pop_front();
-    shipped = true;
+  flush(bq);
+  if (not polling) bq.q.enable_interrupts();
+
+  // handlers may issue new reads, so work on a private list
+  std::vector<request_t*> done;
+  done.swap(bq.received);
+  for (request_t* vbr : done) {
+    bq.inflight--;
+    handle(vbr);
   }
-  if (shipped) req.kick();
-  req.enable_interrupts();
-
-  int handled = 0;
-  for (request_t* hdr : received) {
-    handle(hdr);
-    inflight--; handled++;
-  }
-  received.clear();
-
-  //printf("inflight: %d  handled: %d  shipped: %d  num_free: %u\n",
-  //    inflight, handled, scnt, req.num_free());
 }
 
-void VirtioBlk::shipit(request_t* vbr) {
+void VirtioBlk::flush(Blk_queue& bq)
+{
+  bool shipped = false;
+  while (!bq.jobs.empty() && bq.q.num_free() >= descs_needed(1))
+  {
+    auto* vbr = new request_t(bq.jobs.front().sector);
+    uint64_t next = bq.jobs.front().sector;
+    // merge adjacent parts into the same request, as long as they fit
+    while (!bq.jobs.empty()
+        && bq.jobs.front().sector == next
+        && vbr->parts.size() < max_segments
+        && bq.q.num_free() >= descs_needed(vbr->parts.size() + 1))
+    {
+      next += bq.jobs.front().count;
+      vbr->parts.push_back(std::move(bq.jobs.front()));
+      bq.jobs.pop_front();
+    }
+    if (vbr->parts.size() > 1)
+      (*this->merged) += vbr->parts.size() - 1;
 
-  Token token1 { { (uint8_t*) &vbr->hdr, sizeof(scsi_header_t) }, Token::OUT };
-  Token token2 { { (uint8_t*) &vbr->io, sizeof(blk_io_t) }, Token::IN };
-  Token token3 { { (uint8_t*) &vbr->resp, 1 }, Token::IN }; // 1 status byte
+    shipit(bq, vbr);
+    shipped = true;
+  }
+  // kick once for the whole batch
+  if (shipped) bq.q.kick();
+}
 
-  //printf("shipping job: sect %llu  func %p  buff %p\n",
-  //      vbr->hdr.sector, vbr->resp.handler.get_ptr(), vbr->io.sector);
-  std::array<Token, 3> tokens {{ token1, token2, token3 }};
-  req.enqueue(tokens);
-  inflight++;
+void VirtioBlk::shipit(Blk_queue& bq, request_t* vbr)
+{
+  std::vector<Token> tokens;
+  tokens.reserve(vbr->parts.size() + 2);
+  tokens.push_back({ { (uint8_t*) &vbr->hdr, sizeof(scsi_header_t) }, Token::OUT });
+  for (auto& part : vbr->parts)
+    tokens.push_back({ { part.dest, part.count * SECTOR_SIZE }, Token::IN });
+  tokens.push_back({ { &vbr->status, 1 }, Token::IN }); // 1 status byte
+
+  if (use_indirect) {
+    vbr->indirect.reset(new Virtio::Queue::virtq_desc[tokens.size()]);
+    bq.q.enqueue_indirect(tokens, vbr->indirect.get());
+  }
+  else {
+    bq.q.enqueue(tokens);
+  }
+  bq.inflight++;
   (*this->requests)++;
 }
 
 void VirtioBlk::read (block_t blk, size_t cnt, on_read_func func)
 {
-  // create big buffer for collecting all the disk data
-  auto bigbuf = fs::construct_buffer(block_size() * cnt);
-  // number of reads left
-  auto results = std::make_shared<size_t> (cnt);
-  bool shipped = false;
-  //printf("virtioblk: Enqueue blk %llu cnt %u\n", blk, cnt);
+  if (UNLIKELY(cnt == 0 || blk + cnt > size())) {
+    func(nullptr);
+    return;
+  }
+  struct read_state_t {
+    buffer_t     buffer;
+    on_read_func func;
+    size_t       remaining;
+    bool         failed;
+  };
+  // the device writes straight into one big buffer
+  auto state = std::make_shared<read_state_t> (read_state_t{
+      fs::construct_buffer(block_size() * cnt), std::move(func), 0, false });
+  state->remaining = (cnt + max_part_sectors - 1) / max_part_sectors;
 
-  //for (int i = cnt-1; i >= 0; i--)
-  for (size_t i = 0; i < cnt; i++)
+  auto& bq = local_queue();
+  for (size_t i = 0; i < cnt; i += max_part_sectors)
   {
-    // create a special request where we collect all the data
-    auto* vbr = new request_t(
-      blk + i,
-      request_handler_t::make_packed(
-      [this, i, func, results, bigbuf] (uint8_t* data) {
-        // if the job was already completed, return early
-        if (*results == 0) {
-          printf("[virtioblk] Job cancelled? results == 0,  blk=%zu\n", i);
-          return;
-        }
-        // validate partial result
-        if (data != nullptr) {
-          *results -= 1;
-          // copy partial block
-          memcpy(bigbuf->data() + i * block_size(), data, block_size());
-          // check if we have all blocks
-          if (*results == 0) {
-            // finally, call user-provided callback
-            func(bigbuf);
-          }
-        }
-        else {
-          (*this->errors)++;
-          // if the partial result failed, cancel all
-          *results = 0;
-          // callback with no data
-          func(nullptr);
-        }
-      })
-    );
-    //printf("virtioblk: Enqueue blk %llu\n", blk + i);
-    //
-    if (free_space()) {
-      shipit(vbr);
-      shipped = true;
-    }
+    const uint32_t count = std::min<size_t>(cnt - i, max_part_sectors);
+    bq.jobs.push_back({
+      blk + i, count, state->buffer->data() + i * block_size(),
+      request_handler_t{[state] (bool ok) {
+        if (!ok) state->failed = true;
+        if (--state->remaining == 0)
+          state->func(state->failed ? nullptr : state->buffer);
+      }}
+    });
+  }
+  flush(bq);
+}
+
+VirtioBlk::buffer_t VirtioBlk::read_sync(block_t blk, size_t cnt)
+{
+  buffer_t result = nullptr;
+  bool done = false;
+  read(blk, cnt, on_read_func{[&result, &done] (buffer_t data) {
+    result = std::move(data);
+    done = true;
+  }});
+
+  // poll the queue instead of waiting for the interrupt
+  auto& bq = local_queue();
+  const bool irqs_on = bq.q.interrupts_enabled();
+  while (!done)
+  {
+    if (bq.q.new_incoming())
+      service_queue(bq, true);
     else
-      jobs.push_back(vbr);
+      asm("pause");
   }
-  // kick when we have enqueued stuff
-  if (shipped) req.kick();
+  if (irqs_on) bq.q.enable_interrupts();
+  (*this->polled)++;
+  return result;
 }
 
-VirtioBlk::request_t::request_t(uint64_t blk, request_handler_t cb)
+VirtioBlk::request_t::request_t(uint64_t blk)
 {
   hdr.type   = VIRTIO_BLK_T_IN;
   hdr.ioprio = 0; // reserved
   hdr.sector = blk;
-  resp.status  = VIRTIO_BLK_S_IOERR;
-  resp.handler = cb;
+  status     = VIRTIO_BLK_S_IOERR;
 }
 
 void VirtioBlk::deactivate()
 {
   /// disable interrupts on virtio queues
-  req.disable_interrupts();
+  for (auto& bq : queues)
+    bq->q.disable_interrupts();
 
   /// reset device
   this->Virtio::reset();
@@ -8,6 +8,7 @@
 #include <hw/pci_device.hpp>
 #include <virtio/virtio.hpp>
 #include <deque>
+#include <smp>
 
 /** Virtio-net device driver.  */
 class VirtioBlk : public Virtio, public hw::Block_device
@@ -40,13 +41,16 @@ public:
   // read @blk + @cnt from disk, call func with buffer when done
   void read(block_t blk, size_t cnt, on_read_func cb) override;
 
-  // unsupported sync reads
-  buffer_t read_sync(block_t, size_t) override {
-    return buffer_t();
-  }
+  // polled synchronous read, spins on the current CPU's queue
+  buffer_t read_sync(block_t, size_t) override;
 
   void deactivate() override;
 
+  // number of request queues in use (> 1 with VIRTIO_BLK_F_MQ)
+  size_t num_queues() const noexcept {
+    return queues.size();
+  }
+
   /** Constructor. @param pcidev an initialized PCI device. */
   VirtioBlk(hw::PCI_Device& pcidev);
 
@@ -69,6 +73,9 @@ private:
     uint8_t alignment_offset;    // Alignment offset in logical blocks
     uint16_t min_io_size;        // Minimum I/O size without performance penalty in logical blocks
     uint32_t opt_io_size;        // Optimal sustained I/O size in logical blocks
+    uint8_t  writeback;
+    uint8_t  unused0;
+    uint16_t num_queues;         // Only valid with VIRTIO_BLK_F_MQ
   };
 
   struct scsi_header_t
@@ -77,73 +84,87 @@ private:
     uint32_t ioprio;
     uint64_t sector;
   };
-  struct blk_io_t
-  {
-    uint8_t      sector[512];
-  };
-  typedef delegate<void(uint8_t*)> request_handler_t;
-  struct blk_resp_t
+  typedef delegate<void(bool)> request_handler_t;
+
+  // a contiguous range of sectors read directly into its destination
+  struct part_t
   {
-    uint8_t           status;
+    uint64_t          sector;
+    uint32_t          count;
+    uint8_t*          dest;
     request_handler_t handler;
   };
 
+  // one virtio request, possibly covering several adjacent parts
   struct request_t
   {
     scsi_header_t hdr;
-    blk_io_t      io;
-    blk_resp_t    resp;
+    uint8_t       status;
+    std::vector<part_t> parts;
+    std::unique_ptr<Virtio::Queue::virtq_desc[]> indirect;
 
-    request_t(uint64_t blk, request_handler_t cb);
+    request_t(uint64_t blk);
+  };
+
+  struct Blk_queue
+  {
+    Virtio::Queue q;
+    // parts waiting for space in vring
+    std::deque<part_t> jobs;
+    size_t inflight = 0;
+    // stack of dequeued requests to be processed
+    std::vector<request_t*> received;
+
+    Blk_queue(const std::string& name, uint16_t size, uint16_t index, uint16_t iobase)
+      : q(name, size, index, iobase) {}
   };
 
   /** Get virtio PCI config. @see Virtio::get_config.*/
   void get_config();
 
-  /** Service the RX Queue.
-      Push incoming data up to linklayer, dequeue RX buffers. */
-  void service_RX();
-
-  /** Service the TX Queue
-      Dequeue used TX buffers. @note: This function does not take any
-      responsibility for memory management. */
-  void service_TX();
+  /** Service a request queue, handling completed requests
+      and shipping queued jobs. */
+  void service_queue(Blk_queue&, bool polling = false);
 
   /** Handle device IRQ.
 
-      Will look for config. changes and service RX/TX queues as necessary.*/
+      Will look for config. changes and service all queues as necessary.*/
   void irq_handler();
 
   void msix_conf_handler();
 
-  // need at least 3 tokens free to ship a request
-  inline bool free_space() const noexcept
-  { return req.num_free() >= 3; }
+  // the queue used by the calling CPU
+  Blk_queue& local_queue() {
+    return *queues.at(SMP::cpu_id() % queues.size());
+  }
+
+  // descriptors needed to ship a request with @parts data segments
+  inline size_t descs_needed(size_t parts) const noexcept
+  { return (use_indirect) ? 1 : parts + 2; }
 
-  // need many free tokens free to efficiently ship requests
-  inline bool lots_free_space() const noexcept
-  { return req.num_free() >= 32; }
+  // merge adjacent queued jobs into requests, ship them, then kick once
+  void flush(Blk_queue&);
 
-  // add one request to queue and kick
-  void shipit(request_t*);
+  // add one request to queue (no kick)
+  void shipit(Blk_queue&, request_t*);
 
   void handle(request_t*);
 
-  Virtio::Queue req;
+  std::vector<std::unique_ptr<Blk_queue>> queues;
 
   // configuration as read from paravirtual PCI device
   virtio_blk_config_t config;
 
-  // queue waiting for space in vring
-  std::deque<request_t*> jobs;
-  size_t    inflight;
-
-  // stack of dequeued requests to be processed
-  std::vector<request_t*> received;
+  // negotiated limits for merging and scatter-gather
+  bool     use_indirect = false;
+  uint32_t max_part_sectors;
+  uint32_t max_segments;
 
   // stat counters
   uint32_t* errors;
   uint32_t* requests;
+  uint32_t* merged;
+  uint32_t* polled;
 };
 
 #endif
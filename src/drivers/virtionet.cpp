@@ -23,6 +23,8 @@
 
 #include "virtionet.hpp"
 #include <kernel/events.hpp>
+#include <kernel/busy_poll.hpp>
+#include <kernel/trace.hpp>
 #include <malloc.h>
 #include <cstring>
 
@@ -70,6 +72,7 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
 
 {
   INFO("VirtioNet", "Driver initializing");
+  Busy_poll::add_device(*this);
 #undef VNET_TOT_BUFFERS
 
   uint32_t needed_features = 0
@@ -215,10 +218,15 @@ void VirtioNet::msix_conf_handler()
 }
 void VirtioNet::msix_recv_handler()
 {
+  if (Busy_poll::get().schedule(*this)) return;
+  receive(128);
+}
+int VirtioNet::receive(int max)
+{
+  TRACEPOINT(NIC_RX_BEGIN);
   auto rx = stat_packets_rx_total_;
   rx_q.disable_interrupts();
   // handle incoming packets as long as bufstore has available buffers
-  int max = 128;
   while (rx_q.new_incoming() && max-- > 0)
   {
     auto res = rx_q.dequeue();
@@ -239,8 +247,12 @@ void VirtioNet::msix_recv_handler()
     }
     add_receive_buffer(bufstore().get_buffer());
   }
-  rx_q.enable_interrupts();
-  if (rx != stat_packets_rx_total_) rx_q.kick();
+  // interrupts stay masked while the device is being busy-polled
+  if (not rx_polled_) rx_q.enable_interrupts();
+  const int received = stat_packets_rx_total_ - rx;
+  if (received) rx_q.kick();
+  TRACEPOINT(NIC_RX_END, 0, received);
+  return received;
 }
 void VirtioNet::msix_xmit_handler()
 {
@@ -281,6 +293,22 @@ void VirtioNet::legacy_handler()
   msix_xmit_handler();
 }
 
+void VirtioNet::set_rx_interrupts(bool enabled)
+{
+  rx_polled_ = not enabled;
+  if (enabled)
+    rx_q.enable_interrupts();
+  else
+    rx_q.disable_interrupts();
+}
+
+int VirtioNet::poll_rx(int budget)
+{
+  const int received = receive(budget);
+  msix_xmit_handler();
+  return received;
+}
+
 void VirtioNet::add_receive_buffer(uint8_t* pkt)
 {
   assert(pkt >= (uint8_t*) 0x1000);
@@ -359,6 +387,7 @@ void VirtioNet::transmit(net::Packet_ptr pckt)
     // Increase TX-stats
     stat_packets_tx_total_++;
     stat_bytes_tx_total_ += next->size();
+    TRACEPOINT(NIC_TX, 0, next->size());
     stat_packets_tx_total_++;
   }
 
@@ -409,7 +438,7 @@ void VirtioNet::handle_deferred_devices()
 
 void VirtioNet::poll()
 {
-  msix_recv_handler();
+  receive(128);
   msix_xmit_handler();
   // flush transmit_q immediately
   if (this->deferred_kick)
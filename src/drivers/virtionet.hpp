@@ -153,6 +153,9 @@ public:
 
   void poll() override;
 
+  int  poll_rx(int budget) override;
+  void set_rx_interrupts(bool enabled) override;
+
 private:
   hw::PCI_Device& m_pcidev;
 
@@ -205,6 +208,10 @@ private:
   void msix_xmit_handler();
   void msix_conf_handler();
 
+  /** Pass at most @max received packets up the stack, returning how many */
+  int receive(int max);
+  bool rx_polled_ = false;
+
   /** Legacy IRQ handler */
   void legacy_handler();
 
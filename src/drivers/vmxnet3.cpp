@@ -4,10 +4,12 @@
 #include "vmxnet3_queues.hpp"
 
 #include <kernel/events.hpp>
+#include <kernel/trace.hpp>
 #include <arch.hpp>
 #include <smp>
 #include <statman>
 #include <info>
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <malloc.h>
@@ -40,11 +42,13 @@ struct vmxnet3_dma {
     struct vmxnet3_rx_desc desc[vmxnet3::NUM_RX_DESC];
     struct vmxnet3_rx_comp comp[VMXNET3_NUM_RX_COMP];
   };
-  struct vmxnet3_rx rx[vmxnet3::NUM_RX_QUEUES];
+  struct vmxnet3_rx rx[vmxnet3::MAX_RX_QUEUES];
   /** Queue descriptors */
   struct vmxnet3_queues queues;
   /** Shared area */
   struct vmxnet3_shared shared;
+  /** RSS configuration */
+  struct vmxnet3_rss_config rss;
 
 } __attribute__ ((aligned(VMXNET3_DMA_ALIGN)));
 
@@ -96,6 +100,27 @@ inline void mmio_write32(uintptr_t location, uint32_t value)
   *(uint32_t volatile*) location = value;
 }
 
+// the well-known default Toeplitz key, also used by most other drivers
+static const uint8_t rss_toeplitz_key[UPT1_RSS_MAX_KEY_SIZE] = {
+  0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+  0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+  0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+  0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+  0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+// hash buckets per RX queue in the indirection table
+static const int RSS_BUCKETS_PER_QUEUE = 4;
+
+// one RX queue per CPU, rounded down to a power of two as the device requires
+static int rss_queue_count(int msix_vectors)
+{
+  const int max = std::min({(int) SMP::active_cpus().size(),
+                            vmxnet3::MAX_RX_QUEUES, msix_vectors - 2});
+  int queues = 1;
+  while (queues * 2 <= max) queues *= 2;
+  return queues;
+}
+
 static inline uint16_t buffer_size_for_mtu(const uint16_t mtu)
 {
   const uint16_t header = sizeof(net::Packet) + vmxnet3::DRIVER_OFFSET;
@@ -139,19 +164,37 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
     uint8_t msix_vectors = d.get_msix_vectors();
     INFO2("[x] Device has %u MSI-X vectors", msix_vectors);
     assert(msix_vectors >= 3);
-    if (msix_vectors > 2 + NUM_RX_QUEUES) msix_vectors = 2 + NUM_RX_QUEUES;
+    this->home_cpu      = SMP::cpu_id();
+    this->num_rx_queues = rss_queue_count(msix_vectors);
 
-    for (int i = 0; i < msix_vectors; i++)
+    // queue 0 stays on this CPU, the rest go to the other active CPUs
+    const auto& cpus = SMP::active_cpus();
+    for (int q = 0, next = 0; q < num_rx_queues; q++)
     {
-      auto irq = Events::get().subscribe(nullptr);
+      if (q == 0) { rx[q].cpu = home_cpu; continue; }
+      if (cpus.at(next) == home_cpu) next++;
+      rx[q].cpu = cpus.at(next++);
+    }
+
+    for (int i = 0; i < 2 + num_rx_queues; i++)
+    {
+      const int cpu = (i < 2) ? home_cpu : rx[i - 2].cpu;
+      // the target CPU only looks at its handlers once the vector fires
+      auto irq = Events::get(cpu).subscribe(nullptr);
       this->irqs.push_back(irq);
-      d.setup_msix_vector(SMP::cpu_id(), IRQ_BASE + irq);
+      d.setup_msix_vector(cpu, IRQ_BASE + irq);
     }
 
     Events::get().subscribe(irqs[0], {this, &vmxnet3::msix_evt_handler});
     Events::get().subscribe(irqs[1], {this, &vmxnet3::msix_xmit_handler});
-    for (int q = 0; q < NUM_RX_QUEUES; q++)
-    Events::get().subscribe(irqs[2 + q], {this, &vmxnet3::msix_recv_handler});
+    for (int q = 0; q < num_rx_queues; q++)
+      Events::get(rx[q].cpu).subscribe(irqs[2 + q],
+          [this, q] () { this->receive_handler(q); });
+
+    if (num_rx_queues > 1) {
+      this->handoff_irq = Events::get().subscribe({this, &vmxnet3::handoff_handler});
+      INFO2("RSS over %d RX queues", num_rx_queues);
+    }
   }
   else {
     assert(0 && "This driver does not support legacy IRQs");
@@ -201,9 +244,18 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   // temp rxq buffer storage
   memset(tx.buffers, 0, sizeof(tx.buffers));
 
-  // setup rx queues
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  // setup rx queues, each with its own buffer pool
+  for (int q = 0; q < num_rx_queues; q++)
   {
+    if (q == 0) {
+      rx[q].store = &bufstore_;
+    }
+    else {
+      rx_stores[q].reset(new net::BufferStore(1024, bufstore_.bufsize()));
+      rx[q].store = rx_stores[q].get();
+    }
+    rx[q].stat_packets = &Statman::get().create(Stat::UINT64,
+        device_name() + ".rxq" + std::to_string(q) + ".packets").get_uint64();
     memset(rx[q].buffers, 0, sizeof(rx[q].buffers));
     rx[q].desc0 = &dma->rx[q].desc[0];
     rx[q].desc1 = nullptr;
@@ -235,17 +287,19 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   shared.misc.driver_data_address = (uintptr_t) &dma;
   shared.misc.queue_desc_address  = (uintptr_t) &dma->queues;
   shared.misc.driver_data_len     = sizeof(vmxnet3_dma);
-  shared.misc.queue_desc_len      = sizeof(vmxnet3_queues);
+  shared.misc.queue_desc_len      = sizeof(vmxnet3_tx_queue)
+                                  + num_rx_queues * sizeof(vmxnet3_rx_queue);
   shared.misc.mtu = max_packet_len(); // 60-9000
   shared.misc.num_tx_queues  = 1;
-  shared.misc.num_rx_queues  = NUM_RX_QUEUES;
+  shared.misc.num_rx_queues  = num_rx_queues;
   shared.interrupt.mask_mode = VMXNET3_IT_AUTO | (VMXNET3_IMM_AUTO << 2);
-  shared.interrupt.num_intrs = 2 + NUM_RX_QUEUES;
+  shared.interrupt.num_intrs = 2 + num_rx_queues;
   shared.interrupt.event_intr_index = 0;
   memset(shared.interrupt.moderation_level, UPT1_IML_ADAPTIVE, VMXNET3_MAX_INTRS);
   shared.interrupt.control   = 0x1; // disable all
   shared.rx_filter.mode =
       VMXNET3_RXM_UCAST | VMXNET3_RXM_BCAST | VMXNET3_RXM_ALL_MULTI;
+  if (num_rx_queues > 1) this->setup_rss();
 
   // location of shared area to device
   uintptr_t shabus = (uintptr_t) &shared;
@@ -259,7 +313,7 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   }
 
   // initialize and fill RX queue...
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < num_rx_queues; q++)
   {
     refill(rx[q]);
   }
@@ -270,10 +324,30 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   // enable interrupts
   enable_intr(0);
   enable_intr(1);
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < num_rx_queues; q++)
       enable_intr(2 + q);
 }
 
+void vmxnet3::setup_rss()
+{
+  auto& rss = dma->rss;
+  rss.hash_type = UPT1_RSS_HASH_TYPE_IPV4 | UPT1_RSS_HASH_TYPE_TCP_IPV4
+                | UPT1_RSS_HASH_TYPE_IPV6 | UPT1_RSS_HASH_TYPE_TCP_IPV6;
+  rss.hash_func = UPT1_RSS_HASH_FUNC_TOEPLITZ;
+  rss.hash_key_size  = sizeof(rss_toeplitz_key);
+  memcpy(rss.hash_key, rss_toeplitz_key, sizeof(rss_toeplitz_key));
+  // spread hash buckets evenly over the queues
+  rss.ind_table_size = num_rx_queues * RSS_BUCKETS_PER_QUEUE;
+  for (int i = 0; i < rss.ind_table_size; i++)
+      rss.ind_table[i] = i % num_rx_queues;
+
+  auto& shared = dma->shared;
+  shared.misc.upt_features |= UPT1_F_RSS;
+  shared.rss.version = 1;
+  shared.rss.length  = sizeof(vmxnet3_rss_config);
+  shared.rss.address = (uintptr_t) &rss;
+}
+
 uint32_t vmxnet3::command(uint32_t cmd)
 {
   mmio_write32(this->iobase + VMXNET3_VD_CMD, cmd);
@@ -356,7 +430,7 @@ void vmxnet3::refill(rxring_state& rxq)
   {
     // break when not allowed to refill anymore
     if (rxq.prod_count > 0 /* prevent full stop? */
-     && not Nic::buffers_still_available(bufstore().buffers_in_use()))
+     && not Nic::buffers_still_available(rxq.store->buffers_in_use()))
     {
       stat_rx_refill_dropped += VMXNET3_RX_FILL - rxq.prod_count;
       break;
@@ -367,7 +441,7 @@ void vmxnet3::refill(rxring_state& rxq)
         (rxq.producers & vmxnet3::NUM_RX_DESC) ? 0 : VMXNET3_RXF_GEN;
 
     // get a pointer to packet data
-    auto* pkt_data = bufstore().get_buffer();
+    auto* pkt_data = rxq.store->get_buffer();
     rxq.buffers[i] = &pkt_data[sizeof(net::Packet) + DRIVER_OFFSET];
 
     // assign rx descriptor
@@ -385,14 +459,14 @@ void vmxnet3::refill(rxring_state& rxq)
 }
 
 net::Packet_ptr
-vmxnet3::recv_packet(uint8_t* data, uint16_t size)
+vmxnet3::recv_packet(uint8_t* data, uint16_t size, net::BufferStore& store)
 {
   auto* ptr = (net::Packet*) (data - DRIVER_OFFSET - sizeof(net::Packet));
   new (ptr) net::Packet(
         DRIVER_OFFSET,
         size,
         DRIVER_OFFSET + size,
-        &bufstore());
+        &store);
   return net::Packet_ptr(ptr);
 }
 net::Packet_ptr
@@ -444,13 +518,6 @@ void vmxnet3::msix_xmit_handler()
   this->transmit_handler();
   this->enable_intr(1);
 }
-void vmxnet3::msix_recv_handler()
-{
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
-  {
-      this->receive_handler(q);
-  }
-}
 
 bool vmxnet3::transmit_handler()
 {
@@ -514,8 +581,7 @@ bool vmxnet3::receive_handler(const int Q)
       //TODO assert / log if eop and sop are not set in empty packet.
 
       //release unused buffer
-      auto* packet = (net::Packet*) (tx.buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
-      delete packet; // call deleter on Packet to release it
+      rx[Q].store->release(rx[Q].buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
       rx[Q].buffers[desc] = nullptr;
       stat_rx_zero_dropped++;
       break;
@@ -526,10 +592,7 @@ bool vmxnet3::receive_handler(const int Q)
 
     // get buffer and construct packet
     assert(rx[Q].buffers[desc] != nullptr);
-    recvq.push_back(recv_packet(rx[Q].buffers[desc], len));
-
-    stat_rx_total_packets++;
-    stat_rx_total_bytes+=len;
+    recvq.push_back(recv_packet(rx[Q].buffers[desc], len, *rx[Q].store));
 
     rx[Q].buffers[desc] = nullptr;
   }
@@ -538,11 +601,51 @@ bool vmxnet3::receive_handler(const int Q)
   if (!recvq.empty()) {
     this->refill(rx[Q]);
   }
-  // handle packets
+  const bool received = recvq.empty() == false;
+  this->deliver(Q, recvq);
+  return received;
+}
+
+void vmxnet3::deliver(const int Q, std::vector<net::Packet_ptr>& recvq)
+{
+  if (recvq.empty()) return;
+  *rx[Q].stat_packets += recvq.size();
+  // the network stack runs on the home CPU only
+  if (SMP::cpu_id() != home_cpu)
+  {
+    rx[Q].handoff_lock.lock();
+    const bool notify = rx[Q].handoff.empty();
+    for (auto& pckt : recvq)
+        rx[Q].handoff.push_back(std::move(pckt));
+    rx[Q].handoff_lock.unlock();
+    if (notify) SMP::unicast(home_cpu, handoff_irq);
+    return;
+  }
+  TRACEPOINT(NIC_RX_BEGIN);
   for (auto& pckt : recvq) {
+    stat_rx_total_packets++;
+    stat_rx_total_bytes += pckt->size();
     Link::receive(std::move(pckt));
   }
-  return recvq.empty() == false;
+  TRACEPOINT(NIC_RX_END, 0, recvq.size());
+}
+
+void vmxnet3::handoff_handler()
+{
+  std::vector<net::Packet_ptr> recvq;
+  for (int q = 1; q < num_rx_queues; q++)
+  {
+    rx[q].handoff_lock.lock();
+    recvq.swap(rx[q].handoff);
+    rx[q].handoff_lock.unlock();
+
+    for (auto& pckt : recvq) {
+      stat_rx_total_packets++;
+      stat_rx_total_bytes += pckt->size();
+      Link::receive(std::move(pckt));
+    }
+    recvq.clear();
+  }
 }
 
 void vmxnet3::transmit(net::Packet_ptr pckt_ptr)
@@ -610,6 +713,7 @@ void vmxnet3::transmit_data(uint8_t* data, uint16_t data_length)
 
   stat_tx_total_packets++;
   stat_tx_total_bytes+=data_length;
+  TRACEPOINT(NIC_TX, 0, data_length);
 }
 
 void vmxnet3::flush()
@@ -642,8 +746,11 @@ void vmxnet3::poll()
   bool work;
   do {
     work = false;
-    for (int q = 0; q < NUM_RX_QUEUES; q++)
+    // queues on other CPUs are serviced by their own interrupts
+    for (int q = 0; q < num_rx_queues; q++)
+      if (rx[q].cpu == SMP::cpu_id())
         work |= receive_handler(q);
+    if (num_rx_queues > 1) handoff_handler();
     // transmit
     work |= transmit_handler();
     // immediately flush when possible
@@ -668,7 +775,7 @@ void vmxnet3::deactivate()
   // disable all queues
   this->disable_intr(0);
   this->disable_intr(1);
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < num_rx_queues; q++)
     this->disable_intr(2 + q);
 
   // reset this device
@@ -679,13 +786,26 @@ void vmxnet3::move_to_this_cpu()
 {
   bufstore().move_to_this_cpu();
 
+  const int old_cpu = this->home_cpu;
+  this->home_cpu = SMP::cpu_id();
+  // queue 0 follows the device, the other RX queues stay on their CPUs
+  rx[0].cpu = home_cpu;
+  if (num_rx_queues > 1) {
+    Events::get(old_cpu).unsubscribe(this->handoff_irq);
+    this->handoff_irq = Events::get().subscribe({this, &vmxnet3::handoff_handler});
+  }
+
   if (m_pcidev.has_msix())
   {
-    for (size_t i = 0; i < irqs.size(); i++)
+    for (int i = 0; i < HOME_VECTORS; i++)
     {
+      Events::get(old_cpu).unsubscribe(this->irqs[i]);
       this->irqs[i] = Events::get().subscribe(nullptr);
-      m_pcidev.rebalance_msix_vector(i, SMP::cpu_id(), IRQ_BASE + this->irqs[i]);
+      m_pcidev.rebalance_msix_vector(i, home_cpu, IRQ_BASE + this->irqs[i]);
     }
+    Events::get().subscribe(irqs[0], {this, &vmxnet3::msix_evt_handler});
+    Events::get().subscribe(irqs[1], {this, &vmxnet3::msix_xmit_handler});
+    Events::get().subscribe(irqs[2], [this] () { this->receive_handler(0); });
   }
 }
 
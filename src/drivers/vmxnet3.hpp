@@ -3,7 +3,9 @@
 #include <net/link_layer.hpp>
 #include <net/ethernet/ethernet_8021q.hpp>
 #include <deque>
+#include <memory>
 #include <vector>
+#include <smp_utils>
 struct vmxnet3_dma;
 struct vmxnet3_rx_desc;
 struct vmxnet3_rx_comp;
@@ -14,7 +16,8 @@ public:
   using Link          = net::Link_layer<net::Ethernet>;
   using Link_protocol = Link::Protocol;
   static const int DRIVER_OFFSET = 2;
-  static const int NUM_RX_QUEUES = 1;
+  /** RX queues are spread over up to this many CPUs using RSS */
+  static const int MAX_RX_QUEUES = 8;
   static const int NUM_TX_DESC   = 128;
   static const int NUM_RX_DESC   = 512;
 
@@ -67,11 +70,18 @@ public:
 
   void add_vlan(const int id) override;
 
+  /** Number of RX queues in use (one per CPU, when RSS is active) */
+  int rx_queues() const noexcept {
+    return this->num_rx_queues;
+  }
+
 private:
   void msix_evt_handler();
   void msix_xmit_handler();
-  void msix_recv_handler();
   bool receive_handler(int);
+  void deliver(int, std::vector<net::Packet_ptr>&);
+  void handoff_handler();
+  void setup_rss();
   bool transmit_handler();
   void enable_intr(uint8_t idx) noexcept;
   void disable_intr(uint8_t idx) noexcept;
@@ -80,7 +90,7 @@ private:
   inline int  tx_tokens_free() const noexcept;
   inline bool can_transmit() const noexcept;
   void transmit_data(uint8_t* data, uint16_t);
-  net::Packet_ptr recv_packet(uint8_t* data, uint16_t);
+  net::Packet_ptr recv_packet(uint8_t* data, uint16_t, net::BufferStore&);
 
   // tx/rx ring state
   struct ring_stuff {
@@ -96,9 +106,15 @@ private:
     vmxnet3_rx_desc* desc1 = nullptr;
     vmxnet3_rx_comp* comp  = nullptr;
     int index = 0;
+    int cpu   = 0;
     uint32_t producers  = 0;
     uint32_t prod_count = 0;
     uint32_t consumers  = 0;
+    net::BufferStore* store = nullptr;
+    // packets received on another CPU, waiting for the home CPU
+    std::vector<net::Packet_ptr> handoff;
+    smp_spinlock handoff_lock;
+    uint64_t* stat_packets = nullptr;
   };
   void refill(rxring_state&);
 
@@ -110,7 +126,10 @@ private:
   void     set_hwaddr(MAC::Addr&);
 
   hw::PCI_Device& m_pcidev;
+  // MSI-X vectors: events, TX, then one per RX queue
   std::vector<uint8_t> irqs;
+  // the vectors following the device between CPUs: events, TX and RX queue 0
+  static const int HOME_VECTORS = 3;
   uintptr_t     iobase = 0;
   uintptr_t     ptbase = 0;
   MAC::Addr     hw_addr;
@@ -118,7 +137,12 @@ private:
   vmxnet3_dma*  dma = nullptr;
 
   ring_stuff tx;
-  rxring_state rx[NUM_RX_QUEUES];
+  rxring_state rx[MAX_RX_QUEUES];
+  int num_rx_queues = 1;
+  // CPU running the network stack for this device
+  int home_cpu      = 0;
+  uint8_t handoff_irq = 0;
+  std::unique_ptr<net::BufferStore> rx_stores[MAX_RX_QUEUES];
   // deferred transmit dma
   uint8_t  deferred_irq  = 0;
   bool     deferred_kick = false;
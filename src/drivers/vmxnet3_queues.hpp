@@ -4,6 +4,8 @@
 
 /** Maximum number of interrupts */
 #define VMXNET3_MAX_INTRS 25
+/** Receive side scaling feature */
+#define UPT1_F_RSS        0x2
 /** Adaptive Interrupt Moderation */
 #define UPT1_IML_ADAPTIVE 0x8
 /** VLAN tag stripping feature */
@@ -74,6 +76,28 @@ enum vmxnet3_rx_filter_mode {
   VMXNET3_RXM_PROMISC = 0x10,  /**< Promiscuous */
 };
 
+/** RSS hash types */
+#define UPT1_RSS_HASH_TYPE_IPV4     0x01
+#define UPT1_RSS_HASH_TYPE_TCP_IPV4 0x02
+#define UPT1_RSS_HASH_TYPE_IPV6     0x04
+#define UPT1_RSS_HASH_TYPE_TCP_IPV6 0x08
+/** RSS hash function */
+#define UPT1_RSS_HASH_FUNC_TOEPLITZ 0x01
+
+#define UPT1_RSS_MAX_KEY_SIZE        40
+#define UPT1_RSS_MAX_IND_TABLE_SIZE 128
+
+/** RSS configuration, pointed to by vmxnet3_shared::rss */
+struct vmxnet3_rss_config {
+  uint16_t hash_type;
+  uint16_t hash_func;
+  uint16_t hash_key_size;
+  uint16_t ind_table_size;
+  uint8_t  hash_key[UPT1_RSS_MAX_KEY_SIZE];
+  /** RX queue index for each hash bucket */
+  uint8_t  ind_table[UPT1_RSS_MAX_IND_TABLE_SIZE];
+} __attribute__ ((packed));
+
 /** Variable-length configuration descriptor */
 struct vmxnet3_variable_config {
   uint32_t version;
@@ -273,11 +297,11 @@ struct vmxnet3_rx_queue {
 /**
  * Queue descriptor set
  *
- * We use only a single TX and RX queue
+ * We use a single TX queue and one RX queue per CPU
  */
 struct vmxnet3_queues {
   /** Transmit queue descriptor(s) */
   struct vmxnet3_tx_queue tx;
   /** Receive queue descriptor(s) */
-  struct vmxnet3_rx_queue rx[vmxnet3::NUM_RX_QUEUES];
+  struct vmxnet3_rx_queue rx[vmxnet3::MAX_RX_QUEUES];
 } __attribute__ ((packed));
@@ -0,0 +1,501 @@
+
+#include <fs/block_cache.hpp>
+#include <fs/common.hpp>
+#include <common>
+#include <algorithm>
+#include <cstring>
+#include <statman>
+
+//#define BC_PRINT(fmt, ...)  printf(fmt, ##__VA_ARGS__)
+#define BC_PRINT(fmt, ...)  /** **/
+
+namespace fs {
+
+  Block_cache& Block_cache::get()
+  {
+    static Block_cache cache;
+    return cache;
+  }
+
+  Block_cache::Block_cache(size_t capacity, const std::string& name)
+    : capacity_ { std::max(capacity, (size_t) 4) },
+      stat_hits_( Statman::get().create(
+               Stat::UINT64, name + ".hits").get_uint64() ),
+      stat_misses_( Statman::get().create(
+               Stat::UINT64, name + ".misses").get_uint64() ),
+      stat_readahead_( Statman::get().create(
+               Stat::UINT64, name + ".readahead").get_uint64() ),
+      stat_evictions_( Statman::get().create(
+               Stat::UINT64, name + ".evictions").get_uint64() ),
+      stat_writebacks_( Statman::get().create(
+               Stat::UINT64, name + ".writebacks").get_uint64() ),
+      stat_write_errors_( Statman::get().create(
+               Stat::UINT64, name + ".write_errors").get_uint64() )
+  {
+    max_readahead_ = std::min(max_readahead_, capacity_ / 4);
+    pages_.reserve(capacity_);
+    index_.reserve(capacity_);
+  }
+
+  Block_cache::Page* Block_cache::lookup(int dev, block_t blk) noexcept
+  {
+    auto it = index_.find({dev, blk});
+    if (it == index_.end()) return nullptr;
+    return &pages_[it->second];
+  }
+
+  bool Block_cache::contains(int dev, block_t blk) const noexcept
+  {
+    return index_.find({dev, blk}) != index_.end();
+  }
+
+  size_t Block_cache::evict()
+  {
+    // CLOCK: sweep the hand over the pages, giving referenced
+    // pages a second chance, until an unreferenced page is found.
+    // Two rounds clear every reference bit, so after that only dirty
+    // pages failing to write back are left.
+    for (size_t round = 0; round < 2 * pages_.size(); round++)
+    {
+      auto& page = pages_[hand_];
+      const size_t slot = hand_;
+      hand_ = (hand_ + 1) % pages_.size();
+
+      if (page.key.dev < 0) return slot;
+      if (page.referenced) {
+        page.referenced = false;
+        continue;
+      }
+      if (page.dirty)
+      {
+        // write back before the page can be reused
+        auto* writer = writers_.at(page.key.dev);
+        auto buf = construct_buffer(page.data.begin(), page.data.end());
+        if (UNLIKELY(writer->write_sync(page.key.blk, buf))) {
+          // keep it, the next flush will try again
+          BC_PRINT("Block_cache: writeback failed dev=%d blk=%lu\n",
+                   page.key.dev, page.key.blk);
+          stat_write_errors_++;
+          continue;
+        }
+        stat_writebacks_++;
+      }
+      BC_PRINT("Block_cache: evict dev=%d blk=%lu\n", page.key.dev, page.key.blk);
+      drop(page);
+      stat_evictions_++;
+      return slot;
+    }
+    return NO_SLOT;
+  }
+
+  void Block_cache::drop(Page& page)
+  {
+    if (page.dirty) {
+      dirty_[page.key.dev]--;
+      page.dirty = false;
+    }
+    index_.erase(page.key);
+    page.key = {-1, 0};
+    page.referenced = false;
+  }
+
+  Block_cache::Page* Block_cache::insert(int dev, block_t blk, const uint8_t* data, size_t len)
+  {
+    Page* page = lookup(dev, blk);
+    if (page == nullptr)
+    {
+      size_t slot;
+      if (pages_.size() < capacity_) {
+        slot = pages_.size();
+        pages_.emplace_back();
+      }
+      else {
+        slot = evict();
+        if (UNLIKELY(slot == NO_SLOT)) return nullptr;
+      }
+      page = &pages_[slot];
+      page->key = {dev, blk};
+      index_.emplace(page->key, slot);
+    }
+    page->data.assign(data, data + len);
+    // newly inserted pages have to earn their second chance
+    page->referenced = false;
+    return page;
+  }
+
+  Block_cache::Plan Block_cache::plan(hw::Block_device& dev, block_t blk, size_t count)
+  {
+    Plan p;
+    // large reads would only thrash the cache
+    if (count > capacity_ / 4) {
+      p.bypass = true;
+      streams_[dev.id()] = { blk + count, 0 };
+      return p;
+    }
+
+    const size_t bsize = dev.block_size();
+    p.result = construct_buffer(count * bsize);
+    p.cached.assign(count, false);
+    size_t missing = 0;
+    bool   found_miss = false;
+    for (size_t i = 0; i < count; i++)
+    {
+      auto* page = lookup(dev.id(), blk + i);
+      if (page != nullptr && page->data.size() == bsize) {
+        page->referenced = true;
+        std::memcpy(p.result->data() + i * bsize, page->data.data(), bsize);
+        p.cached[i] = true;
+        continue;
+      }
+      if (not found_miss) {
+        p.first_miss = i;
+        found_miss = true;
+      }
+      p.last_miss = i;
+      missing++;
+    }
+    stat_hits_   += count - missing;
+    stat_misses_ += missing;
+
+    // grow the read-ahead window on sequential access, reset otherwise
+    auto& stream = streams_[dev.id()];
+    if (blk == stream.next && max_readahead_ > 0)
+      stream.window = std::min(std::max(stream.window * 2, INITIAL_READAHEAD),
+                               max_readahead_);
+    else
+      stream.window = 0;
+    stream.next = blk + count;
+
+    if (missing == 0) return p;
+
+    size_t fill_end = p.last_miss + 1;
+    if (stream.window > 0) fill_end = count + stream.window;
+    // never read past the end of the device
+    const block_t dev_size = dev.size();
+    if (blk + fill_end > dev_size)
+      fill_end = (dev_size > blk) ? dev_size - blk : count;
+    fill_end = std::max(fill_end, p.last_miss + 1);
+
+    p.fill_count = fill_end - p.first_miss;
+    if (fill_end > count) stat_readahead_ += fill_end - count;
+    BC_PRINT("Block_cache: dev=%d blk=%lu cnt=%zu fill=%zu+%zu\n",
+             dev.id(), blk, count, p.first_miss, p.fill_count);
+    return p;
+  }
+
+  Block_cache::buffer_t Block_cache::complete(hw::Block_device& dev,
+                  block_t blk, size_t count, const Plan& p, const buffer_t& fill)
+  {
+    const size_t bsize = dev.block_size();
+    const size_t fill_blocks = (fill) ? fill->size() / bsize : 0;
+
+    // complete the result with the (optional) device data, before
+    // inserting, so that the fill cannot evict pages we need
+    auto& result = p.result;
+    for (size_t i = 0; i < count; i++)
+    {
+      auto* dst = result->data() + i * bsize;
+      // cached pages win, as they may have been written since planning
+      auto* page = lookup(dev.id(), blk + i);
+      if (page != nullptr && page->data.size() == bsize) {
+        std::memcpy(dst, page->data.data(), bsize);
+        continue;
+      }
+      // cached when planning, but evicted (and written back) since
+      if (p.cached[i]) continue;
+      if (UNLIKELY(i < p.first_miss || i - p.first_miss >= fill_blocks))
+        return nullptr;
+      std::memcpy(dst, fill->data() + (i - p.first_miss) * bsize, bsize);
+    }
+
+    // not cached when every page is dirty and stuck
+    for (size_t i = 0; i < fill_blocks; i++) {
+      if (lookup(dev.id(), blk + p.first_miss + i)) continue;
+      if (insert(dev.id(), blk + p.first_miss + i, fill->data() + i * bsize, bsize) == nullptr)
+        break;
+    }
+
+    return result;
+  }
+
+  void Block_cache::read(hw::Block_device& dev, block_t blk, size_t count, on_read_func reader)
+  {
+    // memory-backed devices need no caching
+    auto view = dev.read_view(blk, count);
+    if (!view.empty() && dirty(dev.id()) == 0) {
+      reader(construct_buffer(view.begin(), view.end()));
+      return;
+    }
+    const Plan p = plan(dev, blk, count);
+    if (p.bypass)
+    {
+      if (dirty(dev.id()) == 0) {
+        dev.read(blk, count, std::move(reader));
+        return;
+      }
+      dev.read(blk, count,
+        on_read_func::make_packed(
+        [this, &dev, blk, count, reader] (buffer_t data)
+        {
+          if (data != nullptr) overlay_dirty(dev.id(), blk, count, data);
+          reader(std::move(data));
+        })
+      );
+      return;
+    }
+    if (p.fill_count == 0) {
+      reader(complete(dev, blk, count, p, nullptr));
+      return;
+    }
+
+    dev.read(
+      blk + p.first_miss,
+      p.fill_count,
+      on_read_func::make_packed(
+      [this, &dev, blk, count, p, reader] (buffer_t data)
+      {
+        if (UNLIKELY(data == nullptr)) {
+          reader(nullptr);
+          return;
+        }
+        reader(complete(dev, blk, count, p, data));
+      })
+    );
+  }
+
+  Block_cache::buffer_t Block_cache::read_sync(hw::Block_device& dev, block_t blk, size_t count)
+  {
+    // memory-backed devices need no caching
+    auto view = dev.read_view(blk, count);
+    if (!view.empty() && dirty(dev.id()) == 0)
+      return construct_buffer(view.begin(), view.end());
+
+    const Plan p = plan(dev, blk, count);
+    if (p.bypass) {
+      auto data = dev.read_sync(blk, count);
+      if (data != nullptr) overlay_dirty(dev.id(), blk, count, data);
+      return data;
+    }
+
+    buffer_t fill = nullptr;
+    if (p.fill_count > 0) {
+      fill = dev.read_sync(blk + p.first_miss, p.fill_count);
+      if (UNLIKELY(fill == nullptr)) return nullptr;
+    }
+    return complete(dev, blk, count, p, fill);
+  }
+
+  void Block_cache::prefetch(hw::Block_device& dev, block_t blk, size_t count)
+  {
+    // prefetching in chunks keeps each chunk below the bypass limit
+    const size_t chunk = std::max(capacity_ / 4, (size_t) 1);
+    for (size_t i = 0; i < count; i += chunk)
+    {
+      const size_t n = std::min(chunk, count - i);
+      read(dev, blk + i, n, on_read_func{[] (buffer_t) {}});
+    }
+  }
+
+  void Block_cache::overlay_dirty(int dev, block_t blk, size_t count, buffer_t& data)
+  {
+    if (dirty(dev) == 0) return;
+    for (size_t i = 0; i < count; i++)
+    {
+      auto* page = lookup(dev, blk + i);
+      if (page == nullptr || !page->dirty) continue;
+      const size_t bsize = page->data.size();
+      if ((i + 1) * bsize > data->size()) break;
+      std::memcpy(data->data() + i * bsize, page->data.data(), bsize);
+    }
+  }
+
+  bool Block_cache::write(hw::Writable_Block_device& dev, block_t blk,
+                          const uint8_t* data, size_t count)
+  {
+    const size_t bsize = dev.block_size();
+    writers_[dev.id()] = &dev;
+    bool error = false;
+    for (size_t i = 0; i < count; i++)
+    {
+      auto* page = insert(dev.id(), blk + i, data + i * bsize, bsize);
+      if (UNLIKELY(page == nullptr)) {
+        // every page is dirty and stuck, write through instead
+        auto buf = construct_buffer(data + i * bsize, data + (i + 1) * bsize);
+        if (dev.write_sync(blk + i, buf)) {
+          stat_write_errors_++;
+          error = true;
+        }
+        continue;
+      }
+      page->referenced = true;
+      page->version++;
+      if (not page->dirty) {
+        page->dirty = true;
+        dirty_[dev.id()]++;
+      }
+    }
+    return error;
+  }
+
+  size_t Block_cache::dirty(int dev) const noexcept
+  {
+    auto it = dirty_.find(dev);
+    return (it != dirty_.end()) ? it->second : 0;
+  }
+
+  std::vector<Block_cache::Run> Block_cache::dirty_runs(int dev)
+  {
+    std::vector<Page*> dirty_pages;
+    for (auto& page : pages_)
+      if (page.dirty && page.key.dev == dev) dirty_pages.push_back(&page);
+
+    std::sort(dirty_pages.begin(), dirty_pages.end(),
+      [] (const Page* a, const Page* b) { return a->key.blk < b->key.blk; });
+
+    // merge adjacent blocks into runs
+    std::vector<Run> runs;
+    for (auto* page : dirty_pages)
+    {
+      if (runs.empty() ||
+          runs.back().blk + runs.back().versions.size() != page->key.blk)
+      {
+        runs.push_back({page->key.blk, construct_buffer(), {}});
+      }
+      auto& buf = runs.back().data;
+      buf->insert(buf->end(), page->data.begin(), page->data.end());
+      runs.back().versions.push_back(page->version);
+    }
+    return runs;
+  }
+
+  void Block_cache::written(int dev, const Run& run)
+  {
+    for (size_t i = 0; i < run.versions.size(); i++)
+    {
+      auto* page = lookup(dev, run.blk + i);
+      // evicted (and written back), or written to again since
+      if (page == nullptr || !page->dirty || page->version != run.versions[i])
+        continue;
+      page->dirty = false;
+      dirty_[dev]--;
+    }
+    stat_writebacks_ += run.versions.size();
+  }
+
+  void Block_cache::flush(int dev, on_flush_func on_flush)
+  {
+    auto it = writers_.find(dev);
+    if (it == writers_.end() || dirty(dev) == 0) {
+      on_flush(false);
+      return;
+    }
+    auto* writer = it->second;
+
+    struct flush_state_t {
+      int              dev;
+      std::vector<Run> runs;
+      size_t           remaining;
+      bool             error;
+      on_flush_func    on_flush;
+    };
+    auto state = std::make_shared<flush_state_t> (
+        flush_state_t{dev, dirty_runs(dev), 0, false, std::move(on_flush)});
+    state->remaining = state->runs.size();
+
+    for (size_t i = 0; i < state->runs.size(); i++)
+    {
+      const auto& run = state->runs[i];
+      BC_PRINT("Block_cache: flush dev=%d blk=%lu bytes=%zu\n",
+               dev, run.blk, run.data->size());
+      writer->write(run.blk, run.data,
+        hw::Block_device::on_write_func{[this, state, i] (bool error) {
+          // failed blocks stay dirty, to be written by the next flush
+          if (error) {
+            state->error = true;
+            stat_write_errors_++;
+          }
+          else {
+            written(state->dev, state->runs[i]);
+          }
+          if (--state->remaining == 0) state->on_flush(state->error);
+        }});
+    }
+  }
+
+  bool Block_cache::flush_sync(int dev)
+  {
+    auto it = writers_.find(dev);
+    if (it == writers_.end() || dirty(dev) == 0) return false;
+
+    bool error = false;
+    for (auto& run : dirty_runs(dev))
+    {
+      if (it->second->write_sync(run.blk, run.data)) {
+        stat_write_errors_++;
+        error = true;
+        continue;
+      }
+      written(dev, run);
+    }
+    return error;
+  }
+
+  bool Block_cache::flush_sync()
+  {
+    bool error = false;
+    for (auto& writer : writers_)
+      error |= flush_sync(writer.first);
+    return error;
+  }
+
+  void Block_cache::set_writeback_interval(Timers::duration_t interval)
+  {
+    if (writeback_timer_ != Timers::UNUSED_ID) {
+      Timers::stop(writeback_timer_);
+      writeback_timer_ = Timers::UNUSED_ID;
+    }
+    if (interval.count() == 0) return;
+
+    writeback_timer_ = Timers::periodic(interval, interval,
+      [this] (Timers::id_t) {
+        // failed writes are counted in write_errors, and their
+        // blocks stay dirty to be retried on the next tick
+        for (auto& writer : writers_)
+          if (dirty(writer.first)) flush(writer.first, [] (bool) {});
+      });
+  }
+
+  void Block_cache::invalidate(int dev, block_t blk, size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      auto* page = lookup(dev, blk + i);
+      if (page != nullptr) drop(*page);
+    }
+  }
+
+  void Block_cache::invalidate(int dev)
+  {
+    for (auto& page : pages_)
+    {
+      if (page.key.dev != dev) continue;
+      drop(page);
+    }
+    streams_.erase(dev);
+    writers_.erase(dev);
+    dirty_.erase(dev);
+  }
+
+  void Block_cache::clear()
+  {
+    for (auto& page : pages_) {
+      page.key = {-1, 0};
+      page.referenced = false;
+      page.dirty = false;
+    }
+    index_.clear();
+    streams_.clear();
+    dirty_.clear();
+  }
+
+} //< namespace fs
@@ -0,0 +1,109 @@
+#include <fs/dentry_cache.hpp>
+#include <algorithm>
+#include <statman>
+
+namespace fs {
+
+  Dentry_cache& Dentry_cache::get()
+  {
+    static Dentry_cache cache;
+    return cache;
+  }
+
+  Dentry_cache::Dentry_cache(size_t capacity, const std::string& name)
+    : capacity_ { std::max(capacity, (size_t) 1) },
+      stat_hits_( Statman::get().create(
+               Stat::UINT64, name + ".hits").get_uint64() ),
+      stat_misses_( Statman::get().create(
+               Stat::UINT64, name + ".misses").get_uint64() ),
+      stat_negative_( Statman::get().create(
+               Stat::UINT64, name + ".negative").get_uint64() )
+  {
+    paths_.reserve(capacity_);
+    names_.reserve(capacity_);
+  }
+
+  template <typename Map, typename Key>
+  const Dirent* Dentry_cache::find(Map& map, const Key& key)
+  {
+    auto it = map.find(key);
+    if (it == map.end()) {
+      stat_misses_++;
+      return nullptr;
+    }
+    stat_hits_++;
+    if (not it->second.dirent.is_valid()) stat_negative_++;
+    return &it->second.dirent;
+  }
+
+  template <typename Map, typename Key>
+  void Dentry_cache::store(Map& map, Key&& key, int dev, const Dirent& ent)
+  {
+    auto it = map.find(key);
+    if (it != map.end()) {
+      it->second = Entry{dev, ent};
+      return;
+    }
+    // make room by dropping an arbitrary entry
+    if (map.size() >= capacity_)
+      map.erase(map.begin());
+    map.emplace(std::forward<Key>(key), Entry{dev, ent});
+  }
+
+  const Dirent* Dentry_cache::lookup(int ns, const std::string& path)
+  {
+    return find(paths_, Path_key{ns, path});
+  }
+
+  void Dentry_cache::insert(int ns, const std::string& path, const Dirent& ent)
+  {
+    const int dev = (ns == VFS_NS) ? ent.device_id() : ns;
+    store(paths_, Path_key{ns, path}, dev, ent);
+  }
+
+  const Dirent* Dentry_cache::lookup(int dev, uint64_t dir, const std::string& name)
+  {
+    return find(names_, Name_key{dev, dir, name});
+  }
+
+  void Dentry_cache::insert(int dev, uint64_t dir, const std::string& name, const Dirent& ent)
+  {
+    store(names_, Name_key{dev, dir, name}, dev, ent);
+  }
+
+  void Dentry_cache::invalidate(int dev)
+  {
+    for (auto it = paths_.begin(); it != paths_.end(); )
+    {
+      if (it->second.dev == dev || not it->second.dirent.is_valid())
+        it = paths_.erase(it);
+      else
+        ++it;
+    }
+    for (auto it = names_.begin(); it != names_.end(); )
+    {
+      if (it->second.dev == dev)
+        it = names_.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  void Dentry_cache::invalidate_paths(int ns)
+  {
+    for (auto it = paths_.begin(); it != paths_.end(); )
+    {
+      if (it->first.ns == ns)
+        it = paths_.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  void Dentry_cache::clear()
+  {
+    paths_.clear();
+    names_.clear();
+  }
+
+} //< namespace fs
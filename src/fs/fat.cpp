@@ -24,7 +24,10 @@ inline std::string trim_right_copy(
 namespace fs
 {
   FAT::FAT(hw::Block_device& dev)
-    : device(dev) {
+    : device(dev),
+      writer(dynamic_cast<hw::Writable_Block_device*>(&dev)),
+      cache(Block_cache::get()),
+      dcache(Dentry_cache::get()) {
     //
   }
 
@@ -83,6 +86,8 @@ namespace fs
 
     // number of reserved sectors is needed constantly
     this->reserved = bpb->reserved_sectors;
+    // every copy of the FAT is updated on writes
+    this->num_fats = bpb->fa_tables;
     FS_PRINT("Reserved sectors: %u\n", this->reserved);
 
     // number of sectors per cluster is important for calculating entry offsets
@@ -127,10 +132,12 @@ namespace fs
   {
     this->lba_base = base;
     this->lba_size = size;
+    // anything cached for this device belongs to a previous mount
+    dcache.invalidate(device.id());
 
     // read Partition block
-    device.read(
-      base,
+    cache.read(
+      device, base, 1,
       hw::Block_device::on_read_func::make_packed(
       [this, on_init] (buffer_t data)
       {
@@ -172,7 +179,8 @@ namespace fs
     );
   }
 
-  bool FAT::int_dirent(uint32_t sector, const void* data, dirvector& dirents) const
+  bool FAT::int_dirent(uint32_t sector, const void* data, dirvector& dirents,
+                       std::vector<int>* slots) const
   {
     auto* root = (cl_dir*) data;
     bool  found_last = false;
@@ -237,6 +245,7 @@ namespace fs
             // to the short version for the stats and cluster
             auto* D = &root[i];
             std::string dirname(final_name, final_count);
+            if (slots) slots->push_back(i);
 
             dirents.emplace_back(
                 this,
@@ -255,6 +264,7 @@ namespace fs
 
           std::string dirname((char*) D->shortname, 11);
           dirname = trim_right_copy(dirname);
+          if (slots) slots->push_back(i);
 
           dirents.emplace_back(
               this,
@@ -272,4 +282,60 @@ namespace fs
     return found_last;
   }
 
+  uint32_t FAT::next_dir_sector(uint32_t sector) const
+  {
+    // FAT12 directories are assumed to be contiguous
+    if (fat_type == T_FAT12) return sector + 1;
+
+    const uint32_t data_start = lba_base + data_index;
+    // the FAT16 root directory has a fixed size region of its own
+    if (sector < data_start)
+      return (sector + 1 < data_start) ? sector + 1 : 0;
+
+    const uint32_t cl = (sector - data_start) / sectors_per_cluster + 2;
+    if (sector + 1 < data_sector(cl) + sectors_per_cluster)
+      return sector + 1;
+    // continue in the next cluster of the directory
+    const uint32_t next = fat_entry(cl);
+    if (cl_is_end(next)) return 0;
+    return data_sector(next);
+  }
+
+  std::vector<FAT::extent_t>
+  FAT::file_extents(const Dirent& ent, uint32_t sector, uint32_t nsect) const
+  {
+    std::vector<extent_t> extents;
+    if (nsect == 0) return extents;
+    // FAT12 files are assumed to be contiguous
+    if (fat_type == T_FAT12) {
+      extents.push_back({ this->cl_to_sector(ent.block()) + sector, nsect });
+      return extents;
+    }
+
+    uint32_t cl = ent.block();
+    // skip ahead to the cluster holding @sector
+    for (uint32_t i = 0; i < sector / sectors_per_cluster; i++) {
+      cl = fat_entry(cl);
+      if (cl_is_end(cl)) return extents;
+    }
+    uint32_t ofs = sector % sectors_per_cluster;
+
+    while (nsect > 0)
+    {
+      const uint32_t lba   = data_sector(cl) + ofs;
+      const uint32_t count = std::min(nsect, (uint32_t) sectors_per_cluster - ofs);
+      // merge physically adjacent clusters into one run
+      if (!extents.empty() && extents.back().lba + extents.back().count == lba)
+        extents.back().count += count;
+      else
+        extents.push_back({ lba, count });
+      nsect -= count;
+      ofs = 0;
+      if (nsect == 0) break;
+      cl = fat_entry(cl);
+      if (cl_is_end(cl)) break;
+    }
+    return extents;
+  }
+
 }
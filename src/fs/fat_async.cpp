@@ -31,8 +31,8 @@ namespace fs
     {
       FS_PRINT("int_ls: sec=%u\n", sector);
       auto next = weak_next.lock();
-      device.read(
-        sector,
+      cache.read(
+        device, sector, 1,
         hw::Block_device::on_read_func::make_packed(
         [this, sector, callback, dirents, next] (buffer_t data)
         {
@@ -44,12 +44,14 @@ namespace fs
 
           // parse entries in sector
           bool done = int_dirent(sector, data->data(), *dirents);
-          if (done)
+          // follow the directory into its next sector, if any
+          uint32_t next_sector = (done) ? 0 : next_dir_sector(sector);
+          if (next_sector == 0)
             // execute callback
             callback(no_error, dirents);
           else
             // go to next sector
-            (*next)(sector+1);
+            (*next)(next_sector);
 
         })
       ); // read root dir
@@ -167,6 +169,13 @@ namespace fs
       callback({ error_t::E_IO, "Zero read length" }, nullptr);
       return;
     }
+    // memory-backed devices are copied from exactly once
+    auto view = read_view(ent, pos, n);
+    if (!view.empty()) {
+      callback(no_error, construct_buffer(view.begin(), view.end()));
+      return;
+    }
+
     // bounds check the read position and length
     uint32_t stapos = std::min(ent.size(), pos);
     uint32_t endpos = std::min(ent.size(), pos + n);
@@ -177,14 +186,37 @@ namespace fs
     uint32_t nsect = roundup(endpos, sector_size) / sector_size - sector;
     uint32_t internal_ofs = stapos % device.block_size();
 
+    auto extents = file_extents(ent, sector, nsect);
+    if (UNLIKELY(extents.empty())) {
+      callback({ error_t::E_IO, "Unable to read file" }, nullptr);
+      return;
+    }
+    // fragmented files are read one contiguous run at a time, in parallel
+    if (extents.size() > 1) {
+      read_extents(std::move(extents), nsect,
+        on_read_func::make_packed(
+        [n, callback, internal_ofs] (error_t err, buffer_t data)
+        {
+          if (err) {
+            callback(err, nullptr);
+            return;
+          }
+          callback(no_error, construct_buffer(data->begin() + internal_ofs,
+                                              data->begin() + internal_ofs + n));
+        }));
+      return;
+    }
+
     // cluster -> sector + position
-    device.read(
-      this->cl_to_sector(ent.block()) + sector,
-      nsect,
+    const size_t len = nsect * sector_size;
+    cache.read(
+      device,
+      extents[0].lba,
+      extents[0].count,
       hw::Block_device::on_read_func::make_packed(
-      [n, callback, internal_ofs] (buffer_t data)
+      [n, len, callback, internal_ofs] (buffer_t data)
       {
-        if (!data) {
+        if (!data || data->size() < len) {
           // general I/O error occurred
           callback({ error_t::E_IO, "Unable to read file" }, nullptr);
           return;
@@ -206,6 +238,42 @@ namespace fs
     );
   }
 
+  void FAT::read_extents(std::vector<extent_t> extents, uint32_t nsect, on_read_func callback) const
+  {
+    struct read_state_t {
+      buffer_t     data;
+      size_t       remaining;
+      bool         error;
+      on_read_func callback;
+    };
+    auto state = std::make_shared<read_state_t> (
+        read_state_t{construct_buffer(nsect * sector_size), extents.size(), false, callback});
+
+    size_t ofs = 0;
+    for (auto& ext : extents)
+    {
+      const size_t len = ext.count * sector_size;
+      cache.read(
+        device, ext.lba, ext.count,
+        hw::Block_device::on_read_func::make_packed(
+        [state, ofs, len] (buffer_t data)
+        {
+          if (!data || data->size() < len)
+            state->error = true;
+          else
+            std::memcpy(state->data->data() + ofs, data->data(), len);
+
+          if (--state->remaining > 0) return;
+          if (state->error)
+            state->callback({ error_t::E_IO, "Unable to read file" }, nullptr);
+          else
+            state->callback(no_error, state->data);
+        })
+      );
+      ofs += len;
+    }
+  }
+
   void FAT::stat(Path_ptr path, on_stat_func func, const Dirent* const start) const
   {
     // manual lookup
@@ -215,6 +283,16 @@ namespace fs
       return;
     }
 
+    // answer straight from the dentry cache when possible
+    Dirent cached(this, INVALID_ENTITY);
+    if (cached_stat(*path, start, cached)) {
+      if (cached.is_valid())
+        func(no_error, cached);
+      else
+        func({ error_t::E_NOENT, path->back() }, cached);
+      return;
+    }
+
     FS_PRINT("stat: %s\n", path->back().c_str());
     // extract file we are looking for
     std::string filename = path->back();
@@ -250,10 +328,12 @@ namespace fs
   void FAT::cstat(const std::string& strpath, on_stat_func func)
   {
     // cache lookup
-    auto it = stat_cache.find(strpath);
-    if (it != stat_cache.end()) {
+    if (const auto* ent = dcache.lookup(device.id(), strpath)) {
       FS_PRINT("used cached stat for %s\n", strpath.c_str());
-      func(no_error, it->second);
+      if (ent->is_valid())
+        func(no_error, *ent);
+      else
+        func({ error_t::E_NOENT, strpath }, *ent);
       return;
     }
 
@@ -262,7 +342,9 @@ namespace fs
       fs::on_stat_func::make_packed(
       [this, strpath, func] (error_t error, const Dirent& ent)
       {
-        stat_cache.emplace(strpath, ent);
+        // only cache answers, not I/O errors
+        if (!error || error.code() == error_t::E_NOENT)
+          dcache.insert(device.id(), strpath, ent);
         func(error, ent);
       })
     );
@@ -17,8 +17,35 @@ inline size_t roundup(size_t n, size_t multiple)
 
 namespace fs
 {
+  view_t FAT::read_view(const Dirent& ent, uint64_t pos, uint64_t n) const
+  {
+    // bounds check the read position and length
+    auto stapos = std::min(ent.size(), pos);
+    auto endpos = std::min(ent.size(), pos + n);
+    if (UNLIKELY(stapos == endpos)) return {};
+    // blocks waiting to be written back are newer than the device
+    if (cache.dirty(device.id())) return {};
+    // cluster -> sector + position
+    auto sector = stapos / this->sector_size;
+    auto nsect = roundup(endpos, sector_size) / sector_size - sector;
+
+    // only contiguous ranges can be viewed
+    auto extents = file_extents(ent, sector, nsect);
+    if (extents.size() != 1 || extents[0].count != nsect) return {};
+    auto view = device.read_view(extents[0].lba, nsect);
+    if (view.empty()) return {};
+    // trim the sector-aligned view down to the requested range
+    auto internal_ofs = stapos % device.block_size();
+    return view.subspan(internal_ofs, endpos - stapos);
+  }
+
   Buffer FAT::read(const Dirent& ent, uint64_t pos, uint64_t n) const
   {
+    // memory-backed devices are copied from exactly once
+    auto view = read_view(ent, pos, n);
+    if (!view.empty())
+      return Buffer(no_error, construct_buffer(view.begin(), view.end()));
+
     // bounds check the read position and length
     auto stapos = std::min(ent.size(), pos);
     auto endpos = std::min(ent.size(), pos + n);
@@ -28,8 +55,23 @@ namespace fs
     auto sector = stapos / this->sector_size;
     auto nsect = roundup(endpos, sector_size) / sector_size - sector;
 
-    // read @nsect sectors ahead
-    buffer_t data = device.read_sync(this->cl_to_sector(ent.block()) + sector, nsect);
+    // read @nsect sectors ahead, one device read per contiguous run
+    buffer_t data;
+    auto extents = file_extents(ent, sector, nsect);
+    if (extents.size() == 1) {
+      data = cache.read_sync(device, extents[0].lba, extents[0].count);
+    }
+    else {
+      data = construct_buffer();
+      data->reserve(nsect * sector_size);
+      for (auto& ext : extents) {
+        auto part = cache.read_sync(device, ext.lba, ext.count);
+        if (UNLIKELY(!part)) { data = nullptr; break; }
+        data->insert(data->end(), part->begin(), part->end());
+      }
+    }
+    if (UNLIKELY(!data || data->size() < nsect * sector_size))
+      return Buffer({ error_t::E_IO, "Unable to read file" }, nullptr);
     // where to start copying from the device result
     auto internal_ofs = stapos % device.block_size();
     // when the offset is non-zero we aren't on a sector boundary
@@ -49,14 +91,14 @@ namespace fs
     bool done = false;
     do {
       // read sector sync
-      buffer_t data = device.read_sync(sector);
+      buffer_t data = cache.read_sync(device, sector);
       if (UNLIKELY(!data))
           return { error_t::E_IO, "Unable to read directory" };
       // parse directory into @ents
       done = int_dirent(sector, data->data(), ents);
       // go to next sector until done
-      sector++;
-    } while (!done);
+      sector = next_dir_sector(sector);
+    } while (!done && sector != 0);
     return no_error;
   }
 
@@ -130,6 +172,49 @@ namespace fs
     return { err, ents };
   }
 
+  Dirent FAT::dir_lookup(uint32_t cluster, const std::string& name) const
+  {
+    // directories are keyed by their first sector, as the root has two clusters
+    const uint32_t S = this->cl_to_sector(cluster);
+    if (const auto* ent = dcache.lookup(device.id(), S, name))
+      return *ent;
+
+    dirvector ents;
+    if (UNLIKELY(int_ls(S, ents)))
+      return Dirent(this, INVALID_ENTITY, name);
+
+    // remember the whole directory, siblings are likely to be looked up next
+    Dirent found(this, INVALID_ENTITY, name);
+    for (auto& e : ents) {
+      dcache.insert(device.id(), S, e.name(), e);
+      if (e.name() == name) found = e;
+    }
+    if (not found.is_valid())
+      dcache.insert(device.id(), S, name, found);
+    return found;
+  }
+
+  bool FAT::cached_stat(Path path, const Dirent* const start, Dirent& result) const
+  {
+    uint32_t cluster = start ? start->block() : 0;
+    while (!path.empty())
+    {
+      const auto* ent = dcache.lookup(device.id(), cl_to_sector(cluster), path.front());
+      if (ent == nullptr) return false;
+      path.pop_front();
+      if (!ent->is_valid() || path.empty()) {
+        result = *ent;
+        return true;
+      }
+      if (!ent->is_dir()) {
+        result = Dirent(this, INVALID_ENTITY, ent->name());
+        return true;
+      }
+      cluster = ent->block();
+    }
+    return false;
+  }
+
   Dirent FAT::stat(Path path, const Dirent* const start) const
   {
     if (UNLIKELY(path.empty())) {
@@ -137,24 +222,18 @@ namespace fs
     }
 
     FS_PRINT("stat_sync: %s\n", path.back().c_str());
-    // extract file we are looking for
-    const std::string filename = path.back();
-    path.pop_back();
-
-    // result directory entries are put into @dirents
-    dirvector dirents;
-
-    auto err = traverse(path, dirents, start);
-    if (UNLIKELY(err))
-      return Dirent(this, INVALID_ENTITY); // for now
-
-    // find the matching filename in directory
-    for (auto& e : dirents)
-    if (UNLIKELY(e.name() == filename)) {
-      // return this directory entry
-      return e;
+    // walk the path one directory at a time, through the dentry cache
+    uint32_t cluster = start ? start->block() : 0;
+    while (true)
+    {
+      auto ent = dir_lookup(cluster, path.front());
+      path.pop_front();
+      if (!ent.is_valid() || path.empty())
+        return ent;
+      // only directories can be walked into
+      if (!ent.is_dir())
+        return Dirent(this, INVALID_ENTITY);
+      cluster = ent.block();
     }
-    // entry not found
-    return Dirent(this, INVALID_ENTITY);
   }
 }
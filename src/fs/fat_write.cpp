@@ -0,0 +1,477 @@
+#include <fs/fat.hpp>
+#include <fs/fat_internal.hpp>
+
+#include <fs/path.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <common>
+
+//#define FS_PRINT(fmt, ...)  printf(fmt, ##__VA_ARGS__)
+#define FS_PRINT(fmt, ...)  /** **/
+
+namespace fs
+{
+  static const error_t err_readonly { error_t::E_ROFS, "FAT12 or read-only device" };
+
+  uint32_t FAT::fat_entry(uint32_t cl) const
+  {
+    auto data = cache.read_sync(device, lba_base + cl_to_entry_sector(cl));
+    // unreadable entries end the chain
+    if (UNLIKELY(!data)) return cl_eoc();
+
+    const auto* ptr = data->data() + cl_to_entry_offset(cl);
+    if (fat_type == T_FAT16)
+      return *(uint16_t*) ptr;
+    return *(uint32_t*) ptr & 0x0FFFFFFF;
+  }
+
+  void FAT::set_fat_entry(uint32_t cl, uint32_t val) const
+  {
+    for (int i = 0; i < num_fats; i++)
+    {
+      const uint32_t sector = lba_base + cl_to_entry_sector(cl) + i * sectors_per_fat;
+      auto data = cache.read_sync(device, sector);
+      if (UNLIKELY(!data)) continue;
+
+      auto* ptr = data->data() + cl_to_entry_offset(cl);
+      if (fat_type == T_FAT16) {
+        *(uint16_t*) ptr = val;
+      }
+      else {
+        // the top 4 bits are reserved and must be preserved
+        auto* entry = (uint32_t*) ptr;
+        *entry = (*entry & 0xF0000000) | (val & 0x0FFFFFFF);
+      }
+      cache.write(*writer, sector, data->data(), 1);
+    }
+  }
+
+  std::vector<uint32_t> FAT::chain(uint32_t first) const
+  {
+    std::vector<uint32_t> result;
+    uint32_t cl = first;
+    // bounded by the number of clusters, in case of loops
+    while (!cl_is_end(cl) && result.size() <= clusters) {
+      result.push_back(cl);
+      cl = fat_entry(cl);
+    }
+    return result;
+  }
+
+  uint32_t FAT::alloc_cluster(uint32_t prev) const
+  {
+    // cluster 2 is never handed out, as cl_to_sector() maps it to the root
+    const uint32_t first = 3;
+    const uint32_t last  = clusters + 1;
+    const uint32_t per_sector = sector_size / ((fat_type == T_FAT16) ? 2 : 4);
+    if (alloc_hint < first || alloc_hint > last) alloc_hint = first;
+
+    uint32_t cl = alloc_hint;
+    for (uint32_t scanned = 0; scanned <= last - first; )
+    {
+      // scan one FAT sector at a time
+      auto data = cache.read_sync(device, lba_base + cl_to_entry_sector(cl));
+      if (UNLIKELY(!data)) return 0;
+
+      const uint32_t end = std::min(last + 1, (cl / per_sector + 1) * per_sector);
+      for (; cl < end; cl++, scanned++)
+      {
+        const auto* ptr = data->data() + cl_to_entry_offset(cl);
+        const uint32_t val = (fat_type == T_FAT16)
+            ? *(uint16_t*) ptr : *(uint32_t*) ptr & 0x0FFFFFFF;
+        if (val != 0) continue;
+
+        FS_PRINT("alloc_cluster: %u (prev=%u)\n", cl, prev);
+        set_fat_entry(cl, cl_eoc());
+        if (prev) set_fat_entry(prev, cl);
+        alloc_hint = cl + 1;
+        return cl;
+      }
+      if (cl > last) cl = first;
+    }
+    return 0;
+  }
+
+  void FAT::free_chain(uint32_t first) const
+  {
+    for (auto cl : chain(first)) {
+      set_fat_entry(cl, 0);
+      if (cl < alloc_hint) alloc_hint = cl;
+    }
+  }
+
+  void FAT::write_sector(uint32_t sector, const uint8_t* data) const
+  {
+    cache.write(*writer, sector, data, 1);
+  }
+
+  error_t FAT::locate(const Dirent& ent, entry_ref_t& ref) const
+  {
+    // the parent block is the sector holding the directory entry
+    ref.sector = ent.parent();
+    ref.data = cache.read_sync(device, ref.sector);
+    if (UNLIKELY(!ref.data))
+      return { error_t::E_IO, "Unable to read directory" };
+
+    dirvector ents;
+    std::vector<int> slots;
+    int_dirent(ref.sector, ref.data->data(), ents, &slots);
+    for (size_t i = 0; i < ents.size(); i++)
+    if (ents[i].name() == ent.name()) {
+      ref.slot = slots.at(i);
+      return no_error;
+    }
+    return { error_t::E_NOENT, ent.name() };
+  }
+
+  void FAT::write_range(const std::vector<uint32_t>& cls, uint64_t size,
+                        uint64_t pos, const uint8_t* data, uint64_t n) const
+  {
+    const uint32_t spc = sectors_per_cluster;
+    // sectors past the old end of file have nothing worth reading
+    const uint64_t valid_end = ((size + sector_size - 1) / sector_size) * sector_size;
+
+    while (n > 0)
+    {
+      const uint64_t index = pos / sector_size;
+      const uint32_t lba   = data_sector(cls.at(index / spc)) + index % spc;
+      const uint32_t ofs   = pos % sector_size;
+      const uint32_t len   = std::min(n, (uint64_t) sector_size - ofs);
+
+      if (len == sector_size && data != nullptr) {
+        cache.write(*writer, lba, data, 1);
+      }
+      else {
+        // read-modify-write of a partial sector
+        buffer_t sect;
+        if (len < sector_size && index * sector_size < valid_end)
+          sect = cache.read_sync(device, lba);
+        if (!sect) sect = construct_buffer(sector_size, 0);
+
+        if (data) std::memcpy(sect->data() + ofs, data, len);
+        else      std::memset(sect->data() + ofs, 0, len);
+        cache.write(*writer, lba, sect->data(), 1);
+      }
+      pos += len;
+      n   -= len;
+      if (data) data += len;
+    }
+  }
+
+  error_t FAT::write_file(Dirent& ent, uint64_t pos, const uint8_t* data, uint64_t n) const
+  {
+    if (!is_writable()) return err_readonly;
+    if (!ent.is_file()) return { error_t::E_NOTFILE, ent.name() };
+    // FAT file sizes are 32-bit
+    if (pos + n > 0xFFFFFFFF) return { error_t::E_NOSPC, "File too large" };
+
+    entry_ref_t ref;
+    auto err = locate(ent, ref);
+    if (err) return err;
+    auto* D = (cl_dir*) ref.data->data() + ref.slot;
+    const uint64_t size = D->size();
+
+    // the on-disk entry is authoritative for the first cluster
+    const uint32_t first = D->cluster_lo | (D->cluster_hi << 16);
+    auto cls = chain(first);
+
+    const uint64_t cluster_bytes = sector_size * sectors_per_cluster;
+    const uint64_t end = pos + n;
+    bool nospace = false;
+    while (cls.size() * cluster_bytes < end)
+    {
+      auto cl = alloc_cluster(cls.empty() ? 0 : cls.back());
+      if (cl == 0) { nospace = true; break; }
+      cls.push_back(cl);
+    }
+    if (nospace) {
+      // release what was allocated for this write
+      const size_t keep = (size + cluster_bytes - 1) / cluster_bytes;
+      if (cls.size() > keep) {
+        if (keep > 0) set_fat_entry(cls[keep-1], cl_eoc());
+        free_chain(cls[keep]);
+      }
+      return { error_t::E_NOSPC, ent.name() };
+    }
+
+    // zero the gap between the old end of file and @pos
+    if (pos > size)
+      write_range(cls, size, size, nullptr, pos - size);
+    if (n > 0)
+      write_range(cls, size, pos, data, n);
+
+    // update the directory entry
+    const uint32_t new_first = cls.empty() ? 0 : cls.front();
+    const uint64_t new_size  = std::max(size, end);
+    D->cluster_lo = new_first & 0xFFFF;
+    D->cluster_hi = new_first >> 16;
+    D->filesize   = new_size;
+    D->attrib    |= ATTR_ARCHIVE;
+    write_sector(ref.sector, ref.data->data());
+
+    ent.update(D->dir_cluster(root_cluster), new_size);
+    dcache.invalidate(device.id());
+    return no_error;
+  }
+
+  error_t FAT::write(Dirent& ent, uint64_t pos, const void* data, uint64_t n) const
+  {
+    if (n == 0) return no_error;
+    Expects(data != nullptr);
+    return write_file(ent, pos, (const uint8_t*) data, n);
+  }
+
+  error_t FAT::truncate(Dirent& ent, uint64_t new_size) const
+  {
+    if (!is_writable()) return err_readonly;
+    if (!ent.is_file()) return { error_t::E_NOTFILE, ent.name() };
+
+    entry_ref_t ref;
+    auto err = locate(ent, ref);
+    if (err) return err;
+    auto* D = (cl_dir*) ref.data->data() + ref.slot;
+    const uint64_t size = D->size();
+
+    // growing is the same as writing zeroes at the end
+    if (new_size > size)
+      return write_file(ent, size, nullptr, new_size - size);
+    if (new_size == size)
+      return no_error;
+
+    const uint32_t first = D->cluster_lo | (D->cluster_hi << 16);
+    const uint64_t cluster_bytes = sector_size * sectors_per_cluster;
+    const size_t keep = (new_size + cluster_bytes - 1) / cluster_bytes;
+    auto cls = chain(first);
+    if (keep < cls.size()) {
+      if (keep > 0) set_fat_entry(cls[keep-1], cl_eoc());
+      free_chain(cls[keep]);
+    }
+    if (keep == 0) {
+      D->cluster_lo = 0;
+      D->cluster_hi = 0;
+    }
+    D->filesize = new_size;
+    D->attrib  |= ATTR_ARCHIVE;
+    write_sector(ref.sector, ref.data->data());
+
+    ent.update(D->dir_cluster(root_cluster), new_size);
+    dcache.invalidate(device.id());
+    return no_error;
+  }
+
+  // characters not allowed in short names
+  static bool short_name_char(char c)
+  {
+    if (c <= 0x20 || c >= 0x7F) return false;
+    return std::strchr("\"*+,./:;<=>?[\\]|", c) == nullptr;
+  }
+
+  // build a unique 8.3 alias for @name, as in "LONGFI~1TXT"
+  static std::string short_alias(const std::string& name,
+                                 const std::vector<std::string>& taken)
+  {
+    const auto dot = name.rfind('.');
+    std::string base, ext;
+    for (size_t i = 0; i < std::min(dot, name.size()) && base.size() < 6; i++)
+      if (short_name_char(name[i])) base += toupper(name[i]);
+    if (dot != std::string::npos)
+    for (size_t i = dot + 1; i < name.size() && ext.size() < 3; i++)
+      if (short_name_char(name[i])) ext += toupper(name[i]);
+    if (base.empty()) base = "_";
+    ext.resize(3, ' ');
+
+    for (int n = 1; n < 1000000; n++)
+    {
+      auto tail = "~" + std::to_string(n);
+      auto alias = base.substr(0, 8 - tail.size()) + tail;
+      alias.resize(8, ' ');
+      alias += ext;
+      if (std::find(taken.begin(), taken.end(), alias) == taken.end())
+        return alias;
+    }
+    return "";
+  }
+
+  static uint8_t short_checksum(const uint8_t* name)
+  {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++)
+      sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+    return sum;
+  }
+
+  error_t FAT::create(Path path, const Dirent* const start) const
+  {
+    if (!is_writable()) return err_readonly;
+    if (UNLIKELY(path.empty())) return { error_t::E_EXIST, "/" };
+
+    const std::string filename = path.back();
+    path.pop_back();
+    if (filename == "." || filename == "..")
+      return { error_t::E_EXIST, filename };
+
+    // long names must fit in one sector along with the short entry
+    const int long_entries = (filename.size() + 12) / 13;
+    const int needed = long_entries + 1;
+    if (needed > (int) (sector_size / sizeof(cl_dir)))
+      return { error_t::E_NOSPC, "Name too long: " + filename };
+
+    // find the parent directory
+    uint32_t dir_cluster = start ? start->block() : 0;
+    if (!path.empty()) {
+      auto parent = stat(path, start);
+      if (!parent.is_valid()) return { error_t::E_NOENT, path.to_string() };
+      if (!parent.is_dir())   return { error_t::E_NOTDIR, path.to_string() };
+      dir_cluster = parent.block();
+    }
+
+    // look for @needed free entries within one sector,
+    // gathering existing names along the way
+    dirvector ents;
+    std::vector<std::string> taken;
+    const int per_sector = sector_size / sizeof(cl_dir);
+    uint32_t sector = cl_to_sector(dir_cluster);
+    uint32_t last   = sector;
+    uint32_t found_sector = 0;
+    int      found_slot   = 0;
+    while (sector != 0)
+    {
+      auto data = cache.read_sync(device, sector);
+      if (UNLIKELY(!data)) return { error_t::E_IO, "Unable to read directory" };
+
+      const bool at_end = int_dirent(sector, data->data(), ents);
+      auto* dir = (cl_dir*) data->data();
+      int run = 0;
+      for (int i = 0; i < per_sector; i++)
+      {
+        if (dir[i].shortname[0] == 0x0 || dir[i].shortname[0] == 0xE5) {
+          if (++run == needed && found_sector == 0) {
+            found_sector = sector;
+            found_slot   = i - needed + 1;
+          }
+          continue;
+        }
+        run = 0;
+        if (!dir[i].is_longname())
+          taken.emplace_back((char*) dir[i].shortname, 11);
+      }
+      last = sector;
+      if (at_end) break;
+      sector = next_dir_sector(sector);
+    }
+
+    for (auto& e : ents)
+    if (e.name() == filename)
+      return { error_t::E_EXIST, filename };
+
+    buffer_t data;
+    if (found_sector == 0)
+    {
+      // the FAT16 root directory can't grow
+      if (last < lba_base + data_index)
+        return { error_t::E_NOSPC, "Root directory is full" };
+      // extend the directory with a zeroed cluster
+      const uint32_t last_cl = (last - lba_base - data_index) / sectors_per_cluster + 2;
+      const uint32_t cl = alloc_cluster(last_cl);
+      if (cl == 0) return { error_t::E_NOSPC, filename };
+
+      data = construct_buffer(sector_size, 0);
+      for (int i = 0; i < sectors_per_cluster; i++)
+        write_sector(data_sector(cl) + i, data->data());
+      found_sector = data_sector(cl);
+      found_slot   = 0;
+    }
+    else {
+      data = cache.read_sync(device, found_sector);
+      if (UNLIKELY(!data)) return { error_t::E_IO, "Unable to read directory" };
+    }
+
+    const auto alias = short_alias(filename, taken);
+    if (alias.empty()) return { error_t::E_EXIST, filename };
+
+    auto* dir = (cl_dir*) data->data() + found_slot;
+    // short entry goes last
+    auto* D = &dir[long_entries];
+    std::memset(D, 0, sizeof(cl_dir));
+    std::memcpy(D->shortname, alias.data(), 11);
+    D->attrib = ATTR_ARCHIVE;
+    const uint8_t checksum = short_checksum(D->shortname);
+
+    // long entries are stored in reverse order, the highest first
+    for (int idx = 1; idx <= long_entries; idx++)
+    {
+      auto* L = (cl_long*) &dir[long_entries - idx];
+      std::memset(L, 0, sizeof(cl_long));
+      L->index = idx | ((idx == long_entries) ? LAST_LONG_ENTRY : 0);
+      L->attrib = 0x0F;
+      L->checksum = checksum;
+
+      uint16_t chars[13];
+      for (int j = 0; j < 13; j++) {
+        const size_t c = (idx - 1) * 13 + j;
+        if (c < filename.size())       chars[j] = (uint8_t) filename[c];
+        else if (c == filename.size()) chars[j] = 0x0;
+        else                           chars[j] = 0xFFFF;
+      }
+      std::memcpy(L->first,  chars + 0, 10);
+      std::memcpy(L->second, chars + 5, 12);
+      std::memcpy(L->third,  chars + 11, 4);
+    }
+    write_sector(found_sector, data->data());
+
+    FS_PRINT("create: %s as %.11s in sector %u slot %d\n",
+             filename.c_str(), alias.c_str(), found_sector, found_slot);
+    dcache.invalidate(device.id());
+    return no_error;
+  }
+
+  error_t FAT::unlink(Path path, const Dirent* const start) const
+  {
+    if (!is_writable()) return err_readonly;
+
+    auto ent = stat(path, start);
+    if (!ent.is_valid()) return { error_t::E_NOENT, path.to_string() };
+    if (!ent.is_file())  return { error_t::E_NOTFILE, path.to_string() };
+
+    entry_ref_t ref;
+    auto err = locate(ent, ref);
+    if (err) return err;
+
+    auto* dir = (cl_dir*) ref.data->data();
+    auto* D = &dir[ref.slot];
+    const uint32_t first = D->cluster_lo | (D->cluster_hi << 16);
+    // mark the short entry and its long name entries as deleted
+    D->shortname[0] = 0xE5;
+    for (int i = ref.slot - 1; i >= 0 && dir[i].is_longname()
+                               && dir[i].shortname[0] != 0xE5; i--)
+    {
+      const bool last = ((cl_long*) &dir[i])->is_last();
+      dir[i].shortname[0] = 0xE5;
+      if (last) break;
+    }
+    write_sector(ref.sector, ref.data->data());
+
+    if (first >= 2) free_chain(first);
+    dcache.invalidate(device.id());
+    return no_error;
+  }
+
+  void FAT::sync(on_sync_func fn) const
+  {
+    cache.flush(device.id(),
+      Block_cache::on_flush_func::make_packed(
+      [fn] (bool error) {
+        if (error) fn({ error_t::E_IO, "Write back failed" });
+        else       fn(no_error);
+      }));
+  }
+
+  error_t FAT::sync() const
+  {
+    if (cache.flush_sync(device.id()))
+      return { error_t::E_IO, "Write back failed" };
+    return no_error;
+  }
+
+}
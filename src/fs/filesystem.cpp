@@ -9,14 +9,17 @@ namespace fs
   error_t no_error { error_t::NO_ERR, "" };
 
   const std::string& error_t::token() const noexcept {
-    const static std::array<std::string, 6> tok_str
+    const static std::array<std::string, 9> tok_str
     {{
       "No error",
       "General I/O error",
       "Mounting filesystem failed",
       "No such entry",
       "Not a directory",
-      "Not a file"
+      "Not a file",
+      "Entry already exists",
+      "No space left on device",
+      "Read-only filesystem"
     }};
 
     return tok_str[token_];
@@ -52,6 +55,15 @@ namespace fs
       return read(ent, 0, ent.size());
   }
 
+  view_t File_system::read_file_view(const std::string& path) const {
+      auto ent = stat(path);
+
+      if(UNLIKELY(!ent.is_valid() || !ent.is_file()))
+        return {};
+
+      return read_view(ent, 0, ent.size());
+  }
+
   static error_t print_subtree(Dirvec_ptr entries, int depth)
   {
     int indent = depth * 3;
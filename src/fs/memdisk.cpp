@@ -30,6 +30,16 @@ namespace fs {
   }
 
   MemDisk::buffer_t MemDisk::read_sync(block_t blk, size_t cnt)
+  {
+    auto view = read_view(blk, cnt);
+    // Disallow reading memory past disk image
+    if (UNLIKELY(view.empty()))
+      return nullptr;
+
+    return fs::construct_buffer(view.begin(), view.end());
+  }
+
+  MemDisk::view_t MemDisk::read_view(block_t blk, size_t cnt) const noexcept
   {
     stat_read++;
 
@@ -37,10 +47,10 @@ namespace fs {
     auto end_loc = start_loc + cnt * block_size();
 
     // Disallow reading memory past disk image
-    if (UNLIKELY(end_loc > image_end_))
-      return nullptr;
+    if (UNLIKELY(cnt == 0 || start_loc > image_end_ || end_loc > image_end_))
+      return {};
 
-    return fs::construct_buffer(start_loc, end_loc);
+    return { (const uint8_t*) start_loc, (const uint8_t*) end_loc };
   }
 
   MemDisk::block_t MemDisk::size() const noexcept {
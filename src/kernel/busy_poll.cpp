@@ -0,0 +1,97 @@
+
+#include <kernel/busy_poll.hpp>
+#include <hw/nic.hpp>
+#include <algorithm>
+#include <deque>
+#include <statman>
+
+static std::vector<Busy_poll> pollers;
+SMP_RESIZE_EARLY_GCTOR(pollers);
+
+static bool busy_poll_enabled = false;
+
+Busy_poll& Busy_poll::get()
+{
+  return PER_CPU(pollers);
+}
+
+void Busy_poll::enable(bool on) noexcept
+{
+  busy_poll_enabled = on;
+}
+bool Busy_poll::is_enabled() noexcept
+{
+  return busy_poll_enabled;
+}
+
+// registered at driver init, before any CPU starts polling
+static std::deque<Busy_poll::Device_stats> devices;
+
+void Busy_poll::add_device(hw::Nic& nic)
+{
+  const std::string name = nic.device_name();
+  devices.push_back({&nic,
+      Statman::get().create(Stat::UINT64, name + ".busypoll.polls").get_uint64(),
+      Statman::get().create(Stat::UINT64, name + ".busypoll.interrupts").get_uint64(),
+      Statman::get().create(Stat::UINT64, name + ".busypoll.packets").get_uint64()});
+}
+
+Busy_poll::Device_stats* Busy_poll::stats(hw::Nic& nic) noexcept
+{
+  // a handful of devices at most
+  for (auto& dev : devices)
+    if (dev.nic == &nic) return &dev;
+  return nullptr;
+}
+
+bool Busy_poll::schedule(hw::Nic& nic)
+{
+  auto* dev = stats(nic);
+  // devices that were never added are left to their interrupts
+  if (UNLIKELY(dev == nullptr)) return false;
+  dev->interrupts++;
+  irqs_++;
+  if (not busy_poll_enabled) return false;
+
+  auto it = std::find_if(list_.begin(), list_.end(),
+      [&nic] (const Entry& e) { return e.nic == &nic; });
+  if (it == list_.end()) {
+    nic.set_rx_interrupts(false);
+    list_.push_back({&nic, dev, 0});
+  }
+  return true;
+}
+
+void Busy_poll::poll()
+{
+  for (auto it = list_.begin(); it != list_.end(); )
+  {
+    auto& entry = *it;
+    const int n = entry.nic->poll_rx(budget_);
+    entry.stats->polls++;
+    entry.stats->packets += n;
+    polls_++;
+    packets_ += n;
+
+    if (n > 0 || ++entry.idle < IDLE_ROUNDS) {
+      if (n > 0) entry.idle = 0;
+      ++it;
+      continue;
+    }
+    // idle for a while: back to interrupts, but catch anything
+    // that arrived before the interrupts were unmasked
+    entry.nic->set_rx_interrupts(true);
+    if (entry.nic->poll_rx(budget_) > 0) {
+      entry.nic->set_rx_interrupts(false);
+      entry.idle = 0;
+      ++it;
+      continue;
+    }
+    it = list_.erase(it);
+  }
+  // disabling hands every device back to interrupts
+  if (UNLIKELY(not busy_poll_enabled)) {
+    for (auto& entry : list_) entry.nic->set_rx_interrupts(true);
+    list_.clear();
+  }
+}
@@ -2,6 +2,7 @@
 #include <kernel/elf.hpp>
 #include <util/crc32.hpp>
 #include <common>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -60,6 +61,12 @@ struct StrTab {
   const char* base;
   uint32_t    size;
 };
+// symbol table entry, sorted by address
+struct SymIndex {
+  ElfAddr  addr;
+  uint32_t size;
+  uint32_t sym;
+};
 
 class ElfTables
 {
@@ -111,8 +118,36 @@ public:
     return {buffer, static_cast<uintptr_t>(addr), 0};
   }
 
+  void build_index()
+  {
+    if (index != nullptr || symtab.entries == 0) return;
+    auto usable = [] (const ElfSym& sym) {
+      const int type = sym.st_info & 0xf;
+      return sym.st_value != 0 && type != STT_SECTION && type != STT_FILE;
+    };
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < symtab.entries; i++)
+        if (usable(symtab.base[i])) count++;
+
+    auto* idx = new SymIndex[count];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < symtab.entries; i++)
+    {
+      const auto& sym = symtab.base[i];
+      if (usable(sym)) idx[n++] = {sym.st_value, (uint32_t) sym.st_size, i};
+    }
+    // larger symbols first for equal addresses
+    std::sort(idx, idx + count,
+      [] (const SymIndex& a, const SymIndex& b) {
+        return a.addr < b.addr || (a.addr == b.addr && a.size > b.size);
+      });
+    this->index = idx;
+    this->index_entries = count;
+  }
+
   const ElfSym* getaddr(ElfAddr addr)
   {
+    if (index != nullptr) return index_lookup(addr);
     // find exact match
     for (int i = 0; i < (int) symtab.entries; i++)
     {
@@ -140,6 +175,25 @@ public:
     return guess;
   }
 
+  const ElfSym* index_lookup(ElfAddr addr) const
+  {
+    // last symbol starting at or below addr
+    const auto* it = std::upper_bound(index, index + index_entries, addr,
+      [] (ElfAddr a, const SymIndex& e) { return a < e.addr; });
+    if (it == index) return nullptr;
+    const int closest = (it - index) - 1;
+    // symbols can overlap, so look at a few more below for one containing addr
+    for (int i = closest; i >= 0 && closest - i < 16; i--)
+    {
+      if (addr < index[i].addr + index[i].size)
+          return &symtab.base[index[i].sym];
+    }
+    // closest match
+    if (addr - index[closest].addr < 512)
+        return &symtab.base[index[closest].sym];
+    return nullptr;
+  }
+
   size_t end_of_file() const {
     auto& hdr = elf_header();
     return hdr.e_ehsize + (hdr.e_phnum * hdr.e_phentsize) + (hdr.e_shnum * hdr.e_shentsize);
@@ -191,6 +245,9 @@ private:
   uint32_t  checksum_syms;
   uint32_t  checksum_strs;
   /* NOTE: DON'T INITIALIZE */
+  // built once the heap is available, until then lookups are linear
+  const SymIndex* index;
+  uint32_t  index_entries;
   friend void elf_protect_symbol_areas();
 };
 static ElfTables parser;
@@ -224,6 +281,11 @@ safe_func_offset Elf::safe_resolve_symbol(const void* addr, char* buffer, size_t
   return get_parser().getsym_safe((ElfAddr) addr, buffer, length);
 }
 
+void Elf::build_symbol_index()
+{
+  get_parser().build_index();
+}
+
 bool Elf::verify_symbols()
 {
   return get_parser().verify_symbols();
@@ -1,5 +1,6 @@
 
 #include <kernel/events.hpp>
+#include <kernel/trace.hpp>
 #include <arch.hpp>
 #include <algorithm>
 #include <cassert>
@@ -105,7 +106,9 @@ void Events::process_events()
         SMP::global_unlock();
       }
 #endif
+      TRACEPOINT(EVENT_BEGIN, intr);
       callbacks[intr]();
+      TRACEPOINT(EVENT_END);
       // increment events handled
       handled_array[intr]++;
       handled_any = true;
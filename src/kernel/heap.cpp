@@ -3,6 +3,7 @@
 #include <util/bitops.hpp>
 #include <util/units.hpp>
 #include <kernel.hpp>
+#include <kernel/memory.hpp>
 
 using namespace util::literals;
 
@@ -33,6 +34,8 @@ size_t os::total_memuse() noexcept {
 
 constexpr size_t heap_alignment = 4096;
 __attribute__((weak)) ssize_t __brk_max = 0x100000;
+// defined by services wanting huge pages, see os::mem::huge_page_size
+__attribute__((weak)) size_t __huge_page_size = 0;
 
 static bool __heap_ready = false;
 
@@ -45,6 +48,17 @@ uintptr_t __init_mmap(uintptr_t begin, size_t size);
 bool kernel::heap_ready() { return __heap_ready; }
 bool os::mem::heap_ready() { return kernel::heap_ready(); }
 
+size_t os::mem::huge_page_size() noexcept
+{
+#if defined(ARCH_x86_64)
+  if (__huge_page_size < 2_MiB)
+    return 0;
+  return os::mem::supported_page_size(__huge_page_size) ? __huge_page_size : 2_MiB;
+#else
+  return 0;
+#endif
+}
+
 void kernel::init_heap(uintptr_t free_mem_begin, uintptr_t memory_end) noexcept {
   // NOTE: Initialize the heap before exceptions
   // cache-align heap, because its not aligned
@@ -1,6 +1,7 @@
 #include <os.hpp>
 #include <kernel.hpp>
 #include <kernel/cpuid.hpp>
+#include <kernel/elf.hpp>
 #include <kernel/rng.hpp>
 #include <service>
 #include <cstdio>
@@ -88,6 +89,12 @@ void kernel::post_start()
   // Seed rand with 32 bits from RNG
   srand(rng_extract_uint32());
 
+  {
+    PROFILE("ELF symbol index");
+    // backtraces and the stack sampler resolve addresses by binary search
+    Elf::build_symbol_index();
+  }
+
   // Custom initialization functions
   MYINFO("Initializing plugins");
   {
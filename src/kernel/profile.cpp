@@ -6,25 +6,49 @@
 #include <kernel/elf.hpp>
 #include <os.hpp>
 #include <util/fixed_vector.hpp>
+#include <net/tcp/tcp.hpp>
 #include <unordered_map>
 #include <cassert>
 #include <algorithm>
 
 #define BUFFER_COUNT    1024
+#define STACK_COUNT     256
+#define STACK_DEPTH     24
+// frames further than this above the sampler are not on our stack
+#define STACK_MAX_SPAN  (1024 * 1024)
 
 extern "C" {
   void parasite_interrupt_handler();
-  void profiler_stack_sampler(void*);
+  void profiler_stack_sampler(void*, void*);
   static void gather_stack_sampling();
 }
 extern char _irq_cb_return_location;
 
 typedef uint32_t func_sample;
+// leaf first: the interrupted address, then return addresses
+struct Callstack {
+  uint32_t  depth;
+  uintptr_t frames[STACK_DEPTH];
+};
+// resolved function addresses, leaf first
+using stack_key = std::vector<uintptr_t>;
+struct stack_hash {
+  size_t operator() (const stack_key& key) const noexcept {
+    size_t hash = key.size();
+    for (auto addr : key)
+        hash = (hash ^ addr) * 0x100000001b3ull;
+    return hash;
+  }
+};
+
 struct Sampler
 {
   Fixed_vector<uintptr_t, BUFFER_COUNT>* samplerq;
   Fixed_vector<uintptr_t, BUFFER_COUNT>* transferq;
+  Fixed_vector<Callstack, STACK_COUNT>* stackq = nullptr;
+  Fixed_vector<Callstack, STACK_COUNT>* stack_transferq = nullptr;
   std::unordered_map<uintptr_t, func_sample> dict;
+  std::unordered_map<stack_key, func_sample, stack_hash> stacks;
   uint64_t total  = 0;
   uint64_t asleep = 0;
   int  lockless = 0;
@@ -44,10 +68,14 @@ struct Sampler
     // install interrupt handler (NOTE: after "initializing" PIT)
     __arch_install_irq(0, parasite_interrupt_handler);
   }
-  void add(void* current)
+  void add(void* current, void* frame)
   {
+    if (mode == StackSampler::MODE_CALLSTACK) {
+      if (stackq->free_capacity())
+          unwind(stackq->emplace_back(), (uintptr_t) current, (uintptr_t) frame);
+    }
     // need free space to take more samples
-    if (samplerq->free_capacity()) {
+    else if (samplerq->free_capacity()) {
       if (mode == StackSampler::MODE_CURRENT)
           samplerq->push_back((uintptr_t) current);
       else if (mode == StackSampler::MODE_CALLER)
@@ -59,8 +87,33 @@ struct Sampler
     // transfer all the built up samples
     transferq->copy(samplerq->begin(), samplerq->size());
     samplerq->clear();
+    if (stackq) {
+      stack_transferq->copy(stackq->begin(), stackq->size());
+      stackq->clear();
+    }
     lockless = 1;
   }
+
+  // follow the frame pointer chain of the interrupted code, which runs
+  // on the same stack as this handler, only above it
+  static void unwind(Callstack& stack, uintptr_t current, uintptr_t fp)
+  {
+    const auto low  = (uintptr_t) __builtin_frame_address(0);
+    const auto high = low + STACK_MAX_SPAN;
+    stack.frames[0] = current;
+    stack.depth = 1;
+    while (stack.depth < STACK_DEPTH)
+    {
+      if (fp <= low || fp >= high || (fp & (sizeof(uintptr_t)-1))) break;
+      const auto* frame = (const uintptr_t*) fp;
+      const uintptr_t ret = frame[1];
+      if (ret < 0x1000) break;
+      stack.frames[stack.depth++] = ret;
+      // callers must be further up the stack
+      if (frame[0] <= fp) break;
+      fp = frame[0];
+    }
+  }
 };
 
 static Sampler& get() {
@@ -75,10 +128,16 @@ void StackSampler::begin()
 }
 void StackSampler::set_mode(mode_t md)
 {
-  get().mode = md;
+  auto& system = get();
+  // make room for call stacks only when requested
+  if (md == MODE_CALLSTACK && system.stackq == nullptr) {
+    system.stack_transferq = new std::remove_pointer<decltype(system.stackq)>::type;
+    system.stackq = new std::remove_pointer<decltype(system.stackq)>::type;
+  }
+  system.mode = md;
 }
 
-void profiler_stack_sampler(void* sample)
+void profiler_stack_sampler(void* sample, void* frame)
 {
   auto& system = get();
   if (UNLIKELY(sample == nullptr)) return;
@@ -91,7 +150,22 @@ void profiler_stack_sampler(void* sample)
   // if discard enabled, ignore samples
   if (UNLIKELY(system.discard)) return;
   // add address to sampler queue
-  system.add(sample);
+  system.add(sample, frame);
+}
+
+static void count_sample(uintptr_t resolved)
+{
+  auto it = get().dict.find(resolved);
+  if (it != get().dict.end()) {
+    it->second++;
+  }
+  else {
+    // add to dictionary
+    get().dict.emplace(
+        std::piecewise_construct,
+        std::forward_as_tuple(resolved),
+        std::forward_as_tuple(1));
+  }
 }
 
 void gather_stack_sampling()
@@ -102,19 +176,23 @@ void gather_stack_sampling()
     for (auto* addr = get().transferq->begin(); addr < get().transferq->end(); addr++)
     {
       // convert return address to function entry address
-      uintptr_t resolved = Elf::resolve_addr(*addr);
-      // insert into unordered map
-      auto it = get().dict.find(resolved);
-      if (it != get().dict.end()) {
-        it->second++;
-      }
-      else {
-        // add to dictionary
-        get().dict.emplace(
-            std::piecewise_construct,
-            std::forward_as_tuple(resolved),
-            std::forward_as_tuple(1));
+      count_sample(Elf::resolve_addr(*addr));
+    }
+    if (get().stack_transferq)
+    {
+      stack_key key;
+      for (auto& stack : *get().stack_transferq)
+      {
+        key.clear();
+        // return addresses point past the call, which may be the next function
+        key.push_back(Elf::resolve_addr(stack.frames[0]));
+        for (uint32_t i = 1; i < stack.depth; i++)
+            key.push_back(Elf::resolve_addr(stack.frames[i] - 1));
+        get().stacks[key]++;
+        // the flat results count the leaf function
+        count_sample(key[0]);
       }
+      get().stack_transferq->clear();
     }
     // switch back transferring of samples
     get().lockless = 0;
@@ -183,6 +261,184 @@ void StackSampler::set_mask(bool mask)
   get().discard = mask;
 }
 
+// every sampled call stack, or single functions unless sampling stacks
+static std::vector<std::pair<stack_key, func_sample>> all_stacks()
+{
+  std::vector<std::pair<stack_key, func_sample>> vec;
+  if (not get().stacks.empty()) {
+    vec.assign(get().stacks.begin(), get().stacks.end());
+  }
+  else {
+    for (auto& sa : get().dict)
+        vec.emplace_back(stack_key{sa.first}, sa.second);
+  }
+  return vec;
+}
+
+struct Symbol_names
+{
+  const std::string& operator() (uintptr_t addr)
+  {
+    auto it = names.find(addr);
+    if (it != names.end()) return it->second;
+    char buffer[8192];
+    auto func = Elf::safe_resolve_symbol((void*) addr, buffer, sizeof(buffer));
+    std::string name = func.name;
+    // ';' separates frames in the folded format
+    std::replace(name.begin(), name.end(), ';', ':');
+    return names.emplace(addr, std::move(name)).first->second;
+  }
+  std::unordered_map<uintptr_t, std::string> names;
+};
+
+std::string StackSampler::folded()
+{
+  Symbol_names names;
+  std::string result;
+  for (auto& sa : all_stacks())
+  {
+    const auto& stack = sa.first;
+    // outermost caller first
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+    {
+      if (it != stack.rbegin()) result += ';';
+      result += names(*it);
+    }
+    result += ' ';
+    result += std::to_string(sa.second);
+    result += '\n';
+  }
+  return result;
+}
+
+void StackSampler::print_folded()
+{
+  const auto text = folded();
+  os::print(text.data(), text.size());
+}
+
+// protobuf wire encoding, just enough for profile.proto
+struct Proto
+{
+  void varint(uint64_t value) {
+    while (value >= 0x80) {
+      buffer.push_back((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    buffer.push_back(value);
+  }
+  void tag(int field, int wire_type) {
+    varint((field << 3) | wire_type);
+  }
+  void uint(int field, uint64_t value) {
+    tag(field, 0);
+    varint(value);
+  }
+  void bytes(int field, const void* data, size_t len) {
+    tag(field, 2);
+    varint(len);
+    auto* p = (const uint8_t*) data;
+    buffer.insert(buffer.end(), p, p + len);
+  }
+  void message(int field, const Proto& msg) {
+    bytes(field, msg.buffer.data(), msg.buffer.size());
+  }
+  std::vector<uint8_t> buffer;
+};
+
+std::vector<uint8_t> StackSampler::pprof()
+{
+  Symbol_names names;
+  std::vector<std::string> strings { "", "samples", "count" };
+  // one location and function per resolved address, sharing ids
+  std::unordered_map<uintptr_t, uint64_t> ids;
+  Proto profile;
+
+  auto value_type = [&profile] (int field) {
+    Proto vt;
+    vt.uint(1, 1); // type: "samples"
+    vt.uint(2, 2); // unit: "count"
+    profile.message(field, vt);
+  };
+  value_type(1); // sample_type
+
+  for (auto& sa : all_stacks())
+  {
+    Proto sample, locations;
+    // leaf first, like our stacks
+    for (auto addr : sa.first)
+    {
+      auto it = ids.find(addr);
+      if (it == ids.end())
+          it = ids.emplace(addr, ids.size() + 1).first;
+      locations.varint(it->second);
+    }
+    sample.message(1, locations); // location_id, packed
+    Proto values;
+    values.varint(sa.second);
+    sample.message(2, values);    // value, packed
+    profile.message(2, sample);
+  }
+  for (auto& id : ids)
+  {
+    Proto line, location;
+    line.uint(1, id.second);      // function_id
+    location.uint(1, id.second);  // id
+    location.uint(3, id.first);   // address
+    location.message(4, line);
+    profile.message(4, location);
+  }
+  for (auto& id : ids)
+  {
+    Proto function;
+    function.uint(1, id.second);  // id
+    function.uint(2, strings.size()); // name
+    strings.push_back(names(id.first));
+    profile.message(5, function);
+  }
+  for (auto& str : strings)
+      profile.bytes(6, str.data(), str.size());
+  value_type(11); // period_type
+  profile.uint(12, 1);
+  return std::move(profile.buffer);
+}
+
+void StackSampler::serve(net::TCP& tcp, uint16_t port)
+{
+  tcp.listen(port,
+    [] (net::tcp::Connection_ptr conn)
+    {
+      conn->on_read(1024,
+        [conn] (auto buf)
+        {
+          const std::string request((const char*) buf->data(), buf->size());
+          const bool http  = request.compare(0, 4, "GET ") == 0;
+          const bool pprof = http && request.compare(4, 6, "/pprof") == 0;
+          // don't sample ourselves
+          set_mask(true);
+          if (pprof) {
+            auto data = StackSampler::pprof();
+            conn->write("HTTP/1.1 200 OK\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "Content-Length: " + std::to_string(data.size()) + "\r\n"
+                        "Connection: close\r\n\r\n");
+            conn->write(data.data(), data.size());
+          }
+          else {
+            auto text = folded();
+            if (http)
+              conn->write("HTTP/1.1 200 OK\r\n"
+                          "Content-Type: text/plain\r\n"
+                          "Content-Length: " + std::to_string(text.size()) + "\r\n"
+                          "Connection: close\r\n\r\n");
+            conn->write(text);
+          }
+          set_mask(false);
+          conn->close();
+        });
+    });
+}
+
 std::string HeapDiag::to_string()
 {
   static intptr_t last = 0;
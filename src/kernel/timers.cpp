@@ -3,6 +3,7 @@
 #include <os.hpp>
 #include <kernel/events.hpp>
 #include <kernel/rtc.hpp>
+#include <kernel/trace.hpp>
 #include <service>
 #include <smp>
 #include <statman>
@@ -240,7 +241,9 @@ void Timers::timers_handler()
       system.scheduled.erase(it);
 
       // call the users callback function
+      TRACEPOINT(TIMER_BEGIN, 0, id);
       system.timers[id].callback(id);
+      TRACEPOINT(TIMER_END);
       // if the timers struct was modified in callback, eg. due to
       // creating a timer, then the timer reference below would have
       // been invalidated, hence why its BELOW, AND MUST STAY THERE
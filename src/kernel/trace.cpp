@@ -0,0 +1,278 @@
+
+#include <kernel/trace.hpp>
+#include <kernel/rtc.hpp>
+#include <net/tcp/tcp.hpp>
+#include <util/ringbuffer.hpp>
+#include <os.hpp>
+#include <smp>
+#include <cstring>
+#include <memory>
+#if defined(ARCH_x86) || defined(ARCH_x86_64)
+  #include <x86intrin.h>
+#endif
+
+struct alignas(SMP_ALIGN) Trace_ring
+{
+  std::unique_ptr<HeapRingBuffer> ring;
+  uint64_t lost = 0;
+  // set while this CPU writes a record
+  bool writing = false;
+};
+static std::vector<Trace_ring> rings;
+SMP_RESIZE_EARLY_GCTOR(rings);
+
+bool Trace::enabled_ = false;
+
+static constexpr int RECORD = sizeof(Trace::Record);
+
+struct Event_type {
+  const char* name;
+  char        phase;  // B(egin), E(nd) or i(nstant)
+  const char* arg_a;  // name of the arguments, nullptr when unused
+  const char* arg_b;
+};
+static const Event_type event_types[Trace::EVENT_TYPES] {
+  {"event",     'B', "intr",     nullptr},
+  {"event",     'E', nullptr,    nullptr},
+  {"timer",     'B', nullptr,    "id"},
+  {"timer",     'E', nullptr,    nullptr},
+  {"nic.rx",    'B', nullptr,    nullptr},
+  {"nic.rx",    'E', nullptr,    "packets"},
+  {"nic.tx",    'i', nullptr,    "bytes"},
+  {"ip4.rx",    'i', "protocol", "bytes"},
+  {"tcp.state", 'i', nullptr,    nullptr},
+  {"user",      'i', "a",        "b"},
+};
+
+static const char* tcp_state_names[] {
+  "CLOSED", "LISTEN", "SYN-SENT", "SYN-RECEIVED", "ESTABLISHED",
+  "FIN-WAIT-1", "FIN-WAIT-2", "CLOSE-WAIT", "CLOSING", "LAST-ACK",
+  "TIME-WAIT"
+};
+
+const char* Trace::name(event_t event) noexcept
+{
+  if (event >= EVENT_TYPES) return "unknown";
+  return event_types[event].name;
+}
+
+void Trace::record(event_t event, uint16_t a, uint32_t b) noexcept
+{
+  auto& cpu = rings[SMP::cpu_id()];
+  // a tracepoint in an interrupt handler, while this CPU was writing
+  if (UNLIKELY(cpu.writing or cpu.ring == nullptr)) {
+    cpu.lost++;
+    return;
+  }
+  __atomic_store_n(&cpu.writing, true, __ATOMIC_SEQ_CST);
+  // paused while we were getting here
+  if (LIKELY(__atomic_load_n(&enabled_, __ATOMIC_SEQ_CST)))
+  {
+    const Record rec {RTC::nanos_now(), event, a, b};
+    auto& ring = *cpu.ring;
+    // keep the latest records
+    if (ring.free_space() < RECORD) {
+      ring.discard(RECORD);
+      cpu.lost++;
+    }
+    ring.write(&rec, RECORD);
+  }
+  __atomic_store_n(&cpu.writing, false, __ATOMIC_RELEASE);
+}
+
+bool Trace::pause() noexcept
+{
+  const bool was = enabled_;
+  __atomic_store_n(&enabled_, false, __ATOMIC_SEQ_CST);
+  for (auto& cpu : rings)
+    while (__atomic_load_n(&cpu.writing, __ATOMIC_ACQUIRE)) {
+#if defined(ARCH_x86) || defined(ARCH_x86_64)
+      _mm_pause();
+#endif
+    }
+  return was;
+}
+
+void Trace::enable(int bytes_per_cpu)
+{
+  Expects(bytes_per_cpu >= RECORD);
+  pause();
+  // whole records, which then never wrap around the end of a ring
+  const int size = bytes_per_cpu / RECORD * RECORD;
+  for (auto& cpu : rings)
+  {
+    if (cpu.ring == nullptr or cpu.ring->capacity() != size)
+      cpu.ring = std::make_unique<HeapRingBuffer>(size);
+  }
+  __atomic_store_n(&enabled_, true, __ATOMIC_SEQ_CST);
+}
+
+void Trace::disable() noexcept
+{
+  pause();
+}
+
+size_t Trace::records() noexcept
+{
+  size_t total = 0;
+  for (auto& cpu : rings)
+    if (cpu.ring) total += cpu.ring->used_space() / RECORD;
+  return total;
+}
+
+uint64_t Trace::lost() noexcept
+{
+  uint64_t total = 0;
+  for (auto& cpu : rings) total += cpu.lost;
+  return total;
+}
+
+void Trace::clear() noexcept
+{
+  const bool was = pause();
+  for (auto& cpu : rings)
+  {
+    if (cpu.ring) cpu.ring->discard(cpu.ring->used_space());
+    cpu.lost = 0;
+  }
+  enabled_ = was;
+}
+
+// take the records of every CPU, oldest first
+template <typename Fn>
+static void take_records(Fn fn)
+{
+  std::vector<Trace::Record> records;
+  for (size_t id = 0; id < rings.size(); id++)
+  {
+    auto& cpu = rings[id];
+    records.resize(cpu.ring ? cpu.ring->used_space() / RECORD : 0);
+    if (not records.empty())
+      cpu.ring->read((char*) records.data(), records.size() * RECORD);
+    fn(id, records);
+  }
+}
+
+static void append_arg(std::string& out, bool& first, const char* name, uint32_t value)
+{
+  char buffer[64];
+  const int len = snprintf(buffer, sizeof(buffer), "%s\"%s\":%u",
+                           first ? "" : ",", name, value);
+  out.append(buffer, len);
+  first = false;
+}
+
+std::string Trace::chrome_json()
+{
+  const bool was = pause();
+  std::string out = "{\"traceEvents\":[";
+  bool first_event = true;
+  char buffer[160];
+
+  take_records(
+  [&] (int cpu, const std::vector<Record>& records)
+  {
+    if (records.empty()) return;
+    int len = snprintf(buffer, sizeof(buffer),
+        "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+        "\"args\":{\"name\":\"cpu%d\"}}", first_event ? "" : ",", cpu, cpu);
+    out.append(buffer, len);
+    first_event = false;
+
+    for (const auto& rec : records)
+    {
+      if (rec.event >= EVENT_TYPES) continue;
+      const auto& type = event_types[rec.event];
+      // Chrome wants microseconds
+      len = snprintf(buffer, sizeof(buffer),
+          ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu.%03lu,\"pid\":1,\"tid\":%d%s,\"args\":{",
+          type.name, type.phase, (unsigned long) (rec.time / 1000),
+          (unsigned long) (rec.time % 1000), cpu,
+          type.phase == 'i' ? ",\"s\":\"t\"" : "");
+      out.append(buffer, len);
+
+      bool first = true;
+      if (rec.event == TCP_STATE)
+      {
+        const unsigned from = rec.a >> 8, to = rec.a & 0xff;
+        len = snprintf(buffer, sizeof(buffer), "\"from\":\"%s\",\"to\":\"%s\"",
+            from <= TCP_TIME_WAIT ? tcp_state_names[from] : "?",
+            to   <= TCP_TIME_WAIT ? tcp_state_names[to]   : "?");
+        out.append(buffer, len);
+        first = false;
+        append_arg(out, first, "local",  rec.b >> 16);
+        append_arg(out, first, "remote", rec.b & 0xffff);
+      }
+      if (type.arg_a) append_arg(out, first, type.arg_a, rec.a);
+      if (type.arg_b) append_arg(out, first, type.arg_b, rec.b);
+      out += "}}";
+    }
+  });
+
+  snprintf(buffer, sizeof(buffer),
+      "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"lost\":\"%lu\"}}\n",
+      (unsigned long) lost());
+  out += buffer;
+  enabled_ = was;
+  return out;
+}
+
+std::vector<uint8_t> Trace::binary()
+{
+  const bool was = pause();
+  std::vector<uint8_t> out(sizeof(Binary_header));
+  Binary_header header {{'I','O','S','T','R','A','C','E'}, 1,
+                        RECORD, (uint32_t) rings.size(), EVENT_TYPES};
+  memcpy(out.data(), &header, sizeof(header));
+
+  take_records(
+  [&out] (int cpu, const std::vector<Record>& records)
+  {
+    const uint32_t head[2] {(uint32_t) cpu, (uint32_t) records.size()};
+    auto* h = (const uint8_t*) head;
+    out.insert(out.end(), h, h + sizeof(head));
+    auto* r = (const uint8_t*) records.data();
+    out.insert(out.end(), r, r + records.size() * RECORD);
+  });
+  enabled_ = was;
+  return out;
+}
+
+void Trace::print()
+{
+  const auto text = chrome_json();
+  os::print(text.data(), text.size());
+}
+
+void Trace::serve(net::TCP& tcp, uint16_t port)
+{
+  tcp.listen(port,
+    [] (net::tcp::Connection_ptr conn)
+    {
+      conn->on_read(1024,
+        [conn] (auto buf)
+        {
+          const std::string request((const char*) buf->data(), buf->size());
+          const bool http   = request.compare(0, 4, "GET ") == 0;
+          const bool binary = http && request.compare(4, 10, "/trace.bin") == 0;
+          if (binary) {
+            auto data = Trace::binary();
+            conn->write("HTTP/1.1 200 OK\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "Content-Length: " + std::to_string(data.size()) + "\r\n"
+                        "Connection: close\r\n\r\n");
+            conn->write(data.data(), data.size());
+          }
+          else {
+            auto text = chrome_json();
+            if (http)
+              conn->write("HTTP/1.1 200 OK\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Content-Length: " + std::to_string(text.size()) + "\r\n"
+                          "Connection: close\r\n\r\n");
+            conn->write(text);
+          }
+          conn->close();
+        });
+    });
+}
@@ -1,12 +1,15 @@
-#include "stub.hpp"
+#include "common.hpp"
 #include <sys/types.h>
+#include <fcntl.h>
 
-static long sys_creat(const char* /*pathname*/, mode_t /*mode*/) {
-  // currently makes no sense, especially since we're read-only
-  return -EROFS;
+extern "C"
+long syscall_SYS_open(const char *pathname, int flags, mode_t mode);
+
+static long sys_creat(const char* pathname, mode_t mode) {
+  return syscall_SYS_open(pathname, O_CREAT | O_WRONLY | O_TRUNC, mode);
 }
 
 extern "C"
 long syscall_SYS_creat(const char *pathname, mode_t mode) {
-  return stubtrace(sys_creat, "creat", pathname, mode);
+  return strace(sys_creat, "creat", pathname, mode);
 }
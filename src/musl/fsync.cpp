@@ -1,9 +1,14 @@
 #include "common.hpp"
 #include <unistd.h>
 
-static long sys_fsync(int /*fd*/)
+#include <posix/fd_map.hpp>
+
+static long sys_fsync(int fd)
 {
-  return -EROFS;
+  if(auto* fildes = FD_map::_get(fd); fildes)
+    return fildes->fsync();
+
+  return -EBADF;
 }
 
 extern "C"
@@ -2,9 +2,14 @@
 #include <unistd.h>
 #include <sys/types.h>
 
-static long sys_ftruncate(int /*fd*/, off_t /*length*/)
+#include <posix/fd_map.hpp>
+
+static long sys_ftruncate(int fd, off_t length)
 {
-  return -EROFS;
+  if(auto* fildes = FD_map::_get(fd); fildes)
+    return fildes->ftruncate(length);
+
+  return -EBADF;
 }
 
 extern "C"
@@ -1,16 +1,27 @@
 #include "common.hpp"
 #include <sys/types.h>
+#include <fcntl.h>
 #include <fs/vfs.hpp>
 #include <posix/fd_map.hpp>
 #include <posix/file_fd.hpp>
 
-static long sys_open(const char *pathname, int /*flags*/, mode_t /*mode = 0*/) {
+static long sys_open(const char *pathname, int flags, mode_t /*mode = 0*/) {
   if (UNLIKELY(pathname == nullptr))
     return -EFAULT;
 
   if (UNLIKELY(pathname[0] == 0))
     return -ENOENT;
 
+  // files that were recently resolved don't need to walk the VFS tree
+  if (not (flags & (O_CREAT | O_TRUNC | O_APPEND)))
+  {
+    const auto* ent = fs::Dentry_cache::get().lookup(fs::Dentry_cache::VFS_NS, pathname);
+    if (ent != nullptr and ent->is_valid()) {
+      auto& fd = FD_map::_open<File_FD>(*ent);
+      return fd.get_id();
+    }
+  }
+
   try {
     auto& entry = fs::VFS::get<FD_compatible>(pathname);
     auto& fd = entry.open_fd();
@@ -21,9 +32,25 @@ static long sys_open(const char *pathname, int /*flags*/, mode_t /*mode = 0*/) {
   {
     try {
       auto ent = fs::VFS::stat_sync(pathname);
+      if (not ent.is_valid() and (flags & O_CREAT))
+      {
+        auto err = fs::VFS::create(pathname);
+        if (err) return fs_errno(err);
+        ent = fs::VFS::stat_sync(pathname);
+      }
+      else if (ent.is_valid() and (flags & O_CREAT) and (flags & O_EXCL)) {
+        return -EEXIST;
+      }
+
       if (ent.is_valid())
       {
-        auto& fd = FD_map::_open<File_FD>(ent);
+        if ((flags & O_TRUNC) and ent.is_file() and (flags & O_ACCMODE) != O_RDONLY)
+        {
+          auto err = ent.truncate(0);
+          if (err) return fs_errno(err);
+        }
+        const uint64_t offset = (flags & O_APPEND) ? ent.size() : 0;
+        auto& fd = FD_map::_open<File_FD>(ent, offset);
         return fd.get_id();
       }
       return -ENOENT;
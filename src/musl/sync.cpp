@@ -1,19 +1,22 @@
-#include "stub.hpp"
+#include "common.hpp"
+#include <fs/block_cache.hpp>
 
 static long sys_sync() {
+  // write back every dirty block, regardless of filesystem
+  fs::Block_cache::get().flush_sync();
   return 0;
 }
 
 static long sys_syncfs() {
-  return 0;
+  return (fs::Block_cache::get().flush_sync()) ? -EIO : 0;
 }
 
 extern "C" {
 long syscall_SYS_sync() {
-  return stubtrace(sys_sync, "sync");
+  return strace(sys_sync, "sync");
 }
 
 long syscall_SYS_syncfs() {
-  return stubtrace(sys_syncfs, "syncfs");
+  return strace(sys_syncfs, "syncfs");
 }
 }
@@ -1,14 +1,26 @@
 #include "common.hpp"
 #include <unistd.h>
+#include <fs/vfs.hpp>
+#include <posix/file_fd.hpp>
 
-static long sys_unlink(const char* /*pathname*/)
+static long sys_unlink(const char* pathname)
 {
-  /* technically path needs to be verified first */
-  return -EROFS;
+  if (UNLIKELY(pathname == nullptr))
+    return -EFAULT;
+
+  if (UNLIKELY(pathname[0] == 0))
+    return -ENOENT;
+
+  try {
+    return fs_errno(fs::VFS::unlink(pathname));
+  }
+  catch(const fs::VFS_err&) {
+    return -ENOENT;
+  }
 }
 
 extern "C"
 long syscall_SYS_unlink(const char *pathname)
 {
-  return strace(sys_unlink, "rmdir", pathname);
+  return strace(sys_unlink, "unlink", pathname);
 }
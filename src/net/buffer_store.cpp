@@ -18,6 +18,8 @@ extern void* aligned_alloc(size_t alignment, size_t size);
 #define BSD_PRINT(fmt, ...)  /** fmt **/
 #endif
 
+using namespace util::literals;
+
 namespace net {
 
   BufferStore::BufferStore(uint32_t num, uint32_t bufsize) :
@@ -64,7 +66,9 @@ namespace net {
 
   void BufferStore::create_new_pool()
   {
-    auto* pool = (uint8_t*) aligned_alloc(os::mem::min_psize(), poolsize_);
+    // on huge pages, a pool spans as few of them (and TLB entries) as it can
+    const size_t align = os::mem::huge_page_size() ? 2_MiB : os::mem::min_psize();
+    auto* pool = (uint8_t*) aligned_alloc(align, poolsize_);
     if (UNLIKELY(pool == nullptr)) {
       throw std::runtime_error("Buffer store failed to allocate memory");
     }
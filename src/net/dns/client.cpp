@@ -1,6 +1,7 @@
 
 #include <net/dns/client.hpp>
 #include <net/inet>
+#include <statman>
 
 namespace net::dns
 {
@@ -11,12 +12,18 @@ namespace net::dns
   Timer::duration_t Client::DEFAULT_RESOLVE_TIMEOUT{std::chrono::seconds(5)};
 #endif
   Timer::duration_t Client::DEFAULT_FLUSH_INTERVAL{std::chrono::seconds(30)};
-  std::chrono::seconds Client::DEFAULT_CACHE_TTL{std::chrono::seconds(60)};
+  std::chrono::seconds Client::DEFAULT_CACHE_TTL{std::chrono::hours(1)};
+  std::chrono::seconds Client::DEFAULT_NEGATIVE_TTL{std::chrono::minutes(5)};
 
   Client::Client(Stack& stack)
     : stack_{stack},
       cache_ttl_{DEFAULT_CACHE_TTL},
-      flush_timer_{{this, &Client::flush_expired}}
+      negative_ttl_{DEFAULT_NEGATIVE_TTL},
+      flush_timer_{{this, &Client::flush_expired}},
+      cache_hits_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns.cache_hits").get_uint32()},
+      cache_misses_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns.cache_misses").get_uint32()},
+      coalesced_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns.queries_coalesced").get_uint32()},
+      prefetches_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns.prefetches").get_uint32()}
   {
   }
 
@@ -30,24 +37,82 @@ namespace net::dns
     {
       hostname.append(".").append(stack_.domain_name());
     }
-    if(not force)
+    const auto rtype = (dns_server.is_v6() ? Record_type::AAAA : Record_type::A);
+
+    if(not force and cache_ttl_ > std::chrono::seconds::zero())
     {
-      auto it = cache_.find(hostname);
-      if(it != cache_.end())
+      auto res = lookup_cache(hostname, rtype);
+      if(res != nullptr)
       {
-        Error err;
-        func(nullptr, err); // fix
+        cache_hits_++;
+        func(std::move(res), {});
         return;
       }
+      cache_misses_++;
+    }
+
+    send_query(dns_server, std::move(hostname), rtype, std::move(func), timeout);
+  }
+
+  Response_ptr Client::lookup_cache(const Hostname& hostname, Record_type rtype)
+  {
+    auto it = cache_.find(hostname);
+    if(it == cache_.end())
+      return nullptr;
+
+    auto& entry = it->second;
+    const auto now = timestamp();
+    if(entry.rtype != rtype or entry.expires <= now)
+      return nullptr;
+
+    entry.hits++;
+    const uint32_t remaining = entry.expires - now;
+    const uint32_t elapsed   = entry.ttl - remaining;
+
+    auto res = std::make_unique<Response>();
+    res->rcode   = entry.rcode;
+    res->answers = entry.answers;
+    // count the records' TTL down, as a server would
+    for(auto& rec : res->answers)
+      rec.ttl = std::min(rec.ttl - elapsed, remaining);
+
+    // refresh entries in use during the last tenth of their TTL
+    if(prefetch_hits_ > 0 and entry.hits >= prefetch_hits_
+      and not entry.is_negative() and remaining * 10 <= entry.ttl
+      and in_flight_.find(hostname) == in_flight_.end())
+    {
+      prefetches_++;
+      send_query(entry.server, hostname, rtype, nullptr, DEFAULT_RESOLVE_TIMEOUT);
     }
+    return res;
+  }
+
+  void Client::send_query(Address server, Hostname hostname, Record_type rtype,
+                          Resolve_handler func, Timer::duration_t timeout)
+  {
+    // join a query in flight for the same name
+    auto pending = in_flight_.find(hostname);
+    if(pending != in_flight_.end())
+    {
+      auto it = requests_.find(pending->second);
+      if(it != requests_.end() and it->second.query.rtype == rtype)
+      {
+        coalesced_++;
+        if(func != nullptr)
+          it->second.callbacks.push_back(std::move(func));
+        return;
+      }
+    }
+
     // Make sure we actually can bind to a socket
-    auto& socket = (dns_server.is_v6()) ? stack_.udp().bind6() : stack_.udp().bind();
+    auto& socket = (server.is_v6()) ? stack_.udp().bind6() : stack_.udp().bind();
 
     // Create our query
-    Query query{std::move(hostname), (dns_server.is_v6() ? Record_type::AAAA : Record_type::A)};
+    Query query{hostname, rtype};
 #ifdef LIBFUZZER_ENABLED
     g_last_xid = query.id;
 #endif
+    in_flight_[std::move(hostname)] = query.id;
 
     // store the request for later match
     auto emp = requests_.emplace(std::piecewise_construct,
@@ -56,7 +121,7 @@ namespace net::dns
 
     Ensures(emp.second && "Unable to insert");
     auto& req = emp.first->second;
-    req.resolve(dns_server, timeout);
+    req.resolve(server, timeout);
   }
 
   Client::Request::Request(Client& cli, udp::Socket& sock,
@@ -65,14 +130,17 @@ namespace net::dns
       query{std::move(q)},
       response{nullptr},
       socket{sock},
-      callback{std::move(cb)},
       timer({this, &Request::timeout})
   {
+    if(cb != nullptr)
+      callbacks.push_back(std::move(cb));
     socket.on_read({this, &Client::Request::parse_response});
   }
 
   void Client::Request::resolve(net::Addr server, Timer::duration_t timeout)
   {
+    this->server = server;
+
     std::array<char, 256> buf;
     size_t len = query.write(buf.data());
 
@@ -96,13 +164,9 @@ namespace net::dns
       // TODO: Validate
       res->parse(data, len);
 
-      this->response = std::move(res);
+      client.add_cache_entry(query.hostname, query.rtype, *res, server);
 
-      // TODO: Cache
-      /*if(client.cache_ttl_ > std::chrono::seconds::zero())
-      {
-        add_cache_entry(...);
-      }*/
+      this->response = std::move(res);
 
       finish({});
     }
@@ -115,10 +179,26 @@ namespace net::dns
 
   void Client::Request::finish(const Error& err)
   {
-    callback(std::move(response), err);
+    auto& cli = client;
+    // the handlers may resolve the same name again
+    auto it = cli.in_flight_.find(query.hostname);
+    if(it != cli.in_flight_.end() and it->second == query.id)
+      cli.in_flight_.erase(it);
+
+    auto handlers = std::move(callbacks);
+    auto res = std::move(response);
 
-    auto erased = client.requests_.erase(query.id);
+    auto erased = cli.requests_.erase(query.id);
     Ensures(erased == 1);
+
+    // everyone waiting gets their own copy of the response
+    for(size_t i = 0; i < handlers.size(); i++)
+    {
+      if(res != nullptr and i + 1 < handlers.size())
+        handlers[i](std::make_unique<Response>(*res), err);
+      else
+        handlers[i](std::move(res), err);
+    }
   }
 
   void Client::Request::timeout()
@@ -144,15 +224,47 @@ namespace net::dns
     flush_timer_.stop();
   }
 
-  void Client::add_cache_entry(const Hostname& hostname, Address addr, std::chrono::seconds ttl)
+  void Client::add_cache_entry(const Hostname& hostname, Record_type rtype,
+                               const Response& res, Address server)
   {
-    // cache the address
-    cache_.emplace(std::piecewise_construct,
-      std::forward_as_tuple(hostname),
-      std::forward_as_tuple(addr, timestamp() + ttl.count()));
+    if(cache_ttl_ == std::chrono::seconds::zero())
+      return;
+
+    uint32_t ttl = cache_ttl_.count();
+    if(res.rcode == Response_code::NO_ERROR and res.has_addr())
+    {
+      // the whole answer, including any aliases, is valid for the lowest TTL
+      for(auto& rec : res.answers)
+        ttl = std::min(ttl, rec.ttl);
+    }
+    else if(res.rcode == Response_code::NO_ERROR or res.rcode == Response_code::NAME_ERROR)
+    {
+      // negative answers can only be cached with a SOA record (RFC 2308)
+      ttl = std::min<uint32_t>(ttl, negative_ttl_.count());
+      bool has_soa = false;
+      for(auto& rec : res.auth)
+      {
+        if(rec.rtype == Record_type::SOA)
+        {
+          ttl = std::min({ttl, rec.ttl, rec.get_soa_minimum()});
+          has_soa = true;
+        }
+      }
+      if(not has_soa)
+        return;
+    }
+    else // server failure, refused etc.
+    {
+      return;
+    }
+
+    if(ttl == 0)
+      return;
+
+    cache_.insert_or_assign(hostname,
+      Cache_entry{res, rtype, ttl, std::move(server), timestamp() + ttl});
 
-    debug("<DNSClient> Cache entry added: [%s] %s (%lld)\n",
-      hostname.c_str(), addr.to_string().c_str(), ttl.count());
+    debug("<DNSClient> Cache entry added: [%s] (%u)\n", hostname.c_str(), ttl);
 
     // start the timer if not already active
     if(not flush_timer_.is_running())
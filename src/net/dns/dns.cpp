@@ -9,6 +9,7 @@
 #include <net/dns/dns.hpp>
 #include <net/util.hpp>
 
+#include <cctype>
 #include <string>
 
 using namespace std;
@@ -40,6 +41,35 @@ namespace net::dns
     return len + 1;
   }
 
+  std::string encode_name(std::string_view name)
+  {
+    if (not name.empty() and name.back() == '.')
+      name.remove_suffix(1);
+
+    std::string wire;
+    wire.reserve(name.size() + 2);
+    while (not name.empty())
+    {
+      const auto dot = name.find('.');
+      const auto label = name.substr(0, dot);
+      if (label.empty() or label.size() > 63)
+        return {};
+      wire += (char) label.size();
+      for (char c : label)
+        wire += (char) std::tolower((unsigned char) c);
+      if (dot == std::string_view::npos)
+        break;
+      name.remove_prefix(dot + 1);
+      // no empty label after a dot
+      if (name.empty())
+        return {};
+    }
+    wire += '\0';
+    if (wire.size() > 255)
+      return {};
+    return wire;
+  }
+
   inline std::string parse_dns_query(unsigned char* c)
   {
     auto tmp = c;
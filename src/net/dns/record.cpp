@@ -1,5 +1,6 @@
 
 #include <net/dns/record.hpp>
+#include <cstring>
 
 namespace net::dns {
 
@@ -29,20 +30,25 @@ namespace net::dns {
     reader += sizeof(rr_data);
     count += sizeof(rr_data);
 
+    // invalid request if the data doesn't fit
+    if (remaining - sizeof(rr_data) < this->data_len)
+      throw std::runtime_error("Nothing left to parse");
+
     switch(this->rtype)
     {
-      case Record_type::A:    // IPv4
-      case Record_type::AAAA: // IPv6
+      case Record_type::NS:
+      case Record_type::ALIAS:
+      case Record_type::PTR:
       {
-        this->rdata.assign(reader, this->data_len);
-        count += data_len;
+        parse_name(reader, buffer, len, this->rdata);
         break;
       }
-      default:
+      default: // A, AAAA, SOA: raw data
       {
-        count += parse_name(reader, buffer, len, this->rdata);
+        this->rdata.assign(reader, this->data_len);
       }
     }
+    count += data_len;
 
     return count;
   }
@@ -61,60 +67,41 @@ namespace net::dns {
   {
     Expects(output.empty());
 
-    unsigned namelen = 0;
+    const auto* ubuf = (const unsigned char*) buffer;
+    size_t pos = reader - buffer;
+    // bytes the name occupies where it started, up to the first pointer
+    int  count  = 0;
     bool jumped = false;
+    int  jumps  = 0;
 
-    int count = 1;
-    const auto* ureader = (unsigned char*) reader;
-
-    while (*ureader)
+    while (pos < tot_len)
     {
-      if (*ureader >= 192)
+      const uint8_t len = ubuf[pos];
+      if (len == 0)
       {
-        // read 16-bit offset, mask out the 2 top bits
-        uint16_t offset = (*ureader >> 8) | *(ureader+1);
-        offset &= 0x3fff; // remove 2 top bits
-
-        if(UNLIKELY(offset > tot_len))
-          return 0;
-
-        ureader = (unsigned char*) &buffer[offset];
-        jumped = true; // we have jumped to another location so counting wont go up!
+        if (jumped == false) count++;
+        return count;
       }
-      else
+      // compression: 2 top bits set, offset in the remaining 14 bits
+      if ((len & 0xc0) == 0xc0)
       {
-        output[namelen++] = *ureader++;
-
-        // maximum label size
-        if(UNLIKELY(namelen > 63)) break;
+        // guard against pointer loops
+        if (UNLIKELY(pos + 1 >= tot_len or ++jumps > 16))
+          break;
+        if (jumped == false) count += 2;
+        jumped = true;
+        pos = ((len & 0x3f) << 8) | ubuf[pos + 1];
+        continue;
       }
+      if (UNLIKELY(len > 63 or pos + 1 + len > tot_len))
+        break;
 
-      // if we havent jumped to another location then we can count up
-      if (jumped == false) count++;
-    }
-
-    output.resize(namelen);
-    if (output.empty()) return 0;
-
-    // number of steps we actually moved forward in the packet
-    if (jumped)
-      count++;
-
-    // now convert 3www6google3com0 to www.google.com
-    for(unsigned i = 0; i < output.size(); i++)
-    {
-      const uint8_t len = output[i];
-
-      for(unsigned j = 0; j < len; j++)
-      {
-        output[i] = output[i+1];
-        i++;
-      }
-      output[i] = '.';
+      if (not output.empty()) output += '.';
+      output.append(buffer + pos + 1, len);
+      if (jumped == false) count += 1 + len;
+      pos += 1 + len;
     }
-    // remove the last dot by resizing down
-    output.resize(output.size()-1);
-    return count;
+    throw std::runtime_error("Invalid name");
   }
 
   ip4::Addr Record::get_ipv4() const
@@ -129,6 +116,16 @@ namespace net::dns {
     return *(ip6::Addr*) rdata.data();
   }
 
+  uint32_t Record::get_soa_minimum() const
+  {
+    // MINIMUM is the last field, after the names and 4 other 32-bit values
+    if (rtype != Record_type::SOA or rdata.size() < 22)
+      return 0;
+    uint32_t minimum;
+    std::memcpy(&minimum, rdata.data() + rdata.size() - 4, sizeof(minimum));
+    return ntohl(minimum);
+  }
+
   net::Addr Record::get_addr() const
   {
     switch(rtype)
@@ -0,0 +1,476 @@
+#include <net/dns/server.hpp>
+#include <net/inet>
+#include <statman>
+#include <cctype>
+#include <cstring>
+#include <map>
+
+namespace net::dns {
+
+  // answer templates start with the response header, except ID and QDCOUNT
+  static const size_t TMPL_HEADER = 8;
+  // question type of the NXDOMAIN answer, stored under each zone's origin
+  static const uint16_t NXDOMAIN_KEY = 0xffff;
+  // question type of the answer for names without the asked type
+  static const uint16_t NODATA_KEY   = 0;
+  static const uint16_t QTYPE_ANY    = 255;
+  // the question name, at the end of the header
+  static const char QNAME_PTR[] = "\xc0\x0c";
+
+  static void put16(std::string& buf, uint16_t val)
+  {
+    buf += (char) (val >> 8);
+    buf += (char) val;
+  }
+  static void put32(std::string& buf, uint32_t val)
+  {
+    put16(buf, val >> 16);
+    put16(buf, val);
+  }
+
+  static std::string encode_record(const std::string& owner, const Record& rec, uint32_t ttl)
+  {
+    std::string data;
+    switch (rec.rtype)
+    {
+      case Record_type::NS:
+      case Record_type::ALIAS:
+      case Record_type::PTR:
+        data = encode_name(rec.rdata);
+        break;
+      default:
+        data = rec.rdata;
+    }
+    std::string rr = owner;
+    put16(rr, static_cast<uint16_t>(rec.rtype));
+    put16(rr, static_cast<uint16_t>(Class::INET));
+    put32(rr, ttl);
+    put16(rr, data.size());
+    return rr + data;
+  }
+
+  static std::string make_template(Response_code rcode, uint16_t answers,
+                                   uint16_t authority, const std::string& body)
+  {
+    std::string tmpl;
+    tmpl += (char) 0x84; // response, authoritative
+    tmpl += (char) rcode;
+    put16(tmpl, answers);
+    put16(tmpl, authority);
+    put16(tmpl, 0);
+    return tmpl + body;
+  }
+
+  static std::string make_key(const std::string& wire, uint16_t qtype)
+  {
+    auto key = wire;
+    put16(key, qtype);
+    return key;
+  }
+
+  static uint32_t hash_key(const uint8_t* key, size_t len) noexcept
+  {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+      hash = (hash ^ key[i]) * 16777619u;
+    return hash;
+  }
+
+  Server::Server(Stack& stack)
+    : stack_{stack},
+      queries_udp_{Statman::get().create(Stat::UINT64, stack.ifname() + ".dns_server.queries_udp").get_uint64()},
+      queries_tcp_{Statman::get().create(Stat::UINT64, stack.ifname() + ".dns_server.queries_tcp").get_uint64()},
+      nxdomain_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns_server.nxdomain").get_uint32()},
+      refused_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns_server.refused").get_uint32()},
+      errors_{Statman::get().create(Stat::UINT32, stack.ifname() + ".dns_server.errors").get_uint32()}
+  {
+  }
+
+  Server::~Server()
+  {
+    close();
+  }
+
+  void Server::add_zone(Zone zone)
+  {
+    remove_zone(zone.origin());
+    zones_.push_back(std::move(zone));
+    build();
+  }
+
+  void Server::remove_zone(const std::string& origin)
+  {
+    const auto before = zones_.size();
+    zones_.erase(std::remove_if(zones_.begin(), zones_.end(),
+      [&origin] (const Zone& zone) { return zone.origin() == origin; }), zones_.end());
+    if (zones_.size() != before)
+      build();
+  }
+
+  void Server::build()
+  {
+    std::vector<std::pair<std::string, std::string>> entries;
+
+    for (const auto& zone : zones_)
+    {
+      const auto origin = encode_name(zone.origin());
+      // negative answers carry the SOA, with the negative TTL (RFC 2308)
+      const auto soa = encode_record(origin, zone.soa(), zone.negative_ttl());
+      const auto nodata = make_template(Response_code::NO_ERROR, 0, 1, soa);
+
+      // record sets by name and type, with the names between them and the origin
+      std::map<std::string, std::map<uint16_t, std::vector<const Record*>>> names;
+      names[zone.origin()][(uint16_t) Record_type::SOA].push_back(&zone.soa());
+      for (const auto& rec : zone.records())
+        names[rec.name][(uint16_t) rec.rtype].push_back(&rec);
+      std::vector<std::string> owners;
+      for (const auto& entry : names)
+        owners.push_back(entry.first);
+      for (auto name : owners)
+      {
+        while (name.size() > zone.origin().size())
+        {
+          const auto dot = name.find('.');
+          if (dot == std::string::npos) break;
+          name = name.substr(dot + 1);
+          names[name];
+        }
+      }
+
+      for (const auto& [name, sets] : names)
+      {
+        const auto wire = encode_name(name);
+        for (const auto& [type, rrs] : sets)
+        {
+          std::string body;
+          for (auto* rec : rrs)
+            body += encode_record(QNAME_PTR, *rec, rec->ttl);
+          entries.emplace_back(make_key(wire, type),
+                               make_template(Response_code::NO_ERROR, rrs.size(), 0, body));
+        }
+        // RFC 8482: answer ANY with one of the sets
+        if (not sets.empty())
+          entries.emplace_back(make_key(wire, QTYPE_ANY), entries.back().second);
+
+        auto alias = sets.find((uint16_t) Record_type::ALIAS);
+        if (alias == sets.end())
+        {
+          entries.emplace_back(make_key(wire, NODATA_KEY), nodata);
+          continue;
+        }
+        // the alias answers everything, followed by its target's records
+        auto& cname = *alias->second.front();
+        const auto cname_rr = encode_record(QNAME_PTR, cname, cname.ttl);
+        entries.emplace_back(make_key(wire, NODATA_KEY),
+                             make_template(Response_code::NO_ERROR, 1, 0, cname_rr));
+        auto target = names.find(cname.rdata);
+        if (target == names.end())
+          continue;
+        const auto target_wire = encode_name(cname.rdata);
+        for (const auto& [type, rrs] : target->second)
+        {
+          if (sets.count(type)) continue;
+          std::string body = cname_rr;
+          for (auto* rec : rrs)
+            body += encode_record(target_wire, *rec, rec->ttl);
+          entries.emplace_back(make_key(wire, type),
+                               make_template(Response_code::NO_ERROR, 1 + rrs.size(), 0, body));
+        }
+      }
+      entries.emplace_back(make_key(origin, NXDOMAIN_KEY),
+                           make_template(Response_code::NAME_ERROR, 0, 1, soa));
+    }
+
+    // at most half full
+    size_t capacity = 16;
+    while (capacity < entries.size() * 2)
+      capacity *= 2;
+    slots_.assign(capacity, Slot{});
+    mask_ = capacity - 1;
+    arena_.clear();
+    count_ = 0;
+    max_tmpl_ = 0;
+    for (const auto& [key, tmpl] : entries)
+      insert(key, tmpl);
+    arena_.shrink_to_fit();
+  }
+
+  void Server::insert(const std::string& key, const std::string& tmpl)
+  {
+    const auto* kp = (const uint8_t*) key.data();
+    // the first zone to define a name wins
+    if (find(kp, key.size()) != nullptr)
+      return;
+    Expects(tmpl.size() <= UINT16_MAX);
+
+    const auto hash = hash_key(kp, key.size());
+    auto idx = hash & mask_;
+    while (slots_[idx].key_len != 0)
+      idx = (idx + 1) & mask_;
+
+    auto& slot = slots_[idx];
+    slot.hash = hash;
+    slot.key  = arena_.size();
+    slot.key_len = key.size();
+    arena_.insert(arena_.end(), key.begin(), key.end());
+    slot.tmpl = arena_.size();
+    slot.tmpl_len = tmpl.size();
+    arena_.insert(arena_.end(), tmpl.begin(), tmpl.end());
+    max_tmpl_ = std::max(max_tmpl_, tmpl.size());
+    count_++;
+  }
+
+  const Server::Slot* Server::find(const uint8_t* key, size_t key_len) const noexcept
+  {
+    if (UNLIKELY(slots_.empty()))
+      return nullptr;
+    const auto hash = hash_key(key, key_len);
+    for (auto idx = hash & mask_;; idx = (idx + 1) & mask_)
+    {
+      const auto& slot = slots_[idx];
+      if (slot.key_len == 0)
+        return nullptr;
+      if (slot.hash == hash and slot.key_len == key_len
+          and std::memcmp(&arena_[slot.key], key, key_len) == 0)
+        return &slot;
+    }
+  }
+
+  size_t Server::answer(const uint8_t* query, size_t len,
+                        uint8_t* out, size_t out_size, bool stream) const
+  {
+    if (UNLIKELY(len < sizeof(Header) or out_size < sizeof(Header)))
+      return 0;
+    const uint8_t flags = query[2];
+    // never answer responses
+    if (UNLIKELY(flags & 0x80))
+      return 0;
+
+    // a response with only the header, and the question if @qlen
+    auto error = [&] (Response_code rcode, size_t qlen) -> size_t {
+      errors_++;
+      if (sizeof(Header) + qlen > out_size) qlen = 0;
+      std::memcpy(out, query, 2);
+      out[2] = 0x80 | (flags & 0x79); // opcode and RD as asked
+      out[3] = (uint8_t) rcode;
+      std::memset(out + 4, 0, 8);
+      if (qlen) {
+        out[5] = 1;
+        std::memcpy(out + sizeof(Header), query + sizeof(Header), qlen);
+      }
+      return sizeof(Header) + qlen;
+    };
+
+    if (UNLIKELY(((flags >> 3) & 0xf) != 0))
+      return error(Response_code::NOT_IMPL, 0);
+    const uint16_t qdcount = (query[4] << 8) | query[5];
+    const uint16_t arcount = (query[10] << 8) | query[11];
+    if (UNLIKELY(qdcount != 1 or query[6] or query[7] or query[8] or query[9] or arcount > 1))
+      return error(Response_code::FORMAT_ERROR, 0);
+
+    // lowercase question name, followed by the type
+    uint8_t key[256 + 2];
+    size_t klen = 0;
+    size_t pos  = sizeof(Header);
+    for (;;)
+    {
+      if (UNLIKELY(pos >= len))
+        return error(Response_code::FORMAT_ERROR, 0);
+      const uint8_t label = query[pos];
+      if (label == 0) {
+        key[klen++] = 0;
+        pos++;
+        break;
+      }
+      if (UNLIKELY(label > 63 or pos + 1 + label > len or klen + 1 + label > 254))
+        return error(Response_code::FORMAT_ERROR, 0);
+      key[klen++] = label;
+      for (size_t i = 1; i <= label; i++)
+        key[klen++] = std::tolower(query[pos + i]);
+      pos += 1 + label;
+    }
+    if (UNLIKELY(pos + sizeof(Question) > len))
+      return error(Response_code::FORMAT_ERROR, 0);
+    const uint16_t qtype  = (query[pos] << 8) | query[pos + 1];
+    const uint16_t qclass = (query[pos + 2] << 8) | query[pos + 3];
+    pos += sizeof(Question);
+    const size_t qlen = pos - sizeof(Header);
+
+    // EDNS(0) raises the UDP size limit, and is answered with an OPT record
+    bool edns = false;
+    size_t limit = stream ? out_size : 512;
+    if (arcount == 1 and pos + 11 <= len and query[pos] == 0
+        and query[pos + 1] == 0 and query[pos + 2] == (uint8_t) Record_type::OPT)
+    {
+      edns = true;
+      if (not stream) {
+        const size_t size = (query[pos + 3] << 8) | query[pos + 4];
+        limit = std::min<size_t>(std::max<size_t>(size, 512), EDNS_UDP_SIZE);
+      }
+    }
+    limit = std::min(limit, out_size);
+
+    if (UNLIKELY(qclass != (uint16_t) Class::INET and qclass != QTYPE_ANY))
+      return error(Response_code::OP_REFUSED, qlen);
+    // zone transfers are not supported, and our own keys are not questions
+    if (UNLIKELY(qtype == NODATA_KEY or qtype == NXDOMAIN_KEY or qtype == 251 or qtype == 252))
+      return error(Response_code::NOT_IMPL, qlen);
+
+    key[klen]     = qtype >> 8;
+    key[klen + 1] = qtype;
+    const Slot* slot = find(key, klen + 2);
+    if (slot == nullptr)
+    {
+      key[klen] = key[klen + 1] = NODATA_KEY;
+      slot = find(key, klen + 2);
+    }
+    if (slot == nullptr)
+    {
+      // the NXDOMAIN answer of the closest zone
+      key[klen] = key[klen + 1] = 0xff;
+      for (size_t off = 0; slot == nullptr; off += 1 + key[off])
+      {
+        slot = find(key + off, klen - off + 2);
+        if (key[off] == 0) break;
+      }
+      if (slot == nullptr) {
+        refused_++;
+        return error(Response_code::OP_REFUSED, qlen);
+      }
+      nxdomain_++;
+    }
+
+    const uint8_t* tmpl = &arena_[slot->tmpl];
+    const size_t body = slot->tmpl_len - TMPL_HEADER;
+    const size_t opt  = edns ? 11 : 0;
+    const bool truncated = sizeof(Header) + qlen + body + opt > limit;
+    if (UNLIKELY(sizeof(Header) + qlen + opt > limit))
+      return 0;
+
+    std::memcpy(out, query, 2);
+    out[2] = tmpl[0] | (flags & 0x01) | (truncated ? 0x02 : 0);
+    out[3] = tmpl[1];
+    out[4] = 0;
+    out[5] = 1;
+    if (LIKELY(not truncated)) {
+      std::memcpy(out + 6, tmpl + 2, 6);
+    } else {
+      std::memset(out + 6, 0, 6);
+    }
+    out[11] += edns;
+    // the question as asked, keeping the case of the name
+    std::memcpy(out + sizeof(Header), query + sizeof(Header), qlen);
+    size_t total = sizeof(Header) + qlen;
+    if (LIKELY(not truncated)) {
+      std::memcpy(out + total, tmpl + TMPL_HEADER, body);
+      total += body;
+    }
+    if (edns)
+    {
+      const uint8_t opt_rr[] = {0, 0, (uint8_t) Record_type::OPT,
+        EDNS_UDP_SIZE >> 8, EDNS_UDP_SIZE & 0xff, 0, 0, 0, 0, 0, 0};
+      std::memcpy(out + total, opt_rr, sizeof(opt_rr));
+      total += sizeof(opt_rr);
+    }
+    return total;
+  }
+
+  void Server::listen(uint16_t port)
+  {
+    Expects(udp_ == nullptr && "Already listening");
+    udp_ = &stack_.udp().bind(port);
+    udp_->on_read_batch({this, &Server::receive_batch}, UDP_BATCH);
+    tcp_ = &stack_.tcp().listen(port, {this, &Server::receive_connection});
+  }
+
+  void Server::close()
+  {
+    if (udp_ != nullptr) {
+      udp_->close();
+      udp_ = nullptr;
+    }
+    if (tcp_ != nullptr) {
+      tcp_->close();
+      tcp_ = nullptr;
+    }
+    // the clients' callbacks refer to this server
+    auto clients = std::move(clients_);
+    clients_.clear();
+    for (auto& conn : clients)
+    {
+      conn->reset_callbacks();
+      conn->close();
+    }
+  }
+
+  void Server::receive_batch(udp::Socket::Packet_batch batch)
+  {
+    udp::Socket::Packet_batch replies;
+    replies.reserve(batch.size());
+    uint8_t buffer[EDNS_UDP_SIZE];
+
+    for (auto& pkt : batch)
+    {
+      queries_udp_++;
+      const auto len = answer(pkt->udp_data(), pkt->udp_data_length(),
+                              buffer, sizeof(buffer));
+      if (len == 0)
+        continue;
+      auto reply = udp_->create_datagram(pkt->ip_src(), pkt->src_port());
+      if (UNLIKELY(reply == nullptr))
+        break;
+      reply->fill(buffer, len);
+      replies.push_back(std::move(reply));
+    }
+    udp_->send_batch(std::move(replies));
+  }
+
+  namespace {
+    // messages over TCP are prefixed by their length (RFC 1035 4.2.2)
+    struct Tcp_client {
+      tcp::Connection&     conn;
+      std::vector<uint8_t> pending;
+    };
+  }
+
+  void Server::receive_connection(tcp::Connection_ptr conn)
+  {
+    clients_.push_back(conn);
+    conn->on_close(
+      [this, ptr = conn.get()] {
+        clients_.erase(std::find_if(clients_.begin(), clients_.end(),
+          [ptr] (const auto& client) { return client.get() == ptr; }));
+      });
+
+    auto client = std::make_shared<Tcp_client>(Tcp_client{*conn, {}});
+    conn->on_read(4096,
+      [this, client] (tcp::buffer_t buf)
+      {
+        auto& pending = client->pending;
+        pending.insert(pending.end(), buf->begin(), buf->end());
+
+        size_t pos = 0;
+        while (pending.size() - pos >= 2)
+        {
+          const size_t msglen = (pending[pos] << 8) | pending[pos + 1];
+          if (pending.size() - pos - 2 < msglen)
+            break;
+          queries_tcp_++;
+          // at most the query's header and question, a template's body and OPT
+          const size_t size = std::min<size_t>(msglen + max_tmpl_ + 11, UINT16_MAX);
+          auto reply = tcp::construct_buffer(2 + size);
+          const auto len = answer(&pending[pos + 2], msglen, reply->data() + 2, size, true);
+          pos += 2 + msglen;
+          if (len == 0)
+            continue;
+          (*reply)[0] = len >> 8;
+          (*reply)[1] = len;
+          reply->resize(2 + len);
+          client->conn.write(std::move(reply));
+        }
+        pending.erase(pending.begin(), pending.begin() + pos);
+      });
+  }
+
+} // net::dns
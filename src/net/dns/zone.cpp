@@ -0,0 +1,376 @@
+#include <net/dns/zone.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace net::dns {
+
+  static std::string lowercase(std::string_view name)
+  {
+    std::string out(name);
+    for (auto& c : out)
+      c = std::tolower((unsigned char) c);
+    return out;
+  }
+
+  // the full name of @name, relative to @base unless it ends with a dot
+  static std::string qualify(std::string_view name, const std::string& base)
+  {
+    if (name == "@")
+      return base;
+    if (not name.empty() and name.back() == '.')
+    {
+      name.remove_suffix(1);
+      return lowercase(name);
+    }
+    if (base.empty())
+      return lowercase(name);
+    return lowercase(name) + "." + base;
+  }
+
+  static std::string wire_name(const std::string& name)
+  {
+    auto wire = encode_name(name);
+    if (wire.empty())
+      throw Zone_error("Invalid name: " + name);
+    return wire;
+  }
+
+  static void put32(std::string& buf, uint32_t val)
+  {
+    val = htonl(val);
+    buf.append((const char*) &val, sizeof(val));
+  }
+
+  static std::string soa_data(const std::string& mname, const std::string& rname,
+                              const uint32_t (&values)[5])
+  {
+    auto data = wire_name(mname) + wire_name(rname);
+    for (auto val : values)
+      put32(data, val);
+    return data;
+  }
+
+  Zone::Zone(const std::string& origin, const std::string& mname,
+             const std::string& rname, uint32_t serial,
+             uint32_t minimum, uint32_t ttl)
+    : origin_{qualify(origin, "")},
+      minimum_{minimum},
+      ttl_{ttl}
+  {
+    wire_name(origin_);
+    soa_.name   = origin_;
+    soa_.rtype  = Record_type::SOA;
+    soa_.rclass = Class::INET;
+    soa_.ttl    = ttl;
+    // refresh, retry and expire only matter to secondary servers
+    soa_.rdata  = soa_data(qualify(mname, origin_), qualify(rname, origin_),
+                           {serial, 7200, 900, 1209600, minimum});
+    soa_.data_len = soa_.rdata.size();
+  }
+
+  std::string Zone::absolute(std::string_view name) const
+  {
+    auto full = qualify(name, origin_);
+    const bool inside = origin_.empty() or full == origin_
+      or (full.size() > origin_.size()
+          and full.compare(full.size() - origin_.size(), origin_.size(), origin_) == 0
+          and full[full.size() - origin_.size() - 1] == '.');
+    if (not inside)
+      throw Zone_error("Name is outside of the zone " + origin_ + ": " + full);
+    wire_name(full);
+    return full;
+  }
+
+  Zone& Zone::add(const std::string& name, Record_type type, std::string rdata, uint32_t ttl)
+  {
+    auto& rec = records_.emplace_back();
+    rec.name   = absolute(name);
+    rec.rtype  = type;
+    rec.rclass = Class::INET;
+    rec.ttl    = ttl;
+    rec.rdata  = std::move(rdata);
+    rec.data_len = rec.rdata.size();
+    return *this;
+  }
+
+  Zone& Zone::add_a(const std::string& name, ip4::Addr addr, uint32_t ttl)
+  {
+    return add(name, Record_type::A, std::string((const char*) &addr, sizeof(addr)), ttl);
+  }
+
+  Zone& Zone::add_aaaa(const std::string& name, const ip6::Addr& addr, uint32_t ttl)
+  {
+    return add(name, Record_type::AAAA, std::string((const char*) &addr, sizeof(addr)), ttl);
+  }
+
+  Zone& Zone::add_alias(const std::string& name, const std::string& target, uint32_t ttl)
+  {
+    const auto full = qualify(target, origin_);
+    wire_name(full);
+    return add(name, Record_type::ALIAS, full, ttl);
+  }
+
+  Zone& Zone::add_ns(const std::string& name, const std::string& target, uint32_t ttl)
+  {
+    const auto full = qualify(target, origin_);
+    wire_name(full);
+    return add(name, Record_type::NS, full, ttl);
+  }
+
+  Zone& Zone::add_mx(const std::string& name, uint16_t preference,
+                     const std::string& exchange, uint32_t ttl)
+  {
+    std::string data(2, '\0');
+    data[0] = preference >> 8;
+    data[1] = preference;
+    data += wire_name(qualify(exchange, origin_));
+    return add(name, Record_type::MX, std::move(data), ttl);
+  }
+
+  Zone& Zone::add_txt(const std::string& name, const std::string& text, uint32_t ttl)
+  {
+    // a sequence of strings of up to 255 bytes
+    std::string data;
+    size_t pos = 0;
+    do {
+      const auto len = std::min(text.size() - pos, (size_t) 255);
+      data += (char) len;
+      data.append(text, pos, len);
+      pos += len;
+    } while (pos < text.size());
+    return add(name, Record_type::TXT, std::move(data), ttl);
+  }
+
+  namespace {
+    struct Line {
+      std::vector<std::string> tokens;
+      bool owner_omitted = false;
+      int  number = 0;
+    };
+
+    // split a master file into logical lines of tokens, joining
+    // parentheses and removing comments
+    std::vector<Line> tokenize(std::string_view text)
+    {
+      std::vector<Line> lines;
+      Line line;
+      int  number = 1;
+      int  depth  = 0;
+      bool quoted = false;
+      bool in_token = false;
+      std::string token;
+      line.number = number;
+
+      auto end_token = [&] {
+        if (in_token) line.tokens.push_back(std::move(token));
+        token.clear();
+        in_token = false;
+      };
+      auto end_line = [&] {
+        end_token();
+        if (not line.tokens.empty())
+          lines.push_back(std::move(line));
+        line = Line{};
+        line.number = number;
+      };
+
+      for (size_t i = 0; i < text.size(); i++)
+      {
+        const char c = text[i];
+        if (quoted)
+        {
+          if (c == '\\' and i + 1 < text.size())
+            token += text[++i];
+          else if (c == '"')
+            quoted = false;
+          else
+            token += c;
+          continue;
+        }
+        switch (c)
+        {
+        case '"':
+          in_token = true;
+          quoted = true;
+          break;
+        case ';':
+          while (i + 1 < text.size() and text[i + 1] != '\n') i++;
+          break;
+        case '(':
+          end_token();
+          depth++;
+          break;
+        case ')':
+          end_token();
+          if (depth-- == 0)
+            throw Zone_error("Unbalanced parentheses on line " + std::to_string(number));
+          break;
+        case '\n':
+          number++;
+          if (depth == 0) end_line();
+          else end_token();
+          break;
+        case ' ': case '\t': case '\r':
+          if (line.tokens.empty() and not in_token and i > 0 and text[i - 1] == '\n')
+            line.owner_omitted = true;
+          end_token();
+          break;
+        default:
+          in_token = true;
+          token += c;
+        }
+      }
+      if (quoted or depth != 0)
+        throw Zone_error("Unterminated record on line " + std::to_string(line.number));
+      end_line();
+      // the first line can't start with whitespace, as there's no previous owner
+      return lines;
+    }
+
+    bool is_number(const std::string& str)
+    {
+      return not str.empty() and std::all_of(str.begin(), str.end(),
+        [] (char c) { return std::isdigit((unsigned char) c); });
+    }
+
+    uint32_t to_number(const std::string& str, int line)
+    {
+      if (not is_number(str) or str.size() > 10)
+        throw Zone_error("Expected a number on line " + std::to_string(line) + ": " + str);
+      const auto val = std::strtoull(str.c_str(), nullptr, 10);
+      if (val > UINT32_MAX)
+        throw Zone_error("Number out of range on line " + std::to_string(line) + ": " + str);
+      return val;
+    }
+  }
+
+  Zone Zone::parse(std::string_view text, const std::string& origin)
+  {
+    Zone zone;
+    bool has_soa = false;
+    std::string base = qualify(origin, "");
+    std::string owner;
+    uint32_t default_ttl = DEFAULT_TTL;
+
+    for (auto& line : tokenize(text))
+    {
+      auto& tok = line.tokens;
+      const auto where = " on line " + std::to_string(line.number);
+      if (tok[0] == "$ORIGIN")
+      {
+        if (tok.size() != 2) throw Zone_error("Invalid $ORIGIN" + where);
+        base = qualify(tok[1], base);
+        continue;
+      }
+      if (tok[0] == "$TTL")
+      {
+        if (tok.size() != 2) throw Zone_error("Invalid $TTL" + where);
+        default_ttl = to_number(tok[1], line.number);
+        continue;
+      }
+      if (tok[0][0] == '$')
+        throw Zone_error("Unsupported directive " + tok[0] + where);
+
+      size_t i = 0;
+      if (not line.owner_omitted)
+        owner = qualify(tok[i++], base);
+      else if (owner.empty() and not has_soa)
+        throw Zone_error("Missing owner name" + where);
+
+      // optional TTL and class, in any order
+      uint32_t ttl = default_ttl;
+      for (int n = 0; n < 2 and i < tok.size(); n++)
+      {
+        if (is_number(tok[i]))
+          ttl = to_number(tok[i++], line.number);
+        else if (tok[i] == "IN" or tok[i] == "in")
+          i++;
+      }
+      if (i >= tok.size())
+        throw Zone_error("Missing record type" + where);
+
+      const auto type = lowercase(tok[i++]);
+      std::vector<std::string> data(tok.begin() + i, tok.end());
+      auto expect = [&] (size_t count) {
+        if (data.size() != count)
+          throw Zone_error("Invalid " + type + " record" + where);
+      };
+
+      if (type == "soa")
+      {
+        expect(7);
+        if (has_soa)
+          throw Zone_error("More than one SOA record" + where);
+        uint32_t values[5];
+        for (int v = 0; v < 5; v++)
+          values[v] = to_number(data[2 + v], line.number);
+        zone = Zone(owner + ".", qualify(data[0], base) + ".",
+                    qualify(data[1], base) + ".", values[0], values[4], default_ttl);
+        zone.soa_.ttl   = ttl;
+        zone.soa_.rdata = soa_data(qualify(data[0], base), qualify(data[1], base), values);
+        zone.soa_.data_len = zone.soa_.rdata.size();
+        has_soa = true;
+        continue;
+      }
+      if (not has_soa)
+        throw Zone_error("The first record must be a SOA record" + where);
+
+      // names in the zone file are relative to $ORIGIN, which may not be the zone's
+      const auto name = owner + ".";
+      try {
+        if (type == "a") {
+          expect(1);
+          zone.add_a(name, ip4::Addr{data[0]}, ttl);
+        }
+        else if (type == "aaaa") {
+          expect(1);
+          zone.add_aaaa(name, ip6::Addr{data[0]}, ttl);
+        }
+        else if (type == "cname") {
+          expect(1);
+          zone.add_alias(name, qualify(data[0], base) + ".", ttl);
+        }
+        else if (type == "ns") {
+          expect(1);
+          zone.add_ns(name, qualify(data[0], base) + ".", ttl);
+        }
+        else if (type == "ptr") {
+          expect(1);
+          const auto target = qualify(data[0], base);
+          wire_name(target);
+          zone.add(name, Record_type::PTR, target, ttl);
+        }
+        else if (type == "mx") {
+          expect(2);
+          zone.add_mx(name, to_number(data[0], line.number), qualify(data[1], base) + ".", ttl);
+        }
+        else if (type == "txt") {
+          if (data.empty()) expect(1);
+          std::string rdata;
+          for (auto& str : data) {
+            if (str.size() > 255)
+              throw Zone_error("TXT string longer than 255 bytes" + where);
+            rdata += (char) str.size();
+            rdata += str;
+          }
+          zone.add(name, Record_type::TXT, std::move(rdata), ttl);
+        }
+        else {
+          throw Zone_error("Unsupported record type " + tok[i - 1] + where);
+        }
+      }
+      catch (const Zone_error&) {
+        throw;
+      }
+      catch (const std::exception& e) {
+        // invalid addresses
+        throw Zone_error(std::string(e.what()) + where);
+      }
+    }
+    if (not has_soa)
+      throw Zone_error("Zone has no SOA record");
+    return zone;
+  }
+
+} // net::dns
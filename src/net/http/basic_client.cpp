@@ -35,8 +35,6 @@ namespace http {
   {
     Expects(cb != nullptr);
     using namespace std;
-    auto& conn = (not secure) ?
-      get_connection(host) : get_secure_connection(host);
 
     auto&& header = req->header();
 
@@ -53,7 +51,8 @@ namespace http {
     if(on_send_)
       on_send_(*req, options, host);
 
-    conn.send(move(req), move(cb), options.follow_redirect, options.timeout);
+    const Pool_key key{host, secure};
+    dispatch(key, pools_[key], {move(req), move(cb), move(options), false});
   }
 
   void Basic_client::send(Request_ptr req, URI url, Response_handler cb, Options options)
@@ -88,8 +87,13 @@ namespace http {
         secure,
         port
       ]
-        (net::dns::Response_ptr res, const net::Error&) mutable
+        (net::dns::Response_ptr res, const net::Error& err) mutable
       {
+        if(UNLIKELY(err or res == nullptr))
+        {
+          cb({Error::RESOLVE_HOST}, nullptr, Connection::empty());
+          return;
+        }
         auto addr = res->get_first_addr();
         if(UNLIKELY(addr == net::Addr::addr_any))
         {
@@ -323,26 +327,105 @@ namespace http {
     stack.resolve(host, cb);
   }
 
-  Client_connection& Basic_client::get_connection(const Host host)
+  size_t Basic_client::connection_count(const Host host, const bool secure) const
+  {
+    auto it = pools_.find({host, secure});
+    return (it != pools_.end()) ? it->second.connections.size() : 0;
+  }
+
+  size_t Basic_client::queued_count(const Host host, const bool secure) const
+  {
+    auto it = pools_.find({host, secure});
+    return (it != pools_.end()) ? it->second.queue.size() : 0;
+  }
+
+  void Basic_client::dispatch(const Pool_key& key, Host_pool& pool, Queued q)
   {
-    // return/create a set for the given host
-    auto& cset = conns_[host];
+    // requests already waiting go first
+    auto* conn = (pool.queue.empty()) ?
+      get_connection(key, pool, q.req->method()) : nullptr;
+
+    if(conn != nullptr)
+    {
+      conn->send(std::move(q.req), std::move(q.cb),
+        q.options.follow_redirect, q.options.timeout, q.retried);
+      return;
+    }
+
+    if(UNLIKELY(pool.queue.size() >= pool_options_.max_queued))
+    {
+      q.cb({Error::QUEUE_FULL}, nullptr, Connection::empty());
+      return;
+    }
+
+    debug("<http::Basic_client> Queueing request to %s (%zu waiting)\n",
+      key.host.to_string().c_str(), pool.queue.size());
+    pool.queue.push_back(std::move(q));
+  }
 
+  Client_connection* Basic_client::get_connection(const Pool_key& key, Host_pool& pool,
+                                                  const Method method)
+  {
     // iterate all the connection and return the first free one
-    for(auto& conn : cset)
+    for(auto& conn : pool.connections)
     {
-      if(!conn->occupied())
-        return *conn;
+      if(conn->available())
+        return conn.get();
+    }
+
+    // no free connections, emplace a new one if below the limit
+    if(pool.connections.size() < pool_options_.max_per_host)
+    {
+      auto stream = (key.secure) ? create_secure_stream(key.host)
+        : std::make_unique<net::tcp::Stream>(tcp_.connect(key.host));
+
+      pool.connections.push_back(
+        std::make_unique<Client_connection>(*this, std::move(stream), key.secure));
+      return pool.connections.back().get();
     }
 
-    // no non-occupied connections, emplace a new one
-    cset.push_back(std::make_unique<Client_connection>(
-      *this, std::make_unique<net::tcp::Stream>(tcp_.connect(host)))
-    );
-    return *cset.back();
+    // otherwise write it behind the requests on the least busy connection
+    Client_connection* best = nullptr;
+    for(auto& conn : pool.connections)
+    {
+      if(conn->can_pipeline(method, pool_options_.pipeline_depth)
+        and (best == nullptr or conn->inflight() < best->inflight()))
+        best = conn.get();
+    }
+    return best;
   }
 
-  Client_connection& Basic_client::get_secure_connection(const Host)
+  void Basic_client::process_queue(const Pool_key& key)
+  {
+    auto it = pools_.find(key);
+    if(it == pools_.end())
+      return;
+
+    auto& pool = it->second;
+    while(not pool.queue.empty())
+    {
+      auto* conn = get_connection(key, pool, pool.queue.front().req->method());
+      if(conn == nullptr)
+        return;
+
+      auto q = std::move(pool.queue.front());
+      pool.queue.pop_front();
+      conn->send(std::move(q.req), std::move(q.cb),
+        q.options.follow_redirect, q.options.timeout, q.retried);
+    }
+  }
+
+  void Basic_client::retry(const Client_connection& conn, std::deque<Queued> requests)
+  {
+    debug("<http::Basic_client> Retrying %zu requests to %s\n",
+      requests.size(), conn.peer().to_string().c_str());
+    // sent when the connection they were lost with is removed (see close)
+    auto& queue = pools_[{conn.peer(), conn.secure()}].queue;
+    queue.insert(queue.begin(),
+      std::make_move_iterator(requests.begin()), std::make_move_iterator(requests.end()));
+  }
+
+  Connection::Stream_ptr Basic_client::create_secure_stream(const Host)
   {
     throw Client_error{"Secured connections not supported (use the HTTPS Client)."};
   }
@@ -350,13 +433,17 @@ namespace http {
   void Basic_client::close(Client_connection& c)
   {
     debug("<http::Basic_client> Closing %u:%s %p\n", c.local_port(), c.peer().to_string().c_str(), &c);
-    auto& cset = conns_.at(c.peer());
+    const Pool_key key{c.peer(), c.secure()};
+    auto& cset = pools_.at(key).connections;
 
     cset.erase(std::remove_if(cset.begin(), cset.end(),
-    [port = c.local_port()] (const std::unique_ptr<Client_connection>& conn)->bool
+    [&c] (const std::unique_ptr<Client_connection>& conn)->bool
     {
-      return conn->local_port() == port;
-    }));
+      return conn.get() == &c;
+    }), cset.end());
+
+    // there may be room for the requests waiting
+    process_queue(key);
   }
 
 }
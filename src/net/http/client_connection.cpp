@@ -4,187 +4,297 @@
 
 namespace http {
 
-  Client_connection::Client_connection(Basic_client& client, Stream_ptr stream)
+  Client_connection::Client_connection(Basic_client& client, Stream_ptr stream, bool secure)
     : Connection{std::move(stream)},
       client_(client),
-      req_(nullptr),
       res_(nullptr),
-      on_response_{nullptr},
-      timer_({this, &Client_connection::timeout_request}),
-      timeout_dur_{timeout_duration::zero()},
-      redirect_{client.default_follow_redirect}
+      body_left_{0},
+      framing_{Framing::LENGTH},
+      timer_({this, &Client_connection::on_timeout}),
+      secure_{secure}
   {
     // setup close event
     stream_->on_close({this, &Client_connection::close});
+
+    // requests are written when the stream is established
+    if(stream_->is_connected())
+      on_connected();
+    else
+      stream_->on_connect([this](auto&) { this->on_connected(); });
   }
 
-  void Client_connection::send(Request_ptr req, Response_handler on_res, int redirects, timeout_duration timeout)
+  bool Client_connection::can_pipeline(Method method, size_t depth) const
   {
-    Expects(available());
-    req_ = std::move(req);
-    on_response_ = std::move(on_res);
-    Expects(on_response_ != nullptr);
-    timeout_dur_ = timeout;
-    redirect_ = redirects;
-
-    if(timeout_dur_ > timeout_duration::zero())
-      timer_.restart(timeout_dur_);
-
-    // if the stream is not established, send the request when connected
-    if(not stream_->is_connected())
+    if(not keep_alive_ or inflight_.size() >= depth)
+      return false;
+
+    // a request that changes something waits for the ones before it,
+    // and nothing is written behind it
+    if(not method::is_safe(method))
+      return inflight_.empty();
+
+    for(const auto& pending : inflight_)
+      if(not method::is_safe(pending.req->method()))
+        return false;
+
+    return true;
+  }
+
+  void Client_connection::send(Request_ptr req, Response_handler on_res, int redirects,
+                               timeout_duration timeout, bool retried)
+  {
+    Expects(keep_alive_);
+    Expects(on_res != nullptr);
+
+    if(req->header().value(header::Connection) == "close")
+      keep_alive_ = false;
+
+    inflight_.push_back({std::move(req), std::move(on_res), timeout, redirects, retried});
+
+    // if the stream is not established, the request is sent when connected
+    if(stream_->is_connected())
     {
-      stream_->on_connect([this](auto&)
-      {
-        this->send_request();
-      });
-    }
-    else {
-      send_request();
+      if(inflight_.size() == 1)
+        restart_timer();
+
+      stream_->write(inflight_.back().req->to_string());
     }
   }
 
-  void Client_connection::send_request()
+  void Client_connection::on_connected()
   {
-    keep_alive_ = (req_->header().value(header::Connection) != "close");
+    stream_->on_read(0, {this, &Client_connection::recv_response});
 
-    stream_->on_read(0 , {this, &Client_connection::recv_response});
+    // write everything queued up while connecting, in one go
+    std::string data;
+    for(const auto& pending : inflight_)
+      data += pending.req->to_string();
 
-    stream_->write(req_->to_string());
+    restart_timer();
+
+    if(not data.empty())
+      stream_->write(data);
   }
 
   void Client_connection::recv_response(buffer_t buf)
   {
-    if (buf->empty()) {
-      end_response({Error::NO_REPLY});
+    if (inflight_.empty())
+    {
+      // nobody is waiting for this, the connection is out of sync
+      keep_alive_ = false;
+      shutdown();
       return;
     }
 
-    const std::string data{(char*) buf->data(), buf->size()};
+    buffer_.append((const char*) buf->data(), buf->size());
 
     // restart timer since we got data
-    if(timer_.is_running())
-      timer_.restart(timeout_dur_);
+    restart_timer();
 
-    // create response if not exist
-    if(res_ == nullptr)
+    // a buffer may end one response and start the next one (pipelining)
+    bool ended = false;
+    while(not inflight_.empty())
     {
-      try {
-        res_ = make_response(data); // this also parses
+      try
+      {
+        if(not parse_response())
+          return;
       }
       catch(...)
       {
+        keep_alive_ = false;
         end_response({Error::INVALID});
+        shutdown();
         return;
       }
-    }
-    // if there already is a response
-    else
-    {
-      // this is the case when Status line is received, but not yet headers.
-      if(not res_->headers_complete() && req_->method() != HEAD)
-      {
-        *res_ << data;
-        res_->parse();
-      }
-      // here we assume all headers has already been received (could not be true?)
-      else
+
+      end_response();
+      ended = true;
+
+      // the user took over the stream (e.g. websocket upgrade)
+      if(released())
       {
-        // add chunks of body data
-        res_->add_chunk(data);
+        end();
+        return;
       }
     }
 
-    const auto& header = res_->header();
-    // TODO: Temporary, not good enough
-    // if(res_->is_complete())
-    // Assume we want some headers
-    if(!header.is_empty())
+    // data nobody asked for, the connection is out of sync
+    if(not buffer_.empty())
+      keep_alive_ = false;
+
+    if(not keep_alive_)
+    {
+      shutdown();
+      return;
+    }
+
+    restart_timer();
+
+    // room for more requests
+    if(ended)
+      client_.on_available(*this);
+  }
+
+  bool Client_connection::parse_response()
+  {
+    if(res_ == nullptr)
+    {
+      const auto end = buffer_.find("\r\n\r\n");
+      if(end == std::string::npos)
+        return false;
+
+      res_ = make_response(buffer_.substr(0, end + 4)); // this also parses
+      buffer_.erase(0, end + 4);
+      parse_framing();
+    }
+
+    while(true)
     {
-      // Note: Content Length is not required
-      if(header.has_field(header::Content_Length))
+      switch(framing_)
       {
-        try
+        case Framing::UNTIL_CLOSE:
+          res_->add_chunk(buffer_);
+          buffer_.clear();
+          return false;
+
+        case Framing::LENGTH:
+        {
+          const auto n = std::min(body_left_, buffer_.size());
+          res_->add_chunk(buffer_.substr(0, n));
+          buffer_.erase(0, n);
+          body_left_ -= n;
+          return body_left_ == 0;
+        }
+
+        case Framing::CHUNKED:
         {
-          const unsigned conlen = std::stoul(std::string(header.value(header::Content_Length)));
-          const unsigned body_size = res_->body().size();
-          //printf("<http::Connection> [%s] Data: %u ConLen: %u Body:%u\n",
-          //  req_->uri().to_string().to_string().c_str(), data.size(), conlen, body_size);
-          // risk buffering forever if no timeout
-          if(body_size == conlen)
+          if(body_left_ > 0)
           {
-            end_response();
+            const auto n = std::min(body_left_, buffer_.size());
+            res_->add_chunk(buffer_.substr(0, n));
+            buffer_.erase(0, n);
+            body_left_ -= n;
+            if(body_left_ > 0)
+              return false;
           }
-          else if(body_size > conlen)
+          const auto eol = buffer_.find("\r\n");
+          if(eol == std::string::npos)
+            return false;
+          // the line ending a chunk is skipped, otherwise it's the next chunk size
+          if(eol > 0)
           {
-            end_response({Error::INVALID});
+            body_left_ = std::stoul(buffer_.substr(0, eol), nullptr, 16);
+            if(body_left_ == 0)
+              framing_ = Framing::TRAILER;
           }
+          buffer_.erase(0, eol + 2);
+          break;
+        }
+
+        case Framing::TRAILER:
+        {
+          const auto eol = buffer_.find("\r\n");
+          if(eol == std::string::npos)
+            return false;
+          buffer_.erase(0, eol + 2);
+          // trailer fields are ignored, an empty line ends the response
+          if(eol == 0)
+            return true;
+          break;
         }
-        catch(...)
-        { end_response({Error::INVALID}); }
-      }
-      // HTTP/1.1 7.2.2 Length: Any response message which must not include an entity body
-      // (such as the 1xx, 204, and 304 responses and any response to a HEAD request)
-      // is always terminated by the first empty line after the header fields
-      else if(const auto code = res_->status_code();
-        is_informational(code) or code == No_Content or code == Not_Modified
-        or req_->method() == HEAD)
-      {
-        end_response();
       }
     }
-    else if(req_->method() == HEAD)
+  }
+
+  void Client_connection::parse_framing()
+  {
+    const auto& header = res_->header();
+    const auto code = res_->status_code();
+
+    // HTTP/1.0 closes unless told otherwise, HTTP/1.1 keeps alive unless told otherwise
+    const auto connection = header.value(header::Connection);
+    if(connection == "close"
+      or (res_->version().minor() == 0 and connection != "keep-alive"))
+      keep_alive_ = false;
+
+    framing_   = Framing::LENGTH;
+    body_left_ = 0;
+
+    // HTTP/1.1 7.2.2 Length: Any response message which must not include an entity body
+    // (such as the 1xx, 204, and 304 responses and any response to a HEAD request)
+    // is always terminated by the first empty line after the header fields
+    if(is_informational(code) or code == No_Content or code == Not_Modified
+      or inflight_.front().req->method() == HEAD)
     {
-      end_response();
+      return;
+    }
+
+    if(header.value("Transfer-Encoding").find("chunked") != util::sview::npos)
+    {
+      framing_ = Framing::CHUNKED;
+    }
+    // Note: Content Length is not required
+    else if(header.has_field(header::Content_Length))
+    {
+      body_left_ = std::stoul(std::string(header.value(header::Content_Length)));
+    }
+    else
+    {
+      framing_    = Framing::UNTIL_CLOSE;
+      keep_alive_ = false;
     }
   }
 
   void Client_connection::end_response(Error err)
   {
-    // If the request has timed out, but the response is received later,
-    // just discard (we can't do anything because we have no callback).
-    // This MAY have side effects if the connection is reused and
-    // a delayed response is received
-    if (on_response_)
+    auto pending = std::move(inflight_.front());
+    inflight_.pop_front();
+    auto res = std::move(res_);
+    res_ = nullptr;
+
+    if(UNLIKELY(not err and can_redirect(res, pending.redirects)))
     {
-      if(UNLIKELY(not err and can_redirect(res_)))
+      uri::URI location{res->header().value("Location")};
+
+      if(location.is_valid())
       {
-        uri::URI location{res_->header().value("Location")};
+        redirect(pending, location);
+        return;
+      }
+    }
 
-        if(location.is_valid())
-        {
-          redirect(location);
-          end(); // hope its good here..
-          return;
-        }
+    pending.on_response(err, std::move(res), *this);
+  }
 
-      }
-      // move response to a copy in case of callback result in new request
-      auto callback = std::move(on_response_);
-      on_response_.reset();
+  void Client_connection::restart_timer()
+  {
+    // the first request in flight is timed, an idle connection is closed
+    // if not reused in time
+    const auto dur = (not inflight_.empty()) ?
+      inflight_.front().timeout : client_.pool_options().idle_timeout;
 
-      // stop timeout timer
+    if(dur > timeout_duration::zero())
+      timer_.restart(dur);
+    else
       timer_.stop();
+  }
 
-      callback(err, std::move(res_), *this);
-    }
-    end();
-    /*if(!released())
-    {
-      // avoid trying to parse any more responses
-      tcpconn_->on_read(0, nullptr);
+  void Client_connection::on_timeout()
+  {
+    // responses may still arrive, so the connection can't be reused
+    keep_alive_ = false;
 
-      if(!keep_alive_) // user callback may override this
-        shutdown();
-    }
-    else
-    {
-      close();
-    }*/
+    if(not inflight_.empty())
+      end_response({Error::TIMEOUT});
+
+    // the rest is retried or failed in close()
+    shutdown();
   }
 
-  bool Client_connection::can_redirect(const Response_ptr& res) const
+  bool Client_connection::can_redirect(const Response_ptr& res, int redirects) const
   {
-    if(redirect_ < 1) return false;
+    if(redirects < 1) return false;
     if(res == nullptr) return false;
     if(not is_redirection(res->status_code())) return false;
     if(not res->header().has_field("Location")) return false;
@@ -192,42 +302,56 @@ namespace http {
     return true;
   }
 
-  void Client_connection::redirect(uri::URI location)
+  void Client_connection::redirect(Pending& pending, uri::URI location)
   {
-    Expects(on_response_);
-
     // modify req
-    client_.populate_from_url(*req_, location);
+    client_.populate_from_url(*pending.req, location);
 
     // build option
     Basic_client::Options options;
-    options.timeout         = timeout_dur_;
-    options.follow_redirect = --redirect_;
-
-    // move callback
-    auto callback = std::move(on_response_);
-    on_response_.reset();
+    options.timeout         = pending.timeout;
+    options.follow_redirect = pending.redirects - 1;
 
     // have client send new request
-    client_.send(std::move(req_), location, std::move(callback), options);
+    client_.send(std::move(pending.req), location, std::move(pending.on_response), options);
   }
 
   void Client_connection::close()
   {
-    // if the user havent received a response yet
-    if(on_response_ != nullptr)
+    timer_.stop();
+    keep_alive_ = false;
+
+    auto pending = std::move(inflight_);
+    inflight_.clear();
+    std::deque<Basic_client::Queued> retries;
+
+    for(auto& p : pending)
     {
-      auto callback = std::move(on_response_);
-      on_response_.reset();
-      timer_.stop();
-      if(res_ != nullptr and res_->headers_complete()) {
-        callback(Error::NONE, std::move(res_), *this);
+      const bool first = (&p == &pending.front());
+
+      // if the user havent received a response yet
+      if(first and res_ != nullptr and res_->headers_complete())
+      {
+        p.on_response(Error::NONE, std::move(res_), *this);
+      }
+      // nothing received for it, so it's safe to retry an idempotent request
+      // (e.g. the server closed an idle connection as the request was written)
+      else if((not first or buffer_.empty()) and not p.retried
+        and method::is_idempotent(p.req->method()))
+      {
+        Basic_client::Options options;
+        options.timeout         = p.timeout;
+        options.follow_redirect = p.redirects;
+        retries.push_back({std::move(p.req), std::move(p.on_response), options, true});
       }
-      else {
-        callback(Error::CLOSING, std::move(res_), *this);
+      else
+      {
+        p.on_response(Error::CLOSING, first ? std::move(res_) : nullptr, *this);
       }
     }
 
+    if(not retries.empty())
+      client_.retry(*this, std::move(retries));
     client_.close(*this);
   }
 
@@ -0,0 +1,867 @@
+
+#include <net/http/h2_connection.hpp>
+#include <net/http/server.hpp>
+#include <util/base64.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace http {
+
+  using namespace h2;
+
+  // fields about the HTTP/1 connection have no meaning in HTTP/2 (RFC 7540 8.1.2.2)
+  static bool is_connection_specific(const std::string& name)
+  {
+    return name == "connection" or name == "keep-alive" or name == "proxy-connection"
+        or name == "transfer-encoding" or name == "upgrade";
+  }
+
+  H2_stream::H2_stream(H2_connection& conn, uint32_t id)
+    : conn_(conn),
+      id_{id},
+      send_window_{conn.initial_send_window_},
+      recv_window_{conn.settings_.initial_window_size}
+  {
+  }
+
+  void H2_stream::write(const void* buf, size_t n)
+  {
+    if(closed_ or reset_ or n == 0)
+      return;
+
+    const auto* data = static_cast<const char*>(buf);
+
+    // the head is collected until complete, and sent as HEADERS
+    if(not head_sent_)
+    {
+      head_.append(data, n);
+      const auto end = head_.find("\r\n\r\n");
+      if(end == std::string::npos)
+        return;
+
+      out_.append(head_, end + 4, std::string::npos);
+      head_.resize(end + 4);
+      conn_.send_head(*this);
+      head_.clear();
+      head_.shrink_to_fit();
+    }
+    else
+    {
+      out_.append(data, n);
+    }
+
+    conn_.flush(*this);
+  }
+
+  void H2_stream::close()
+  {
+    if(closed_)
+      return;
+
+    closed_ = true;
+    if(auto cb = std::move(on_close_))
+      cb();
+
+    if(reset_)
+      conn_.remove(id_);
+    // nothing was answered
+    else if(not head_sent_)
+      conn_.reset_stream(id_, Error_code::INTERNAL_ERROR);
+    // ends the stream, and removes it when everything is sent
+    else
+      conn_.flush(*this);
+  }
+
+  net::Socket H2_stream::local() const
+  { return conn_.parent_.stream()->local(); }
+
+  net::Socket H2_stream::remote() const
+  { return conn_.parent_.stream()->remote(); }
+
+  std::string H2_stream::to_string() const
+  { return "HTTP/2 stream " + std::to_string(id_) + " on " + conn_.parent_.stream()->to_string(); }
+
+  int H2_stream::get_cpuid() const noexcept
+  { return conn_.parent_.stream()->get_cpuid(); }
+
+  net::Stream* H2_stream::transport() noexcept
+  { return conn_.parent_.stream().get(); }
+
+  H2_connection::H2_connection(Server& server, Connection& parent, const Settings& settings)
+    : server_(server),
+      parent_(parent),
+      settings_(settings),
+      decoder_{settings.header_table_size},
+      preface_left_{PREFACE_LEN},
+      send_window_{DEFAULT_WINDOW_SIZE},
+      recv_window_{std::max(settings.initial_window_size, DEFAULT_WINDOW_SIZE)},
+      initial_send_window_{DEFAULT_WINDOW_SIZE},
+      peer_max_frame_{DEFAULT_MAX_FRAME_SIZE}
+  {
+  }
+
+  bool H2_connection::is_preface(const char* data, size_t len) noexcept
+  {
+    // "PRI" is not a method, so the first bytes tell
+    return len >= 4 and std::memcmp(data, PREFACE, std::min(len, PREFACE_LEN)) == 0;
+  }
+
+  bool H2_connection::is_upgrade(const Request& req)
+  {
+    const auto& header = req.header();
+    return header.value(header::Upgrade).find("h2c") != util::sview::npos
+      and header.has_field("HTTP2-Settings");
+  }
+
+  bool H2_connection::upgrade(Request_ptr& req)
+  {
+    // SETTINGS payload in base64url, without padding (RFC 7540 3.2.1)
+    std::string value{req->header().value("HTTP2-Settings")};
+    value.append((4 - value.size() % 4) % 4, '=');
+
+    try
+    {
+      const auto payload = base64::decode(value, base64::url_alphabet{true});
+      if(payload.size() % 6 != 0)
+        return false;
+      apply_settings(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+    }
+    catch(const std::runtime_error&)
+    {
+      return false;
+    }
+
+    send("HTTP/1.1 101 Switching Protocols\r\n"
+         "Connection: Upgrade\r\n"
+         "Upgrade: h2c\r\n\r\n");
+    start();
+
+    // the request is answered on stream 1, which the client has half-closed
+    last_stream_ = 1;
+    auto& stream = open(1);
+    stream.req_        = std::move(req);
+    stream.remote_end_ = true;
+    dispatch(stream);
+    return true;
+  }
+
+  void H2_connection::start()
+  {
+    started_ = true;
+
+    std::string payload;
+    auto setting = [&payload] (Setting id, uint32_t value) {
+      payload.push_back(static_cast<uint16_t>(id) >> 8);
+      payload.push_back(static_cast<uint16_t>(id));
+      append_u32(payload, value);
+    };
+    setting(Setting::HEADER_TABLE_SIZE,      settings_.header_table_size);
+    setting(Setting::MAX_CONCURRENT_STREAMS, settings_.max_concurrent_streams);
+    setting(Setting::INITIAL_WINDOW_SIZE,    settings_.initial_window_size);
+    setting(Setting::MAX_FRAME_SIZE,         settings_.max_frame_size);
+    setting(Setting::MAX_HEADER_LIST_SIZE,   settings_.max_header_list_size);
+
+    std::string out;
+    append_frame(out, Frame_type::SETTINGS, 0, 0, payload.data(), payload.size());
+
+    // the connection window is not set by SETTINGS, only grown
+    if(recv_window_ > DEFAULT_WINDOW_SIZE)
+    {
+      append_frame_header(out, 4, Frame_type::WINDOW_UPDATE, 0, 0);
+      append_u32(out, recv_window_ - DEFAULT_WINDOW_SIZE);
+    }
+
+    send(out);
+  }
+
+  void H2_connection::receive(const uint8_t* data, size_t len)
+  {
+    in_.append(reinterpret_cast<const char*>(data), len);
+    size_t pos = 0;
+
+    try
+    {
+      if(preface_left_ > 0)
+      {
+        const auto n = std::min(preface_left_, in_.size());
+        if(std::memcmp(in_.data(), PREFACE + (PREFACE_LEN - preface_left_), n) != 0)
+          throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid preface"};
+
+        preface_left_ -= n;
+        pos = n;
+
+        if(not started_)
+          start();
+      }
+
+      while(preface_left_ == 0 and in_.size() - pos >= FRAME_HEADER_LEN)
+      {
+        const auto* frame = reinterpret_cast<const uint8_t*>(in_.data() + pos);
+        const auto header = Frame_header::parse(frame);
+
+        if(header.length > settings_.max_frame_size)
+          throw Connection_error{Error_code::FRAME_SIZE_ERROR, "Frame too large"};
+
+        if(in_.size() - pos < FRAME_HEADER_LEN + header.length)
+          break;
+
+        pos += FRAME_HEADER_LEN + header.length;
+        handle_frame(header, frame + FRAME_HEADER_LEN);
+      }
+    }
+    catch(const Connection_error& err)
+    {
+      goaway(err.code);
+      parent_.shutdown(); // deletes this
+      return;
+    }
+    catch(const hpack::Error&)
+    {
+      // the decoder is out of sync with the peer's encoder
+      goaway(Error_code::COMPRESSION_ERROR);
+      parent_.shutdown(); // deletes this
+      return;
+    }
+    catch(...)
+    {
+      in_.erase(0, pos);
+      throw;
+    }
+
+    in_.erase(0, pos);
+  }
+
+  void H2_connection::handle_frame(const Frame_header& header, const uint8_t* payload)
+  {
+    // a header block is not interrupted by other frames
+    if(continuation_ != 0 and (header.type != Frame_type::CONTINUATION or header.stream != continuation_))
+      throw Connection_error{Error_code::PROTOCOL_ERROR, "Expected CONTINUATION"};
+
+    switch(header.type)
+    {
+      case Frame_type::DATA:
+        on_data(header, payload);
+        break;
+
+      case Frame_type::HEADERS:
+        on_headers(header, payload);
+        break;
+
+      case Frame_type::PRIORITY:
+        if(header.stream == 0)
+          throw Connection_error{Error_code::PROTOCOL_ERROR, "PRIORITY on stream 0"};
+        // priorities are not used
+        if(header.length != 5)
+          reset_stream(header.stream, Error_code::FRAME_SIZE_ERROR);
+        break;
+
+      case Frame_type::RST_STREAM:
+        on_rst_stream(header, payload);
+        break;
+
+      case Frame_type::SETTINGS:
+        on_settings(header, payload);
+        break;
+
+      case Frame_type::PUSH_PROMISE:
+        throw Connection_error{Error_code::PROTOCOL_ERROR, "PUSH_PROMISE from client"};
+
+      case Frame_type::PING:
+        if(header.stream != 0)
+          throw Connection_error{Error_code::PROTOCOL_ERROR, "PING on a stream"};
+        if(header.length != 8)
+          throw Connection_error{Error_code::FRAME_SIZE_ERROR, "Invalid PING"};
+        if(not (header.flags & flag::ACK))
+        {
+          std::string out;
+          append_frame(out, Frame_type::PING, flag::ACK, 0,
+                       reinterpret_cast<const char*>(payload), header.length);
+          send(out);
+        }
+        break;
+
+      case Frame_type::GOAWAY:
+        if(header.stream != 0)
+          throw Connection_error{Error_code::PROTOCOL_ERROR, "GOAWAY on a stream"};
+        // the streams open are finished, the client closes when done
+        goaway_ = true;
+        break;
+
+      case Frame_type::WINDOW_UPDATE:
+        on_window_update(header, payload);
+        break;
+
+      case Frame_type::CONTINUATION:
+        if(continuation_ == 0)
+          throw Connection_error{Error_code::PROTOCOL_ERROR, "Unexpected CONTINUATION"};
+        header_block_.append(reinterpret_cast<const char*>(payload), header.length);
+        if(header_block_.size() > settings_.max_header_list_size + settings_.max_frame_size)
+          throw Connection_error{Error_code::ENHANCE_YOUR_CALM, "Header block too large"};
+        if(header.flags & flag::END_HEADERS)
+          end_headers(header.stream);
+        break;
+
+      default:
+        // unknown frames are ignored (RFC 7540 4.1)
+        break;
+    }
+  }
+
+  void H2_connection::on_headers(const Frame_header& header, const uint8_t* payload)
+  {
+    if(header.stream == 0 or header.stream % 2 == 0)
+      throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid stream id"};
+
+    size_t len = header.length;
+    if(header.flags & flag::PADDED)
+    {
+      if(len == 0 or payload[0] >= len)
+        throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid padding"};
+      len -= 1 + payload[0];
+      payload++;
+    }
+    // stream dependency and weight, not used
+    if(header.flags & flag::PRIORITY)
+    {
+      if(len < 5)
+        throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid HEADERS"};
+      len     -= 5;
+      payload += 5;
+    }
+
+    header_block_.assign(reinterpret_cast<const char*>(payload), len);
+    block_flags_ = header.flags;
+
+    if(header.flags & flag::END_HEADERS)
+      end_headers(header.stream);
+    else
+      continuation_ = header.stream;
+  }
+
+  void H2_connection::end_headers(uint32_t id)
+  {
+    continuation_ = 0;
+
+    // always decoded, the table changes even if the stream is refused
+    const auto fields = decoder_.decode(
+        reinterpret_cast<const uint8_t*>(header_block_.data()), header_block_.size());
+    header_block_.clear();
+
+    const bool end_stream = block_flags_ & flag::END_STREAM;
+
+    if(auto* stream = find(id))
+    {
+      // trailers end the request, their fields are not used
+      if(stream->remote_end_ or not end_stream)
+      {
+        reset_stream(id, stream->remote_end_ ? Error_code::STREAM_CLOSED : Error_code::PROTOCOL_ERROR);
+        return;
+      }
+      stream->remote_end_ = true;
+      dispatch(*stream);
+      return;
+    }
+
+    if(id <= last_stream_)
+      throw Connection_error{Error_code::STREAM_CLOSED, "HEADERS on a closed stream"};
+    last_stream_ = id;
+
+    if(goaway_ or streams_.size() >= settings_.max_concurrent_streams)
+    {
+      reset_stream(id, Error_code::REFUSED_STREAM);
+      return;
+    }
+
+    size_t list_size = 0;
+    for(const auto& field : fields)
+      list_size += field.first.size() + field.second.size() + hpack::Table::ENTRY_OVERHEAD;
+    if(list_size > settings_.max_header_list_size)
+    {
+      reset_stream(id, Error_code::ENHANCE_YOUR_CALM);
+      return;
+    }
+
+    auto req = build_request(fields);
+    if(req == nullptr)
+    {
+      reset_stream(id, Error_code::PROTOCOL_ERROR);
+      return;
+    }
+
+    auto& stream = open(id);
+    stream.req_ = std::move(req);
+
+    if(end_stream)
+    {
+      stream.remote_end_ = true;
+      dispatch(stream);
+    }
+  }
+
+  Request_ptr H2_connection::build_request(const hpack::Field_list& fields) const
+  {
+    auto req = http::make_request();
+    req->set_version(Version{2U, 0U});
+
+    std::string path, authority, cookie;
+    bool has_method = false;
+    bool regular    = false;
+
+    for(const auto& field : fields)
+    {
+      const auto& name = field.first;
+      if(name.empty() or std::any_of(name.begin(), name.end(), ::isupper))
+        return nullptr;
+
+      if(name.front() == ':')
+      {
+        // pseudo-header fields come first (RFC 7540 8.1.2.1)
+        if(regular)
+          return nullptr;
+
+        if(name == ":method")
+        {
+          req->set_method(method::code(field.second));
+          has_method = true;
+        }
+        else if(name == ":path")
+          path = field.second;
+        else if(name == ":authority")
+          authority = field.second;
+        else if(name != ":scheme")
+          return nullptr;
+      }
+      else
+      {
+        regular = true;
+
+        if(is_connection_specific(name) or (name == "te" and field.second != "trailers"))
+          return nullptr;
+
+        // cookie crumbs are put back together (RFC 7540 8.1.2.5)
+        if(name == "cookie")
+          cookie += (cookie.empty() ? "" : "; ") + field.second;
+        else
+          req->header().add_field(name, field.second);
+      }
+    }
+
+    if(not has_method or req->method() == INVALID or path.empty())
+      return nullptr;
+
+    req->set_uri(URI{path});
+
+    if(not cookie.empty())
+      req->header().add_field("cookie", std::move(cookie));
+
+    if(not authority.empty() and not req->header().has_field(header::Host))
+      req->header().add_field("host", std::move(authority));
+
+    req->set_headers_complete(true);
+    return req;
+  }
+
+  H2_stream& H2_connection::open(uint32_t id)
+  {
+    auto conn = std::make_unique<Connection>(std::make_unique<H2_stream>(*this, id), false);
+    auto& stream = static_cast<H2_stream&>(*conn->stream());
+    streams_.emplace(id, std::move(conn));
+    return stream;
+  }
+
+  void H2_connection::dispatch(H2_stream& stream)
+  {
+    auto& req = *stream.req_;
+
+    if(req.header().has_field(header::Content_Length)
+      and req.content_length() != req.body().size())
+    {
+      reset_stream(stream.id_, Error_code::PROTOCOL_ERROR);
+      return;
+    }
+
+    stream.head_request_ = (req.method() == HEAD);
+    server_.receive(std::move(stream.req_), OK, *streams_.at(stream.id_));
+  }
+
+  void H2_connection::on_data(const Frame_header& header, const uint8_t* payload)
+  {
+    if(header.stream == 0)
+      throw Connection_error{Error_code::PROTOCOL_ERROR, "DATA on stream 0"};
+
+    // flow control counts the whole payload, padding included
+    recv_window_ -= header.length;
+    if(recv_window_ < 0)
+      throw Connection_error{Error_code::FLOW_CONTROL_ERROR, "Connection window exceeded"};
+
+    const int64_t window = std::max(settings_.initial_window_size, DEFAULT_WINDOW_SIZE);
+    if(recv_window_ <= window / 2)
+    {
+      send_window_update(0, window - recv_window_);
+      recv_window_ = window;
+    }
+
+    size_t len = header.length;
+    if(header.flags & flag::PADDED)
+    {
+      if(len == 0 or payload[0] >= len)
+        throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid padding"};
+      len -= 1 + payload[0];
+      payload++;
+    }
+
+    auto* stream = find(header.stream);
+    if(stream == nullptr)
+    {
+      if(header.stream > last_stream_)
+        throw Connection_error{Error_code::PROTOCOL_ERROR, "DATA on an idle stream"};
+      // a stream reset or answered already
+      return;
+    }
+
+    if(stream->remote_end_)
+    {
+      reset_stream(header.stream, Error_code::STREAM_CLOSED);
+      return;
+    }
+
+    stream->recv_window_ -= header.length;
+    if(stream->recv_window_ < 0)
+    {
+      reset_stream(header.stream, Error_code::FLOW_CONTROL_ERROR);
+      return;
+    }
+
+    stream->req_->add_chunk(std::string(reinterpret_cast<const char*>(payload), len));
+
+    if(header.flags & flag::END_STREAM)
+    {
+      stream->remote_end_ = true;
+      dispatch(*stream);
+    }
+    else if(stream->recv_window_ <= settings_.initial_window_size / 2)
+    {
+      send_window_update(header.stream, settings_.initial_window_size - stream->recv_window_);
+      stream->recv_window_ = settings_.initial_window_size;
+    }
+  }
+
+  void H2_connection::on_settings(const Frame_header& header, const uint8_t* payload)
+  {
+    if(header.stream != 0)
+      throw Connection_error{Error_code::PROTOCOL_ERROR, "SETTINGS on a stream"};
+
+    if(header.flags & flag::ACK)
+    {
+      if(header.length != 0)
+        throw Connection_error{Error_code::FRAME_SIZE_ERROR, "Invalid SETTINGS ack"};
+      return;
+    }
+
+    if(header.length % 6 != 0)
+      throw Connection_error{Error_code::FRAME_SIZE_ERROR, "Invalid SETTINGS"};
+
+    apply_settings(payload, header.length);
+
+    std::string out;
+    append_frame_header(out, 0, Frame_type::SETTINGS, flag::ACK, 0);
+    send(out);
+
+    // the windows may have grown
+    flush_all();
+  }
+
+  void H2_connection::apply_settings(const uint8_t* data, size_t len)
+  {
+    for(size_t i = 0; i + 6 <= len; i += 6)
+    {
+      const auto id    = static_cast<Setting>((data[i] << 8) | data[i + 1]);
+      const auto value = Frame_header::read_u32(data + i + 2);
+
+      switch(id)
+      {
+        case Setting::HEADER_TABLE_SIZE:
+          encoder_.set_max_table_size(value);
+          break;
+
+        case Setting::ENABLE_PUSH:
+          if(value > 1)
+            throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid ENABLE_PUSH"};
+          break;
+
+        case Setting::INITIAL_WINDOW_SIZE:
+        {
+          if(value > MAX_WINDOW_SIZE)
+            throw Connection_error{Error_code::FLOW_CONTROL_ERROR, "Invalid INITIAL_WINDOW_SIZE"};
+
+          // applies to the open streams as well (RFC 7540 6.9.2)
+          const int64_t delta = int64_t(value) - initial_send_window_;
+          initial_send_window_ = value;
+          for(auto& entry : streams_)
+          {
+            auto& stream = static_cast<H2_stream&>(*entry.second->stream());
+            stream.send_window_ += delta;
+            if(stream.send_window_ > MAX_WINDOW_SIZE)
+              throw Connection_error{Error_code::FLOW_CONTROL_ERROR, "Stream window overflow"};
+          }
+          break;
+        }
+
+        case Setting::MAX_FRAME_SIZE:
+          if(value < DEFAULT_MAX_FRAME_SIZE or value > FRAME_SIZE_LIMIT)
+            throw Connection_error{Error_code::PROTOCOL_ERROR, "Invalid MAX_FRAME_SIZE"};
+          peer_max_frame_ = value;
+          break;
+
+        default:
+          // MAX_CONCURRENT_STREAMS limits pushes, which are not used
+          break;
+      }
+    }
+  }
+
+  void H2_connection::on_window_update(const Frame_header& header, const uint8_t* payload)
+  {
+    if(header.length != 4)
+      throw Connection_error{Error_code::FRAME_SIZE_ERROR, "Invalid WINDOW_UPDATE"};
+
+    const auto increment = Frame_header::read_u32(payload) & MAX_WINDOW_SIZE;
+
+    if(header.stream == 0)
+    {
+      if(increment == 0)
+        throw Connection_error{Error_code::PROTOCOL_ERROR, "WINDOW_UPDATE of 0"};
+      send_window_ += increment;
+      if(send_window_ > MAX_WINDOW_SIZE)
+        throw Connection_error{Error_code::FLOW_CONTROL_ERROR, "Connection window overflow"};
+      flush_all();
+      return;
+    }
+
+    auto* stream = find(header.stream);
+    if(stream == nullptr)
+      return;
+
+    if(increment == 0)
+    {
+      reset_stream(header.stream, Error_code::PROTOCOL_ERROR);
+      return;
+    }
+
+    stream->send_window_ += increment;
+    if(stream->send_window_ > MAX_WINDOW_SIZE)
+    {
+      reset_stream(header.stream, Error_code::FLOW_CONTROL_ERROR);
+      return;
+    }
+
+    flush(*stream);
+  }
+
+  void H2_connection::on_rst_stream(const Frame_header& header, const uint8_t*)
+  {
+    if(header.stream == 0 or header.stream > last_stream_)
+      throw Connection_error{Error_code::PROTOCOL_ERROR, "RST_STREAM on an idle stream"};
+    if(header.length != 4)
+      throw Connection_error{Error_code::FRAME_SIZE_ERROR, "Invalid RST_STREAM"};
+
+    auto* stream = find(header.stream);
+    if(stream == nullptr)
+      return;
+
+    stream->reset_ = true;
+    stream->out_.clear();
+
+    // nobody is answering it
+    if(stream->closed_ or stream->req_ != nullptr)
+    {
+      remove(header.stream);
+      return;
+    }
+
+    // the response is still being written, and is now discarded
+    if(auto cb = std::move(stream->on_close_))
+      cb();
+  }
+
+  void H2_connection::send_head(H2_stream& stream)
+  {
+    const auto& head = stream.head_;
+
+    // "HTTP/1.1 200 OK", and a field per line
+    const auto sp = head.find(' ');
+    const auto status = (sp != std::string::npos) ? head.substr(sp + 1, 3) : "500";
+
+    std::string block;
+    encoder_.encode(block, ":status", status);
+
+    for(auto pos = head.find("\r\n") + 2; pos < head.size(); )
+    {
+      const auto eol = head.find("\r\n", pos);
+      if(eol == pos or eol == std::string::npos)
+        break;
+
+      const auto colon = head.find(':', pos);
+      if(colon < eol)
+      {
+        auto name = head.substr(pos, colon - pos);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        const auto start = std::min(head.find_first_not_of(' ', colon + 1), eol);
+        const auto value = head.substr(start, eol - start);
+
+        if(not is_connection_specific(name))
+        {
+          if(name == "content-length")
+            stream.content_left_ = std::strtoll(value.c_str(), nullptr, 10);
+          encoder_.encode(block, name, value);
+        }
+      }
+      pos = eol + 2;
+    }
+
+    const bool end = stream.head_request_ or stream.content_left_ == 0
+      or status == "204" or status == "304";
+
+    // HEADERS, and CONTINUATION with what doesn't fit in a frame
+    std::string out;
+    auto type = Frame_type::HEADERS;
+    size_t off = 0;
+    do
+    {
+      const auto n = std::min<size_t>(block.size() - off, peer_max_frame_);
+      uint8_t flags = (off + n == block.size()) ? flag::END_HEADERS : 0;
+      if(type == Frame_type::HEADERS and end)
+        flags |= flag::END_STREAM;
+
+      append_frame(out, type, flags, stream.id_, block.data() + off, n);
+      off += n;
+      type = Frame_type::CONTINUATION;
+    } while(off < block.size());
+
+    send(out);
+    stream.head_sent_ = true;
+    stream.local_end_ = end;
+  }
+
+  void H2_connection::flush(H2_stream& stream)
+  {
+    // nothing more is sent after END_STREAM
+    if(stream.local_end_)
+      stream.out_.clear();
+
+    std::string out;
+    size_t sent = 0;
+
+    while(not stream.out_.empty())
+    {
+      const auto n = std::min<int64_t>({static_cast<int64_t>(stream.out_.size()),
+        stream.send_window_, send_window_, peer_max_frame_});
+      if(n <= 0)
+        break;
+
+      uint8_t flags = 0;
+      if(stream.content_left_ > 0)
+      {
+        stream.content_left_ -= n;
+        if(stream.content_left_ <= 0)
+        {
+          flags = flag::END_STREAM;
+          stream.local_end_ = true;
+        }
+      }
+
+      append_frame(out, Frame_type::DATA, flags, stream.id_, stream.out_.data(), n);
+      stream.out_.erase(0, n);
+      stream.send_window_ -= n;
+      send_window_        -= n;
+      sent += n;
+
+      if(stream.local_end_)
+        stream.out_.clear();
+    }
+
+    // a closed stream ends when everything is sent
+    const bool done = stream.closed_ and stream.out_.empty();
+    if(done and not stream.local_end_)
+    {
+      append_frame(out, Frame_type::DATA, flag::END_STREAM, stream.id_, "", 0);
+      stream.local_end_ = true;
+    }
+
+    if(not out.empty())
+      send(out);
+
+    if(sent > 0 and stream.on_write_)
+      stream.on_write_(sent);
+
+    if(done)
+      remove(stream.id_);
+  }
+
+  void H2_connection::flush_all()
+  {
+    // flushing may remove streams
+    std::vector<uint32_t> waiting;
+    for(const auto& entry : streams_)
+      if(not static_cast<H2_stream&>(*entry.second->stream()).out_.empty())
+        waiting.push_back(entry.first);
+
+    for(const auto id : waiting)
+      if(auto* stream = find(id))
+        flush(*stream);
+  }
+
+  void H2_connection::remove(uint32_t id)
+  {
+    streams_.erase(id);
+  }
+
+  void H2_connection::reset_stream(uint32_t id, Error_code code)
+  {
+    std::string out;
+    append_frame_header(out, 4, Frame_type::RST_STREAM, 0, id);
+    append_u32(out, static_cast<uint32_t>(code));
+    send(out);
+
+    if(auto* stream = find(id))
+    {
+      stream->reset_ = true;
+      stream->out_.clear();
+
+      // kept until closed if the user is answering it
+      if(stream->closed_ or stream->req_ != nullptr)
+        remove(id);
+    }
+  }
+
+  void H2_connection::send_window_update(uint32_t id, uint32_t increment)
+  {
+    std::string out;
+    append_frame_header(out, 4, Frame_type::WINDOW_UPDATE, 0, id);
+    append_u32(out, increment);
+    send(out);
+  }
+
+  void H2_connection::goaway(Error_code code)
+  {
+    std::string out;
+    append_frame_header(out, 8, Frame_type::GOAWAY, 0, 0);
+    append_u32(out, last_stream_);
+    append_u32(out, static_cast<uint32_t>(code));
+    send(out);
+  }
+
+  void H2_connection::send(const std::string& data)
+  {
+    parent_.stream()->write(data);
+  }
+
+  H2_stream* H2_connection::find(uint32_t id) const
+  {
+    const auto it = streams_.find(id);
+    return (it != streams_.end()) ? &static_cast<H2_stream&>(*it->second->stream()) : nullptr;
+  }
+
+}
@@ -0,0 +1,459 @@
+
+#include <net/http/hpack.hpp>
+#include <array>
+
+namespace http {
+namespace hpack {
+
+  // RFC 7541 Appendix A
+  static const std::array<Field, Table::STATIC_SIZE> static_table {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+  }};
+
+  struct Code {
+    uint32_t bits;
+    uint8_t  len;
+  };
+
+  // RFC 7541 Appendix B, indexed by symbol (256 is EOS)
+  static const std::array<Code, 257> huffman_codes {{
+    {0x00001ff8, 13}, {0x007fffd8, 23}, {0x0fffffe2, 28}, {0x0fffffe3, 28},
+    {0x0fffffe4, 28}, {0x0fffffe5, 28}, {0x0fffffe6, 28}, {0x0fffffe7, 28},
+    {0x0fffffe8, 28}, {0x00ffffea, 24}, {0x3ffffffc, 30}, {0x0fffffe9, 28},
+    {0x0fffffea, 28}, {0x3ffffffd, 30}, {0x0fffffeb, 28}, {0x0fffffec, 28},
+    {0x0fffffed, 28}, {0x0fffffee, 28}, {0x0fffffef, 28}, {0x0ffffff0, 28},
+    {0x0ffffff1, 28}, {0x0ffffff2, 28}, {0x3ffffffe, 30}, {0x0ffffff3, 28},
+    {0x0ffffff4, 28}, {0x0ffffff5, 28}, {0x0ffffff6, 28}, {0x0ffffff7, 28},
+    {0x0ffffff8, 28}, {0x0ffffff9, 28}, {0x0ffffffa, 28}, {0x0ffffffb, 28},
+    {0x00000014,  6}, {0x000003f8, 10}, {0x000003f9, 10}, {0x00000ffa, 12},
+    {0x00001ff9, 13}, {0x00000015,  6}, {0x000000f8,  8}, {0x000007fa, 11},
+    {0x000003fa, 10}, {0x000003fb, 10}, {0x000000f9,  8}, {0x000007fb, 11},
+    {0x000000fa,  8}, {0x00000016,  6}, {0x00000017,  6}, {0x00000018,  6},
+    {0x00000000,  5}, {0x00000001,  5}, {0x00000002,  5}, {0x00000019,  6},
+    {0x0000001a,  6}, {0x0000001b,  6}, {0x0000001c,  6}, {0x0000001d,  6},
+    {0x0000001e,  6}, {0x0000001f,  6}, {0x0000005c,  7}, {0x000000fb,  8},
+    {0x00007ffc, 15}, {0x00000020,  6}, {0x00000ffb, 12}, {0x000003fc, 10},
+    {0x00001ffa, 13}, {0x00000021,  6}, {0x0000005d,  7}, {0x0000005e,  7},
+    {0x0000005f,  7}, {0x00000060,  7}, {0x00000061,  7}, {0x00000062,  7},
+    {0x00000063,  7}, {0x00000064,  7}, {0x00000065,  7}, {0x00000066,  7},
+    {0x00000067,  7}, {0x00000068,  7}, {0x00000069,  7}, {0x0000006a,  7},
+    {0x0000006b,  7}, {0x0000006c,  7}, {0x0000006d,  7}, {0x0000006e,  7},
+    {0x0000006f,  7}, {0x00000070,  7}, {0x00000071,  7}, {0x00000072,  7},
+    {0x000000fc,  8}, {0x00000073,  7}, {0x000000fd,  8}, {0x00001ffb, 13},
+    {0x0007fff0, 19}, {0x00001ffc, 13}, {0x00003ffc, 14}, {0x00000022,  6},
+    {0x00007ffd, 15}, {0x00000003,  5}, {0x00000023,  6}, {0x00000004,  5},
+    {0x00000024,  6}, {0x00000005,  5}, {0x00000025,  6}, {0x00000026,  6},
+    {0x00000027,  6}, {0x00000006,  5}, {0x00000074,  7}, {0x00000075,  7},
+    {0x00000028,  6}, {0x00000029,  6}, {0x0000002a,  6}, {0x00000007,  5},
+    {0x0000002b,  6}, {0x00000076,  7}, {0x0000002c,  6}, {0x00000008,  5},
+    {0x00000009,  5}, {0x0000002d,  6}, {0x00000077,  7}, {0x00000078,  7},
+    {0x00000079,  7}, {0x0000007a,  7}, {0x0000007b,  7}, {0x00007ffe, 15},
+    {0x000007fc, 11}, {0x00003ffd, 14}, {0x00001ffd, 13}, {0x0ffffffc, 28},
+    {0x000fffe6, 20}, {0x003fffd2, 22}, {0x000fffe7, 20}, {0x000fffe8, 20},
+    {0x003fffd3, 22}, {0x003fffd4, 22}, {0x003fffd5, 22}, {0x007fffd9, 23},
+    {0x003fffd6, 22}, {0x007fffda, 23}, {0x007fffdb, 23}, {0x007fffdc, 23},
+    {0x007fffdd, 23}, {0x007fffde, 23}, {0x00ffffeb, 24}, {0x007fffdf, 23},
+    {0x00ffffec, 24}, {0x00ffffed, 24}, {0x003fffd7, 22}, {0x007fffe0, 23},
+    {0x00ffffee, 24}, {0x007fffe1, 23}, {0x007fffe2, 23}, {0x007fffe3, 23},
+    {0x007fffe4, 23}, {0x001fffdc, 21}, {0x003fffd8, 22}, {0x007fffe5, 23},
+    {0x003fffd9, 22}, {0x007fffe6, 23}, {0x007fffe7, 23}, {0x00ffffef, 24},
+    {0x003fffda, 22}, {0x001fffdd, 21}, {0x000fffe9, 20}, {0x003fffdb, 22},
+    {0x003fffdc, 22}, {0x007fffe8, 23}, {0x007fffe9, 23}, {0x001fffde, 21},
+    {0x007fffea, 23}, {0x003fffdd, 22}, {0x003fffde, 22}, {0x00fffff0, 24},
+    {0x001fffdf, 21}, {0x003fffdf, 22}, {0x007fffeb, 23}, {0x007fffec, 23},
+    {0x001fffe0, 21}, {0x001fffe1, 21}, {0x003fffe0, 22}, {0x001fffe2, 21},
+    {0x007fffed, 23}, {0x003fffe1, 22}, {0x007fffee, 23}, {0x007fffef, 23},
+    {0x000fffea, 20}, {0x003fffe2, 22}, {0x003fffe3, 22}, {0x003fffe4, 22},
+    {0x007ffff0, 23}, {0x003fffe5, 22}, {0x003fffe6, 22}, {0x007ffff1, 23},
+    {0x03ffffe0, 26}, {0x03ffffe1, 26}, {0x000fffeb, 20}, {0x0007fff1, 19},
+    {0x003fffe7, 22}, {0x007ffff2, 23}, {0x003fffe8, 22}, {0x01ffffec, 25},
+    {0x03ffffe2, 26}, {0x03ffffe3, 26}, {0x03ffffe4, 26}, {0x07ffffde, 27},
+    {0x07ffffdf, 27}, {0x03ffffe5, 26}, {0x00fffff1, 24}, {0x01ffffed, 25},
+    {0x0007fff2, 19}, {0x001fffe3, 21}, {0x03ffffe6, 26}, {0x07ffffe0, 27},
+    {0x07ffffe1, 27}, {0x03ffffe7, 26}, {0x07ffffe2, 27}, {0x00fffff2, 24},
+    {0x001fffe4, 21}, {0x001fffe5, 21}, {0x03ffffe8, 26}, {0x03ffffe9, 26},
+    {0x0ffffffd, 28}, {0x07ffffe3, 27}, {0x07ffffe4, 27}, {0x07ffffe5, 27},
+    {0x000fffec, 20}, {0x00fffff3, 24}, {0x000fffed, 20}, {0x001fffe6, 21},
+    {0x003fffe9, 22}, {0x001fffe7, 21}, {0x001fffe8, 21}, {0x007ffff3, 23},
+    {0x003fffea, 22}, {0x003fffeb, 22}, {0x01ffffee, 25}, {0x01ffffef, 25},
+    {0x00fffff4, 24}, {0x00fffff5, 24}, {0x03ffffea, 26}, {0x007ffff4, 23},
+    {0x03ffffeb, 26}, {0x07ffffe6, 27}, {0x03ffffec, 26}, {0x03ffffed, 26},
+    {0x07ffffe7, 27}, {0x07ffffe8, 27}, {0x07ffffe9, 27}, {0x07ffffea, 27},
+    {0x07ffffeb, 27}, {0x0ffffffe, 28}, {0x07ffffec, 27}, {0x07ffffed, 27},
+    {0x07ffffee, 27}, {0x07ffffef, 27}, {0x07fffff0, 27}, {0x03ffffee, 26},
+    {0x3fffffff, 30}
+  }};
+
+  static constexpr uint16_t EOS = 256;
+
+  /**
+   * The code is canonical: codes of the same length are consecutive,
+   * in the order of their symbols. Decoding a code of a given length is
+   * then a range check and a lookup.
+   */
+  struct Huffman_decoding {
+    static constexpr int MAX_LEN = 30;
+    std::array<uint32_t, MAX_LEN + 1> first{};  // first code of each length
+    std::array<uint16_t, MAX_LEN + 1> count{};  // codes of each length
+    std::array<uint16_t, MAX_LEN + 1> offset{}; // index of the first code in symbols
+    std::array<uint16_t, 257>         symbols{};
+
+    Huffman_decoding()
+    {
+      for (const auto& code : huffman_codes) count[code.len]++;
+
+      uint16_t idx = 0;
+      for (int len = 1; len <= MAX_LEN; len++) {
+        offset[len] = idx;
+        idx += count[len];
+      }
+      auto next = offset;
+      for (uint16_t sym = 0; sym < huffman_codes.size(); sym++)
+      {
+        const auto& code = huffman_codes[sym];
+        if (next[code.len] == offset[code.len]) first[code.len] = code.bits;
+        symbols[next[code.len]++] = sym;
+      }
+    }
+  };
+
+  void encode_integer(std::string& out, uint8_t prefix, uint8_t flags, uint64_t value)
+  {
+    const uint8_t max = (1u << prefix) - 1;
+    if (value < max) {
+      out.push_back(flags | value);
+      return;
+    }
+    out.push_back(flags | max);
+    value -= max;
+    while (value >= 128) {
+      out.push_back((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    out.push_back(value);
+  }
+
+  uint64_t decode_integer(const uint8_t*& pos, const uint8_t* end, uint8_t prefix)
+  {
+    if (pos >= end) throw Error{"Integer out of bounds"};
+    const uint8_t max = (1u << prefix) - 1;
+    uint64_t value = *pos++ & max;
+    if (value < max) return value;
+
+    for (int shift = 0; shift <= 28; shift += 7)
+    {
+      if (pos >= end) throw Error{"Integer out of bounds"};
+      const uint8_t byte = *pos++;
+      value += uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return value;
+    }
+    throw Error{"Integer too large"};
+  }
+
+  size_t huffman_length(const std::string& str) noexcept
+  {
+    size_t bits = 0;
+    for (const uint8_t c : str) bits += huffman_codes[c].len;
+    return (bits + 7) / 8;
+  }
+
+  void huffman_encode(std::string& out, const std::string& str)
+  {
+    uint64_t acc  = 0;
+    int      bits = 0;
+    for (const uint8_t c : str)
+    {
+      const auto& code = huffman_codes[c];
+      acc = (acc << code.len) | code.bits;
+      bits += code.len;
+      while (bits >= 8) {
+        bits -= 8;
+        out.push_back(acc >> bits);
+      }
+    }
+    // pad with the most significant bits of EOS (all ones)
+    if (bits > 0)
+      out.push_back((acc << (8 - bits)) | (0xff >> bits));
+  }
+
+  std::string huffman_decode(const uint8_t* data, size_t len)
+  {
+    static const Huffman_decoding dec;
+    std::string out;
+    out.reserve(len * 8 / 5);
+
+    uint32_t code = 0;
+    int      bits = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+      for (int b = 7; b >= 0; b--)
+      {
+        code = (code << 1) | ((data[i] >> b) & 1);
+        bits++;
+        const uint32_t idx = code - dec.first[bits];
+        if (dec.count[bits] > 0 and code >= dec.first[bits] and idx < dec.count[bits])
+        {
+          const auto sym = dec.symbols[dec.offset[bits] + idx];
+          if (sym == EOS) throw Error{"EOS in Huffman string"};
+          out.push_back(sym);
+          code = 0;
+          bits = 0;
+        }
+        else if (bits == Huffman_decoding::MAX_LEN) {
+          throw Error{"Invalid Huffman code"};
+        }
+      }
+    }
+    // padding is at most 7 bits, all ones
+    if (bits > 7 or code != (1u << bits) - 1)
+      throw Error{"Invalid Huffman padding"};
+    return out;
+  }
+
+  const Field* Table::get(size_t index) const noexcept
+  {
+    if (index == 0) return nullptr;
+    if (index <= STATIC_SIZE) return &static_table[index - 1];
+    index -= STATIC_SIZE + 1;
+    return (index < entries_.size()) ? &entries_[index] : nullptr;
+  }
+
+  void Table::add(Field field)
+  {
+    const size_t size = field.first.size() + field.second.size() + ENTRY_OVERHEAD;
+    // an entry larger than the table empties it (RFC 7541 4.4)
+    if (size > max_size_) {
+      evict(0);
+      return;
+    }
+    evict(max_size_ - size);
+    entries_.push_front(std::move(field));
+    size_ += size;
+  }
+
+  size_t Table::find(const std::string& name, const std::string& value, bool& exact) const noexcept
+  {
+    size_t name_match = 0;
+    exact = false;
+    for (size_t i = 0; i < static_table.size(); i++)
+    {
+      if (static_table[i].first != name) continue;
+      if (static_table[i].second == value) {
+        exact = true;
+        return i + 1;
+      }
+      if (name_match == 0) name_match = i + 1;
+    }
+    for (size_t i = 0; i < entries_.size(); i++)
+    {
+      if (entries_[i].first != name) continue;
+      if (entries_[i].second == value) {
+        exact = true;
+        return STATIC_SIZE + 1 + i;
+      }
+      if (name_match == 0) name_match = STATIC_SIZE + 1 + i;
+    }
+    return name_match;
+  }
+
+  void Table::set_max_size(size_t max_size)
+  {
+    max_size_ = max_size;
+    evict(max_size_);
+  }
+
+  void Table::evict(size_t max)
+  {
+    while (size_ > max)
+    {
+      const auto& last = entries_.back();
+      size_ -= last.first.size() + last.second.size() + ENTRY_OVERHEAD;
+      entries_.pop_back();
+    }
+  }
+
+  std::string Decoder::read_string(const uint8_t*& pos, const uint8_t* end)
+  {
+    if (pos >= end) throw Error{"String out of bounds"};
+    const bool huffman = *pos & 0x80;
+    const auto len = decode_integer(pos, end, 7);
+    if (len > size_t(end - pos)) throw Error{"String out of bounds"};
+
+    const auto* data = pos;
+    pos += len;
+    return (huffman) ? huffman_decode(data, len) : std::string((const char*) data, len);
+  }
+
+  Field_list Decoder::decode(const uint8_t* data, size_t len, size_t max_list_size)
+  {
+    Field_list fields;
+    size_t list_size = 0;
+    const uint8_t* pos = data;
+    const uint8_t* end = data + len;
+
+    while (pos < end)
+    {
+      const uint8_t byte = *pos;
+      Field field;
+      bool index = false;
+
+      // indexed field
+      if (byte & 0x80)
+      {
+        const auto* entry = table_.get(decode_integer(pos, end, 7));
+        if (entry == nullptr) throw Error{"Invalid index"};
+        field = *entry;
+      }
+      // dynamic table size update, only at the start of a block
+      else if ((byte & 0xe0) == 0x20)
+      {
+        if (not fields.empty()) throw Error{"Table size update after a field"};
+        const auto size = decode_integer(pos, end, 5);
+        if (size > limit_) throw Error{"Table size above the limit"};
+        table_.set_max_size(size);
+        continue;
+      }
+      // literal, with incremental indexing (6-bit prefix), without indexing
+      // or never indexed (4-bit prefix)
+      else
+      {
+        index = (byte & 0xc0) == 0x40;
+        const auto idx = decode_integer(pos, end, (index) ? 6 : 4);
+        if (idx > 0)
+        {
+          const auto* entry = table_.get(idx);
+          if (entry == nullptr) throw Error{"Invalid index"};
+          field.first = entry->first;
+        }
+        else {
+          field.first = read_string(pos, end);
+        }
+        field.second = read_string(pos, end);
+      }
+
+      list_size += field.first.size() + field.second.size() + Table::ENTRY_OVERHEAD;
+      if (max_list_size > 0 and list_size > max_list_size)
+        throw Error{"Header list too large"};
+
+      if (index) table_.add(field);
+      fields.push_back(std::move(field));
+    }
+    return fields;
+  }
+
+  void Encoder::write_string(std::string& out, const std::string& str)
+  {
+    const auto hlen = huffman_length(str);
+    if (hlen < str.size())
+    {
+      encode_integer(out, 7, 0x80, hlen);
+      huffman_encode(out, str);
+    }
+    else
+    {
+      encode_integer(out, 7, 0x00, str.size());
+      out.append(str);
+    }
+  }
+
+  void Encoder::encode(std::string& out, const std::string& name, const std::string& value)
+  {
+    if (size_update_)
+    {
+      encode_integer(out, 5, 0x20, table_.max_size());
+      size_update_ = false;
+    }
+
+    bool exact;
+    const auto idx = table_.find(name, value, exact);
+    if (exact)
+    {
+      encode_integer(out, 7, 0x80, idx);
+      return;
+    }
+
+    // credentials are not put in the table, and not indexed by intermediaries
+    if (name == "authorization" or name == "proxy-authorization" or name == "set-cookie")
+    {
+      encode_integer(out, 4, 0x10, idx);
+    }
+    else
+    {
+      encode_integer(out, 6, 0x40, idx);
+      table_.add({name, value});
+    }
+    if (idx == 0) write_string(out, name);
+    write_string(out, value);
+  }
+
+  void Encoder::set_max_table_size(size_t size)
+  {
+    // never above what the table started with
+    size = std::min(size, DEFAULT_TABLE_SIZE);
+    if (size == table_.max_size()) return;
+    table_.set_max_size(size);
+    size_update_ = true;
+  }
+
+} // < namespace hpack
+} // < namespace http
@@ -66,6 +66,7 @@ namespace http {
       header << response_->status_line() << "\r\n" << response_->header();
 
       connection_.stream()->write(header.str());
+      header_sent_ = true;
 
       // disable keep alive if "Connection: close" is present
       if(response_->header().value(http::header::Connection) == "close")
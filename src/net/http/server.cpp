@@ -11,12 +11,14 @@ namespace http {
     : tcp_(tcp),
       on_request_(std::move(cb)),
       keep_alive_(true),
+      http2_(false),
       timer_id_(Timers::UNUSED_ID),
       idle_timeout_(timeout),
       stat_conns_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.connections")},
       stat_req_rx_{Statman::get().create(Stat::UINT64, tcp.stack().ifname() + ".http_server.requests_rx")},
       stat_req_bad_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.requests_bad")},
-      stat_timeouts_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.timeouts")}
+      stat_timeouts_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.timeouts")},
+      stat_h2_conns_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.h2_connections")}
   {
   }
 
@@ -92,7 +94,7 @@ namespace http {
     }
   }
 
-  void Server::receive(Request_ptr req, status_t code, Server_connection& conn)
+  void Server::receive(Request_ptr req, status_t code, Connection& conn)
   {
     ++stat_req_rx_;
     if(code == OK)
@@ -104,7 +106,7 @@ namespace http {
       ++stat_req_bad_;
       // an error occured when parsing
       // call user on_error or something
-      conn.send(create_response(code));
+      conn.stream()->write(create_response(code)->to_string());
     }
   }
 
@@ -1,6 +1,7 @@
 
 #include <net/http/server_connection.hpp>
 #include <net/http/server.hpp>
+#include <net/http/h2_connection.hpp>
 
 namespace http {
 
@@ -16,6 +17,8 @@ namespace http {
     stream_->on_close({this, &Server_connection::close});
   }
 
+  Server_connection::~Server_connection() = default;
+
   void Server_connection::send(Response_ptr res)
   {
     stream_->write(res->to_string());
@@ -28,8 +31,26 @@ namespace http {
       return;
     }
 
+    if(h2_ != nullptr)
+    {
+      update_idle();
+      h2_->receive(buf->data(), buf->size()); // may delete this
+      return;
+    }
+
     const std::string data{(char*) buf->data(), buf->size()};
 
+    // HTTP/2 with prior knowledge, or negotiated with ALPN
+    if(req_ == nullptr and server_.http2_enabled()
+      and H2_connection::is_preface(data.data(), data.size()))
+    {
+      start_http2();
+      ++server_.stat_h2_conns_;
+      update_idle();
+      h2_->receive(buf->data(), buf->size()); // may delete this
+      return;
+    }
+
     // create response if not exist
     if(req_ == nullptr)
     {
@@ -79,9 +100,27 @@ namespace http {
 
   void Server_connection::end_request(const status_t code)
   {
+    // h2c is only offered over cleartext, TLS negotiates with ALPN
+    if(code == http::OK and server_.http2_enabled() and stream_->transport() == nullptr
+      and H2_connection::is_upgrade(*req_))
+    {
+      start_http2();
+      if(h2_->upgrade(req_))
+      {
+        ++server_.stat_h2_conns_;
+        return;
+      }
+      h2_ = nullptr;
+    }
+
     server_.receive(std::move(req_), code, *this);
   }
 
+  void Server_connection::start_http2()
+  {
+    h2_ = std::make_unique<H2_connection>(server_, *this, server_.http2_settings());
+  }
+
   void Server_connection::close()
   {
     server_.close(*this);
@@ -0,0 +1,583 @@
+
+#include <net/http/static_files.hpp>
+#include <net/http/mime_types.hpp>
+#include <net/http/time.hpp>
+#include <util/crc32.hpp>
+#include <util/percent_encoding.hpp>
+#include <tinf.h>             // From uzlib (mod)
+#include <rtc>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace http {
+
+  static util::sview trim(util::sview sv)
+  {
+    while(not sv.empty() and (sv.front() == ' ' or sv.front() == '\t'))
+      sv.remove_prefix(1);
+    while(not sv.empty() and (sv.back() == ' ' or sv.back() == '\t'))
+      sv.remove_suffix(1);
+    return sv;
+  }
+
+  // calls fn with every item of a comma separated list
+  template <typename Fn>
+  static void for_each_item(util::sview list, Fn fn)
+  {
+    while(not list.empty())
+    {
+      const auto comma = list.find(',');
+      const auto item = trim(list.substr(0, comma));
+      if(not item.empty() and fn(item))
+        return;
+      if(comma == util::sview::npos)
+        break;
+      list.remove_prefix(comma + 1);
+    }
+  }
+
+  // whether an Accept-Encoding allows coding, which isn't refused with q=0
+  static bool accepts(util::sview accept, util::sview coding)
+  {
+    int exact = -1, any = -1;
+    for_each_item(accept, [&] (util::sview item) {
+      const auto semi = item.find(';');
+      const auto name = trim(item.substr(0, semi));
+      if(name != coding and name != "*")
+        return false;
+
+      bool refused = false;
+      if(semi != util::sview::npos)
+      {
+        const auto q = item.find("q=", semi);
+        if(q != util::sview::npos)
+          refused = std::strtod(std::string(item.substr(q + 2)).c_str(), nullptr) <= 0.0;
+      }
+      (name == coding ? exact : any) = not refused;
+      return name == coding;
+    });
+    return (exact != -1) ? exact : (any == 1);
+  }
+
+  // weak comparison, as for If-None-Match (RFC 7232 2.3.2)
+  static bool etag_matches(util::sview list, const std::string& etag)
+  {
+    const auto opaque = util::sview{etag};
+    bool match = false;
+    for_each_item(list, [&] (util::sview item) {
+      if(item.substr(0, 2) == "W/")
+        item.remove_prefix(2);
+      match = (item == "*" or item == opaque);
+      return match;
+    });
+    return match;
+  }
+
+  // the directory entries of FAT keep the time in the low and the date
+  // in the high 16 bits, 0 when unknown
+  static std::time_t fat_time(uint64_t modified)
+  {
+    const uint16_t time = modified & 0xffff;
+    const uint16_t date = (modified >> 16) & 0xffff;
+    if(date == 0)
+      return 0;
+
+    std::tm tm{};
+    tm.tm_year = 80 + (date >> 9);
+    tm.tm_mon  = ((date >> 5) & 0xf) - 1;
+    tm.tm_mday = date & 0x1f;
+    tm.tm_hour = time >> 11;
+    tm.tm_min  = (time >> 5) & 0x3f;
+    tm.tm_sec  = (time & 0x1f) * 2;
+    return std::mktime(&tm);
+  }
+
+  static bool is_compressible(util::sview mime)
+  {
+    return mime.substr(0, 5) == "text/"
+      or mime.find("javascript") != util::sview::npos
+      or mime.find("json") != util::sview::npos
+      or mime.find("xml") != util::sview::npos;
+  }
+
+  // gzip (RFC 1952) of a single fixed-Huffman block from uzlib
+  static Static_files::buffer_t gzip(const uint8_t* data, size_t len)
+  {
+    static const int HASH_BITS = 12;
+    std::vector<uzlib_hash_entry_t> hash(1u << HASH_BITS);
+    uzlib_comp comp {};
+    comp.hash_table = hash.data();
+    comp.hash_bits  = HASH_BITS;
+    comp.dict_size  = 32768;
+
+    zlib_start_block(&comp.out);
+    uzlib_compress(&comp, data, len);
+    zlib_finish_block(&comp.out);
+
+    static const uint8_t header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+
+    const auto* raw = comp.out.outbuf;
+    auto out = net::Stream::construct_buffer();
+    out->reserve(sizeof(header) + comp.out.outlen + 8);
+    out->insert(out->end(), header, header + sizeof(header));
+    out->insert(out->end(), raw, raw + comp.out.outlen);
+    free(comp.out.outbuf);
+    for(const uint32_t value : { crc32(data, len), static_cast<uint32_t>(len) })
+      for(int i = 0; i < 32; i += 8)
+        out->push_back(value >> i);
+    return out;
+  }
+
+  enum class Range { NONE, SATISFIABLE, UNSATISFIABLE };
+
+  // a single byte range, several are answered with the whole file
+  static Range parse_range(util::sview value, uint64_t size, uint64_t& offset, uint64_t& length)
+  {
+    if(value.substr(0, 6) != "bytes=")
+      return Range::NONE;
+    value.remove_prefix(6);
+    if(value.find(',') != util::sview::npos)
+      return Range::NONE;
+
+    const auto dash = value.find('-');
+    if(dash == util::sview::npos)
+      return Range::NONE;
+
+    const auto first = trim(value.substr(0, dash));
+    const auto last  = trim(value.substr(dash + 1));
+    auto number = [] (util::sview str, uint64_t& n) {
+      if(str.empty() or str.find_first_not_of("0123456789") != util::sview::npos)
+        return false;
+      n = std::strtoull(std::string(str).c_str(), nullptr, 10);
+      return true;
+    };
+
+    uint64_t a = 0, b = 0;
+    // the last n bytes
+    if(first.empty())
+    {
+      if(not number(last, b))
+        return Range::NONE;
+      if(b == 0 or size == 0)
+        return Range::UNSATISFIABLE;
+      offset = size - std::min(b, size);
+      length = size - offset;
+      return Range::SATISFIABLE;
+    }
+
+    if(not number(first, a) or (not last.empty() and not number(last, b)))
+      return Range::NONE;
+    if(not last.empty() and b < a)
+      return Range::NONE;
+    if(a >= size)
+      return Range::UNSATISFIABLE;
+    if(last.empty())
+      b = size - 1;
+
+    offset = a;
+    length = std::min(b, size - 1) - a + 1;
+    return Range::SATISFIABLE;
+  }
+
+  // percent-decoded, without empty and "." segments, "" if it climbs out
+  static std::string normalize(util::sview path)
+  {
+    const auto decoded = uri::decode(path);
+    if(decoded.find('\0') != std::string::npos)
+      return {};
+
+    std::string result;
+    util::sview rest{decoded};
+    while(not rest.empty())
+    {
+      const auto slash = rest.find('/');
+      const auto segment = rest.substr(0, slash);
+      if(segment == "..")
+        return {};
+      if(not segment.empty() and segment != ".")
+        result.append("/").append(segment);
+      if(slash == util::sview::npos)
+        break;
+      rest.remove_prefix(slash + 1);
+    }
+    return result.empty() ? "/" : result;
+  }
+
+  static void respond(Response_writer& writer, status_t code)
+  {
+    writer.header().set_field(header::Content_Length, "0");
+    writer.write_header(code);
+  }
+
+  Static_files::Static_files(const fs::File_system& fs, Options options)
+    : fs_(fs),
+      options_(std::move(options))
+  {
+  }
+
+  void Static_files::serve(Request_ptr req, Response_writer_ptr writer)
+  {
+    const auto method = req->method();
+    if(method != GET and method != HEAD)
+    {
+      writer->header().set_field(header::Allow, "GET, HEAD");
+      respond(*writer, Method_Not_Allowed);
+      return;
+    }
+
+    const auto path = normalize(req->uri().path());
+    auto* entry = path.empty() ? nullptr : lookup(path);
+    if(entry == nullptr)
+    {
+      respond(*writer, Not_Found);
+      return;
+    }
+
+    const auto& header = req->header();
+    auto& res = writer->header();
+
+    // a range is of the file itself, otherwise the smallest encoding accepted
+    const bool ranged = (method == GET) and header.has_field(header::Range);
+    auto* variant = &entry->identity;
+    if(not ranged)
+    {
+      const auto accept = header.value(header::Accept_Encoding);
+      if(entry->br.exists() and accepts(accept, "br"))
+      {
+        variant = &entry->br;
+        res.set_field(header::Content_Encoding, "br");
+      }
+      else if(entry->gzip.exists() and accepts(accept, "gzip"))
+      {
+        variant = &entry->gzip;
+        res.set_field(header::Content_Encoding, "gzip");
+      }
+    }
+
+    res.set_field(header::Content_Type, std::string(entry->mime));
+    res.set_field(header::ETag, variant->etag);
+    if(not entry->last_modified.empty())
+      res.set_field(header::Last_Modified, entry->last_modified);
+    if(options_.max_age.count() > 0)
+      res.set_field("Cache-Control", "max-age=" + std::to_string(options_.max_age.count()));
+    if(entry->gzip.exists() or entry->br.exists())
+      res.set_field(header::Vary, "Accept-Encoding");
+    res.set_field(header::Accept_Ranges, "bytes");
+
+    // conditional requests (RFC 7232 6)
+    bool not_modified = false;
+    if(header.has_field(header::If_None_Match))
+    {
+      not_modified = etag_matches(header.value(header::If_None_Match), variant->etag);
+    }
+    else if(entry->modified != 0 and header.has_field(header::If_Modified_Since))
+    {
+      const auto since = time::to_time_t(header.value(header::If_Modified_Since));
+      not_modified = (since != 0 and entry->modified <= since);
+    }
+    if(not_modified)
+    {
+      writer->write_header(Not_Modified);
+      return;
+    }
+
+    status_t code = OK;
+    uint64_t offset = 0;
+    uint64_t length = variant->size;
+
+    if(ranged)
+    {
+      // the range is ignored if the file changed since the client got a part
+      bool current = true;
+      if(header.has_field(header::If_Range))
+      {
+        const auto if_range = header.value(header::If_Range);
+        current = (not if_range.empty() and if_range.front() == '"') ? (if_range == variant->etag)
+          : (entry->modified != 0 and time::to_time_t(if_range) == entry->modified);
+      }
+
+      const auto range = current ?
+        parse_range(header.value(header::Range), variant->size, offset, length) : Range::NONE;
+
+      if(range == Range::UNSATISFIABLE)
+      {
+        res.set_field(header::Content_Range, "bytes */" + std::to_string(variant->size));
+        respond(*writer, Range_Not_Satisfiable);
+        return;
+      }
+      if(range == Range::SATISFIABLE)
+      {
+        code = Partial_Content;
+        res.set_field(header::Content_Range, "bytes " + std::to_string(offset) + "-"
+          + std::to_string(offset + length - 1) + "/" + std::to_string(variant->size));
+      }
+      else
+      {
+        offset = 0;
+        length = variant->size;
+      }
+    }
+
+    // a file that isn't cached is read a chunk at a time
+    buffer_t body = nullptr;
+    if(method == GET and length > 0)
+    {
+      const auto first = (variant->data == nullptr) ?
+        std::min<uint64_t>(length, options_.read_chunk) : length;
+      body = content(*variant, offset, first);
+      if(body == nullptr)
+      {
+        writer->set_response(make_response());
+        respond(*writer, Internal_Server_Error);
+        return;
+      }
+    }
+
+    res.set_field(header::Content_Length, std::to_string(length));
+    writer->write_header(code);
+    if(body == nullptr)
+      return;
+    if(body->size() < length)
+      send_file(*writer, std::move(body), variant->file, offset, length);
+    else
+      writer->write(std::move(body));
+  }
+
+  // the rest of a file, read when less than a chunk is left to send
+  struct File_transfer {
+    net::Stream& stream;
+    fs::Dirent   file;
+    uint64_t     offset;
+    uint64_t     remaining;
+    size_t       chunk;
+    bool         close_when_done;
+    size_t       queued = 0;
+    bool         sending = false;
+
+    void written(size_t n)
+    {
+      queued -= std::min(n, queued);
+      // writing may send, and report it, right away
+      if(not sending)
+        send();
+    }
+
+    void send()
+    {
+      sending = true;
+      while(remaining > 0 and queued < chunk)
+      {
+        const auto n = std::min<uint64_t>(chunk, remaining);
+        auto buf = file.read(offset, n);
+        if(not buf.is_valid() or buf.size() != n)
+        {
+          // too late to tell the client, who sees the body cut short
+          stream.on_write(nullptr);
+          stream.close();
+          return;
+        }
+        offset    += n;
+        remaining -= n;
+        queued    += n;
+        stream.write(buf.get());
+      }
+      sending = false;
+      if(remaining == 0)
+      {
+        // the caller holds on to this
+        stream.on_write(nullptr);
+        if(close_when_done)
+          stream.close();
+      }
+    }
+  };
+
+  void Static_files::send_file(Response_writer& writer, buffer_t first, const fs::Dirent& file,
+                               uint64_t offset, uint64_t length) const
+  {
+    auto& conn = writer.connection();
+    auto& stream = *conn.stream();
+    auto transfer = std::make_shared<File_transfer>(File_transfer{
+      stream, file, offset + first->size(), length - first->size(),
+      options_.read_chunk, not conn.keep_alive()});
+    // the writer would close the connection when it goes, leave that to the transfer
+    conn.keep_alive(true);
+
+    stream.on_write(
+    [transfer] (size_t n)
+    {
+      // on_write(nullptr) deletes this closure
+      auto t = transfer;
+      t->written(n);
+    });
+    transfer->queued = first->size();
+    transfer->sending = true;
+    stream.write(std::move(first));
+    transfer->sending = false;
+    transfer->send();
+  }
+
+  Static_files::Entry* Static_files::lookup(const std::string& path)
+  {
+    const auto it = index_.find(path);
+    if(it != index_.end())
+    {
+      if(is_current(*it->second))
+      {
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return &lru_.front();
+      }
+      erase(it->second);
+    }
+    ++misses_;
+
+    const auto root = (options_.root.back() == '/') ?
+      options_.root.substr(0, options_.root.size() - 1) : options_.root;
+    auto name = root + path;
+    auto file = fs_.stat(name);
+    if(file.is_valid() and file.is_dir())
+    {
+      name += (name.back() == '/' ? "" : "/") + options_.index;
+      file = fs_.stat(name);
+    }
+    if(not file.is_valid() or not file.is_file())
+      return nullptr;
+
+    Entry entry;
+    entry.path = path;
+    entry.name = name;
+    entry.stamp = file.modified();
+    entry.validated = RTC::now();
+
+    const auto dot = name.find_last_of("./");
+    const auto mime = (dot != std::string::npos and name[dot] == '.') ?
+      ext_to_mime_type(util::sview{name}.substr(dot + 1)) : util::sview{};
+    entry.mime = mime.empty() ? "application/octet-stream" : mime;
+
+    entry.modified = fat_time(file.modified());
+    if(entry.modified != 0)
+      entry.last_modified = time::from_time_t(entry.modified);
+
+    // size and time, as the file isn't read to tell if it changed
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx",
+             (unsigned long long) file.size(), (unsigned long long) file.modified());
+
+    entry.identity = load(file, std::string(etag) + "\"");
+
+    const auto gz = fs_.stat(name + ".gz");
+    if(gz.is_valid() and gz.is_file())
+      entry.gzip = load(gz, std::string(etag) + "-gz\"");
+
+    const auto br = fs_.stat(name + ".br");
+    if(br.is_valid() and br.is_file())
+      entry.br = load(br, std::string(etag) + "-br\"");
+
+    // compressed once, kept if it saves something
+    const auto& data = entry.identity.data;
+    if(options_.compress and not entry.gzip.exists() and data != nullptr
+      and data->size() >= options_.min_compress_size and is_compressible(entry.mime))
+    {
+      auto compressed = gzip(data->data(), data->size());
+      if(compressed->size() < data->size())
+      {
+        entry.gzip.size = compressed->size();
+        entry.gzip.data = std::move(compressed);
+        entry.gzip.etag = std::string(etag) + "-gz\"";
+      }
+    }
+
+    for(const auto* variant : { &entry.identity, &entry.gzip, &entry.br })
+      if(variant->data != nullptr)
+        entry.memory += variant->data->size();
+
+    insert(std::move(entry));
+    return &lru_.front();
+  }
+
+  bool Static_files::is_current(Entry& entry) const
+  {
+    if(options_.immutable)
+      return true;
+    const auto now = RTC::now();
+    if(now < entry.validated + options_.revalidate.count())
+      return true;
+
+    const auto file = fs_.stat(entry.name);
+    if(not file.is_valid() or not file.is_file()
+      or file.size() != entry.identity.size or file.modified() != entry.stamp)
+      return false;
+    entry.validated = now;
+    return true;
+  }
+
+  Static_files::Variant Static_files::load(fs::Dirent file, std::string etag) const
+  {
+    Variant variant;
+    variant.size = file.size();
+    variant.etag = std::move(etag);
+
+    if(file.size() <= options_.max_cached_file)
+    {
+      auto buf = file.read(0, file.size());
+      if(buf.is_valid())
+        variant.data = buf.get();
+    }
+
+    variant.file = std::move(file);
+    return variant;
+  }
+
+  void Static_files::insert(Entry entry)
+  {
+    used_ += entry.memory;
+    lru_.push_front(std::move(entry));
+    index_[lru_.front().path] = lru_.begin();
+
+    // the least recently used go first, but not the one just added
+    while(used_ > options_.cache_size and lru_.size() > 1)
+      erase(std::prev(lru_.end()));
+  }
+
+  void Static_files::erase(Entry_list::iterator it)
+  {
+    used_ -= it->memory;
+    index_.erase(it->path);
+    lru_.erase(it);
+  }
+
+  void Static_files::invalidate(const std::string& path)
+  {
+    const auto it = index_.find(path);
+    if(it != index_.end())
+      erase(it->second);
+  }
+
+  void Static_files::clear()
+  {
+    lru_.clear();
+    index_.clear();
+    used_ = 0;
+  }
+
+  Static_files::buffer_t Static_files::content(Variant& variant, uint64_t offset, uint64_t length) const
+  {
+    if(variant.data != nullptr)
+    {
+      // shared with the connection, not copied
+      if(offset == 0 and length == variant.data->size())
+        return variant.data;
+      const auto begin = variant.data->begin() + offset;
+      return net::Stream::construct_buffer(begin, begin + length);
+    }
+
+    if(not variant.file.is_valid())
+      return nullptr;
+
+    auto buf = variant.file.read(offset, length);
+    return buf.is_valid() ? buf.get() : nullptr;
+  }
+
+}
@@ -57,10 +57,15 @@ namespace http
 
   void Botan_server::on_connect(TCP_conn conn)
   {
+    // h2 when the client offers it, otherwise http/1.1 (RFC 7301)
+    std::vector<std::string> protocols;
+    if (http2_enabled())
+      protocols = {"h2", "http/1.1"};
+
     connect(
       std::make_unique<net::botan::Server> (
         std::make_unique<net::tcp::Stream>(
-          std::move(conn)), rng, *credman)
+          std::move(conn)), rng, *credman, std::move(protocols))
     );
   }
 
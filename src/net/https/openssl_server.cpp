@@ -5,6 +5,16 @@
 
 namespace http
 {
+  // h2 when the client offers it, otherwise http/1.1 (RFC 7301)
+  static int alpn_select(SSL*, const unsigned char** out, unsigned char* outlen,
+                         const unsigned char* in, unsigned int inlen, void*)
+  {
+    static const unsigned char protos[] = "\x02h2\x08http/1.1";
+    const int res = SSL_select_next_proto((unsigned char**) out, outlen,
+                                          protos, sizeof(protos) - 1, in, inlen);
+    return (res == OPENSSL_NPN_NEGOTIATED) ? SSL_TLSEXT_ERR_OK : SSL_TLSEXT_ERR_NOACK;
+  }
+
   void OpenSSL_server::openssl_initialize(const std::string& certif,
                                           const std::string& key)
   {
@@ -29,6 +39,15 @@ namespace http
 
   void OpenSSL_server::bind(const uint16_t port)
   {
+    if (http2_enabled())
+    {
+      auto* ctx = (SSL_CTX*) this->m_ctx;
+      // HTTP/2 clients refuse ciphers without AEAD (RFC 7540 9.2.2)
+      int res = SSL_CTX_set_cipher_list(ctx,
+          "ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384:AES256-SHA");
+      assert(res == 1);
+      SSL_CTX_set_alpn_select_cb(ctx, alpn_select, nullptr);
+    }
     tcp_.listen(port, {this, &OpenSSL_server::on_connect});
     INFO("HTTPS Server", "Listening on port %u", port);
   }
@@ -48,6 +48,17 @@ namespace http
   
   void S2N_server::bind(const uint16_t port)
   {
+    if (http2_enabled())
+    {
+      // h2 when the client offers it, otherwise http/1.1 (RFC 7301)
+      static const char* protocols[] = { "h2", "http/1.1" };
+      int res = s2n_config_set_protocol_preferences(
+          (s2n_config*) this->m_config, protocols, 2);
+      if (res < 0) {
+        print_s2n_error("Error setting ALPN protocols");
+        exit(1);
+      }
+    }
     tcp_.listen(port, {this, &S2N_server::on_connect});
     INFO("HTTPS Server", "Listening on port %u", port);
   }
@@ -12,6 +12,7 @@
 #include <net/packet.hpp>
 #include <statman>
 #include <net/ip4/icmp4.hpp>
+#include <kernel/trace.hpp>
 
 namespace net {
 
@@ -29,7 +30,8 @@ namespace net {
   prerouting_dropped_   {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.prerouting_dropped").get_uint32()},
   postrouting_dropped_  {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.postrouting_dropped").get_uint32()},
   input_dropped_        {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.input_dropped").get_uint32()},
-  output_dropped_       {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.output_dropped").get_uint32()}
+  output_dropped_       {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.output_dropped").get_uint32()},
+  reassembly_           {inet}
   {}
 
 
@@ -123,6 +125,7 @@ namespace net {
 
     // Stat increment packets received
     packets_rx_++;
+    TRACEPOINT(IP4_RX, (uint16_t) packet->ip_protocol(), packet->size());
 
     // Account for possible linklayer padding
     packet->adjust_size_from_header();
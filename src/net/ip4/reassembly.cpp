@@ -1,6 +1,6 @@
-#include <net/ip4/ip4.hpp>
-#include <cassert>
-#include <rtc>
+#include <net/ip4/reassembly.hpp>
+#include <net/inet>
+#include <statman>
 
 //#define REASSEMBLY_DEBUG 1
 #ifdef REASSEMBLY_DEBUG
@@ -12,228 +12,279 @@
 
 namespace net
 {
-  static const int REASSEMBLY_ENTRIES = 64;
-  static const int TIMEOUT = 15;
-  //static const int TTL_MAX = 163;
+  IP4::IP_packet_ptr IP4::reassemble(IP4::IP_packet_ptr packet)
+  {
+    assert(packet != nullptr);
+    return reassembly_.process(std::move(packet));
+  }
+}
+
+namespace net::ip4
+{
   static const int IP_ALIGN = 2;
-  static const int MAX_DATAGRAM = 65515;
 
-  inline net::Packet_ptr create_packet(uint16_t length)
+  inline Reassembly::IP_packet_ptr create_packet(uint16_t length)
   {
     size_t buffer_len = sizeof(Packet) + IP_ALIGN + length;
     auto  buffer = new uint8_t[buffer_len];
     auto* ptr    = (net::Packet*) buffer;
 
     new (ptr) net::Packet(IP_ALIGN, 0, IP_ALIGN + length, nullptr);
-    return net::Packet_ptr(ptr);
+    return Reassembly::IP_packet_ptr(static_cast<PacketIP4*>(ptr));
   }
 
-  struct Entry
+  // fragments in the chain are only reachable as Packet
+  static inline const PacketIP4& fragment(const Packet* pkt) noexcept
+  { return *static_cast<const PacketIP4*>(pkt); }
+
+  static inline uint32_t frag_offset(const PacketIP4& pkt) noexcept
+  { return pkt.ip_frag_offs() * 8u; }
+
+  // the IP length, as the frame may be padded
+  static inline uint32_t frag_length(const PacketIP4& pkt) noexcept
+  { return pkt.ip_total_length() - pkt.ip_header_length(); }
+
+  size_t Reassembly::Key_hash::operator()(const Key& key) const noexcept
   {
-    ip4::Addr src = IP4::ADDR_ANY;
-    Protocol proto;
-    uint16_t frag_id;
-    DSCP     dscp;
-    uint32_t received;
-    uint32_t total_length;
-    RTC::timestamp_t last_seen;
-    IP4::IP_packet_ptr buffer = nullptr;
+    uint64_t val = ((uint64_t) key.src.whole << 32) | key.dst.whole;
+    val ^= ((uint64_t) key.id << 8 | (uint8_t) key.proto) * 0x9e3779b97f4a7c15ull;
+    return std::hash<uint64_t>{}(val * 0xff51afd7ed558ccdull);
+  }
 
-    Entry() = default;
-    inline Entry(RTC::timestamp_t, IP4::IP_packet&);
+  Reassembly::Reassembly(Stack& stack)
+    : stack_{stack},
+      timer_{{this, &Reassembly::on_timeout}},
+      reassembled_{Statman::get().create(Stat::UINT64, stack.ifname() + ".ip4.reassembled").get_uint64()},
+      timeouts_{Statman::get().create(Stat::UINT32, stack.ifname() + ".ip4.reassembly_timeouts").get_uint32()},
+      dropped_{Statman::get().create(Stat::UINT32, stack.ifname() + ".ip4.reassembly_dropped").get_uint32()}
+  {}
 
-    bool is_dead(RTC::timestamp_t now) const noexcept {
-      return src == IP4::ADDR_ANY || now - last_seen >= TIMEOUT;
-    }
-    bool matches(RTC::timestamp_t now, IP4::IP_packet& packet) const noexcept {
-      return is_dead(now) == false
-          && this->src == packet.ip_src()
-          && this->proto == packet.ip_protocol()
-          && this->frag_id == packet.ip_id();
+  Reassembly::IP_packet_ptr Reassembly::process(IP_packet_ptr packet)
+  {
+    const uint32_t offset = frag_offset(*packet);
+    const uint32_t len    = frag_length(*packet);
+    const bool     last   = ((uint8_t) packet->ip_flags() & (uint8_t) Flags::MF) == 0;
+
+    // some basic validation
+    if (UNLIKELY(len == 0 or packet->ip_src() == IP4::ADDR_ANY)) return nullptr;
+    if (UNLIKELY(offset + len > MAX_DATAGRAM)) return nullptr;
+    // non-last fragments ...
+    if (not last)
+    {
+      // must have length mult of 8
+      if (UNLIKELY(len % 8 != 0)) return nullptr;
+      // should be at least 400 octets long
+      if (UNLIKELY(len < 400)) return nullptr;
     }
-    void disable() { this->src = IP4::ADDR_ANY; }
+    // fragments are chained here, and never arrive chained
+    packet->detach_tail();
 
-    IP4::IP_packet_ptr assemble_from(IP4::IP_packet&);
+    const auto now = RTC::now();
+    expire(now);
 
-    auto release() {
-      this->src = IP4::ADDR_ANY;
-      return std::move(buffer);
+    // make room by dropping the oldest datagrams
+    const size_t size = packet->bufsize();
+    while (memory_ + size > limit_ and not expiry_.empty())
+    {
+      PRINT("-> Memory limit reached, dropping oldest datagram\n");
+      dropped_++;
+      remove(table_.find(expiry_.front()));
     }
-  };
-  IP4::IP_packet_ptr Entry::assemble_from(IP4::IP_packet& packet)
-  {
-    const int fragoff = packet.ip_frag_offs() * 8;
-    assert(fragoff >= 0);
-    // we don't allow non-initial fragments to start with
-    if (fragoff != 0 && this->buffer == nullptr) {
-      PRINT("-> Non-initial fragment in new buffer, dropping entry\n");
-      this->disable();
+    if (UNLIKELY(memory_ + size > limit_)) {
+      dropped_++;
       return nullptr;
     }
 
-    if (fragoff == 0)
+    const Key key{packet->ip_src(), packet->ip_dst(), packet->ip_id(), packet->ip_protocol()};
+    auto it = table_.find(key);
+    if (it == table_.end())
     {
-      PRINT("Creating entry buffer\n");
-      // first fragment
-      try {
-        // NOTE: we can run out of memory here
-        auto raw = create_packet(MAX_DATAGRAM);
-        this->buffer = static_unique_ptr_cast<IP4::IP_packet> (std::move(raw));
-      }
-      catch (std::exception&) {
-        return nullptr;
+      if (table_.size() >= MAX_DATAGRAMS) {
+        dropped_++;
+        remove(table_.find(expiry_.front()));
       }
-      // set header and options
-      buffer->set_ip_version(4);
-      buffer->set_ip_header_length(20);
-      buffer->set_ip_dscp(packet.ip_dscp());
-      buffer->set_ip_ecn(packet.ip_ecn());
-      buffer->set_ip_total_length(20);
+      it = table_.emplace(key, Datagram{}).first;
+      it->second.expires = now + TIMEOUT;
+      it->second.expiry  = expiry_.insert(expiry_.end(), key);
+      if (not timer_.is_running())
+        timer_.start(std::chrono::seconds(TIMEOUT));
+    }
+    auto& dgram = it->second;
+    PRINT("Reassembly on %s id=%u offset=%u len=%u (%u fragments)\n",
+          key.src.to_string().c_str(), key.id, offset, len, dgram.fragments);
+
+    switch (insert(dgram, packet, offset, len, last))
+    {
+    case Insert::Duplicate:
+      return nullptr;
+    case Insert::Invalid:
+      PRINT("-> Overlapping or invalid fragment, dropping datagram\n");
+      dropped_++;
+      remove(it);
+      return nullptr;
+    case Insert::Ok:
+      break;
+    }
+    memory_ += size;
+    dgram.memory += size;
 
-      buffer->set_ip_ttl(packet.ip_ttl());
-      buffer->set_protocol(packet.ip_protocol());
-      buffer->set_ip_checksum(0);
+    if (dgram.total == 0 or dgram.received != dgram.total)
+      return nullptr;
 
-      buffer->set_ip_src(packet.ip_src());
-      buffer->set_ip_dst(packet.ip_dst());
+    // without overlaps, every byte up to the end is here
+    auto result = linearize(dgram);
+    remove(it);
+    if (result != nullptr) {
+      PRINT("Shipping reassembled datagram (%d bytes)\n", result->size());
+      reassembled_++;
     }
-    else
+    return result;
+  }
+
+  Reassembly::Insert Reassembly::insert(Datagram& dgram, IP_packet_ptr& packet,
+                                        uint32_t offset, uint32_t len, bool last)
+  {
+    if (UNLIKELY(dgram.fragments >= MAX_FRAGMENTS))
+      return Insert::Invalid;
+
+    // find the neighbours
+    Packet* prev = nullptr;
+    Packet* next = dgram.head.get();
+    while (next != nullptr and frag_offset(fragment(next)) < offset) {
+      prev = next;
+      next = next->tail();
+    }
+    if (next != nullptr and frag_offset(fragment(next)) == offset
+        and frag_length(fragment(next)) == len)
+      return Insert::Duplicate;
+    if (prev != nullptr
+        and frag_offset(fragment(prev)) + frag_length(fragment(prev)) > offset)
+      return Insert::Invalid;
+    if (next != nullptr and offset + len > frag_offset(fragment(next)))
+      return Insert::Invalid;
+
+    // nothing can be beyond the last fragment
+    if (last)
     {
-      // verify member fields match
-      if (UNLIKELY(this->dscp != packet.ip_dscp())) {
-        PRINT("-> DSCP mismatch in entry, dropping entry\n");
-        this->disable();
-        return nullptr;
-      }
+      if (dgram.total != 0 or dgram.end > offset + len)
+        return Insert::Invalid;
+      dgram.total = offset + len;
     }
-    // validate length
-    const int len = packet.ip_data_length();
-    if (this->received + len > MAX_DATAGRAM) {
-      PRINT("-> data overflow in entry (%u > %u), dropping entry\n",
-            this->received + len, MAX_DATAGRAM);
-      this->disable();
-      return nullptr;
+    else if (dgram.total != 0 and offset + len >= dgram.total)
+    {
+      return Insert::Invalid;
     }
-    // add data, increase bytes received
-    auto* data = buffer->layer_begin() + buffer->ip_header_length();
-    auto* src_data = packet.layer_begin() + packet.ip_header_length();
-    std::memcpy(&data[fragoff], src_data, len);
-    this->received += len;
 
-    // when last fragment received, record total length
-    if (packet.ip_flags() != ip4::Flags::MF) {
-      this->total_length = fragoff + len;
-      PRINT("-> last fragment received, total length is %u\n",
-            this->total_length);
+    if (prev == nullptr)
+    {
+      if (dgram.head != nullptr)
+        packet->chain(std::move(dgram.head));
+      dgram.head = std::move(packet);
     }
-    // if we've received all bytes,
-    if (this->total_length != 0)
+    else
     {
-      // if exact, we're done
-      if (this->received == this->total_length)
-      {
-        buffer->set_ip_total_length(buffer->size());
-        buffer->set_ip_data_length(this->total_length);
-        PRINT("Shipping large packet (%u / %u)\n",
-              buffer->size(), buffer->bufsize());
-        return this->release();
-      }
-      else if (this->received > this->total_length)
-      {
-        // received too many bytes, possibly overlapping
-        PRINT("-> data overflow (%u > %u), dropping entry\n",
-              this->received, this->total_length);
-        this->disable();
-        return nullptr;
-      }
+      auto rest = prev->detach_tail();
+      if (rest != nullptr)
+        packet->chain(std::move(rest));
+      prev->chain(std::move(packet));
     }
-    // otherwise, return nothing
-    return nullptr;
+    dgram.received += len;
+    dgram.end = std::max(dgram.end, offset + len);
+    dgram.fragments++;
+    return Insert::Ok;
   }
 
-  Entry::Entry(RTC::timestamp_t now, IP4::IP_packet& packet)
-    : frag_id(packet.ip_id()), received(0), total_length(0),
-      last_seen(now), buffer(nullptr)
+  Reassembly::IP_packet_ptr Reassembly::linearize(Datagram& dgram)
   {
-    this->src   = packet.ip_src();
-    this->proto = packet.ip_protocol();
-    this->dscp  = packet.ip_dscp();
-  }
+    auto head = std::move(dgram.head);
+    auto rest = head->detach_tail();
+    const uint32_t hlen  = head->ip_header_length();
+    const uint32_t first = frag_length(*head);
 
-  struct Reassembly
-  {
-    Reassembly() = default;
-    std::array<Entry, REASSEMBLY_ENTRIES> entries {};
+    IP_packet_ptr result;
+    if (head->capacity() >= (int) (hlen + dgram.total))
+    {
+      // the rest fits after the first fragment
+      result = std::move(head);
+    }
+    else
+    {
+      try {
+        // NOTE: we can run out of memory here
+        result = create_packet(hlen + dgram.total);
+      }
+      catch (std::exception&) {
+        return nullptr;
+      }
+      // header, with options, and data of the first fragment
+      std::memcpy(result->layer_begin(), head->layer_begin(), hlen + first);
+      head = nullptr;
+    }
+    result->set_data_end(hlen + dgram.total);
 
-    int get_entry(RTC::timestamp_t, IP4::IP_packet&);
+    auto* data = result->layer_begin() + hlen;
+    for (auto pkt = std::move(rest); pkt != nullptr; pkt = pkt->detach_tail())
+    {
+      auto& frag = fragment(pkt.get());
+      std::memcpy(&data[frag_offset(frag)], frag.layer_begin() + frag.ip_header_length(),
+                  frag_length(frag));
+    }
 
-    IP4::IP_packet_ptr process(IP4::IP_packet_ptr packet);
-  };
-  static std::vector<std::pair<IP4&, Reassembly>> assemblies;
+    result->set_ip_total_length(hlen + dgram.total);
+    result->set_ip_flags(Flags::NONE);
+    result->set_ip_frag_offs(0);
+    result->set_ip_checksum();
+    return result;
+  }
 
-  static inline auto& get_assembly(IP4& current)
+  void Reassembly::remove(Table::iterator it)
   {
-    for (auto& stk : assemblies) {
-      if (&stk.first == &current) return stk.second;
-    }
-    // create new
-    assemblies.emplace_back(current, Reassembly{});
-    return assemblies.back().second;
+    auto& dgram = it->second;
+    memory_ -= dgram.memory;
+    expiry_.erase(dgram.expiry);
+    table_.erase(it);
+    if (table_.empty())
+      timer_.stop();
   }
 
-  IP4::IP_packet_ptr IP4::reassemble(IP4::IP_packet_ptr packet)
+  void Reassembly::flush()
   {
-    assert(packet != nullptr);
-    auto& assembly = get_assembly(*this);
-    return assembly.process(std::move(packet));
+    table_.clear();
+    expiry_.clear();
+    memory_ = 0;
+    timer_.stop();
   }
 
-  int Reassembly::get_entry(RTC::timestamp_t now, IP4::IP_packet& packet)
+  void Reassembly::expire(RTC::timestamp_t now)
   {
-    // first fragment
-    if (packet.ip_frag_offs() == 0)
+    while (not expiry_.empty())
     {
-      // assign new entry
-      for (int i = 0; i < (int) entries.size(); i++) {
-        if (entries[i].is_dead(now)) {
-          entries[i] = Entry(now, packet);
-          return i;
-        }
+      auto it = table_.find(expiry_.front());
+      if (it->second.expires > now)
+        break;
+      PRINT("-> Reassembly timed out for id=%u\n", it->first.id);
+      timeouts_++;
+      // RFC 792: report it, if we got the first fragment
+      auto& dgram = it->second;
+      if (frag_offset(*dgram.head) == 0)
+      {
+        auto head = std::move(dgram.head);
+        dgram.head.reset(static_cast<PacketIP4*>(head->detach_tail().release()));
+        stack_.icmp().time_exceeded(std::move(head), icmp4::code::Time_exceeded::FRAGMENT_REASSEMBLY);
       }
-      // no free entries
-      return -1;
-    }
-    // find matching entry
-    for (int i = 0; i < (int) entries.size(); i++)
-    {
-      if (entries[i].matches(now, packet)) return i;
+      remove(it);
     }
-    // no match, and we don't allow initial non-zero offsets
-    return -1;
   }
 
-  IP4::IP_packet_ptr Reassembly::process(IP4::IP_packet_ptr packet)
+  void Reassembly::on_timeout()
   {
-    // some basic validation
-    if (UNLIKELY(packet->ip_data_length() == 0)) return nullptr;
-    if (UNLIKELY(packet->ip_src() == IP4::ADDR_ANY)) return nullptr;
-    // non-last fragments ...
-    if (packet->ip_flags() == ip4::Flags::MF)
+    const auto now = RTC::now();
+    expire(now);
+    if (not expiry_.empty())
     {
-      // must have length mult of 8
-      if (UNLIKELY(packet->ip_data_length() % 8 != 0)) return nullptr;
-      // should be at least 400 octets long
-      if (UNLIKELY(packet->ip_data_length() < 400)) return nullptr;
-    }
-    // create timestamp used for timeouts
-    RTC::timestamp_t now = RTC::now();
-    // get entry for this fragment
-    int idx = this->get_entry(now, *packet);
-    if (idx < 0) return nullptr;
-    PRINT("Reassembly on %s  id=%u (entry %d)\n",
-          packet->ip_src().to_string().c_str(), packet->ip_id(), idx);
-
-    auto& entry = this->entries.at(idx);
-    return entry.assemble_from(*packet);
+      const auto left = table_.find(expiry_.front())->second.expires - now;
+      timer_.start(std::chrono::seconds(std::max<RTC::timestamp_t>(left, 1)));
+    }
   }
-}
+
+} // net::ip4
@@ -178,17 +178,19 @@ Socket NAPT::masq(Conntrack::Entry_ptr entry, const ip4::Addr addr, Port_util& p
   // If the entry is mirrored, it's not masked yet
   if(not is_snat(entry))
   {
-    // Generate a new eph port and bind it
-    auto port = ports.get_next_ephemeral();
-    ports.bind(port);
+    // Generate a new eph port and bind it, only towards the remote
+    // as the flow is told apart by its tuple
+    const auto remote = entry->second.src;
+    auto port = ports.get_next_ephemeral(remote);
+    ports.bind(port, remote);
 
     // Update the entry to have the new socket as second
     auto masq_sock = Socket{addr, port};
     auto updated = conntrack->update_entry(
-      entry->proto, entry->second, {entry->second.src, masq_sock});
+      entry->proto, entry->second, {remote, masq_sock});
 
-    // Setup to unbind port on entry close
-    auto on_close = [&ports, port](Conntrack::Entry_ptr){ ports.unbind(port); };
+    // Setup to unbind port on entry close (the remote is still second.src)
+    auto on_close = [&ports, port](Conntrack::Entry_ptr ent){ ports.unbind(port, ent->second.src); };
     updated->on_close = on_close;
   }
 
@@ -7,6 +7,7 @@
 #include <net/tcp/connection_states.hpp>
 #include <net/tcp/tcp.hpp>
 #include <net/tcp/tcp_errors.hpp>
+#include <kernel/trace.hpp>
 
 using namespace net::tcp;
 using namespace std;
@@ -1168,6 +1169,23 @@ seq_t Connection::generate_iss() {
 void Connection::set_state(State& state) {
   prev_state_ = state_;
   state_ = &state;
+#ifndef NO_TRACEPOINTS
+  if (UNLIKELY(Trace::is_enabled()))
+  {
+    // in the order of Trace::tcp_state_t
+    const State* states[] {
+      &Closed::instance(), &Listen::instance(), &SynSent::instance(),
+      &SynReceived::instance(), &Established::instance(), &FinWait1::instance(),
+      &FinWait2::instance(), &CloseWait::instance(), &Closing::instance(),
+      &LastAck::instance(), &TimeWait::instance()
+    };
+    auto number = [&states] (const State* s) -> uint16_t {
+      return std::find(std::begin(states), std::end(states), s) - std::begin(states);
+    };
+    Trace::record(Trace::TCP_STATE, number(prev_state_) << 8 | number(state_),
+                  local().port() << 16 | remote().port());
+  }
+#endif
   debug("<TCP::Connection::set_state> %s => %s \n",
         prev_state_->to_string().c_str(), state_->to_string().c_str());
 }
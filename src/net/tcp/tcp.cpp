@@ -133,12 +133,12 @@ void TCP::connect(Socket remote, ConnectCallback callback)
     }
   }();
 
-  create_connection(bind(addr), remote, std::move(callback))->open(true);
+  create_connection(bind(addr, remote), remote, std::move(callback))->open(true);
 }
 
 void TCP::connect(Address source, Socket remote, ConnectCallback callback)
 {
-  connect(bind(source), remote, std::move(callback));
+  create_connection(bind(source, remote), remote, std::move(callback))->open(true);
 }
 
 void TCP::connect(Socket local, Socket remote, ConnectCallback callback)
@@ -161,14 +161,14 @@ Connection_ptr TCP::connect(Socket remote)
     }
   }();
 
-  auto conn = create_connection(bind(addr), remote);
+  auto conn = create_connection(bind(addr, remote), remote);
   conn->open(true);
   return conn;
 }
 
 Connection_ptr TCP::connect(Address source, Socket remote)
 {
-  auto conn = create_connection(bind(source), remote);
+  auto conn = create_connection(bind(source, remote), remote);
   conn->open(true);
   return conn;
 }
@@ -474,6 +474,18 @@ Socket TCP::bind(const Address& addr)
   return {addr, port};
 }
 
+Socket TCP::bind(const Address& addr, const Socket& remote)
+{
+  if(UNLIKELY( is_valid_source(addr) == false ))
+    throw TCP_error{"Cannot bind to address: " + addr.to_string()};
+
+  auto& port_util = ports_[addr];
+  // may be a port already connected to other remotes
+  const auto port = port_util.get_next_ephemeral(remote);
+  port_util.bind(port, remote);
+  return {addr, port};
+}
+
 bool TCP::unbind(const Socket& socket)
 {
   auto it = ports_.find(socket.address());
@@ -1,6 +1,7 @@
 
 #include <net/udp/socket.hpp>
 #include <net/udp/udp.hpp>
+#include <net/inet>
 #include <common>
 #include <memory>
 
@@ -17,6 +18,104 @@ namespace net::udp
                    (const char*) udp.udp_data(), udp.udp_data_length());
   }
 
+  void Socket::on_read_batch(recv_batch_handler callback, size_t max_batch)
+  {
+    on_batch_handler = std::move(callback);
+    rx_batch_max = std::max(max_batch, (size_t) 1);
+    if (on_batch_handler == nullptr)
+      rx_batch.clear();
+    else
+      rx_batch.reserve(rx_batch_max);
+  }
+
+  void Socket::batch_read(Packet_view_ptr udp)
+  {
+    rx_batch.push_back(std::move(udp));
+    if (rx_batch.size() >= rx_batch_max) {
+      deliver_batch();
+      return;
+    }
+    // deliver when the current burst has been processed
+    if (rx_batch.size() == 1)
+      udp_.schedule_batch(socket_);
+  }
+
+  void Socket::deliver_batch()
+  {
+    if (rx_batch.empty()) return;
+    auto batch = std::move(rx_batch);
+    rx_batch.clear();
+    rx_batch.reserve(rx_batch_max);
+    // may close this socket
+    on_batch_handler(std::move(batch));
+  }
+
+  Packet_view_ptr Socket::create_datagram(addr_t dest, port_t port)
+  {
+    return udp_.create_packet(socket_, net::Socket{dest, port});
+  }
+
+  size_t Socket::send_batch(const Datagram* datagrams, size_t count)
+  {
+    size_t sent = 0;
+    size_t i = 0;
+    // queued datagrams go first
+    if (udp_.sendq.empty())
+    {
+      const size_t max_size = udp_.max_datagram_size();
+      size_t room = udp_.stack().transmit_queue_available();
+      for (; i < count && room > 0; i++)
+      {
+        const auto& dgram = datagrams[i];
+        if (UNLIKELY(dgram.length == 0)) continue;
+        if (UNLIKELY(dgram.length > max_size)) break;
+
+        auto pkt = create_datagram(dgram.addr, dgram.port);
+        if (UNLIKELY(pkt == nullptr)) break;
+        pkt->fill((const uint8_t*) dgram.data, dgram.length);
+        udp_.transmit(std::move(pkt));
+        sent++;
+        room--;
+      }
+    }
+    // the rest is sent like with sendto()
+    for (; i < count; i++)
+    {
+      const auto& dgram = datagrams[i];
+      sendto(dgram.addr, dgram.port, dgram.data, dgram.length);
+    }
+    return sent;
+  }
+
+  size_t Socket::send_batch(Packet_batch batch)
+  {
+    size_t sent = 0;
+    size_t i = 0;
+    // queued datagrams go first
+    if (udp_.sendq.empty())
+    {
+      size_t room = udp_.stack().transmit_queue_available();
+      for (; i < batch.size() && room > 0; i++)
+      {
+        if (batch[i] == nullptr) continue;
+        udp_.transmit(std::move(batch[i]));
+        sent++;
+        room--;
+      }
+    }
+    // the rest is queued behind sendto() datagrams, still as packets
+    bool queued = false;
+    for (; i < batch.size(); i++)
+    {
+      auto& pkt = batch[i];
+      if (pkt == nullptr or pkt->udp_data_length() == 0) continue;
+      udp_.sendq.emplace_back(this->udp_, socket_, std::move(pkt));
+      queued = true;
+    }
+    if (queued) udp_.flush();
+    return sent;
+  }
+
   void Socket::sendto(
      addr_t destIP,
      port_t port,
@@ -14,6 +14,7 @@
 #include <net/util.hpp>
 #include <memory>
 #include <net/ip4/icmp4.hpp>
+#include <kernel/events.hpp>
 
 namespace net {
 
@@ -75,7 +76,10 @@ namespace net {
     if (it != sockets_.end()) {
       PRINT("<%s> UDP found listener on %s\n",
               stack_.ifname().c_str(), udp_packet->destination().to_string().c_str());
-      it->second.internal_read(*udp_packet);
+      if (it->second.on_batch_handler != nullptr)
+        it->second.batch_read(std::move(udp_packet));
+      else
+        it->second.internal_read(*udp_packet);
       return;
     }
 
@@ -105,6 +109,29 @@ namespace net {
     send_dest_unreachable(std::move(udp_packet));
   }
 
+  void UDP::schedule_batch(const net::Socket& socket)
+  {
+    batch_pending_.push_back(socket);
+    if (not batch_scheduled_) {
+      batch_scheduled_ = true;
+      Events::get().defer({this, &UDP::deliver_batches});
+    }
+  }
+
+  void UDP::deliver_batches()
+  {
+    batch_scheduled_ = false;
+    auto pending = std::move(batch_pending_);
+    batch_pending_.clear();
+    for (const auto& socket : pending)
+    {
+      // the socket may have been closed in the meantime
+      auto it = find(socket);
+      if (it != sockets_.end())
+        it->second.deliver_batch();
+    }
+  }
+
   void UDP::send_dest_unreachable(udp::Packet_view_ptr udp)
   {
     if(udp->ipv() == Protocol::IPv4)
@@ -308,8 +335,23 @@ namespace net {
       std::shared_ptr<uint8_t> (copy, std::default_delete<uint8_t[]>());
   }
 
+  UDP::WriteBuffer::WriteBuffer(UDP& stack, net::Socket source,
+                                udp::Packet_view_ptr pkt)
+    : udp(stack),
+      src{std::move(source)}, dst{pkt->destination()},
+      packet(std::move(pkt)), offset(0),
+      send_callback(nullptr), error_callback(nullptr)
+  {
+    this->len = packet->udp_data_length();
+  }
+
   void UDP::WriteBuffer::write()
   {
+    if (packet != nullptr) {
+      this->offset = this->len;
+      udp.transmit(std::move(packet));
+      return;
+    }
     udp::Packet_view_ptr chain_head = nullptr;
 
     PRINT("<%s> UDP: %i bytes to write, need %i packets \n",
@@ -0,0 +1,399 @@
+#include <net/ws/deflate.hpp>
+#include <common>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <tinf.h>             // From uzlib (mod)
+
+/**
+ * permessage-deflate on top of uzlib.
+ *
+ * The compressor runs uzlib's LZ77 over each message and emits one
+ * fixed-Huffman block ending with a sync flush. With context takeover the
+ * earlier messages are kept in front of the next one, and the hash table
+ * keeps pointing into them, so repeated keys and values in a feed become
+ * short back-references. The decompressor inflates through a ring the size
+ * of the peer's window, which is kept between messages.
+ */
+namespace net {
+
+static inline const uint8_t* dict_tail(const WS_deflate_options::Dictionary& dict,
+                                       size_t wsize, size_t& len)
+{
+  len = std::min(dict->size(), wsize);
+  return dict->data() + dict->size() - len;
+}
+
+static void init_uzlib()
+{
+  static bool has_uzlib_init = false;
+  if (not has_uzlib_init) {
+    uzlib_init();
+    has_uzlib_init = true;
+  }
+}
+
+/// Compressor ///
+
+struct WS_deflate::Deflater
+{
+  static const int HASH_BITS = 12;
+  static_assert(std::is_pointer<uzlib_hash_entry_t>::value,
+                "rebase() moves hash entries as pointers into the window");
+
+  Deflater(int window_bits, bool reset, WS_deflate_options::Dictionary dict)
+    : wsize(1u << window_bits), reset_each(reset), dict(std::move(dict)),
+      hash(1u << HASH_BITS)
+  {
+    comp.hash_table = hash.data();
+    comp.hash_bits  = HASH_BITS;
+    comp.dict_size  = wsize;
+    win.reserve(2 * wsize);
+    this->reset();
+  }
+
+  ~Deflater()
+  {
+    free(comp.out.outbuf);
+  }
+
+  const std::vector<uint8_t>& compress(const uint8_t* data, size_t len)
+  {
+    if (reset_each) reset();
+    else if (win.size() > wsize) slide(win.size() - wsize);
+    append(data, len);
+
+    auto& out = comp.out;
+    out.outlen = 0;
+    out.outbits = 0;
+    out.noutbits = 0;
+    // BFINAL=0, BTYPE=01 (fixed Huffman)
+    outbits(&out, 0, 1);
+    outbits(&out, 1, 2);
+    uzlib_compress(&comp, win.data() + win.size() - len, len);
+    // end of block, then a sync flush: an empty stored block, whose
+    // LEN/NLEN (00 00 ff ff) is removed from the message as required by RFC 7692
+    outbits(&out, 0, 7);
+    outbits(&out, 0, 3);
+    if (out.noutbits > 0)
+      outbits(&out, 0, 8 - out.noutbits);
+
+    result.assign(out.outbuf, out.outbuf + out.outlen);
+    return result;
+  }
+
+private:
+  const size_t wsize;
+  const bool   reset_each;
+  WS_deflate_options::Dictionary dict;
+  std::vector<uzlib_hash_entry_t> hash;
+  uzlib_comp comp {};
+  // history followed by the message being compressed
+  std::vector<uint8_t> win;
+  std::vector<uint8_t> result;
+
+  void reset()
+  {
+    win.clear();
+    std::fill(hash.begin(), hash.end(), nullptr);
+    if (dict != nullptr && not dict->empty()) {
+      size_t len;
+      const auto* tail = dict_tail(dict, wsize, len);
+      append(tail, len);
+      // fill the hash table by compressing the dictionary,
+      // compress() throws the output away
+      uzlib_compress(&comp, win.data(), len);
+    }
+  }
+
+  void append(const uint8_t* data, size_t len)
+  {
+    const auto base = (uintptr_t) win.data();
+    win.insert(win.end(), data, data + len);
+    if ((uintptr_t) win.data() != base) rebase(base, 0);
+  }
+
+  void slide(size_t n)
+  {
+    win.erase(win.begin(), win.begin() + n);
+    rebase((uintptr_t) win.data(), n);
+  }
+
+  // the hash table points into the window, move it along with the data
+  void rebase(uintptr_t old_base, size_t dropped)
+  {
+    for (auto& entry : hash)
+    {
+      if (entry == nullptr) continue;
+      const size_t offset = (uintptr_t) entry - old_base;
+      entry = (offset < dropped) ? nullptr : win.data() + offset - dropped;
+    }
+  }
+};
+
+/// Decompressor ///
+
+struct WS_deflate::Inflater
+{
+  // uzlib has no end of input: decompress in chunks, and give it zeros to
+  // read past the end of a corrupt message before we notice
+  static const unsigned CHUNK   = 256;
+  static const size_t   PADDING = 2048;
+
+  Inflater(int window_bits, bool reset, WS_deflate_options::Dictionary dict)
+    : ring(1u << window_bits), reset_each(reset), dict(std::move(dict))
+  {
+    this->reset();
+  }
+
+  bool decompress(const uint8_t* data, size_t len,
+                  std::vector<uint8_t>& dest, size_t max)
+  {
+    // put back the 00 00 ff ff removed by the sender, then end the stream
+    // with an empty final block so uzlib stops after the sync flush
+    static const uint8_t trailer[] = {0x00, 0x00, 0xff, 0xff, 0x03, 0x00};
+    in.assign(data, data + len);
+    in.insert(in.end(), trailer, trailer + sizeof(trailer));
+    const size_t end = in.size();
+    in.resize(end + PADDING);
+
+    const auto dict_idx = d.dict_idx;
+    uzlib_uncompress_init(&d, ring.data(), ring.size());
+    d.dict_idx = dict_idx;
+    d.source = in.data();
+
+    const size_t start = dest.size();
+    int res = TINF_OK;
+    while (res == TINF_OK)
+    {
+      const size_t have = dest.size();
+      dest.resize(have + CHUNK);
+      d.dest = dest.data() + have;
+      d.destSize = CHUNK;
+      res = uzlib_uncompress(&d);
+      dest.resize(d.dest - dest.data());
+
+      if (d.source > in.data() + end or (max > 0 and dest.size() - start > max))
+        res = TINF_DATA_ERROR;
+    }
+    const bool ok = (res == TINF_DONE);
+    if (not ok) dest.resize(start);
+    if (reset_each or not ok) reset();
+    return ok;
+  }
+
+private:
+  std::vector<uint8_t> ring;
+  const bool   reset_each;
+  WS_deflate_options::Dictionary dict;
+  TINF_DATA d {};
+  std::vector<uint8_t> in;
+
+  void reset()
+  {
+    d.dict_idx = 0;
+    if (dict != nullptr && not dict->empty()) {
+      size_t len;
+      const auto* tail = dict_tail(dict, ring.size(), len);
+      memcpy(ring.data(), tail, len);
+      d.dict_idx = len % ring.size();
+    }
+  }
+};
+
+/// Connection state ///
+
+WS_deflate::WS_deflate(const WS_deflate_options& opt, bool client)
+  : min_size_{opt.min_size}
+{
+  init_uzlib();
+  if (client) {
+    deflater_ = std::make_unique<Deflater>(opt.client_max_window_bits,
+                    opt.client_no_context_takeover, opt.dictionary);
+    inflater_ = std::make_unique<Inflater>(opt.server_max_window_bits,
+                    opt.server_no_context_takeover, opt.dictionary);
+  }
+  else {
+    deflater_ = std::make_unique<Deflater>(opt.server_max_window_bits,
+                    opt.server_no_context_takeover, opt.dictionary);
+    inflater_ = std::make_unique<Inflater>(opt.client_max_window_bits,
+                    opt.client_no_context_takeover, opt.dictionary);
+  }
+}
+WS_deflate::~WS_deflate() = default;
+
+const std::vector<uint8_t>& WS_deflate::compress(const uint8_t* data, size_t len)
+{
+  return deflater_->compress(data, len);
+}
+
+bool WS_deflate::decompress(const uint8_t* data, size_t len,
+                            std::vector<uint8_t>& out, size_t limit)
+{
+  return inflater_->decompress(data, len, out, limit);
+}
+
+/// Negotiation ///
+
+static std::string_view trim(std::string_view sv)
+{
+  while (not sv.empty() && (sv.front() == ' ' || sv.front() == '\t'))
+    sv.remove_prefix(1);
+  while (not sv.empty() && (sv.back() == ' ' || sv.back() == '\t'))
+    sv.remove_suffix(1);
+  return sv;
+}
+
+static std::vector<std::string_view> split(std::string_view sv, char delim)
+{
+  std::vector<std::string_view> parts;
+  while (true) {
+    const auto pos = sv.find(delim);
+    parts.push_back(trim(sv.substr(0, pos)));
+    if (pos == std::string_view::npos) return parts;
+    sv.remove_prefix(pos + 1);
+  }
+}
+
+// parses "name" or "name=value" / "name=\"value\""
+static std::pair<std::string_view, std::string_view> param(std::string_view sv)
+{
+  const auto eq = sv.find('=');
+  if (eq == std::string_view::npos) return {sv, {}};
+  auto value = trim(sv.substr(eq + 1));
+  if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+    value = value.substr(1, value.size() - 2);
+  return {trim(sv.substr(0, eq)), value};
+}
+
+// window bits are 8-15, returns 0 if invalid
+static uint8_t window_bits(std::string_view value)
+{
+  if (value.size() == 1 && value[0] >= '8' && value[0] <= '9')
+    return value[0] - '0';
+  if (value.size() == 2 && value[0] == '1' && value[1] >= '0' && value[1] <= '5')
+    return 10 + value[1] - '0';
+  return 0;
+}
+
+static const std::string_view EXTENSION = "permessage-deflate";
+
+std::string WS_deflate_options::offer() const
+{
+  std::string str{EXTENSION};
+  str += "; client_max_window_bits";
+  if (client_max_window_bits < 15)
+    str += "=" + std::to_string(client_max_window_bits);
+  if (server_max_window_bits < 15)
+    str += "; server_max_window_bits=" + std::to_string(server_max_window_bits);
+  if (server_no_context_takeover) str += "; server_no_context_takeover";
+  if (client_no_context_takeover) str += "; client_no_context_takeover";
+  return str;
+}
+
+WS_deflate_options WS_deflate_options::accept(std::string_view extensions) const
+{
+  WS_deflate_options agreed = *this;
+  agreed.enabled = false;
+  if (not enabled) return agreed;
+
+  for (auto ext : split(extensions, ','))
+  {
+    auto params = split(ext, ';');
+    if (params.front() != EXTENSION) continue;
+
+    WS_deflate_options opt = *this;
+    bool client_bits = false;
+    bool valid = true;
+    int  seen  = 0;
+    for (size_t i = 1; i < params.size() && valid; i++)
+    {
+      auto [name, value] = param(params[i]);
+      int bit = 0;
+      if (name == "server_no_context_takeover" && value.empty()) {
+        opt.server_no_context_takeover = true; bit = 1;
+      }
+      else if (name == "client_no_context_takeover" && value.empty()) {
+        opt.client_no_context_takeover = true; bit = 2;
+      }
+      else if (name == "server_max_window_bits") {
+        const auto bits = window_bits(value);
+        valid = bits != 0;
+        opt.server_max_window_bits = std::min(opt.server_max_window_bits, bits);
+        bit = 4;
+      }
+      else if (name == "client_max_window_bits") {
+        client_bits = true;
+        if (not value.empty()) {
+          const auto bits = window_bits(value);
+          valid = bits != 0;
+          opt.client_max_window_bits = std::min(opt.client_max_window_bits, bits);
+        }
+        bit = 8;
+      }
+      else valid = false;
+      // each parameter at most once
+      if (seen & bit) valid = false;
+      seen |= bit;
+    }
+    if (not valid) continue;
+    // the client can't be asked to use a smaller window
+    if (not client_bits) opt.client_max_window_bits = 15;
+    opt.enabled = true;
+    return opt;
+  }
+  return agreed;
+}
+
+std::string WS_deflate_options::response() const
+{
+  std::string str{EXTENSION};
+  if (server_no_context_takeover) str += "; server_no_context_takeover";
+  if (client_no_context_takeover) str += "; client_no_context_takeover";
+  if (server_max_window_bits < 15)
+    str += "; server_max_window_bits=" + std::to_string(server_max_window_bits);
+  if (client_max_window_bits < 15)
+    str += "; client_max_window_bits=" + std::to_string(client_max_window_bits);
+  return str;
+}
+
+bool WS_deflate_options::agree(std::string_view extensions,
+                               WS_deflate_options& agreed) const
+{
+  agreed = *this;
+  agreed.enabled = false;
+  if (trim(extensions).empty()) return true;
+  // the server may only respond with what we offered
+  if (not enabled) return false;
+
+  auto exts = split(extensions, ',');
+  if (exts.size() != 1) return false;
+  auto params = split(exts.front(), ';');
+  if (params.front() != EXTENSION) return false;
+
+  agreed.server_max_window_bits = 15;
+  for (size_t i = 1; i < params.size(); i++)
+  {
+    auto [name, value] = param(params[i]);
+    if (name == "server_no_context_takeover" && value.empty())
+      agreed.server_no_context_takeover = true;
+    else if (name == "client_no_context_takeover" && value.empty())
+      agreed.client_no_context_takeover = true;
+    else if (name == "server_max_window_bits") {
+      agreed.server_max_window_bits = window_bits(value);
+      if (agreed.server_max_window_bits == 0) return false;
+    }
+    else if (name == "client_max_window_bits") {
+      const auto bits = window_bits(value);
+      if (bits == 0) return false;
+      agreed.client_max_window_bits = std::min(client_max_window_bits, bits);
+    }
+    else return false;
+  }
+  if (agreed.server_max_window_bits > server_max_window_bits) return false;
+  agreed.enabled = true;
+  return true;
+}
+
+} // net
@@ -0,0 +1,108 @@
+
+#include <net/ws/header.hpp>
+#include <common>
+#if defined(__x86_64__) || defined(__i386__)
+#include <kernel/cpuid.hpp>
+#include <immintrin.h>
+#define WS_MASK_X86
+#endif
+
+namespace net {
+
+// XOR 8 bytes at a time, then the remaining bytes
+static inline void mask_words(uint8_t* data, size_t len, uint32_t key)
+{
+  const uint64_t key64 = ((uint64_t) key << 32) | key;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, &data[i], sizeof(word));
+    word ^= key64;
+    memcpy(&data[i], &word, sizeof(word));
+  }
+  const auto* kb = (const uint8_t*) &key;
+  for (; i < len; i++)
+      data[i] ^= kb[i & 3];
+}
+
+#ifdef WS_MASK_X86
+static void mask_sse2(uint8_t* data, size_t len, uint32_t key)
+{
+  const __m128i vkey = _mm_set1_epi32(key);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64)
+  {
+    auto* p = (__m128i*) &data[i];
+    __m128i a = _mm_loadu_si128(p + 0);
+    __m128i b = _mm_loadu_si128(p + 1);
+    __m128i c = _mm_loadu_si128(p + 2);
+    __m128i d = _mm_loadu_si128(p + 3);
+    _mm_storeu_si128(p + 0, _mm_xor_si128(a, vkey));
+    _mm_storeu_si128(p + 1, _mm_xor_si128(b, vkey));
+    _mm_storeu_si128(p + 2, _mm_xor_si128(c, vkey));
+    _mm_storeu_si128(p + 3, _mm_xor_si128(d, vkey));
+  }
+  for (; i + 16 <= len; i += 16)
+  {
+    auto* p = (__m128i*) &data[i];
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), vkey));
+  }
+  // 16 is a multiple of the key length, so the key is still in phase
+  mask_words(&data[i], len - i, key);
+}
+
+__attribute__((target("avx2")))
+static void mask_avx2(uint8_t* data, size_t len, uint32_t key)
+{
+  const __m256i vkey = _mm256_set1_epi32(key);
+  size_t i = 0;
+  for (; i + 128 <= len; i += 128)
+  {
+    auto* p = (__m256i*) &data[i];
+    __m256i a = _mm256_loadu_si256(p + 0);
+    __m256i b = _mm256_loadu_si256(p + 1);
+    __m256i c = _mm256_loadu_si256(p + 2);
+    __m256i d = _mm256_loadu_si256(p + 3);
+    _mm256_storeu_si256(p + 0, _mm256_xor_si256(a, vkey));
+    _mm256_storeu_si256(p + 1, _mm256_xor_si256(b, vkey));
+    _mm256_storeu_si256(p + 2, _mm256_xor_si256(c, vkey));
+    _mm256_storeu_si256(p + 3, _mm256_xor_si256(d, vkey));
+  }
+  for (; i + 32 <= len; i += 32)
+  {
+    auto* p = (__m256i*) &data[i];
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), vkey));
+  }
+  mask_sse2(&data[i], len - i, key);
+}
+#endif
+
+void ws_mask(char* ptr, size_t len, uint32_t key, size_t offset) noexcept
+{
+  // rotate the key so that byte 0 of ptr uses mask byte (offset & 3)
+  const int rot = (offset & 3) * 8;
+  if (rot) key = (key >> rot) | (key << (32 - rot));
+  auto* data = (uint8_t*) ptr;
+
+#ifdef WS_MASK_X86
+  // short frames (most control frames) aren't worth the vector setup
+  if (len < 16) return mask_words(data, len, key);
+
+  static bool has_avx2 = false;
+  static bool has_checked = false;
+  if (UNLIKELY(has_checked == false)) {
+    has_avx2 = CPUID::has_feature(CPUID::Feature::AVX2)
+            && CPUID::has_feature(CPUID::Feature::OSXSAVE);
+    has_checked = true;
+  }
+  if (has_avx2)
+    mask_avx2(data, len, key);
+  else
+    mask_sse2(data, len, key);
+#else
+  mask_words(data, len, key);
+#endif
+}
+
+} // net
@@ -38,7 +38,8 @@ const char* WebSocket::to_string(op_code code)
   }
 }
 
-WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writer)
+WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writer,
+                                 const WS_deflate_options& deflate)
 {
   // validate handshake
   auto view = req.header().value("Sec-WebSocket-Version");
@@ -59,6 +60,11 @@ WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writ
   header.set_field(http::header::Connection, "Upgrade");
   header.set_field(http::header::Upgrade,    "WebSocket");
   header.set_field("Sec-WebSocket-Accept", encode_hash(std::string(key)));
+  // negotiate compression
+  const auto agreed = deflate.accept(req.header().value("Sec-WebSocket-Extensions"));
+  if (agreed.enabled) {
+    header.set_field("Sec-WebSocket-Extensions", agreed.response());
+  }
   writer.write_header(http::Switching_Protocols);
 
   auto stream = writer.connection().release();
@@ -66,12 +72,15 @@ WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writ
   // discard streams which can be FIN-WAIT-1
   if (stream->is_connected()) {
     // for now, only accept fully connected streams
-    return std::make_unique<WebSocket>(std::move(stream), false);
+    auto ws = std::make_unique<WebSocket>(std::move(stream), false);
+    if (agreed.enabled) ws->set_compression(agreed);
+    return ws;
   }
   return nullptr;
 }
 
-WebSocket_ptr WebSocket::upgrade(http::Error err, http::Response& res, http::Connection& conn, const std::string& key)
+WebSocket_ptr WebSocket::upgrade(http::Error err, http::Response& res, http::Connection& conn,
+                                 const std::string& key, const WS_deflate_options& deflate)
 {
   if (err or res.status_code() != http::Switching_Protocols)
   {
@@ -85,11 +94,19 @@ WebSocket_ptr WebSocket::upgrade(http::Error err, http::Response& res, http::Con
     {
       return nullptr;
     }
+    /// the server may only agree to extensions we offered
+    WS_deflate_options agreed;
+    if (not deflate.agree(res.header().value("Sec-WebSocket-Extensions"), agreed))
+    {
+      return nullptr;
+    }
     /// create open websocket
     auto stream = conn.release();
     assert(stream->is_connected());
     // create client websocket and call callback
-    return std::make_unique<WebSocket>(std::move(stream), true);
+    auto ws = std::make_unique<WebSocket>(std::move(stream), true);
+    if (agreed.enabled) ws->set_compression(agreed);
+    return ws;
   }
 }
 
@@ -106,12 +123,13 @@ std::vector<char> WebSocket::generate_key()
 }
 
 http::Server::Request_handler WebSocket::create_request_handler(
-  Connect_handler on_connect, Accept_handler on_accept)
+  Connect_handler on_connect, Accept_handler on_accept, WS_deflate_options deflate)
 {
   return http::Server::Request_handler::make_packed(
     [
       on_connect{std::move(on_connect)},
-      on_accept{std::move(on_accept)}
+      on_accept{std::move(on_accept)},
+      deflate{std::move(deflate)}
     ]
     (http::Request_ptr req, http::Response_writer_ptr writer)
     {
@@ -126,23 +144,24 @@ http::Server::Request_handler WebSocket::create_request_handler(
           return;
         }
       }
-      auto ws = WebSocket::upgrade(*req, *writer);
+      auto ws = WebSocket::upgrade(*req, *writer, deflate);
 
       on_connect(std::move(ws));
     });
 }
 
 http::Basic_client::Response_handler WebSocket::create_response_handler(
-  Connect_handler on_connect, std::string key)
+  Connect_handler on_connect, std::string key, WS_deflate_options deflate)
 {
   return http::Basic_client::Response_handler::make_packed(
     [
       on_connect{std::move(on_connect)},
-      key{std::move(key)}
+      key{std::move(key)},
+      deflate{std::move(deflate)}
     ]
     (http::Error err, http::Response_ptr res, http::Connection& conn)
     {
-      auto ws = WebSocket::upgrade(err, *res, conn, key);
+      auto ws = WebSocket::upgrade(err, *res, conn, key, deflate);
 
       on_connect(std::move(ws));
     });
@@ -151,7 +170,8 @@ http::Basic_client::Response_handler WebSocket::create_response_handler(
 void WebSocket::connect(
       http::Basic_client&   client,
       uri::URI              remote,
-      Connect_handler       callback)
+      Connect_handler       callback,
+      const WS_deflate_options& deflate)
 {
   // doesn't have to be extremely random, just random
   std::string key  = base64::encode(generate_key());
@@ -162,9 +182,12 @@ void WebSocket::connect(
       {"Sec-WebSocket-Version", "13"},
       {"Sec-WebSocket-Key",     key }
   };
+  if (deflate.enabled) {
+    ws_headers.push_back({"Sec-WebSocket-Extensions", deflate.offer()});
+  }
   // send HTTP request
   client.get(remote, ws_headers,
-    WS_client_connector::create_response_handler(std::move(callback), std::move(key)));
+    WS_client_connector::create_response_handler(std::move(callback), std::move(key), deflate));
 }
 
 void WebSocket::read_data(Stream::buffer_t buf)
@@ -173,40 +196,43 @@ void WebSocket::read_data(Stream::buffer_t buf)
   if (this->stream == nullptr) return;
 
   size_t len = buf->size();
-  const uint8_t* data = buf->data();
+  uint8_t* data = buf->data();
   while (len)
   {
+    size_t used;
     if (message != nullptr)
     {
-      const size_t written = message->append(data, len);
-      len -= written;
-      data += len;
+      used = message->append(data, len);
     }
     // create new message
     else
     {
-      const size_t written = create_message(data, len);
+      used = create_message(buf, data, len);
 
       if(UNLIKELY(message == nullptr))
         return; // Something was invalid, error has been called and stream closed.
-
-      len -= written;
-      data += len;
     }
+    data += used;
+    len  -= used;
 
     if (message->is_complete()) {
       finalize_message();
+      // the handlers may have closed the connection
+      if (this->stream == nullptr) return;
     }
   }
 }
 
 size_t WebSocket::Message::append(const uint8_t* data, size_t len)
 {
+  Expects(view_ == nullptr);
   size_t total = 0;
-  // more partial header
-  if (UNLIKELY(this->header_complete() == false))
+  // more partial header: the first two bytes tell how long it is
+  while (UNLIKELY(this->header_complete() == false) && len > 0)
   {
-    auto hdr_bytes = std::min(header().header_length() - this->header_length, (int) len);
+    const size_t wanted = (this->header_length < 2)
+        ? 2 : header().header_length();
+    const size_t hdr_bytes = std::min(wanted - this->header_length, len);
     memcpy(&header_[this->header_length], data, hdr_bytes);
     this->header_length += hdr_bytes;
     // move forward in buffer
@@ -219,14 +245,14 @@ size_t WebSocket::Message::append(const uint8_t* data, size_t len)
   // fill data with remainder
   if (this->header_complete())
   {
-    const size_t insert_size = std::min(data_.capacity() - data_.size(), len);
+    const size_t insert_size = std::min(header().data_length() - data_.size(), len);
     data_.insert(data_.end(), data, data + insert_size);
     total += insert_size;
   }
   return total;
 }
 
-size_t WebSocket::create_message(const uint8_t* buf, size_t len)
+size_t WebSocket::create_message(const Stream::buffer_t& buffer, uint8_t* buf, size_t len)
 {
   // parse header
   if (len < sizeof(ws_header)) {
@@ -265,7 +291,22 @@ size_t WebSocket::create_message(const uint8_t* buf, size_t len)
     failure("Read unmasked message from client");
     return std::min(hdr.data_length(), len);
   }
+  // RSV1 marks the first frame of a compressed message (RFC 7692 section 6),
+  // it is never set on control or continuation frames
+  if (hdr.is_compressed()
+      && (hdr.opcode() == op_code::CONTINUE || (uint8_t) hdr.opcode() >= 0x8))
+  {
+    failure("read: RSV1 set on a control or continuation frame");
+    return len;
+  }
 
+  // the whole frame is in this buffer: refer to it in place
+  if (len >= hdr.header_length()
+      && len - hdr.header_length() >= hdr.data_length())
+  {
+    this->message = std::make_unique<Message>(buffer, buf);
+    return hdr.header_length() + hdr.data_length();
+  }
   this->message = std::make_unique<Message>(buf, len);
   return len;
 }
@@ -278,6 +319,23 @@ void WebSocket::finalize_message()
   switch (hdr.opcode()) {
   case op_code::TEXT:
   case op_code::BINARY:
+    if (hdr.is_compressed())
+    {
+      if (UNLIKELY(this->deflate == nullptr)) {
+        failure("read: Compressed message without permessage-deflate");
+        message.reset();
+        return;
+      }
+      Message::Data data;
+      if (not this->deflate->decompress((const uint8_t*) message->data(),
+                                        message->size(), data, max_msg_size))
+      {
+        failure("read: Invalid compressed message");
+        message.reset();
+        return;
+      }
+      message->set_data(std::move(data));
+    }
     /// .. call on_read
     if (this->on_read) {
       this->m_busy = true;
@@ -299,13 +357,13 @@ void WebSocket::finalize_message()
     // the websocket is DEAD after close()
     return;
   case op_code::PING:
-    if (on_ping(hdr.data(), hdr.data_length())) // if return true, pong back
-      write_opcode(op_code::PONG, hdr.data(), hdr.data_length());
+    if (on_ping(message->data(), message->size())) // if return true, pong back
+      write_opcode(op_code::PONG, message->data(), message->size());
     break;
   case op_code::PONG:
     ping_timer.stop();
     if (on_pong != nullptr)
-      on_pong(hdr.data(), hdr.data_length());
+      on_pong(message->data(), message->size());
     break;
   default:
     //printf("Unknown opcode: %d\n", (int) hdr.opcode());
@@ -349,8 +407,16 @@ void WebSocket::write(const char* data, size_t len, op_code code)
   Expects((code == op_code::TEXT or code == op_code::BINARY)
       && "Write currently only supports TEXT or BINARY");
 
+  const bool compress = this->deflate != nullptr && this->deflate->should_compress(len);
+  if (compress)
+  {
+    const auto& payload = this->deflate->compress((const uint8_t*) data, len);
+    data = (const char*) payload.data();
+    len  = payload.size();
+  }
   // fill header
   auto buf = create_wsmsg(len, code, clientside);
+  if (compress) ((ws_header*) buf->data())->set_compressed();
   // get data offset & fill in data into buffer
   buf->insert(buf->end(), data, data + len);
   // for client-side we have to mask the data
@@ -364,6 +430,20 @@ void WebSocket::write(const char* data, size_t len, op_code code)
   /// send everything as shared buffer
   this->stream->write(buf);
 }
+Stream::buffer_t WebSocket::encode_frame(const char* data, size_t len, op_code code)
+{
+  auto buf = create_wsmsg(len, code, false);
+  buf->insert(buf->end(), data, data + len);
+  return buf;
+}
+bool WebSocket::write_frame(Stream::buffer_t frame)
+{
+  if (UNLIKELY(this->stream == nullptr || this->stream->is_writable() == false))
+    return false;
+  Expects(clientside == false && "Client-side frames must be masked");
+  this->stream->write(std::move(frame));
+  return true;
+}
 void WebSocket::write(Stream::buffer_t buffer, op_code code)
 {
   if (UNLIKELY(this->stream == nullptr)) {
@@ -382,6 +462,12 @@ void WebSocket::write(Stream::buffer_t buffer, op_code code)
   Expects((code == op_code::TEXT or code == op_code::BINARY)
         && "Write currently only supports TEXT or BINARY");
 
+  // the compressed message can't share the buffer
+  if (this->deflate != nullptr && this->deflate->should_compress(buffer->size()))
+  {
+    write((const char*) buffer->data(), buffer->size(), code);
+    return;
+  }
   /// write header
   auto header = create_wsmsg(buffer->size(), code, false);
   this->stream->write(header);
@@ -410,6 +496,11 @@ WebSocket::WebSocket(net::Stream_ptr stream_ptr, bool client)
   this->stream->on_close({this, &WebSocket::close_callback_once});
 }
 
+void WebSocket::set_compression(const WS_deflate_options& agreed)
+{
+  this->deflate = std::make_unique<WS_deflate>(agreed, clientside);
+}
+
 void WebSocket::close(const uint16_t reason)
 {
   if (this->m_busy) {
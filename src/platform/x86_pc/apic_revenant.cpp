@@ -5,6 +5,7 @@
 #include "idt.hpp"
 #include "init_libc.hpp"
 #include <kernel/events.hpp>
+#include <kernel/busy_poll.hpp>
 #include <kernel/rng.hpp>
 #include <kernel/threads.hpp>
 #include <kernel/smp_common.hpp>
@@ -52,10 +53,14 @@ void revenant_thread_main(int cpu)
     SMP::global_lock();
     smp::main_system.initialized_cpus.push_back(cpu);
     SMP::global_unlock();
+    auto& poller = Busy_poll::get();
     while (true)
     {
       Events::get().process_events();
-      os::halt();
+      if (poller.active())
+        poller.poll();
+      else
+        os::halt();
     }
     __builtin_unreachable();
 }
@@ -7,8 +7,10 @@
 #include <os.hpp>
 #include <rtc>
 #include <kernel/events.hpp>
+#include <kernel/busy_poll.hpp>
 #include <kernel/memory.hpp>
 #include <kprint>
+#include <statman>
 #include <service>
 #include <cstdio>
 #include "cmos.hpp"
@@ -132,6 +134,27 @@ void kernel::start(uint32_t boot_magic, uint32_t boot_addr)
   memmap.assign_range({kernel::heap_begin(), heap_range_max_,
         "Dynamic memory", kernel::heap_usage });
 
+#if defined(ARCH_x86_64)
+  {
+    PROFILE("Heap pages");
+    auto& statman = Statman::get();
+    const size_t heap_size = heap_range_max_ - kernel::heap_begin() + 1;
+    if (const auto psize = os::mem::huge_page_size(); psize != 0) {
+      const auto mapped = os::mem::map_huge(kernel::heap_begin(), heap_size, psize);
+      statman.create(Stat::UINT64, "mem.heap.huge_mapped").get_uint64() = mapped;
+      INFO2("* Heap backed by pages up to %s (%s)", util::Byte_r(psize).to_string().c_str(),
+            util::Byte_r(mapped).to_string().c_str());
+    }
+    // each page of the heap is a TLB entry when touched
+    const auto pages = os::mem::page_stats(kernel::heap_begin(), heap_size);
+    INFO2("* Heap pages: %zu 4KiB, %zu 2MiB, %zu 1GiB",
+          pages.pages_4k, pages.pages_2m, pages.pages_1g);
+    statman.create(Stat::UINT64, "mem.heap.pages_4k").get_uint64() = pages.pages_4k;
+    statman.create(Stat::UINT64, "mem.heap.pages_2m").get_uint64() = pages.pages_2m;
+    statman.create(Stat::UINT64, "mem.heap.pages_1g").get_uint64() = pages.pages_1g;
+  }
+#endif
+
   MYINFO("Virtual memory map");
   {
     PROFILE("Print memory map");
@@ -155,9 +178,14 @@ extern void __arch_poweroff();
 
 void os::event_loop()
 {
+  auto& poller = Busy_poll::get();
   Events::get(0).process_events();
   do {
-    os::halt();
+    // keep polling busy devices instead of waiting for their next interrupt
+    if (poller.active())
+      poller.poll();
+    else
+      os::halt();
     Events::get(0).process_events();
   } while (kernel::is_running());
 
@@ -39,8 +39,48 @@ ssize_t File_FD::readv(const struct iovec* iov, int iovcnt)
   return total;
 }
 
-int File_FD::write(const void*, size_t) {
-  return -1;
+int fs_errno(const fs::error_t& err)
+{
+  switch (err.code()) {
+  case fs::error_t::NO_ERR:    return 0;
+  case fs::error_t::E_NOENT:   return -ENOENT;
+  case fs::error_t::E_NOTDIR:  return -ENOTDIR;
+  case fs::error_t::E_NOTFILE: return -EISDIR;
+  case fs::error_t::E_EXIST:   return -EEXIST;
+  case fs::error_t::E_NOSPC:   return -ENOSPC;
+  case fs::error_t::E_ROFS:    return -EROFS;
+  default:                     return -EIO;
+  }
+}
+
+int File_FD::write(const void* p, size_t n)
+{
+  Expects(p != nullptr);
+
+  if(UNLIKELY(ent_.is_dir()))
+    return -EISDIR;
+
+  if(UNLIKELY(n == 0))
+    return 0;
+
+  auto err = ent_.write(offset_, p, n);
+  if (err) return fs_errno(err);
+
+  offset_ += n;
+  return n;
+}
+
+int File_FD::ftruncate(off_t length)
+{
+  if (length < 0)
+    return -EINVAL;
+
+  return fs_errno(ent_.truncate(length));
+}
+
+int File_FD::fsync()
+{
+  return fs_errno(ent_.fs().sync());
 }
 
 int File_FD::close() {
@@ -3,6 +3,8 @@
 #include <cstdint>
 #include <cstddef>
 #include <common>
+#include <kernel/cpuid.hpp>
+#include <util/detail/crc_fold.hpp>
 
 /** Intel (iSCSI) or vanilla-polynomial, DONT mix with other code **/
 #if defined(ARCH_x86_64) || defined(ARCH_i686)
@@ -15,21 +17,28 @@ inline bool ____is__aligned(const uint8_t* buffer, const int align) noexcept {
 
 #if defined(ARCH_x86_64) || defined(ARCH_i686)
 __attribute__ ((target ("sse4.2")))
-uint32_t crc32c_hw(const uint8_t* buffer, size_t len)
+static uint32_t crc32c_hw(uint32_t hash, const uint8_t* buffer, size_t len)
 {
-  uint32_t hash = 0xFFFFFFFF;
-  // 8-bits until 4-byte aligned
-  while (____is__aligned(buffer, 4) == false && len > 0) {
+  // 8-bits until 8-byte aligned
+  while (____is__aligned(buffer, 8) == false && len > 0) {
     hash = _mm_crc32_u8(hash, *buffer); buffer++; len--;
   }
-  // 16 bytes at a time
-  while (len >= 16) {
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer +  0));
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer +  4));
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer +  8));
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer + 12));
-    buffer += 16; len -= 16;
+#ifdef ARCH_x86_64
+  uint64_t hash64 = hash;
+  // 32 bytes at a time
+  while (len >= 32) {
+    hash64 = _mm_crc32_u64(hash64, *(uint64_t*) (buffer +  0));
+    hash64 = _mm_crc32_u64(hash64, *(uint64_t*) (buffer +  8));
+    hash64 = _mm_crc32_u64(hash64, *(uint64_t*) (buffer + 16));
+    hash64 = _mm_crc32_u64(hash64, *(uint64_t*) (buffer + 24));
+    buffer += 32; len -= 32;
+  }
+  while (len >= 8) {
+    hash64 = _mm_crc32_u64(hash64, *(uint64_t*) buffer);
+    buffer += 8; len -= 8;
   }
+  hash = hash64;
+#endif
   // 4 bytes at a time
   while (len >= 4) {
     hash = _mm_crc32_u32(hash, *(uint32_t*) buffer);
@@ -43,10 +52,111 @@ uint32_t crc32c_hw(const uint8_t* buffer, size_t len)
   if (len & 1) {
     hash = _mm_crc32_u8(hash, *buffer);
   }
-  return hash ^ 0xFFFFFFFF;
+  return hash;
+}
+
+namespace util::detail {
+__attribute__ ((target ("pclmul,sse4.1")))
+static inline __m128i load(const uint8_t* p) {
+  return _mm_loadu_si128((const __m128i*) p);
+}
+// multiply each half with its key, moving it 128 or 512 bits ahead
+__attribute__ ((target ("pclmul,sse4.1")))
+static inline __m128i fold(__m128i x, __m128i k) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                       _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+/**
+ * Fold @len bytes (a multiple of 16, at least 64) down to 16 bytes
+ * with the same remainder, 4x128 bits at a time, as described in
+ * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+ * The running @crc register is folded in with the first block.
+ */
+__attribute__ ((target ("pclmul,sse4.1")))
+void crc_fold(const crc_fold_keys& keys, uint64_t crc,
+              const uint8_t* data, size_t len, uint8_t out[16]) noexcept
+{
+  __m128i x1 = _mm_xor_si128(load(data), _mm_set_epi64x(0, crc));
+  __m128i x2 = load(data + 16);
+  __m128i x3 = load(data + 32);
+  __m128i x4 = load(data + 48);
+  data += 64; len -= 64;
+
+  const __m128i k4 = _mm_loadu_si128((const __m128i*) keys.fold4);
+  while (len >= 64)
+  {
+    x1 = _mm_xor_si128(fold(x1, k4), load(data));
+    x2 = _mm_xor_si128(fold(x2, k4), load(data + 16));
+    x3 = _mm_xor_si128(fold(x3, k4), load(data + 32));
+    x4 = _mm_xor_si128(fold(x4, k4), load(data + 48));
+    data += 64; len -= 64;
+  }
+  // fold the 4 lanes into one
+  const __m128i k1 = _mm_loadu_si128((const __m128i*) keys.fold1);
+  x1 = _mm_xor_si128(fold(x1, k1), x2);
+  x1 = _mm_xor_si128(fold(x1, k1), x3);
+  x1 = _mm_xor_si128(fold(x1, k1), x4);
+  while (len >= 16)
+  {
+    x1 = _mm_xor_si128(fold(x1, k1), load(data));
+    data += 16; len -= 16;
+  }
+  _mm_storeu_si128((__m128i*) out, x1);
+}
+
+bool crc_fold_available() noexcept
+{
+  static bool has_clmul = false;
+  static bool has_checked = false;
+  if (UNLIKELY(has_checked == false)) {
+    has_clmul = CPUID::has_feature(CPUID::Feature::PCLMULQDQ)
+             && CPUID::has_feature(CPUID::Feature::SSE4_1);
+    has_checked = true;
+  }
+  return has_clmul;
+}
+} // util::detail
+#else
+namespace util::detail {
+void crc_fold(const crc_fold_keys&, uint64_t, const uint8_t*, size_t, uint8_t*) noexcept {}
+bool crc_fold_available() noexcept { return false; }
 }
 #endif
 
+namespace util::detail {
+// x^E mod P, with P given in reflected form (as used by table-driven CRCs),
+// as a 64-bit constant whose bit j is the coefficient of x^(63-j)
+static uint64_t fold_key(int E, uint64_t poly, int width)
+{
+  uint64_t normal = 0;
+  for (int i = 0; i < width; i++)
+    if (poly & (1ull << i)) normal |= 1ull << (width - 1 - i);
+  // bit d is the coefficient of x^d
+  uint64_t rem = 1;
+  for (int i = 0; i < E; i++)
+  {
+    const bool carry = (rem >> (width - 1)) & 1;
+    rem <<= 1;
+    if (width < 64) rem &= (1ull << width) - 1;
+    if (carry) rem ^= normal;
+  }
+  uint64_t key = 0;
+  for (int d = 0; d < width; d++)
+    if (rem & (1ull << d)) key |= 1ull << (63 - d);
+  return key;
+}
+
+crc_fold_keys crc_fold_keys_for(uint64_t poly, int width)
+{
+  // the low half of a block is 64 bits further from the end than the high
+  return {
+    { fold_key(63 + 512, poly, width), fold_key(511, poly, width) },
+    { fold_key(63 + 128, poly, width), fold_key(127, poly, width) }
+  };
+}
+} // util::detail
+
 uint32_t crc32c_sw(uint32_t partial, const char* buf, size_t len)
 {
   static const uint32_t crc32c_tab[] = {
@@ -121,27 +231,67 @@ uint32_t crc32c_sw(uint32_t partial, const char* buf, size_t len)
   return partial;
 }
 
-#include <kernel/cpuid.hpp>
-uint32_t crc32_fast(const void* buf, size_t len)
+static bool has_sse42() noexcept
 {
 #ifdef __SSE4_2__
-  return crc32c_hw((const uint8_t*) buf, len);
-#else
-#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  return true;
+#elif defined(ARCH_x86_64) || defined(ARCH_i686)
   static bool has_sse42 = false;
   static bool has_checked = false;
   if (UNLIKELY(has_checked == false)) {
     has_sse42 = CPUID::has_feature(CPUID::Feature::SSE4_2);
     has_checked = true;
   }
-  if (has_sse42 == false) {
-      return ~crc32c_sw(0xFFFFFFFF, (const char*) buf, len);
-  } else {
-      return crc32c_hw((const uint8_t*) buf, len);
-  }
+  return has_sse42;
 #else
-  // for all other arches (and linux) ...
-  return ~crc32c_sw(0xFFFFFFFF, (const char*) buf, len);
+  return false;
 #endif
+}
+
+// below this folding isn't worth it
+static const size_t FOLD_MIN = 256;
+
+uint32_t crc32c_update(uint32_t partial, const void* buf, size_t len)
+{
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  if (has_sse42())
+  {
+    auto* data = (const uint8_t*) buf;
+    using namespace util::detail;
+    // the crc32 instruction has a 3 cycle latency, while folding
+    // keeps several multipliers busy
+    if (len >= FOLD_MIN && crc_fold_available())
+    {
+      static const auto keys = crc_fold_keys_for(0x82F63B78, 32);
+      uint8_t folded[16];
+      const size_t bulk = len & ~(size_t) 15;
+      crc_fold(keys, partial, data, bulk, folded);
+      partial = crc32c_hw(0, folded, sizeof(folded));
+      data += bulk; len -= bulk;
+    }
+    return crc32c_hw(partial, data, len);
+  }
 #endif
+  return crc32c_sw(partial, (const char*) buf, len);
+}
+
+uint32_t crc32_update(uint32_t partial, const void* buf, size_t len)
+{
+  auto* data = (const char*) buf;
+  using namespace util::detail;
+  if (len >= FOLD_MIN && crc_fold_available())
+  {
+    static const auto keys = crc_fold_keys_for(0xEDB88320, 32);
+    uint8_t folded[16];
+    const size_t bulk = len & ~(size_t) 15;
+    crc_fold(keys, partial, (const uint8_t*) data, bulk, folded);
+    partial = crc32(0, (const char*) folded, sizeof(folded));
+    data += bulk; len -= bulk;
+  }
+  return crc32(partial, data, len);
+}
+
+uint32_t crc32_fast(const void* buf, size_t len)
+{
+  return ~crc32c_update(0xFFFFFFFF, buf, len);
 }
@@ -99,6 +99,7 @@ Virtio::Virtio(hw::PCI_Device& dev)
         dev.setup_msix_vector(current_cpu, IRQ_BASE + irq);
         // store IRQ for later
         this->irqs.push_back(irq);
+        this->irq_cpus.push_back(current_cpu);
       }
     }
     else
@@ -119,6 +120,7 @@ Virtio::Virtio(hw::PCI_Device& dev)
 
     // store for later
     irqs.push_back(irq);
+    irq_cpus.push_back(SMP::cpu_id());
   }
 
   INFO("Virtio", "Initialization complete");
@@ -193,7 +195,7 @@ void Virtio::move_to_this_cpu()
     // unsubscribe IRQs on old CPU
     for (size_t i = 0; i < irqs.size(); i++)
     {
-      auto& oldman = Events::get(this->current_cpu);
+      auto& oldman = Events::get(this->irq_cpus[i]);
       oldman.unsubscribe(this->irqs[i]);
     }
     // resubscribe on the new CPU
@@ -201,11 +203,21 @@ void Virtio::move_to_this_cpu()
     for (size_t i = 0; i < irqs.size(); i++)
     {
       this->irqs[i] = Events::get().subscribe(nullptr);
+      this->irq_cpus[i] = current_cpu;
       _pcidev.rebalance_msix_vector(i, current_cpu, IRQ_BASE + this->irqs[i]);
     }
   }
 }
 
+void Virtio::move_vector_to_cpu(size_t index, int cpu)
+{
+  if (has_msix() == false) return;
+  Events::get(this->irq_cpus.at(index)).unsubscribe(this->irqs[index]);
+  this->irqs[index] = Events::get(cpu).subscribe(nullptr);
+  this->irq_cpus[index] = cpu;
+  _pcidev.rebalance_msix_vector(index, cpu, IRQ_BASE + this->irqs[index]);
+}
+
 void Virtio::setup_complete(bool ok)
 {
   uint8_t value = hw::inp(_iobase + VIRTIO_PCI_STATUS);
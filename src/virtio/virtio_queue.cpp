@@ -109,6 +109,42 @@ int Virtio::Queue::enqueue(gsl::span<Token> buffers)
   return buffers.size();
 }
 
+int Virtio::Queue::enqueue_indirect(gsl::span<Token> buffers, virtq_desc* table)
+{
+  debug ("<%s> Enqueuing %i tokens indirectly \n", qname.c_str(), buffers.size());
+  Expects(buffers.size() > 0);
+
+  // chain the buffers inside the indirect table
+  uint16_t idx = 0;
+  for (auto buf : buffers)
+  {
+    table[idx].flags =
+      buf.direction() ? VIRTQ_DESC_F_NEXT : VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE;
+    table[idx].addr = (uint64_t) buf.data();
+    table[idx].len  = buf.size();
+    table[idx].next = idx + 1;
+    idx++;
+  }
+  table[idx-1].flags &= ~VIRTQ_DESC_F_NEXT;
+  table[idx-1].next = 0;
+
+  // the ring itself only holds the one indirect descriptor
+  uint16_t head = _free_head;
+  _queue.desc[head].flags = VIRTQ_DESC_F_INDIRECT;
+  _queue.desc[head].addr  = (uint64_t) table;
+  _queue.desc[head].len   = buffers.size() * sizeof(virtq_desc);
+  _free_head = _queue.desc[head].next;
+
+  _desc_in_flight += 1;
+  Ensures(_desc_in_flight <= size());
+
+  uint16_t avail_index = (_queue.avail->idx + _num_added) % _size;
+  _num_added++;
+  _queue.avail->ring[avail_index] = head;
+
+  return buffers.size();
+}
+
 void Virtio::Queue::release(uint32_t head)
 {
   // Mark queue element "head" as free (the whole token chain)
@@ -139,8 +175,14 @@ Virtio::Token Virtio::Queue::dequeue()
   // Release buffer
   release(e.id);
   _last_used_idx++;
+  // indirect chains return the first buffer of the table
+  auto& desc = _queue.desc[e.id];
+  if (desc.flags & VIRTQ_DESC_F_INDIRECT) {
+    auto* table = (virtq_desc*) desc.addr;
+    return {{(uint8_t*) table[0].addr, e.len }, Token::IN};
+  }
   // return token:
-  return {{(uint8_t*) _queue.desc[e.id].addr, e.len }, Token::IN};
+  return {{(uint8_t*) desc.addr, e.len }, Token::IN};
 }
 
 void Virtio::Queue::disable_interrupts() {
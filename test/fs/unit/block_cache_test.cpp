@@ -0,0 +1,359 @@
+
+#include <common.cxx>
+#include <fs/block_cache.hpp>
+#include <fs/common.hpp>
+#include <cstring>
+#include <functional>
+
+// block device where every byte of block N is (N & 0xff)
+class Pattern_device : public hw::Block_device {
+public:
+  Pattern_device(block_t blocks) : blocks_{blocks} {}
+
+  std::string device_name() const override { return "pattern" + std::to_string(id()); }
+  const char* driver_name() const noexcept override { return "Pattern"; }
+  block_t size() const noexcept override { return blocks_; }
+  block_t block_size() const noexcept override { return 512; }
+
+  void read(block_t blk, size_t cnt, on_read_func reader) override {
+    if (deferred) {
+      pending.push_back([this, blk, cnt, reader] { reader(read_sync(blk, cnt)); });
+      return;
+    }
+    reader(read_sync(blk, cnt));
+  }
+  buffer_t read_sync(block_t blk, size_t cnt) override {
+    reads++;
+    blocks_read += cnt;
+    if (blk + cnt > blocks_) return nullptr;
+    auto buf = fs::construct_buffer(cnt * block_size());
+    for (size_t i = 0; i < cnt; i++)
+      std::memset(buf->data() + i * block_size(), (blk + i) & 0xff, block_size());
+    return buf;
+  }
+  void deactivate() override {}
+
+  // complete async reads later, with complete_reads()
+  void complete_reads() {
+    auto reads = std::move(pending);
+    for (auto& read : reads) read();
+  }
+
+  int    reads = 0;
+  size_t blocks_read = 0;
+  bool   deferred = false;
+  std::vector<std::function<void()>> pending;
+private:
+  block_t blocks_;
+};
+
+static bool matches(const fs::buffer_t& buf, uint64_t blk, size_t cnt)
+{
+  if (buf == nullptr || buf->size() != cnt * 512) return false;
+  for (size_t i = 0; i < buf->size(); i++)
+    if (buf->at(i) != ((blk + i / 512) & 0xff)) return false;
+  return true;
+}
+
+CASE("Block cache serves repeated reads from memory")
+{
+  Pattern_device dev{256};
+  fs::Block_cache cache{64, "bctest1"};
+
+  auto buf = cache.read_sync(dev, 10, 2);
+  EXPECT(matches(buf, 10, 2));
+  EXPECT(dev.reads == 1);
+  EXPECT(cache.misses() == 2u);
+
+  buf = cache.read_sync(dev, 10, 2);
+  EXPECT(matches(buf, 10, 2));
+  EXPECT(dev.reads == 1);
+  EXPECT(cache.hits() == 2u);
+
+  // async reads complete immediately on hit
+  bool called = false;
+  cache.read(dev, 11, 1,
+    [&] (fs::buffer_t data) {
+      called = true;
+      EXPECT(matches(data, 11, 1));
+    });
+  EXPECT(called);
+  EXPECT(dev.reads == 1);
+}
+
+CASE("Block cache only fetches missing blocks")
+{
+  Pattern_device dev{256};
+  fs::Block_cache cache{64, "bctest2"};
+  cache.set_readahead(0);
+
+  cache.read_sync(dev, 20);
+  cache.read_sync(dev, 23);
+  EXPECT(dev.blocks_read == 2u);
+  // blocks 21..22 are missing, 20 and 23 are cached
+  auto buf = cache.read_sync(dev, 20, 4);
+  EXPECT(matches(buf, 20, 4));
+  EXPECT(dev.blocks_read == 4u);
+  EXPECT(cache.size() == 4u);
+}
+
+CASE("Block cache reads ahead on sequential access")
+{
+  Pattern_device dev{256};
+  fs::Block_cache cache{64, "bctest3"};
+
+  for (uint64_t blk = 0; blk < 32; blk++) {
+    EXPECT(matches(cache.read_sync(dev, blk), blk, 1));
+  }
+  // without read-ahead this would be one device read per block
+  EXPECT(dev.reads < 8);
+  EXPECT(cache.readaheads() > 0u);
+
+  // read-ahead never goes past the end of the device
+  Pattern_device small{6};
+  for (uint64_t blk = 0; blk < 6; blk++) {
+    EXPECT(matches(cache.read_sync(small, blk), blk, 1));
+  }
+  EXPECT(cache.read_sync(small, 6) == nullptr);
+}
+
+CASE("Block cache evicts with CLOCK and bypasses large reads")
+{
+  Pattern_device dev{1024};
+  fs::Block_cache cache{16, "bctest4"};
+  cache.set_readahead(0);
+
+  for (uint64_t blk = 0; blk < 64; blk += 2)
+    cache.read_sync(dev, blk);
+  EXPECT(cache.size() == 16u);
+  EXPECT(cache.evictions() == 16u);
+  EXPECT(cache.contains(dev.id(), 62));
+  EXPECT(not cache.contains(dev.id(), 0));
+
+  const auto before = cache.size();
+  auto buf = cache.read_sync(dev, 100, 8);
+  EXPECT(matches(buf, 100, 8));
+  EXPECT(cache.size() == before);
+  EXPECT(not cache.contains(dev.id(), 100));
+}
+
+CASE("Block cache invalidation is per device")
+{
+  Pattern_device dev1{64};
+  Pattern_device dev2{64};
+  fs::Block_cache cache{32, "bctest5"};
+  cache.set_readahead(0);
+
+  cache.read_sync(dev1, 1);
+  cache.read_sync(dev2, 1);
+  EXPECT(cache.contains(dev1.id(), 1));
+  EXPECT(cache.contains(dev2.id(), 1));
+
+  cache.invalidate(dev1.id());
+  EXPECT(not cache.contains(dev1.id(), 1));
+  EXPECT(cache.contains(dev2.id(), 1));
+
+  cache.invalidate(dev2.id(), 1);
+  EXPECT(cache.size() == 0u);
+  EXPECT(matches(cache.read_sync(dev2, 1), 1, 1));
+}
+
+CASE("Block cache keeps hits when they are evicted during a device read")
+{
+  Pattern_device dev{256};
+  fs::Block_cache cache{8, "bctest_evict"};
+  cache.set_readahead(0);
+
+  EXPECT(matches(cache.read_sync(dev, 10), 10, 1));
+  dev.deferred = true;
+  fs::buffer_t result;
+  bool called = false;
+  cache.read(dev, 10, 2,
+    [&] (fs::buffer_t data) { called = true; result = data; });
+  EXPECT(not called);
+
+  // the hit on block 10 is evicted before the device delivers block 11
+  dev.deferred = false;
+  for (uint64_t blk = 100; blk < 132; blk++)
+    cache.read_sync(dev, blk);
+  EXPECT(not cache.contains(dev.id(), 10));
+
+  dev.complete_reads();
+  EXPECT(called);
+  EXPECT(matches(result, 10, 2));
+}
+
+// writable block device backed by a vector
+class Ram_device : public hw::Writable_Block_device {
+public:
+  Ram_device(block_t blocks) : image(blocks * 512, 0) {}
+
+  std::string device_name() const override { return "ram" + std::to_string(id()); }
+  const char* driver_name() const noexcept override { return "Ram"; }
+  block_t size() const noexcept override { return image.size() / 512; }
+  block_t block_size() const noexcept override { return 512; }
+
+  void read(block_t blk, size_t cnt, on_read_func reader) override {
+    reader(read_sync(blk, cnt));
+  }
+  buffer_t read_sync(block_t blk, size_t cnt) override {
+    if (blk + cnt > size()) return nullptr;
+    return fs::construct_buffer(&image[blk * 512], &image[(blk + cnt) * 512]);
+  }
+  void write(block_t blk, buffer_t buf, on_write_func callback) override {
+    if (deferred) {
+      pending.push_back([this, blk, buf, callback] { callback(write_sync(blk, buf)); });
+      return;
+    }
+    callback(write_sync(blk, buf));
+  }
+  bool write_sync(block_t blk, buffer_t buf) override {
+    writes++;
+    if (failing) return true;
+    if (blk * 512 + buf->size() > image.size()) return true;
+    std::memcpy(&image[blk * 512], buf->data(), buf->size());
+    return false;
+  }
+  void deactivate() override {}
+
+  void complete_writes() {
+    auto writes = std::move(pending);
+    for (auto& write : writes) write();
+  }
+
+  std::vector<uint8_t> image;
+  int  writes = 0;
+  bool failing  = false;
+  bool deferred = false;
+  std::vector<std::function<void()>> pending;
+};
+
+CASE("Block cache buffers writes until flushed")
+{
+  Ram_device dev{64};
+  fs::Block_cache cache{32, "bctest6"};
+  cache.set_readahead(0);
+
+  std::vector<uint8_t> data(3 * 512, 0xAB);
+  cache.write(dev, 4, data.data(), 3);
+  EXPECT(cache.dirty(dev.id()) == 3u);
+  EXPECT(dev.writes == 0);
+  EXPECT(dev.image[4 * 512] == 0);
+
+  // reads see the dirty data, also when bypassing the cache
+  auto buf = cache.read_sync(dev, 5);
+  EXPECT(buf->at(0) == 0xAB);
+  buf = cache.read_sync(dev, 0, 16);
+  EXPECT(buf->at(6 * 512) == 0xAB);
+  EXPECT(buf->at(7 * 512) == 0);
+
+  // adjacent blocks are written back as one device write
+  std::vector<uint8_t> more(512, 0xCD);
+  cache.write(dev, 10, more.data(), 1);
+  bool flushed = false;
+  cache.flush(dev.id(), [&] (bool error) { flushed = !error; });
+  EXPECT(flushed);
+  EXPECT(dev.writes == 2);
+  EXPECT(cache.dirty(dev.id()) == 0u);
+  EXPECT(cache.writebacks() == 4u);
+  EXPECT(dev.image[6 * 512 + 511] == 0xAB);
+  EXPECT(dev.image[10 * 512] == 0xCD);
+
+  // nothing left to write
+  EXPECT(not cache.flush_sync(dev.id()));
+  EXPECT(dev.writes == 2);
+}
+
+CASE("Block cache writes back dirty blocks on eviction")
+{
+  Ram_device dev{128};
+  fs::Block_cache cache{8, "bctest7"};
+  cache.set_readahead(0);
+
+  std::vector<uint8_t> data(512, 0x11);
+  cache.write(dev, 0, data.data(), 1);
+  for (uint64_t blk = 1; blk < 32; blk++)
+    cache.read_sync(dev, blk);
+  EXPECT(not cache.contains(dev.id(), 0));
+  EXPECT(cache.dirty(dev.id()) == 0u);
+  EXPECT(dev.writes == 1);
+  EXPECT(dev.image[0] == 0x11);
+
+  // dropping a device discards its dirty blocks
+  cache.write(dev, 1, data.data(), 1);
+  cache.invalidate(dev.id());
+  EXPECT(cache.dirty(dev.id()) == 0u);
+  EXPECT(dev.image[512] == 0);
+}
+
+CASE("Block cache keeps blocks dirty until they are written")
+{
+  Ram_device dev{64};
+  fs::Block_cache cache{32, "bctest8"};
+  cache.set_readahead(0);
+
+  std::vector<uint8_t> data(512, 0x22);
+  cache.write(dev, 4, data.data(), 1);
+
+  // a failed write is retried by the next flush
+  dev.failing = true;
+  bool error = false;
+  cache.flush(dev.id(), [&] (bool err) { error = err; });
+  EXPECT(error);
+  EXPECT(cache.dirty(dev.id()) == 1u);
+  EXPECT(cache.write_errors() == 1u);
+  EXPECT(cache.flush_sync(dev.id()));
+  EXPECT(cache.dirty(dev.id()) == 1u);
+
+  dev.failing = false;
+  EXPECT(not cache.flush_sync(dev.id()));
+  EXPECT(cache.dirty(dev.id()) == 0u);
+  EXPECT(dev.image[4 * 512] == 0x22);
+
+  // a block written to while being written back stays dirty
+  dev.deferred = true;
+  cache.write(dev, 4, data.data(), 1);
+  cache.flush(dev.id(), [&] (bool err) { error = err; });
+  std::vector<uint8_t> newer(512, 0x33);
+  cache.write(dev, 4, newer.data(), 1);
+  dev.complete_writes();
+  EXPECT(not error);
+  EXPECT(cache.dirty(dev.id()) == 1u);
+
+  dev.deferred = false;
+  EXPECT(not cache.flush_sync(dev.id()));
+  EXPECT(cache.dirty(dev.id()) == 0u);
+  EXPECT(dev.image[4 * 512] == 0x33);
+}
+
+CASE("Block cache doesn't evict dirty blocks that fail to write back")
+{
+  Ram_device dev{128};
+  fs::Block_cache cache{8, "bctest9"};
+  cache.set_readahead(0);
+
+  std::vector<uint8_t> data(8 * 512, 0x44);
+  cache.write(dev, 0, data.data(), 8);
+  EXPECT(cache.dirty(dev.id()) == 8u);
+
+  dev.failing = true;
+  // the reads are served, without room to cache them
+  for (uint64_t blk = 32; blk < 40; blk++)
+    EXPECT(cache.read_sync(dev, blk) != nullptr);
+  EXPECT(cache.dirty(dev.id()) == 8u);
+  EXPECT(not cache.contains(dev.id(), 32));
+  EXPECT(cache.read_sync(dev, 3)->at(0) == 0x44);
+
+  // with no room, writes go straight to the device
+  std::vector<uint8_t> more(512, 0x55);
+  EXPECT(cache.write(dev, 20, more.data(), 1));
+
+  // once the device works, dirty blocks are written back to make room
+  dev.failing = false;
+  EXPECT(not cache.write(dev, 20, more.data(), 1));
+  EXPECT(cache.contains(dev.id(), 20));
+  EXPECT(not cache.flush_sync(dev.id()));
+  EXPECT(cache.dirty(dev.id()) == 0u);
+  EXPECT(dev.image[7 * 512] == 0x44);
+  EXPECT(dev.image[20 * 512] == 0x55);
+}
@@ -0,0 +1,111 @@
+
+#include <common.cxx>
+#include <fs/dentry_cache.hpp>
+#include <fs/disk.hpp>
+#include <fs/memdisk.hpp>
+#include <fs/vfs.hpp>
+#include <unistd.h>
+using namespace fs;
+
+CASE("Dentry cache holds positive and negative entries")
+{
+  Dentry_cache dc{16, "dctest1"};
+  EXPECT(dc.lookup(Dentry_cache::VFS_NS, "/etc/motd") == nullptr);
+  EXPECT(dc.misses() == 1u);
+
+  Dirent file(nullptr, fs::FILE, "motd", 12, 0, 100);
+  dc.insert(Dentry_cache::VFS_NS, "/etc/motd", file);
+  dc.insert(Dentry_cache::VFS_NS, "/etc/nope", Dirent(nullptr, INVALID_ENTITY, "nope"));
+
+  auto* ent = dc.lookup(Dentry_cache::VFS_NS, "/etc/motd");
+  EXPECT(ent != nullptr);
+  EXPECT(ent->is_file());
+  EXPECT(ent->size() == 100u);
+
+  ent = dc.lookup(Dentry_cache::VFS_NS, "/etc/nope");
+  EXPECT(ent != nullptr);
+  EXPECT(not ent->is_valid());
+  EXPECT(dc.hits() == 2u);
+  EXPECT(dc.negatives() == 1u);
+
+  // paths in other namespaces don't collide
+  EXPECT(dc.lookup(3, "/etc/motd") == nullptr);
+}
+
+CASE("Dentry cache parent+name keys and invalidation")
+{
+  Dentry_cache dc{4, "dctest2"};
+  dc.insert(1, 100, "a", Dirent(nullptr, fs::FILE, "a"));
+  dc.insert(1, 100, "b", Dirent(nullptr, DIR, "b"));
+  dc.insert(2, 100, "a", Dirent(nullptr, fs::FILE, "a"));
+  dc.insert(2, "/x", Dirent(nullptr, fs::FILE, "x"));
+  EXPECT(dc.lookup(1, 100, "b")->is_dir());
+  EXPECT(dc.lookup(1, 101, "b") == nullptr);
+
+  dc.invalidate(1);
+  EXPECT(dc.lookup(1, 100, "a") == nullptr);
+  EXPECT(dc.lookup(2, 100, "a") != nullptr);
+  EXPECT(dc.lookup(2, "/x") != nullptr);
+  dc.invalidate_paths(2);
+  EXPECT(dc.lookup(2, "/x") == nullptr);
+
+  // bounded in size
+  for (int i = 0; i < 10; i++)
+    dc.insert(3, 0, std::to_string(i), Dirent(nullptr, fs::FILE));
+  EXPECT(dc.size() <= 2 * dc.capacity());
+}
+
+CASE("FAT and VFS lookups go through the dentry cache")
+{
+  const char* rootp(getenv("INCLUDEOS_SRC"));
+  std::string path="memdisk.fat";
+  if (access(path.c_str(),F_OK) == -1)
+  {
+    if (rootp == nullptr) path = "..";
+    else path = std::string(rootp) + "/test";
+    path += "/memdisk.fat";
+  }
+  auto* fp = fopen(path.c_str(), "rb");
+  EXPECT(fp != nullptr);
+  fseek(fp, 0L, SEEK_END);
+  long int size = ftell(fp);
+  rewind(fp);
+  char* buffer = new char[size];
+  EXPECT(fread(buffer, size, 1, fp) == 1u);
+  fclose(fp);
+
+  static MemDisk mdisk {buffer, buffer + size};
+  static auto disk = std::make_shared<Disk> (mdisk);
+  disk->init_fs([] (auto, File_system&) {});
+  auto& fs = disk->fs();
+  auto& dc = Dentry_cache::get();
+
+  auto ent = fs.stat("/folder/file.txt");
+  EXPECT(ent.is_valid());
+  const auto hits = dc.hits();
+  auto again = fs.stat("/folder/file.txt");
+  EXPECT(again.block() == ent.block());
+  EXPECT(dc.hits() == hits + 2);
+
+  // misses are remembered too
+  EXPECT(not fs.stat("/folder/missing.txt").is_valid());
+  const auto negatives = dc.negatives();
+  EXPECT(not fs.stat("/folder/missing.txt").is_valid());
+  EXPECT(dc.negatives() == negatives + 1);
+
+  // async stat is answered from the cache
+  bool called = false;
+  fs.stat("/folder/file.txt",
+    [&] (fs::error_t err, const Dirent& e) {
+      called = true;
+      EXPECT(not err);
+      EXPECT(e.block() == ent.block());
+    });
+  EXPECT(called);
+
+  // remounting the device drops its entries
+  disk->init_fs([] (auto, File_system&) {});
+  const auto misses = dc.misses();
+  EXPECT(disk->fs().stat("/folder/file.txt").is_valid());
+  EXPECT(dc.misses() == misses + 2);
+}
@@ -0,0 +1,180 @@
+
+#include <common.cxx>
+#include <fs/disk.hpp>
+#include <fs/block_cache.hpp>
+#include <hw/writable_blkdev.hpp>
+#include <cstring>
+using namespace fs;
+
+// writable block device backed by a vector
+class Ram_disk : public hw::Writable_Block_device {
+public:
+  Ram_disk(block_t blocks) : image(blocks * 512, 0) {}
+
+  std::string device_name() const override { return "ramdisk" + std::to_string(id()); }
+  const char* driver_name() const noexcept override { return "Ramdisk"; }
+  block_t size() const noexcept override { return image.size() / 512; }
+  block_t block_size() const noexcept override { return 512; }
+
+  void read(block_t blk, size_t cnt, on_read_func reader) override {
+    reader(read_sync(blk, cnt));
+  }
+  buffer_t read_sync(block_t blk, size_t cnt) override {
+    if (blk + cnt > size()) return nullptr;
+    return fs::construct_buffer(&image[blk * 512], &image[(blk + cnt) * 512]);
+  }
+  void write(block_t blk, buffer_t buf, on_write_func callback) override {
+    callback(write_sync(blk, buf));
+  }
+  bool write_sync(block_t blk, buffer_t buf) override {
+    if (blk * 512 + buf->size() > image.size()) return true;
+    std::memcpy(&image[blk * 512], buf->data(), buf->size());
+    return false;
+  }
+  void deactivate() override {}
+
+  std::vector<uint8_t> image;
+};
+
+// minimal FAT16 volume: 8192 sectors, 1 sector per cluster
+static const int RESERVED = 1;
+static const int SPF      = 32;
+static const int ROOT_SECTORS = 32;
+static void format_fat16(Ram_disk& disk)
+{
+  auto* s = disk.image.data();
+  s[0] = 0xEB; s[1] = 0x3C; s[2] = 0x90;
+  std::memcpy(&s[3], "MSWIN4.1", 8);
+  *(uint16_t*) &s[11] = 512;    // bytes per sector
+  s[13] = 1;                    // sectors per cluster
+  *(uint16_t*) &s[14] = RESERVED;
+  s[16] = 2;                    // number of FATs
+  *(uint16_t*) &s[17] = ROOT_SECTORS * 16;
+  *(uint16_t*) &s[19] = disk.size();
+  s[21] = 0xF8;
+  *(uint16_t*) &s[22] = SPF;
+  s[38] = 0x29;                 // extended boot signature
+  *(uint16_t*) &s[510] = 0xAA55;
+  // reserved FAT entries
+  for (int i = 0; i < 2; i++) {
+    auto* fat = (uint16_t*) &s[(RESERVED + i * SPF) * 512];
+    fat[0] = 0xFFF8;
+    fat[1] = 0xFFFF;
+  }
+}
+
+static Ram_disk* rdisk = nullptr;
+static Disk_ptr  disk  = nullptr;
+
+CASE("Initialize writable FAT16 fs")
+{
+  rdisk = new Ram_disk(8192);
+  format_fat16(*rdisk);
+  disk = std::make_shared<Disk> (*rdisk);
+  disk->init_fs(
+    [&lest_env] (auto err, File_system& fs)
+    {
+      EXPECT(!err);
+      EXPECT(fs.name() == "FAT16");
+    });
+}
+
+CASE("Create, write and read back a file")
+{
+  auto& fs = disk->fs();
+  EXPECT(!fs.create(Path{"/hello.txt"}));
+  // can't create the same file twice
+  EXPECT(fs.create(Path{"/hello.txt"}).code() == fs::error_t::E_EXIST);
+
+  auto ent = fs.stat("/hello.txt");
+  EXPECT(ent.is_file());
+  EXPECT(ent.size() == 0u);
+
+  const std::string text = "Hello, writable world!";
+  EXPECT(!ent.write(0, text.data(), text.size()));
+  EXPECT(ent.size() == text.size());
+  EXPECT(ent.read() == text);
+
+  // spanning several clusters, with a gap that reads back as zeroes
+  std::vector<uint8_t> big(3000, 0x5A);
+  EXPECT(!ent.write(1000, big.data(), big.size()));
+  EXPECT(ent.size() == 4000u);
+  auto buf = fs.read(ent, 0, 4000);
+  EXPECT(buf.is_valid());
+  EXPECT(std::string((const char*) buf.data(), text.size()) == text);
+  EXPECT(buf.data()[500] == 0);
+  EXPECT(buf.data()[1000] == 0x5A);
+  EXPECT(buf.data()[3999] == 0x5A);
+
+  // a fresh stat sees the new size
+  auto again = fs.stat("/hello.txt");
+  EXPECT(again.size() == 4000u);
+  EXPECT(again.block() == ent.block());
+}
+
+CASE("Files written in turns are fragmented but read back correctly")
+{
+  auto& fs = disk->fs();
+  EXPECT(!fs.create(Path{"/a.bin"}));
+  EXPECT(!fs.create(Path{"/b.bin"}));
+  auto a = fs.stat("/a.bin");
+  auto b = fs.stat("/b.bin");
+  std::vector<uint8_t> chunk_a(512, 'a'), chunk_b(512, 'b');
+  for (int i = 0; i < 4; i++) {
+    EXPECT(!a.write(i * 512, chunk_a.data(), 512));
+    EXPECT(!b.write(i * 512, chunk_b.data(), 512));
+  }
+  auto buf = fs.read(a, 0, 2048);
+  EXPECT(buf.size() == 2048u);
+  EXPECT(std::count(buf.data(), buf.data() + 2048, 'a') == 2048);
+
+  bool done = false;
+  b.read(256, 1024,
+    [&] (fs::error_t err, buffer_t data) {
+      done = true;
+      EXPECT(!err);
+      EXPECT(data->size() == 1024u);
+      EXPECT(std::count(data->begin(), data->end(), 'b') == 1024);
+    });
+  EXPECT(done);
+}
+
+CASE("Truncate and unlink release clusters")
+{
+  auto& fs = disk->fs();
+  auto ent = fs.stat("/hello.txt");
+  EXPECT(!ent.truncate(10));
+  EXPECT(ent.size() == 10u);
+  EXPECT(ent.read() == "Hello, wri");
+
+  EXPECT(!fs.unlink(Path{"/hello.txt"}));
+  EXPECT(!fs.stat("/hello.txt").is_valid());
+  EXPECT(fs.unlink(Path{"/hello.txt"}).code() == fs::error_t::E_NOENT);
+
+  // the freed cluster is reused
+  EXPECT(!fs.create(Path{"/new.txt"}));
+  auto ent2 = fs.stat("/new.txt");
+  EXPECT(!ent2.write(0, "x", 1));
+  EXPECT(ent2.block() == ent.block());
+}
+
+CASE("Sync writes everything back to the device")
+{
+  auto& fs = disk->fs();
+  EXPECT(Block_cache::get().dirty(rdisk->id()) > 0u);
+  bool synced = false;
+  fs.sync([&] (fs::error_t err) { synced = !err; });
+  EXPECT(synced);
+  EXPECT(Block_cache::get().dirty(rdisk->id()) == 0u);
+
+  // a fresh mount straight from the device sees the files
+  Block_cache::get().invalidate(rdisk->id());
+  auto disk2 = std::make_shared<Disk> (*rdisk);
+  disk2->init_fs([] (auto, File_system&) {});
+  auto res = disk2->fs().ls("/");
+  EXPECT(!res.error);
+  EXPECT(res.entries->size() == 3u);
+  auto ent = disk2->fs().stat("/a.bin");
+  EXPECT(ent.size() == 2048u);
+  EXPECT(disk2->fs().stat("/new.txt").read() == "x");
+}
@@ -25,3 +25,27 @@ CASE("memdisk properties")
     });
   EXPECT(enumerated_partitions == true);
 }
+
+CASE("memdisk views point straight into the image")
+{
+  static char image[4 * fs::MemDisk::SECTOR_SIZE];
+  for (size_t i = 0; i < sizeof(image); i++) image[i] = i / fs::MemDisk::SECTOR_SIZE;
+  fs::MemDisk memdisk{image, image + sizeof(image)};
+  EXPECT(memdisk.size() == 4ull);
+
+  auto view = memdisk.read_view(1, 2);
+  EXPECT(view.size() == (long) (2 * fs::MemDisk::SECTOR_SIZE));
+  EXPECT((const char*) view.data() == &image[fs::MemDisk::SECTOR_SIZE]);
+  EXPECT(view[0] == 1);
+  EXPECT(view[fs::MemDisk::SECTOR_SIZE] == 2);
+
+  // out of bounds views are empty
+  EXPECT(memdisk.read_view(3, 2).empty());
+  EXPECT(memdisk.read_view(8).empty());
+  EXPECT(memdisk.read_sync(3, 2) == nullptr);
+
+  // copying reads agree with the view
+  auto buf = memdisk.read_sync(1, 2);
+  EXPECT(buf != nullptr);
+  EXPECT(std::equal(buf->begin(), buf->end(), view.begin()));
+}
@@ -152,3 +152,23 @@ CASE("Stat /folder/file.txt")
   const std::string text((const char*) buffer.data(), buffer.size());
   EXPECT(text == "This file contains text\n");
 }
+
+CASE("Zero-copy view of /folder/file.txt")
+{
+  auto& fs = disk->fs();
+  auto view = fs.read_file_view("/folder/file.txt");
+  EXPECT(view.size() == 24);
+  const std::string text((const char*) view.data(), view.size());
+  EXPECT(text == "This file contains text\n");
+
+  // the view points into the memdisk image, not a copy
+  auto image = mdisk->read_view(0, mdisk->size());
+  EXPECT(view.data() >= image.data());
+  EXPECT(view.data() + view.size() <= image.data() + image.size());
+
+  // partial views are trimmed to the requested range
+  auto ent = fs.stat("/folder/file.txt");
+  auto part = ent.view(5, 4);
+  EXPECT(std::string((const char*) part.data(), part.size()) == "file");
+  EXPECT(ent.view(24, 10).empty());
+}
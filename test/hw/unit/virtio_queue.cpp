@@ -39,3 +39,31 @@ CASE("Virtio Queue dequeue")
   EXPECT(res.size() == 0);
   EXPECT(res.data() == nullptr);
 }
+
+CASE("Virtio Queue indirect enqueue uses one descriptor")
+{
+  Virtio::Queue q("Test queue", 16, 0, 0x1000);
+  EXPECT(q.num_free() == 16);
+
+  uint32_t header = 0;
+  uint8_t  data1[512];
+  uint8_t  data2[512];
+  uint8_t  status = 0;
+  std::array<Virtio::Token, 4> tokens {{
+    {{(uint8_t*) &header, sizeof(header)}, Virtio::Token::OUT },
+    {{data1, sizeof(data1)}, Virtio::Token::IN },
+    {{data2, sizeof(data2)}, Virtio::Token::IN },
+    {{&status, 1}, Virtio::Token::IN }
+  }};
+  Virtio::Queue::virtq_desc table[4];
+  q.enqueue_indirect(tokens, table);
+  q.kick();
+  EXPECT(q.num_free() == 15);
+
+  EXPECT(table[0].addr == (uint64_t) &header);
+  EXPECT(table[0].flags == VIRTQ_DESC_F_NEXT);
+  EXPECT(table[1].flags == (VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE));
+  EXPECT(table[1].next == 2);
+  EXPECT(table[3].flags == VIRTQ_DESC_F_WRITE);
+  EXPECT(table[3].len == 1u);
+}
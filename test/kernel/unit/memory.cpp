@@ -480,3 +480,43 @@ CASE("os::mem::protect verify consistency"){
 
   Default_paging::clear_paging();
 }
+
+extern uintptr_t __exec_begin;
+
+CASE("os::mem::map_huge and page_stats")
+{
+  using namespace util;
+  Default_paging p{};
+  const bool gib_pages = mem::supported_page_size(1_GiB);
+
+  // Shrunk to whole 2 MiB pages, keeping the 4 KiB pages of the executable
+  EXPECT(mem::active_page_size(__exec_begin) == 4_KiB);
+  auto mapped = mem::map_huge(3_MiB + 4_KiB, 2_GiB + 2_MiB, 1_GiB);
+  EXPECT(mapped == 2_GiB - 2_MiB);
+  EXPECT(mem::active_page_size(__exec_begin) == 4_KiB);
+  EXPECT(mem::active_page_size(4_MiB) == 2_MiB);
+  EXPECT(mem::active_page_size(1_GiB) == (gib_pages ? 1_GiB : 2_MiB));
+  EXPECT(mem::active_page_size(2_GiB) == 2_MiB);
+  EXPECT(mem::flags(4_MiB) == (mem::Access::read | mem::Access::write));
+
+  auto stats = mem::page_stats(4_MiB, 2_GiB);
+  EXPECT(stats.pages_4k == 512u);
+  EXPECT(stats.pages_2m == (gib_pages ? 511u : 1023u));
+  EXPECT(stats.pages_1g == (gib_pages ? 1u : 0u));
+  EXPECT(stats.unmapped == 0u);
+
+  // Page sizes up to max_psize
+  mapped = mem::map_huge(3_GiB, 1_GiB, 2_MiB);
+  EXPECT(mapped == 1_GiB);
+  stats = mem::page_stats(3_GiB, 1_GiB);
+  EXPECT(stats.pages_2m == 512u);
+  EXPECT(stats.pages() == 512u);
+
+  // The 0-page isn't present
+  stats = mem::page_stats(0, 8_KiB);
+  EXPECT(stats.unmapped == 4_KiB);
+  EXPECT(stats.pages_4k == 1u);
+
+  // Nothing left after rounding
+  EXPECT(mem::map_huge(5_MiB, 2_MiB, 1_GiB) == 0u);
+}
@@ -0,0 +1,155 @@
+#include <common.cxx>
+#include <kernel/elf.hpp>
+#include <profile>
+#include <elf.h>
+#include <cstring>
+
+extern void (*preempt_function)();
+extern "C" void _move_elf_syms_location(const void*, void*);
+extern "C" void _init_elf_parser();
+extern "C" void profiler_stack_sampler(void*, void*);
+
+static const char strings[] =
+    "\0main_loop\0alias\0handle_packet\0checksum\0outer\0inner\0a;b";
+enum {
+  MAIN_LOOP = 1, ALIAS = 11, HANDLE_PACKET = 17, CHECKSUM = 31,
+  OUTER = 40, INNER = 46, SEMICOLON = 52
+};
+
+static Elf64_Sym func(uint32_t name, uintptr_t addr, uint64_t size)
+{
+  Elf64_Sym sym {};
+  sym.st_name  = name;
+  sym.st_info  = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+  sym.st_value = addr;
+  sym.st_size  = size;
+  return sym;
+}
+
+// the symbols as the linker leaves them at _ELF_SYM_START_
+static void load_symbols()
+{
+  static bool loaded = false;
+  if (loaded) return;
+  loaded = true;
+
+  const Elf64_Sym syms[] {
+    func(CHECKSUM,      0x400200, 0x40),
+    func(HANDLE_PACKET, 0x400100, 0x80),
+    // a zero-sized alias of main_loop
+    func(ALIAS,         0x400000, 0),
+    func(MAIN_LOOP,     0x400000, 0x100),
+    // a symbol inside another one
+    func(INNER,         0x400340, 0x20),
+    func(OUTER,         0x400300, 0x100),
+    func(SEMICOLON,     0x400500, 0x10),
+  };
+  const uint32_t header[5] {
+    sizeof(syms) / sizeof(syms[0]), sizeof(strings), 0, 0, 0
+  };
+  static char area[sizeof(header) + sizeof(syms) + sizeof(strings)];
+  memcpy(area, header, sizeof(header));
+  memcpy(area + sizeof(header), syms, sizeof(syms));
+  memcpy(area + sizeof(header) + sizeof(syms), strings, sizeof(strings));
+
+  _move_elf_syms_location(area, area);
+  _init_elf_parser();
+}
+
+static std::string name_of(uintptr_t addr)
+{
+  char buffer[256];
+  return Elf::safe_resolve_symbol((void*) addr, buffer, sizeof(buffer)).name;
+}
+
+static void expect_lookups(lest::env& lest_env)
+{
+  // function boundaries
+  EXPECT(Elf::resolve_addr(0x400000) == 0x400000u);
+  EXPECT(Elf::resolve_addr(0x4000ff) == 0x400000u);
+  EXPECT(Elf::resolve_addr(0x400100) == 0x400100u);
+  EXPECT(Elf::resolve_addr(0x40017f) == 0x400100u);
+  EXPECT(name_of(0x400000) == "main_loop");
+  EXPECT(name_of(0x400150) == "handle_packet");
+  EXPECT(name_of(0x400200) == "checksum");
+  char buffer[64];
+  const auto res = Elf::safe_resolve_symbol((void*) 0x400110, buffer, sizeof(buffer));
+  EXPECT(res.addr == 0x400100u);
+  EXPECT(res.offset == 0x10u);
+  // between symbols, the closest one below within 512 bytes
+  EXPECT(Elf::resolve_addr(0x400180) == 0x400100u);
+  EXPECT(Elf::resolve_addr(0x4001ff) == 0x400100u);
+  EXPECT(Elf::resolve_addr(0x400250) == 0x400200u);
+  // past the last inner symbol, still inside the outer one
+  EXPECT(Elf::resolve_addr(0x400350) == 0x400340u);
+  EXPECT(Elf::resolve_addr(0x400370) == 0x400300u);
+  EXPECT(name_of(0x4003ff) == "outer");
+  // nothing close enough
+  EXPECT(Elf::resolve_addr(0x3ff000) == 0x3ff000u);
+  EXPECT(Elf::resolve_addr(0x400800) == 0x400800u);
+  EXPECT(name_of(0x400800) == "0x400800");
+}
+
+CASE("The sorted symbol index resolves like the linear scan")
+{
+  load_symbols();
+  // before the heap is up, lookups scan the symbol table
+  expect_lookups(lest_env);
+  Elf::build_symbol_index();
+  expect_lookups(lest_env);
+}
+
+static bool contains(const std::vector<uint8_t>& data, const std::string& what)
+{
+  return std::search(data.begin(), data.end(), what.begin(), what.end()) != data.end();
+}
+
+CASE("Sampled call stacks are exported folded and as pprof")
+{
+  load_symbols();
+  Elf::build_symbol_index();
+  StackSampler::begin();
+  EXPECT(preempt_function != nullptr);
+  StackSampler::set_mode(StackSampler::MODE_CALLSTACK);
+
+  // checksum called from handle_packet, called from main_loop,
+  // with return addresses just past each call
+  uintptr_t frames[4];
+  frames[0] = (uintptr_t) &frames[2];
+  frames[1] = 0x400180;
+  frames[2] = 0;
+  frames[3] = 0x400020;
+  for (int i = 0; i < 3; i++) {
+    profiler_stack_sampler((void*) 0x400210, frames);
+    preempt_function();
+  }
+  // a leaf function
+  frames[0] = 0;
+  frames[1] = 0x400010;
+  profiler_stack_sampler((void*) 0x400500, frames);
+  preempt_function();
+  EXPECT(StackSampler::samples_total() == 4u);
+
+  const auto folded = StackSampler::folded();
+  EXPECT(folded.find("main_loop;handle_packet;checksum 3\n") != std::string::npos);
+  // ';' separates frames
+  EXPECT(folded.find("main_loop;a:b 1\n") != std::string::npos);
+  EXPECT(std::count(folded.begin(), folded.end(), '\n') == 2);
+
+  const auto pprof = StackSampler::pprof();
+  // sample_type {type: "samples", unit: "count"}
+  const std::vector<uint8_t> sample_type {0x0a, 0x04, 0x08, 0x01, 0x10, 0x02};
+  EXPECT(std::equal(sample_type.begin(), sample_type.end(), pprof.begin()));
+  // period_type and period
+  const std::vector<uint8_t> period {0x5a, 0x04, 0x08, 0x01, 0x10, 0x02, 0x60, 0x01};
+  EXPECT(std::equal(period.begin(), period.end(), pprof.end() - period.size()));
+  // the string table
+  EXPECT(contains(pprof, "\x32\x07samples"));
+  EXPECT(contains(pprof, "\x32\x09main_loop"));
+  EXPECT(contains(pprof, "\x32\x0dhandle_packet"));
+  EXPECT(contains(pprof, "\x32\x08" "checksum"));
+  EXPECT(contains(pprof, "\x32\x03" "a:b"));
+  // a sample of the 3 locations in the stack, counted 3 times
+  EXPECT(contains(pprof, std::string("\x12\x08\x0a\x03", 4)));
+  EXPECT(contains(pprof, std::string("\x12\x01\x03", 3)));
+}
@@ -0,0 +1,89 @@
+#include <common.cxx>
+#include <liveupdate.hpp>
+using namespace liu;
+
+static const size_t STORAGE_SIZE = 4*1024*1024;
+static location_t storage_location;
+static int value_a = 0;
+static int value_b = 0;
+static std::vector<int> restored;
+static int a_serialized = 0;
+
+static void store_a(Storage& store)
+{
+  a_serialized++;
+  store.add_int(1, value_a);
+  // larger than the initial staging area
+  std::vector<int> big(40000, value_a);
+  store.add_vector<int>(2, big);
+}
+static void store_b(Storage& store)
+{
+  store.add_int(1, value_b);
+}
+static void restore_a(Restore& thing)
+{
+  restored.push_back(thing.as_int()); thing.go_next();
+  auto big = thing.as_vector<int>(); thing.go_next();
+  restored.push_back(big.size());
+  restored.push_back(big.back());
+}
+static void restore_b(Restore& thing)
+{
+  restored.push_back(thing.as_int()); thing.go_next();
+}
+
+CASE("Pre-copied partitions are only serialized again when dirty")
+{
+  // checks partition crcs, and keeps the header valid between resumes
+  extern bool LIVEUPDATE_EXTRA_CHECKS;
+  LIVEUPDATE_EXTRA_CHECKS = true;
+  storage_location = { new char[STORAGE_SIZE], STORAGE_SIZE };
+  LiveUpdate::register_incremental_partition("precopy_a", store_a);
+  LiveUpdate::register_partition("precopy_b", store_b);
+
+  value_a = 1;
+  value_b = 1;
+  EXPECT(LiveUpdate::precopy() > 160000u);
+  // retried with a larger staging area until it fit
+  const int rounds = a_serialized;
+  EXPECT(rounds >= 1);
+  // nothing changed since the last round
+  EXPECT(LiveUpdate::precopy() == 0u);
+  EXPECT(a_serialized == rounds);
+
+  // without marking, the pre-copied value is stored
+  value_a = 2;
+  value_b = 2;
+  LiveUpdate::store(storage_location);
+  EXPECT(a_serialized == rounds);
+
+  restored.clear();
+  LiveUpdate::resume_from_heap("precopy_a", restore_a, storage_location);
+  LiveUpdate::resume_from_heap("precopy_b", restore_b, storage_location);
+  EXPECT(restored == std::vector<int>({1, 40000, 1, 2}));
+
+  // once marked, it is serialized again
+  LiveUpdate::mark_dirty("precopy_a");
+  LiveUpdate::store(storage_location);
+  EXPECT(a_serialized == rounds + 1);
+
+  restored.clear();
+  LiveUpdate::resume_from_heap("precopy_a", restore_a, storage_location);
+  EXPECT(restored == std::vector<int>({2, 40000, 2}));
+}
+
+CASE("Partitions are staged when writing in parallel")
+{
+  value_a = 3;
+  value_b = 3;
+  LiveUpdate::mark_dirty("precopy_a");
+  LiveUpdate::enable_parallel_writers(true);
+  LiveUpdate::store(storage_location);
+  LiveUpdate::enable_parallel_writers(false);
+
+  restored.clear();
+  LiveUpdate::resume_from_heap("precopy_b", restore_b, storage_location);
+  LiveUpdate::resume_from_heap("precopy_a", restore_a, storage_location);
+  EXPECT(restored == std::vector<int>({3, 3, 40000, 3}));
+}
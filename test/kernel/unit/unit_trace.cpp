@@ -0,0 +1,107 @@
+#include <common.cxx>
+#include <kernel/trace.hpp>
+#include <kernel/events.hpp>
+#include <cstring>
+
+extern delegate<uint64_t()> systime_override;
+static uint64_t current_time = 0;
+
+static bool contains(const std::string& str, const std::string& what) {
+  return str.find(what) != std::string::npos;
+}
+
+CASE("Tracepoints record nothing while disabled")
+{
+  systime_override = [] () -> uint64_t { return current_time; };
+  EXPECT(not Trace::is_enabled());
+  TRACEPOINT(USER, 1, 2);
+  EXPECT(Trace::records() == 0u);
+  EXPECT(Trace::lost() == 0u);
+}
+
+CASE("Tracepoints are exported in the Chrome trace format")
+{
+  Trace::enable();
+  EXPECT(Trace::is_enabled());
+
+  current_time = 1234567;
+  TRACEPOINT(IP4_RX, 6, 1500);
+  current_time += 1000;
+  TRACEPOINT(TCP_STATE, Trace::TCP_SYN_SENT << 8 | Trace::TCP_ESTABLISHED,
+             40000 << 16 | 80);
+  EXPECT(Trace::records() == 2u);
+
+  const auto json = Trace::chrome_json();
+  // exporting takes the records
+  EXPECT(Trace::records() == 0u);
+  EXPECT(Trace::is_enabled());
+
+  EXPECT(json.front() == '{');
+  EXPECT(contains(json, "\"traceEvents\":["));
+  EXPECT(contains(json, "\"name\":\"cpu0\""));
+  EXPECT(contains(json, "{\"name\":\"ip4.rx\",\"ph\":\"i\",\"ts\":1234.567,\"pid\":1,\"tid\":0,"
+                        "\"s\":\"t\",\"args\":{\"protocol\":6,\"bytes\":1500}}"));
+  EXPECT(contains(json, "\"args\":{\"from\":\"SYN-SENT\",\"to\":\"ESTABLISHED\","
+                        "\"local\":40000,\"remote\":80}"));
+  Trace::disable();
+}
+
+CASE("Event processing is traced as a duration")
+{
+  Trace::enable();
+  auto& events = Events::get(0);
+  const auto intr = events.subscribe(
+    [] { current_time += 500; });
+  current_time = 2000;
+  events.trigger_event(intr);
+  events.process_events();
+  events.unsubscribe(intr);
+
+  const auto json = Trace::chrome_json();
+  EXPECT(contains(json, "{\"name\":\"event\",\"ph\":\"B\",\"ts\":2.000,\"pid\":1,\"tid\":0,"
+                        "\"args\":{\"intr\":" + std::to_string(intr) + "}}"));
+  EXPECT(contains(json, "{\"name\":\"event\",\"ph\":\"E\",\"ts\":2.500,\"pid\":1,\"tid\":0,"
+                        "\"args\":{}}"));
+  Trace::disable();
+}
+
+CASE("A full ring keeps the latest records")
+{
+  Trace::clear();
+  Trace::enable(4 * sizeof(Trace::Record));
+  for (uint32_t i = 0; i < 10; i++)
+    Trace::record(Trace::USER, 0, i);
+  EXPECT(Trace::records() == 4u);
+  EXPECT(Trace::lost() == 6u);
+
+  Trace::disable();
+  // disabling keeps the records for export
+  EXPECT(Trace::records() == 4u);
+
+  const auto bin = Trace::binary();
+  EXPECT(bin.size() == sizeof(Trace::Binary_header) + 8 + 4 * sizeof(Trace::Record));
+  Trace::Binary_header header;
+  memcpy(&header, bin.data(), sizeof(header));
+  EXPECT(memcmp(header.magic, "IOSTRACE", 8) == 0);
+  EXPECT(header.record_size == sizeof(Trace::Record));
+  EXPECT(header.cpus == 1u);
+  EXPECT(header.event_types == (uint32_t) Trace::EVENT_TYPES);
+
+  uint32_t cpu[2];
+  memcpy(cpu, bin.data() + sizeof(header), sizeof(cpu));
+  EXPECT(cpu[0] == 0u);
+  EXPECT(cpu[1] == 4u);
+  // oldest first
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    Trace::Record rec;
+    memcpy(&rec, bin.data() + sizeof(header) + sizeof(cpu) + i * sizeof(rec), sizeof(rec));
+    EXPECT(rec.event == Trace::USER);
+    EXPECT(rec.b == 6 + i);
+  }
+  EXPECT(Trace::records() == 0u);
+
+  Trace::clear();
+  EXPECT(Trace::lost() == 0u);
+  EXPECT(std::string(Trace::name(Trace::NIC_RX_END)) == "nic.rx");
+}
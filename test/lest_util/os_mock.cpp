@@ -96,6 +96,7 @@ char __service_ctors_end;
 
 char _ELF_START_;
 char _ELF_END_;
+char _irq_cb_return_location;
 uintptr_t _MULTIBOOT_START_;
 uintptr_t _LOAD_START_;
 uintptr_t _LOAD_END_;
@@ -159,6 +160,13 @@ void __arch_subscribe_irq(uint8_t) {}
 void __arch_enable_legacy_irq(uint8_t) {}
 void __arch_disable_legacy_irq(uint8_t) {}
 void __arch_system_deactivate() {}
+void __arch_install_irq(uint8_t, void(*)()) {}
+// the profiler's gathering function, for tests to call
+void (*preempt_function)() = nullptr;
+void __arch_preempt_forever(void(*func)()) {
+  preempt_function = func;
+}
+extern "C" void parasite_interrupt_handler() {}
 
 delegate<uint64_t()> systime_override = [] () -> uint64_t { return 0; };
 uint64_t __arch_system_time() noexcept {
@@ -182,9 +190,13 @@ uint32_t __arch_rand32()
 int SMP::cpu_id() noexcept {
   return 0;
 }
+int SMP::cpu_count() noexcept {
+  return 1;
+}
 void SMP::global_lock() noexcept {}
 void SMP::global_unlock() noexcept {}
 void SMP::add_task(SMP::task_func func, int) { func(); }
+void SMP::add_bsp_task(SMP::done_func func) { func(); }
 void SMP::signal(int) {}
 
 extern "C"
@@ -226,6 +238,10 @@ namespace os {
   size_t total_memuse() noexcept {
     return 0xff00ff00;
   }
+
+  size_t mem::huge_page_size() noexcept {
+    return 0;
+  }
 }
 
 uintptr_t __exec_begin = 0xa00000;
@@ -0,0 +1,183 @@
+#include <common.cxx>
+#include <net/inet>
+#include <net/interfaces>
+#include <hw/async_device.hpp>
+
+using namespace net;
+
+static std::unique_ptr<hw::Async_device<UserNet>> dev1 = nullptr;
+static std::unique_ptr<hw::Async_device<UserNet>> dev2 = nullptr;
+
+// what the fake server answers with
+static uint8_t  reply_rcode = 0;
+static uint32_t reply_ttl   = 300;
+static bool     reply_soa   = true;
+static uint32_t soa_minimum = 60;
+static int      queries     = 0;
+
+static void put16(std::string& buf, uint16_t val)
+{
+  buf += (char) (val >> 8);
+  buf += (char) val;
+}
+static void put32(std::string& buf, uint32_t val)
+{
+  put16(buf, val >> 16);
+  put16(buf, val);
+}
+
+// answers every query with one A record, or a negative answer
+static std::string create_reply(const char* query, size_t len)
+{
+  std::string buf(query, len);
+  const bool answer = (reply_rcode == 0);
+  buf[2] = (char) 0x81; // response, recursion desired
+  buf[3] = (char) (0x80 | reply_rcode);
+  buf[6] = 0; buf[7] = answer ? 1 : 0;
+  buf[8] = 0; buf[9] = (not answer and reply_soa) ? 1 : 0;
+  buf[10] = 0; buf[11] = 0;
+  if (answer) {
+    put16(buf, 0xc00c); // name of the question
+    put16(buf, 1); put16(buf, 1);
+    put32(buf, reply_ttl);
+    put16(buf, 4);
+    buf += std::string{10, 0, 0, 99};
+  }
+  else if (reply_soa) {
+    put16(buf, 0xc00c);
+    put16(buf, 6); put16(buf, 1);
+    put32(buf, 3600);
+    put16(buf, 22);
+    buf += '\0'; buf += '\0'; // root mname and rname
+    for (uint32_t val : {1u, 7200u, 900u, 86400u}) put32(buf, val);
+    put32(buf, soa_minimum);
+  }
+  return buf;
+}
+
+static void process()
+{
+  for (int i = 0; i < 20; i++)
+    Events::get().process_events();
+}
+
+CASE("Setup network and a DNS server")
+{
+  Timers::init(
+    [] (Timers::duration_t) {},
+    [] () {}
+  );
+  dev1 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev2 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev1->connect(*dev2);
+  dev2->connect(*dev1);
+
+  Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,43});
+  Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,42}, {10,0,0,42});
+
+  static auto& server = Interfaces::get(0).udp().bind(dns::SERVICE_PORT);
+  server.on_read(
+    [] (net::Addr addr, UDP::port_t port, const char* data, size_t len) {
+      queries++;
+      auto reply = create_reply(data, len);
+      server.sendto(addr, port, reply.data(), reply.size());
+    });
+}
+
+CASE("Concurrent resolves of a name share one query")
+{
+  auto& inet = Interfaces::get(1);
+  static int resolved = 0;
+  auto handler = [] (dns::Response_ptr res, const Error& err) {
+    if (not err and res != nullptr and res->get_first_ipv4() == ip4::Addr{10,0,0,99})
+      resolved++;
+  };
+  for (int i = 0; i < 5; i++)
+    inet.resolve("coalesced.test", handler);
+  process();
+  EXPECT(resolved == 5);
+  EXPECT(queries == 1);
+}
+
+CASE("Answers are cached for their TTL")
+{
+  auto& inet = Interfaces::get(1);
+  auto& client = inet.dns();
+  queries = 0;
+  reply_ttl = 300;
+  inet.resolve("cached.test", [] (auto, auto&) {});
+  process();
+  EXPECT(queries == 1);
+
+  EXPECT(client.cache().at("cached.test").ttl == 300u);
+
+  static uint32_t ttl = 0;
+  inet.resolve("cached.test", [] (dns::Response_ptr res, const Error&) {
+    ttl = res->answers.at(0).ttl;
+  });
+  // answered from the cache right away
+  EXPECT(queries == 1);
+  EXPECT(ttl > 290u);
+  EXPECT(ttl <= 300u);
+
+  // forcing always asks the server
+  inet.resolve("cached.test", [] (auto, auto&) {}, true);
+  process();
+  EXPECT(queries == 2);
+}
+
+CASE("Cache TTL limits the record TTL, and zero TTL is not cached")
+{
+  auto& inet = Interfaces::get(1);
+  auto& client = inet.dns();
+  queries = 0;
+  client.set_cache_ttl(std::chrono::seconds(100));
+  reply_ttl = 86400;
+  inet.resolve("capped.test", [] (auto, auto&) {});
+  process();
+  EXPECT(client.cache().at("capped.test").ttl == 100u);
+
+  reply_ttl = 0;
+  inet.resolve("uncached.test", [] (auto, auto&) {});
+  process();
+  inet.resolve("uncached.test", [] (auto, auto&) {});
+  process();
+  EXPECT(queries == 3);
+  EXPECT(client.cache().count("uncached.test") == 0u);
+  client.enable_cache();
+}
+
+CASE("Negative answers are cached for the SOA minimum")
+{
+  auto& inet = Interfaces::get(1);
+  auto& client = inet.dns();
+  queries = 0;
+  reply_rcode = 3; // no such name
+  reply_soa = true;
+  inet.resolve("missing.test", [] (auto, auto&) {});
+  process();
+  EXPECT(client.cache().at("missing.test").ttl == soa_minimum);
+  EXPECT(client.cache().at("missing.test").is_negative());
+
+  static bool negative = false;
+  inet.resolve("missing.test", [] (dns::Response_ptr res, const Error& err) {
+    negative = not err and res->rcode == dns::Response_code::NAME_ERROR
+                       and not res->has_addr();
+  });
+  EXPECT(queries == 1);
+  EXPECT(negative);
+
+  // without a SOA record it can't be cached
+  reply_soa = false;
+  inet.resolve("missing-nosoa.test", [] (auto, auto&) {});
+  process();
+  EXPECT(client.cache().count("missing-nosoa.test") == 0u);
+
+  // and server failures are never cached
+  reply_rcode = 2;
+  reply_soa = true;
+  inet.resolve("failing.test", [] (auto, auto&) {});
+  process();
+  EXPECT(client.cache().count("failing.test") == 0u);
+  reply_rcode = 0;
+}
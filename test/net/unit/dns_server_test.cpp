@@ -0,0 +1,264 @@
+#include <common.cxx>
+#include <net/inet>
+#include <net/interfaces>
+#include <net/dns/server.hpp>
+#include <hw/async_device.hpp>
+
+using namespace net;
+
+static std::unique_ptr<hw::Async_device<UserNet>> dev1 = nullptr;
+static std::unique_ptr<hw::Async_device<UserNet>> dev2 = nullptr;
+static std::unique_ptr<dns::Server> server = nullptr;
+
+static const char* zone_file = R"(
+$ORIGIN example.com.
+$TTL 600
+@       IN  SOA ns1 hostmaster (
+                2024010101 ; serial
+                7200 900 1209600
+                60 )       ; minimum
+        IN  NS  ns1
+        IN  MX  10 mail
+ns1         A   10.0.0.42
+www     300 A   10.0.0.80
+            A   10.0.0.81
+web         CNAME www
+mail        A   10.0.0.25
+txt         TXT "hello world" "second"
+a.b.c       A   10.0.0.1
+)";
+
+static std::string query(const std::string& name, uint16_t qtype, bool edns = false)
+{
+  std::string buf = {0x12, 0x34, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, (char) edns};
+  buf += dns::encode_name(name);
+  buf += (char) (qtype >> 8);
+  buf += (char) qtype;
+  buf += '\0'; buf += '\1';
+  if (edns)
+    buf += std::string{0, 0, 41, 0x10, 0, 0, 0, 0, 0, 0, 0};
+  return buf;
+}
+
+struct Answer {
+  size_t  len;
+  uint8_t rcode;
+  uint8_t flags;
+  int     an, ns, ar;
+  uint8_t data[2048];
+};
+
+static Answer ask(const std::string& name, uint16_t qtype, bool edns = false, size_t size = 2048)
+{
+  Answer ans{};
+  auto q = query(name, qtype, edns);
+  ans.len = server->answer((const uint8_t*) q.data(), q.size(), ans.data, size);
+  ans.flags = ans.data[2];
+  ans.rcode = ans.data[3] & 0xf;
+  ans.an = ans.data[7];
+  ans.ns = ans.data[9];
+  ans.ar = ans.data[11];
+  return ans;
+}
+
+static void process()
+{
+  for (int i = 0; i < 20; i++)
+    Events::get().process_events();
+}
+
+CASE("Zones can be loaded from master files")
+{
+  auto zone = dns::Zone::parse(zone_file);
+  EXPECT(zone.origin() == "example.com");
+  EXPECT(zone.negative_ttl() == 60u);
+  EXPECT(zone.records().size() == 9u);
+  EXPECT(zone.records().at(0).name == "example.com");
+  EXPECT(zone.records().at(0).rtype == dns::Record_type::NS);
+  EXPECT(zone.records().at(0).rdata == "ns1.example.com");
+  EXPECT(zone.records().at(3).name == "www.example.com");
+  EXPECT(zone.records().at(3).ttl == 300u);
+  EXPECT(zone.records().at(4).name == "www.example.com");
+  EXPECT(zone.records().at(4).ttl == 600u);
+  EXPECT(zone.records().at(7).rdata == std::string("\x0bhello world\x06second"));
+
+  EXPECT_THROWS_AS(dns::Zone::parse("www A 10.0.0.1", "example.com"), dns::Zone_error);
+  EXPECT_THROWS_AS(dns::Zone::parse("@ SOA ns hm (1 2 3 4 5", "example.com"), dns::Zone_error);
+  EXPECT_THROWS_AS(dns::Zone::parse("@ SOA ns hm 1 2 3 4 5\nwww A 10.0.0.256", "example.com"),
+                   dns::Zone_error);
+  EXPECT_THROWS_AS(dns::Zone("example.com", "ns", "hm").add_a("www.other.com.", {1,2,3,4}),
+                   dns::Zone_error);
+}
+
+CASE("Setup network and an authoritative server")
+{
+  Timers::init(
+    [] (Timers::duration_t) {},
+    [] () {}
+  );
+  dev1 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev2 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev1->connect(*dev2);
+  dev2->connect(*dev1);
+
+  Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,43});
+  Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,42}, {10,0,0,42});
+
+  server = std::make_unique<dns::Server>(Interfaces::get(0));
+  server->add_zone(dns::Zone::parse(zone_file));
+  server->add_zone(dns::Zone("other.org", "ns1.example.com.", "hostmaster.example.com.")
+                   .add_a("@", {10,0,0,99}));
+  EXPECT(server->zones().size() == 2u);
+  EXPECT(server->answers() > 0u);
+  server->listen();
+}
+
+CASE("Answers for names in the zones")
+{
+  auto q = query("www.example.com", 1);
+  q.replace(13, 3, "WWW");
+  uint8_t out[512];
+  EXPECT(server->answer((const uint8_t*) q.data(), q.size(), out, sizeof(out)) > 0u);
+  // the question is returned as asked
+  EXPECT(std::memcmp(out + 13, "WWW", 3) == 0);
+
+  auto ans = ask("www.example.com", 1);
+  EXPECT(ans.rcode == 0);
+  EXPECT((ans.flags & 0x84) == 0x84); // authoritative response
+  EXPECT(ans.an == 2);
+
+  ans = ask("example.com", 15);
+  EXPECT(ans.rcode == 0);
+  EXPECT(ans.an == 1);
+  ans = ask("other.org", 1);
+  EXPECT(ans.an == 1);
+  EXPECT(ans.data[ans.len - 1] == 99);
+
+  // the name exists, but not with the type
+  ans = ask("www.example.com", 28);
+  EXPECT(ans.rcode == 0);
+  EXPECT(ans.an == 0);
+  EXPECT(ans.ns == 1);
+  // so do the names between a name and the origin
+  ans = ask("b.c.example.com", 1);
+  EXPECT(ans.rcode == 0);
+  EXPECT(ans.an == 0);
+
+  ans = ask("nowhere.example.com", 1);
+  EXPECT(ans.rcode == (int) dns::Response_code::NAME_ERROR);
+  EXPECT(ans.ns == 1);
+  ans = ask("deep.below.a.b.c.example.com", 1);
+  EXPECT(ans.rcode == (int) dns::Response_code::NAME_ERROR);
+
+  // no zone for the name
+  ans = ask("example.net", 1);
+  EXPECT(ans.rcode == (int) dns::Response_code::OP_REFUSED);
+  EXPECT(ans.an == 0);
+}
+
+CASE("Aliases are followed within the zone")
+{
+  auto ans = ask("web.example.com", 1);
+  EXPECT(ans.rcode == 0);
+  EXPECT(ans.an == 3);
+  ans = ask("web.example.com", 5);
+  EXPECT(ans.an == 1);
+  ans = ask("web.example.com", 16);
+  EXPECT(ans.an == 1);
+}
+
+CASE("EDNS, truncation and invalid queries")
+{
+  auto ans = ask("www.example.com", 1, true);
+  EXPECT(ans.rcode == 0);
+  EXPECT(ans.an == 2);
+  EXPECT(ans.ar == 1);
+  EXPECT(ans.data[ans.len - 9] == 41);
+
+  auto full = ask("www.example.com", 1);
+  ans = ask("www.example.com", 1, false, full.len - 1);
+  EXPECT((ans.flags & 0x02) == 0x02);
+  EXPECT(ans.an == 0);
+
+  // responses are ignored
+  auto q = query("www.example.com", 1);
+  q[2] |= 0x80;
+  uint8_t out[512];
+  EXPECT(server->answer((const uint8_t*) q.data(), q.size(), out, sizeof(out)) == 0u);
+  // two questions
+  q = query("www.example.com", 1);
+  q[5] = 2;
+  EXPECT(server->answer((const uint8_t*) q.data(), q.size(), out, sizeof(out)) > 0u);
+  EXPECT((out[3] & 0xf) == (int) dns::Response_code::FORMAT_ERROR);
+  // truncated question
+  q = query("www.example.com", 1);
+  EXPECT(server->answer((const uint8_t*) q.data(), q.size() - 3, out, sizeof(out)) > 0u);
+  EXPECT((out[3] & 0xf) == (int) dns::Response_code::FORMAT_ERROR);
+  // zone transfers
+  ans = ask("example.com", 252);
+  EXPECT(ans.rcode == (int) dns::Response_code::NOT_IMPL);
+}
+
+CASE("Resolving over UDP from another stack")
+{
+  auto& inet = Interfaces::get(1);
+  static ip4::Addr addr;
+  static dns::Response_code rcode;
+  inet.resolve("mail.example.com", [] (dns::Response_ptr res, const Error& err) {
+    if (not err and res) addr = res->get_first_ipv4();
+  });
+  process();
+  inet.resolve("missing.example.com", [] (dns::Response_ptr res, const Error&) {
+    if (res) rcode = res->rcode;
+  });
+  process();
+  EXPECT(addr == ip4::Addr(10,0,0,25));
+  EXPECT(rcode == dns::Response_code::NAME_ERROR);
+}
+
+CASE("Queries over TCP")
+{
+  auto& inet = Interfaces::get(1);
+  static std::string received;
+  auto q = query("www.example.com", 1);
+  std::string msg;
+  // two queries in one segment
+  for (int i = 0; i < 2; i++) {
+    msg += (char) (q.size() >> 8);
+    msg += (char) q.size();
+    msg += q;
+  }
+  inet.tcp().connect({{10,0,0,42}, dns::SERVICE_PORT},
+    [msg] (tcp::Connection_ptr conn) {
+      if (conn == nullptr) return;
+      conn->on_read(1024, [] (tcp::buffer_t buf) {
+        received.append((const char*) buf->data(), buf->size());
+      });
+      conn->write(msg);
+    });
+  process();
+
+  auto expected = ask("www.example.com", 1);
+  EXPECT(received.size() == 2 * (2 + expected.len));
+  EXPECT((size_t) (uint8_t) received[1] == expected.len);
+  EXPECT(std::memcmp(received.data() + 2, expected.data, expected.len) == 0);
+}
+
+CASE("Destroying the server closes its TCP connections")
+{
+  auto& inet = Interfaces::get(1);
+  static bool disconnected = false;
+  inet.tcp().connect({{10,0,0,42}, dns::SERVICE_PORT},
+    [] (tcp::Connection_ptr conn) {
+      if (conn == nullptr) return;
+      conn->on_disconnect([] (tcp::Connection_ptr conn, tcp::Connection::Disconnect) {
+        disconnected = true;
+        conn->close();
+      });
+    });
+  process();
+  EXPECT(not disconnected);
+  server = nullptr;
+  process();
+  EXPECT(disconnected);
+}
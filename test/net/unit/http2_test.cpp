@@ -0,0 +1,343 @@
+#include <common.cxx>
+#include <net/http/server.hpp>
+#include <net/http/hpack.hpp>
+#include <net/interfaces>
+#include <hw/async_device.hpp>
+
+using namespace net;
+using namespace http;
+
+static std::string from_hex(const std::string& hex)
+{
+  std::string out;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2)
+    out.push_back(std::stoi(hex.substr(i, 2), nullptr, 16));
+  return out;
+}
+
+static hpack::Field_list decode(hpack::Decoder& decoder, const std::string& hex)
+{
+  const auto block = from_hex(hex);
+  return decoder.decode((const uint8_t*) block.data(), block.size());
+}
+
+CASE("HPACK integers with a prefix (RFC 7541 C.1)")
+{
+  std::string out;
+  hpack::encode_integer(out, 5, 0, 10);
+  hpack::encode_integer(out, 5, 0, 1337);
+  hpack::encode_integer(out, 8, 0, 42);
+  EXPECT(out == from_hex("0a1f9a0a2a"));
+
+  const auto* pos = (const uint8_t*) out.data();
+  const auto* end = pos + out.size();
+  EXPECT(hpack::decode_integer(pos, end, 5) == 10u);
+  EXPECT(hpack::decode_integer(pos, end, 5) == 1337u);
+  EXPECT(hpack::decode_integer(pos, end, 8) == 42u);
+  EXPECT(pos == end);
+  // continued past the end
+  const auto truncated = from_hex("1f9a");
+  pos = (const uint8_t*) truncated.data();
+  EXPECT_THROWS_AS(hpack::decode_integer(pos, pos + 2, 5), hpack::Error);
+}
+
+CASE("HPACK Huffman coding (RFC 7541 C.4.1)")
+{
+  std::string out;
+  hpack::huffman_encode(out, "www.example.com");
+  EXPECT(out == from_hex("f1e3c2e5f23a6ba0ab90f4ff"));
+  EXPECT(hpack::huffman_length("www.example.com") == out.size());
+  EXPECT(hpack::huffman_decode((const uint8_t*) out.data(), out.size()) == "www.example.com");
+
+  std::string all;
+  for (int c = 0; c < 256; c++) all.push_back(c);
+  out.clear();
+  hpack::huffman_encode(out, all);
+  EXPECT(hpack::huffman_decode((const uint8_t*) out.data(), out.size()) == all);
+
+  // padding longer than 7 bits
+  const auto bad = from_hex("ffff");
+  EXPECT_THROWS_AS(hpack::huffman_decode((const uint8_t*) bad.data(), bad.size()), hpack::Error);
+}
+
+CASE("HPACK decodes the request examples (RFC 7541 C.3, C.4)")
+{
+  for (const auto& blocks : {
+    std::vector<std::string>{
+      "828684410f7777772e6578616d706c652e636f6d",
+      "828684be58086e6f2d6361636865",
+      "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565"},
+    std::vector<std::string>{
+      "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+      "828684be5886a8eb10649cbf",
+      "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"}})
+  {
+    hpack::Decoder decoder;
+    auto fields = decode(decoder, blocks[0]);
+    EXPECT(fields == hpack::Field_list({{":method", "GET"}, {":scheme", "http"},
+                                        {":path", "/"}, {":authority", "www.example.com"}}));
+    EXPECT(decoder.table().size() == 57u);
+
+    fields = decode(decoder, blocks[1]);
+    EXPECT(fields.back() == hpack::Field("cache-control", "no-cache"));
+    EXPECT(decoder.table().size() == 110u);
+
+    fields = decode(decoder, blocks[2]);
+    EXPECT(fields.size() == 5u);
+    EXPECT(fields.at(1) == hpack::Field(":scheme", "https"));
+    EXPECT(fields.at(3) == hpack::Field(":authority", "www.example.com"));
+    EXPECT(fields.at(4) == hpack::Field("custom-key", "custom-value"));
+    EXPECT(decoder.table().size() == 164u);
+    EXPECT(decoder.table().count() == 3u);
+  }
+}
+
+CASE("HPACK encoder and decoder stay in sync")
+{
+  hpack::Encoder encoder;
+  hpack::Decoder decoder;
+  const hpack::Field_list fields{{":status", "200"}, {"content-type", "text/html"},
+    {"x-request", "1"}, {"authorization", "secret"}};
+
+  std::string first, second;
+  encoder.encode(first, fields);
+  encoder.encode(second, fields);
+  // indexed the second time
+  EXPECT(second.size() < first.size());
+  EXPECT(decoder.decode((const uint8_t*) first.data(), first.size()) == fields);
+  EXPECT(decoder.decode((const uint8_t*) second.data(), second.size()) == fields);
+  // credentials are never indexed
+  EXPECT(encoder.table().count() == 2u);
+  EXPECT(decoder.table().size() == encoder.table().size());
+
+  // the peer's smaller table is announced in the next block
+  encoder.set_max_table_size(0);
+  std::string third;
+  encoder.encode(third, fields);
+  EXPECT(decoder.decode((const uint8_t*) third.data(), third.size()) == fields);
+  EXPECT(decoder.table().count() == 0u);
+
+  // a size update after the first field
+  hpack::Decoder other;
+  EXPECT_THROWS_AS(decode(other, "82" "3f"), hpack::Error);
+  // an index out of the table
+  EXPECT_THROWS_AS(decode(other, "ff00"), hpack::Error);
+}
+
+static std::unique_ptr<hw::Async_device<UserNet>> dev1 = nullptr;
+static std::unique_ptr<hw::Async_device<UserNet>> dev2 = nullptr;
+static std::unique_ptr<Server> server = nullptr;
+
+static void process()
+{
+  for (int i = 0; i < 50; i++)
+    Events::get().process_events();
+}
+
+struct Frame {
+  h2::Frame_header header;
+  std::string payload;
+};
+
+// a client speaking raw HTTP/2 to the server
+struct H2_client {
+  tcp::Connection_ptr conn;
+  std::string in;
+  hpack::Encoder encoder;
+  hpack::Decoder decoder;
+
+  void connect(uint16_t port)
+  {
+    conn = Interfaces::get(1).tcp().connect({{10,0,0,42}, port});
+    process();
+    conn->on_read(16384, [this] (auto buf) {
+      in.append((const char*) buf->data(), buf->size());
+    });
+  }
+
+  void frame(h2::Frame_type type, uint8_t flags, uint32_t stream, const std::string& payload)
+  {
+    std::string out;
+    h2::append_frame(out, type, flags, stream, payload.data(), payload.size());
+    conn->write(out);
+  }
+
+  void request(uint32_t stream, const std::string& method, const std::string& path, bool end = true)
+  {
+    std::string block;
+    encoder.encode(block, {{":method", method}, {":scheme", "http"},
+                           {":path", path}, {":authority", "10.0.0.42"}});
+    frame(h2::Frame_type::HEADERS, h2::flag::END_HEADERS | (end ? h2::flag::END_STREAM : 0),
+          stream, block);
+  }
+
+  std::vector<Frame> frames()
+  {
+    std::vector<Frame> result;
+    while (in.size() >= h2::FRAME_HEADER_LEN)
+    {
+      const auto header = h2::Frame_header::parse((const uint8_t*) in.data());
+      if (in.size() < h2::FRAME_HEADER_LEN + header.length) break;
+      result.push_back({header, in.substr(h2::FRAME_HEADER_LEN, header.length)});
+      in.erase(0, h2::FRAME_HEADER_LEN + header.length);
+    }
+    return result;
+  }
+
+  hpack::Field_list fields(const Frame& frame)
+  {
+    return decoder.decode((const uint8_t*) frame.payload.data(), frame.payload.size());
+  }
+};
+
+static std::string setting(h2::Setting id, uint32_t value)
+{
+  std::string out;
+  out.push_back(0);
+  out.push_back(static_cast<uint8_t>(id));
+  h2::append_u32(out, value);
+  return out;
+}
+
+CASE("Setup HTTP/2 server")
+{
+  Timers::init(
+    [] (Timers::duration_t) {},
+    [] () {}
+  );
+  dev1 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev2 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev1->connect(*dev2);
+  dev2->connect(*dev1);
+
+  Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,43});
+  Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,42});
+
+  server = std::make_unique<Server>(Interfaces::get(0).tcp());
+  server->enable_http2();
+  server->on_request([] (Request_ptr req, Response_writer_ptr writer) {
+    std::string body{req->uri().path()};
+    if (not req->body().empty())
+      body += ":" + std::string(req->body());
+    writer->write(body);
+  });
+  server->listen(80);
+  EXPECT(server->http2_enabled());
+}
+
+CASE("Requests on concurrent streams with prior knowledge")
+{
+  H2_client client;
+  client.connect(80);
+  client.conn->write(h2::PREFACE);
+  client.frame(h2::Frame_type::SETTINGS, 0, 0, "");
+  client.request(1, "GET", "/first");
+  client.request(3, "POST", "/second", false);
+  client.frame(h2::Frame_type::DATA, h2::flag::END_STREAM, 3, "data");
+  client.frame(h2::Frame_type::PING, 0, 0, "12345678");
+  process();
+
+  auto frames = client.frames();
+  EXPECT(frames.size() == 7u);
+  // the server's settings, and an ack of ours
+  EXPECT(frames.at(0).header.type == h2::Frame_type::SETTINGS);
+  EXPECT(frames.at(0).header.flags == 0);
+  EXPECT(frames.at(1).header.type == h2::Frame_type::SETTINGS);
+  EXPECT(frames.at(1).header.flags == h2::flag::ACK);
+
+  EXPECT(frames.at(2).header.type == h2::Frame_type::HEADERS);
+  EXPECT(frames.at(2).header.stream == 1u);
+  const auto fields = client.fields(frames.at(2));
+  EXPECT(fields.at(0) == hpack::Field(":status", "200"));
+  EXPECT(std::find(fields.begin(), fields.end(), hpack::Field("content-length", "6")) != fields.end());
+  EXPECT(frames.at(3).header.type == h2::Frame_type::DATA);
+  EXPECT(frames.at(3).header.flags == h2::flag::END_STREAM);
+  EXPECT(frames.at(3).payload == "/first");
+
+  EXPECT(frames.at(4).header.stream == 3u);
+  EXPECT(client.fields(frames.at(4)).at(0) == hpack::Field(":status", "200"));
+  EXPECT(frames.at(5).payload == "/second:data");
+
+  EXPECT(frames.at(6).header.type == h2::Frame_type::PING);
+  EXPECT(frames.at(6).header.flags == h2::flag::ACK);
+  EXPECT(frames.at(6).payload == "12345678");
+  EXPECT(server->connected_clients() == 1u);
+  client.conn->close();
+  process();
+}
+
+CASE("Responses wait for the peer's flow control window")
+{
+  H2_client client;
+  client.connect(80);
+  client.conn->write(h2::PREFACE);
+  client.frame(h2::Frame_type::SETTINGS, 0, 0, setting(h2::Setting::INITIAL_WINDOW_SIZE, 4));
+  client.request(1, "GET", "/flow-controlled");
+  process();
+
+  auto frames = client.frames();
+  EXPECT(frames.size() == 4u);
+  EXPECT(frames.at(3).header.type == h2::Frame_type::DATA);
+  EXPECT(frames.at(3).payload == "/flo");
+  EXPECT(frames.at(3).header.flags == 0);
+
+  std::string increment;
+  h2::append_u32(increment, 100);
+  client.frame(h2::Frame_type::WINDOW_UPDATE, 0, 1, increment);
+  process();
+  frames = client.frames();
+  EXPECT(frames.size() == 1u);
+  EXPECT(frames.at(0).payload == "w-controlled");
+  EXPECT(frames.at(0).header.flags == h2::flag::END_STREAM);
+  client.conn->close();
+  process();
+}
+
+CASE("Protocol errors end the connection with GOAWAY")
+{
+  H2_client client;
+  client.connect(80);
+  client.conn->write(h2::PREFACE);
+  // streams initiated by clients are odd
+  client.request(2, "GET", "/");
+  process();
+
+  auto frames = client.frames();
+  EXPECT(frames.size() == 2u);
+  EXPECT(frames.at(1).header.type == h2::Frame_type::GOAWAY);
+  EXPECT(h2::Frame_header::read_u32((const uint8_t*) frames.at(1).payload.data() + 4)
+         == static_cast<uint32_t>(h2::Error_code::PROTOCOL_ERROR));
+  EXPECT(server->connected_clients() == 0u);
+}
+
+CASE("HTTP/1.1 connections are upgraded to h2c")
+{
+  H2_client client;
+  client.connect(80);
+  client.conn->write("GET /upgraded HTTP/1.1\r\nHost: 10.0.0.42\r\n"
+                     "Connection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+                     "HTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n");
+  process();
+
+  const std::string switching = "HTTP/1.1 101 Switching Protocols\r\n";
+  EXPECT(client.in.compare(0, switching.size(), switching) == 0);
+  client.in.erase(0, client.in.find("\r\n\r\n") + 4);
+
+  // the request is answered on stream 1
+  auto frames = client.frames();
+  EXPECT(frames.size() == 3u);
+  EXPECT(frames.at(0).header.type == h2::Frame_type::SETTINGS);
+  EXPECT(frames.at(1).header.stream == 1u);
+  EXPECT(frames.at(2).payload == "/upgraded");
+
+  client.conn->write(h2::PREFACE);
+  client.frame(h2::Frame_type::SETTINGS, 0, 0, "");
+  client.request(3, "GET", "/next");
+  process();
+  frames = client.frames();
+  EXPECT(frames.size() == 3u);
+  EXPECT(frames.at(2).payload == "/next");
+  client.conn->close();
+  process();
+  server = nullptr;
+}
@@ -0,0 +1,311 @@
+#include <common.cxx>
+#include <net/http/basic_client.hpp>
+#include <net/interfaces>
+#include <hw/async_device.hpp>
+#include <set>
+
+using namespace net;
+
+static std::unique_ptr<hw::Async_device<UserNet>> dev1 = nullptr;
+static std::unique_ptr<hw::Async_device<UserNet>> dev2 = nullptr;
+
+static void process()
+{
+  for (int i = 0; i < 50; i++)
+    Events::get().process_events();
+}
+
+// answers requests with their path, unless told to hold them
+struct Test_server {
+  struct Conn {
+    tcp::Connection_ptr conn;
+    std::string data;
+    std::vector<std::string> paths;
+  };
+  std::vector<std::shared_ptr<Conn>> conns;
+  bool hold = false;
+  std::string extra_headers;
+
+  static std::string response(const std::string& body, const std::string& headers = "")
+  {
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size())
+      + "\r\n" + headers + "\r\n" + body;
+  }
+
+  void listen(Inet& inet, uint16_t port)
+  {
+    inet.tcp().listen(port,
+      [this] (tcp::Connection_ptr conn) {
+        auto c = std::make_shared<Conn>();
+        c->conn = conn;
+        conns.push_back(c);
+        conn->on_read(4096,
+          [this, c = c.get()] (auto buf) {
+            c->data.append((const char*) buf->data(), buf->size());
+            size_t end;
+            while ((end = c->data.find("\r\n\r\n")) != std::string::npos)
+            {
+              const auto sp = c->data.find(' ');
+              c->paths.push_back(c->data.substr(sp + 1, c->data.find(' ', sp + 1) - sp - 1));
+              c->data.erase(0, end + 4);
+            }
+            if (not hold) answer(*c);
+          });
+      });
+  }
+
+  size_t waiting() const
+  {
+    size_t n = 0;
+    for (auto& c : conns) n += c->paths.size();
+    return n;
+  }
+
+  void answer(Conn& c)
+  {
+    std::string out;
+    for (auto& path : c.paths) out += response(path, extra_headers);
+    c.paths.clear();
+    if (not out.empty()) c.conn->write(out);
+  }
+
+  void answer_all()
+  {
+    for (auto& c : conns) answer(*c);
+  }
+};
+
+static Test_server server;
+static const http::Basic_client::Host host{{10,0,0,42}, 80};
+
+struct Result {
+  std::vector<std::string> bodies;
+  std::vector<http::Error> errors;
+  std::set<uint16_t> ports;
+};
+
+static http::Response_handler collect(Result& result)
+{
+  return [&result] (http::Error err, http::Response_ptr res, http::Connection& conn) {
+    result.errors.push_back(err);
+    if (res) result.bodies.push_back(std::string(res->body()));
+    result.ports.insert(conn.local_port());
+  };
+}
+
+CASE("Setup network")
+{
+  Timers::init(
+    [] (Timers::duration_t) {},
+    [] () {}
+  );
+  dev1 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev2 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev1->connect(*dev2);
+  dev2->connect(*dev1);
+
+  Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,43});
+  Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,42});
+  server.listen(Interfaces::get(0), 80);
+}
+
+CASE("Keep-alive connections are reused for the next request")
+{
+  http::Basic_client client{Interfaces::get(1).tcp()};
+  // opt-in
+  EXPECT(not client.keep_alive());
+  client.set_keep_alive(true);
+  Result result;
+
+  client.get(host, "/a", {}, collect(result));
+  process();
+  client.get(host, "/b", {}, collect(result));
+  process();
+
+  EXPECT(result.bodies == std::vector<std::string>({"/a", "/b"}));
+  EXPECT(not result.errors.at(0));
+  EXPECT(result.ports.size() == 1u);
+  EXPECT(client.connection_count(host) == 1u);
+  EXPECT(server.conns.size() == 1u);
+  server.conns.clear();
+}
+
+CASE("Requests wait for a connection when the host is at its limit")
+{
+  http::Basic_client client{Interfaces::get(1).tcp()};
+  client.set_keep_alive(true);
+  http::Basic_client::Pool_options options;
+  options.max_per_host = 2;
+  options.max_queued   = 3;
+  client.set_pool_options(options);
+  Result result;
+
+  server.hold = true;
+  for (int i = 0; i < 6; i++)
+    client.get(host, "/" + std::to_string(i), {}, collect(result));
+  process();
+  EXPECT(client.connection_count(host) == 2u);
+  EXPECT(client.queued_count(host) == 3u);
+  EXPECT(server.waiting() == 2u);
+  // no room left in the queue
+  EXPECT(result.errors.size() == 1u);
+  EXPECT(result.errors.at(0).to_string() == "Too many requests queued");
+
+  // the waiting requests go out as responses come in
+  server.hold = false;
+  server.answer_all();
+  process();
+  EXPECT(result.bodies.size() == 5u);
+  EXPECT(client.queued_count(host) == 0u);
+  EXPECT(client.connection_count(host) == 2u);
+  EXPECT(server.conns.size() == 2u);
+  server.conns.clear();
+}
+
+CASE("Safe requests are pipelined, and responses split over reads")
+{
+  http::Basic_client client{Interfaces::get(1).tcp()};
+  client.set_keep_alive(true);
+  http::Basic_client::Pool_options options;
+  options.max_per_host   = 1;
+  options.pipeline_depth = 4;
+  client.set_pool_options(options);
+  Result result;
+
+  server.hold = true;
+  for (auto path : {"/x", "/y", "/z"})
+    client.get(host, path, {}, collect(result));
+  // not safe, so it waits for the ones in flight
+  client.post(host, "/post", {}, "data", collect(result));
+  process();
+  EXPECT(server.waiting() == 3u);
+  EXPECT(client.queued_count(host) == 1u);
+
+  // one response and a half, then the rest
+  auto& conn = *server.conns.at(0);
+  std::string out;
+  for (auto& path : conn.paths) out += Test_server::response(path);
+  conn.paths.clear();
+  const auto half = Test_server::response("/x").size() + 10;
+  conn.conn->write(out.substr(0, half));
+  process();
+  EXPECT(result.bodies == std::vector<std::string>({"/x"}));
+  conn.conn->write(out.substr(half));
+  process();
+  EXPECT(result.bodies == std::vector<std::string>({"/x", "/y", "/z"}));
+
+  server.hold = false;
+  server.answer_all();
+  process();
+  EXPECT(result.bodies.size() == 4u);
+  EXPECT(result.ports.size() == 1u);
+  EXPECT(server.conns.size() == 1u);
+  server.conns.clear();
+}
+
+CASE("Chunked responses, and connections closed by the server")
+{
+  http::Basic_client client{Interfaces::get(1).tcp()};
+  client.set_keep_alive(true);
+  Result result;
+
+  server.hold = true;
+  client.get(host, "/chunked", {}, collect(result));
+  client.get(host, "/closed", {}, collect(result));
+  process();
+  EXPECT(server.conns.size() == 2u);
+
+  server.conns.at(0)->conn->write(
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "4\r\nchun\r\n3;ext=1\r\nked\r\n0\r\n\r\n");
+  server.conns.at(1)->conn->write(
+    Test_server::response("bye", "Connection: close\r\n"));
+  process();
+  EXPECT(result.bodies == std::vector<std::string>({"chunked", "bye"}));
+  // the closed one is removed from the pool
+  EXPECT(client.connection_count(host) == 1u);
+
+  server.hold = false;
+  server.conns.clear();
+}
+
+CASE("Idempotent requests lost with their connection are retried once")
+{
+  http::Basic_client client{Interfaces::get(1).tcp()};
+  client.set_keep_alive(true);
+  Result result;
+
+  server.hold = true;
+  client.get(host, "/again", {}, collect(result));
+  client.post(host, "/once", {}, "data", collect(result));
+  process();
+  EXPECT(server.waiting() == 2u);
+
+  // closed without an answer
+  server.hold = false;
+  for (auto& c : server.conns) c->conn->close();
+  process();
+  EXPECT(result.bodies == std::vector<std::string>({"/again"}));
+  EXPECT(result.errors.size() == 2u);
+  EXPECT(result.errors.at(0).to_string() == "Connection closing");
+  EXPECT(server.conns.size() == 3u);
+  server.conns.clear();
+}
+
+CASE("Retried requests are sent again in the order they were written")
+{
+  http::Basic_client client{Interfaces::get(1).tcp()};
+  client.set_keep_alive(true);
+  http::Basic_client::Pool_options options;
+  options.max_per_host   = 1;
+  options.pipeline_depth = 4;
+  client.set_pool_options(options);
+  Result result;
+
+  server.hold = true;
+  for (auto path : {"/1", "/2", "/3"})
+    client.get(host, path, {}, collect(result));
+  process();
+  EXPECT(server.waiting() == 3u);
+
+  server.hold = false;
+  server.conns.at(0)->conn->close();
+  process();
+  EXPECT(result.bodies == std::vector<std::string>({"/1", "/2", "/3"}));
+  EXPECT(server.conns.size() == 2u);
+  server.conns.clear();
+}
+
+// "https" over plain TCP, to tell the pools apart
+struct Secure_client : public http::Basic_client {
+  explicit Secure_client(TCP& tcp)
+    : Basic_client(tcp, nullptr, true) {}
+
+  http::Connection::Stream_ptr create_secure_stream(const Host host) override
+  {
+    secure_streams++;
+    return std::make_unique<tcp::Stream>(tcp_.connect(host));
+  }
+  int secure_streams = 0;
+};
+
+CASE("Secured and plain requests to a host don't share connections")
+{
+  Secure_client client{Interfaces::get(1).tcp()};
+  client.set_keep_alive(true);
+  Result result;
+
+  client.get(host, "/plain", {}, collect(result));
+  process();
+  client.get(host, "/secure", {}, collect(result), true);
+  process();
+  client.get(host, "/plain", {}, collect(result));
+  process();
+
+  EXPECT(result.bodies == std::vector<std::string>({"/plain", "/secure", "/plain"}));
+  EXPECT(client.secure_streams == 1);
+  EXPECT(client.connection_count(host) == 1u);
+  EXPECT(client.connection_count(host, true) == 1u);
+  EXPECT(result.ports.size() == 2u);
+  server.conns.clear();
+}
@@ -0,0 +1,449 @@
+#include <common.cxx>
+#include <net/http/static_files.hpp>
+#include <util/crc32.hpp>
+#include <tinf.h>
+#include <deque>
+#include <map>
+
+using namespace http;
+
+// files kept in memory
+class Memory_fs : public fs::File_system {
+public:
+  // 2020-01-01 00:00
+  static constexpr uint32_t MODIFIED = ((40u << 9) | (1u << 5) | 1u) << 16;
+
+  void add(const std::string& path, const std::string& data)
+  { files_[path] = data; }
+
+  int device_id() const noexcept override
+  { return 0; }
+
+  void ls(const std::string&, fs::on_ls_func) const override {}
+  void ls(const fs::Dirent&, fs::on_ls_func) const override {}
+  fs::List ls(const std::string&) const override
+  { return {fs::no_error, std::make_shared<fs::dirvector>()}; }
+  fs::List ls(const fs::Dirent&) const override
+  { return {fs::no_error, std::make_shared<fs::dirvector>()}; }
+
+  void read(const fs::Dirent& ent, uint64_t pos, uint64_t n, fs::on_read_func fn) const override
+  {
+    auto buf = read(ent, pos, n);
+    fn(buf.error(), buf.get());
+  }
+
+  fs::Buffer read(const fs::Dirent& ent, uint64_t pos, uint64_t n) const override
+  {
+    ++reads;
+    const auto& data = files_.at(ent.name());
+    pos = std::min<uint64_t>(pos, data.size());
+    n = std::min<uint64_t>(n, data.size() - pos);
+    return {fs::no_error, fs::construct_buffer(data.begin() + pos, data.begin() + pos + n)};
+  }
+
+  void stat(fs::Path_ptr, fs::on_stat_func, const fs::Dirent* const) const override {}
+
+  fs::Dirent stat(fs::Path path, const fs::Dirent* const) const override
+  {
+    auto name = path.to_string();
+    if(name.size() > 1)
+      name.pop_back();
+    if(name == "/" or name == "/docs")
+      return fs::Dirent(this, fs::DIR, name);
+    auto it = files_.find(name);
+    if(it == files_.end())
+      return fs::Dirent(this);
+    return fs::Dirent(this, fs::FILE, name, 0, 0, it->second.size(), 0, MODIFIED);
+  }
+
+  void cstat(const std::string&, fs::on_stat_func) override {}
+
+  std::string name() const override
+  { return "Memory FS"; }
+
+  uint64_t block_size() const override
+  { return 512; }
+
+  void init(uint64_t, uint64_t, fs::on_init_func) override {}
+
+  mutable int reads = 0;
+
+private:
+  std::map<std::string, std::string> files_;
+};
+
+// what a response writer writes
+class Capture_stream : public net::Stream {
+public:
+  explicit Capture_stream(std::string& out) : out_{out} {}
+
+  void on_connect(ConnectCallback) override {}
+  void on_read(size_t, ReadCallback) override {}
+  void on_data(DataCallback) override {}
+  size_t next_size() override { return 0; }
+  buffer_t read_next() override { return construct_buffer(); }
+  void on_close(CloseCallback) override {}
+  void on_write(WriteCallback cb) override
+  { on_write_ = cb; }
+  void write(const void* buf, size_t n) override
+  {
+    out_.append((const char*) buf, n);
+    unsent_.push_back(n);
+  }
+  void write(buffer_t buf) override
+  { write(buf->data(), buf->size()); }
+  void write(const std::string& str) override
+  { write(str.data(), str.size()); }
+  void close() override { closed = true; }
+  void reset_callbacks() override {}
+  net::Socket local() const override { return {}; }
+  net::Socket remote() const override { return {}; }
+  std::string to_string() const override { return "Capture"; }
+  bool is_connected() const noexcept override { return true; }
+  bool is_writable() const noexcept override { return true; }
+  bool is_readable() const noexcept override { return true; }
+  bool is_closing() const noexcept override { return false; }
+  bool is_closed() const noexcept override { return false; }
+  int get_cpuid() const noexcept override { return 0; }
+  Stream* transport() noexcept override { return nullptr; }
+
+  // report everything written as sent
+  void send_all()
+  {
+    while(on_write_ and not unsent_.empty())
+    {
+      const auto n = unsent_.front();
+      unsent_.pop_front();
+      on_write_(n);
+    }
+  }
+
+  bool closed = false;
+
+private:
+  std::string& out_;
+  std::deque<size_t> unsent_;
+  WriteCallback on_write_;
+};
+
+struct Reply {
+  std::string head;
+  std::string body;
+
+  bool has(const std::string& line) const
+  { return head.find(line + "\r\n") != std::string::npos; }
+
+  std::string field(const std::string& name) const
+  {
+    const auto pos = head.find("\r\n" + name + ": ");
+    if(pos == std::string::npos) return "";
+    const auto start = pos + name.size() + 4;
+    return head.substr(start, head.find("\r\n", start) - start);
+  }
+};
+
+static Reply get(Static_files& files, const std::string& path,
+                 std::vector<std::pair<std::string, std::string>> fields = {},
+                 Method method = GET)
+{
+  std::string out;
+  {
+    auto stream = std::make_unique<Capture_stream>(out);
+    auto* capture = stream.get();
+    Connection conn{std::move(stream)};
+    auto req = make_request();
+    req->set_method(method);
+    req->set_uri(URI{path});
+    for(const auto& f : fields)
+      req->header().set_field(f.first, f.second);
+    auto writer = std::make_unique<Response_writer>(make_response(), conn);
+    files.serve(std::move(req), std::move(writer));
+    capture->send_all();
+  }
+  Reply reply;
+  const auto end = out.find("\r\n\r\n");
+  reply.head = out.substr(0, end + 2);
+  reply.body = out.substr(end + 4);
+  return reply;
+}
+
+static std::string text(size_t len)
+{
+  std::string s;
+  while(s.size() < len)
+    s += "All work and no play makes Jack a dull boy. ";
+  s.resize(len);
+  return s;
+}
+
+CASE("Static files are served with validators and cached")
+{
+  Memory_fs disk;
+  disk.add("/index.html", "<h1>Hello</h1>");
+  disk.add("/docs/index.html", "docs");
+  disk.add("/data.bin", "\x01\x02\x03");
+  Static_files files{disk};
+
+  auto reply = get(files, "/index.html");
+  EXPECT(reply.has("HTTP/1.1 200 OK"));
+  EXPECT(reply.body == "<h1>Hello</h1>");
+  EXPECT(reply.field("Content-Type") == "text/html");
+  EXPECT(reply.field("Content-Length") == "14");
+  EXPECT(reply.field("Last-Modified") == "Wed, 01 Jan 2020 00:00:00 GMT");
+  EXPECT(reply.field("Accept-Ranges") == "bytes");
+  const auto etag = reply.field("ETag");
+  EXPECT(etag.size() > 2);
+  EXPECT(etag.front() == '"');
+  EXPECT(files.misses() == 1u);
+  EXPECT(files.cached_files() == 1u);
+  EXPECT(files.cache_used() == 14u);
+
+  // from the cache
+  const int reads = disk.reads;
+  reply = get(files, "/index.html");
+  EXPECT(reply.body == "<h1>Hello</h1>");
+  EXPECT(reply.field("ETag") == etag);
+  EXPECT(disk.reads == reads);
+  EXPECT(files.hits() == 1u);
+
+  // directories have an index
+  EXPECT(get(files, "/").body == "<h1>Hello</h1>");
+  EXPECT(get(files, "/docs/").body == "docs");
+  EXPECT(get(files, "/data.bin").field("Content-Type") == "application/octet-stream");
+
+  // HEAD has no body
+  reply = get(files, "/index.html", {}, HEAD);
+  EXPECT(reply.has("HTTP/1.1 200 OK"));
+  EXPECT(reply.field("Content-Length") == "14");
+  EXPECT(reply.body.empty());
+
+  EXPECT(get(files, "/missing.html").has("HTTP/1.1 404 Not Found"));
+  EXPECT(get(files, "/../index.html").has("HTTP/1.1 404 Not Found"));
+  reply = get(files, "/index.html", {}, POST);
+  EXPECT(reply.has("HTTP/1.1 405 Method Not Allowed"));
+  EXPECT(reply.field("Allow") == "GET, HEAD");
+}
+
+CASE("Conditional requests are answered with 304")
+{
+  Memory_fs disk;
+  disk.add("/app.js", "var x;");
+  Static_files files{disk};
+
+  const auto etag = get(files, "/app.js").field("ETag");
+
+  auto reply = get(files, "/app.js", {{"If-None-Match", etag}});
+  EXPECT(reply.has("HTTP/1.1 304 Not Modified"));
+  EXPECT(reply.field("ETag") == etag);
+  EXPECT(reply.body.empty());
+
+  EXPECT(get(files, "/app.js", {{"If-None-Match", "\"other\", W/" + etag}})
+    .has("HTTP/1.1 304 Not Modified"));
+  EXPECT(get(files, "/app.js", {{"If-None-Match", "*"}}).has("HTTP/1.1 304 Not Modified"));
+  EXPECT(get(files, "/app.js", {{"If-None-Match", "\"other\""}}).has("HTTP/1.1 200 OK"));
+
+  EXPECT(get(files, "/app.js", {{"If-Modified-Since", "Wed, 01 Jan 2020 00:00:00 GMT"}})
+    .has("HTTP/1.1 304 Not Modified"));
+  EXPECT(get(files, "/app.js", {{"If-Modified-Since", "Tue, 31 Dec 2019 00:00:00 GMT"}})
+    .has("HTTP/1.1 200 OK"));
+  // If-None-Match takes precedence
+  EXPECT(get(files, "/app.js", {{"If-None-Match", "\"other\""},
+                                {"If-Modified-Since", "Wed, 01 Jan 2020 00:00:00 GMT"}})
+    .has("HTTP/1.1 200 OK"));
+}
+
+CASE("A byte range is served with 206")
+{
+  Memory_fs disk;
+  disk.add("/file.txt", "0123456789");
+  Static_files files{disk};
+
+  auto reply = get(files, "/file.txt", {{"Range", "bytes=2-5"}});
+  EXPECT(reply.has("HTTP/1.1 206 Partial Content"));
+  EXPECT(reply.field("Content-Range") == "bytes 2-5/10");
+  EXPECT(reply.body == "2345");
+
+  EXPECT(get(files, "/file.txt", {{"Range", "bytes=7-"}}).body == "789");
+  EXPECT(get(files, "/file.txt", {{"Range", "bytes=-3"}}).body == "789");
+  EXPECT(get(files, "/file.txt", {{"Range", "bytes=8-100"}}).body == "89");
+
+  reply = get(files, "/file.txt", {{"Range", "bytes=10-"}});
+  EXPECT(reply.has("HTTP/1.1 416 Range Not Satisfiable"));
+  EXPECT(reply.field("Content-Range") == "bytes */10");
+
+  // not understood, the whole file
+  EXPECT(get(files, "/file.txt", {{"Range", "bytes=0-1,4-5"}}).body == "0123456789");
+  EXPECT(get(files, "/file.txt", {{"Range", "lines=1-2"}}).body == "0123456789");
+
+  const auto etag = get(files, "/file.txt").field("ETag");
+  EXPECT(get(files, "/file.txt", {{"Range", "bytes=0-0"}, {"If-Range", etag}}).body == "0");
+  EXPECT(get(files, "/file.txt", {{"Range", "bytes=0-0"}, {"If-Range", "\"old\""}})
+    .body == "0123456789");
+}
+
+CASE("Compressed variants are chosen by Accept-Encoding")
+{
+  Memory_fs disk;
+  const auto page = text(2000);
+  disk.add("/page.html", page);
+  disk.add("/style.css", text(1000));
+  disk.add("/style.css.br", "brotli");
+  disk.add("/image.png", text(1000));
+  Static_files files{disk};
+
+  auto reply = get(files, "/page.html", {{"Accept-Encoding", "gzip, deflate"}});
+  EXPECT(reply.has("HTTP/1.1 200 OK"));
+  EXPECT(reply.field("Content-Encoding") == "gzip");
+  EXPECT(reply.field("Vary") == "Accept-Encoding");
+  EXPECT(reply.field("ETag").find("-gz\"") != std::string::npos);
+  EXPECT(reply.body.size() < page.size());
+
+  // a gzip member, with its CRC checked by uzlib
+  const auto& gz = reply.body;
+  EXPECT(gz.size() > 18u);
+  EXPECT(gz.substr(0, 3) == "\x1f\x8b\x08");
+  uzlib_init();
+  TINF_DATA d {};
+  d.source = (const uint8_t*) gz.data();
+  EXPECT(uzlib_gzip_parse_header(&d) == TINF_OK);
+  uzlib_uncompress_init(&d, nullptr, 0);
+  std::vector<uint8_t> raw(page.size() + 1);
+  d.destStart = d.dest = raw.data();
+  d.destSize = raw.size();
+  EXPECT(uzlib_uncompress_chksum(&d) == TINF_DONE);
+  raw.resize(d.dest - raw.data());
+  EXPECT(std::string(raw.begin(), raw.end()) == page);
+  EXPECT(d.source == (const uint8_t*) gz.data() + gz.size());
+  const auto* trailer = (const uint8_t*) gz.data() + gz.size() - 8;
+  uint32_t crc = 0, len = 0;
+  for(int i = 3; i >= 0; i--) {
+    crc = (crc << 8) | trailer[i];
+    len = (len << 8) | trailer[4 + i];
+  }
+  EXPECT(crc == crc32(page.data(), page.size()));
+  EXPECT(len == page.size());
+
+  // refused, or not asked for
+  EXPECT(get(files, "/page.html", {{"Accept-Encoding", "gzip;q=0"}}).body == page);
+  EXPECT(get(files, "/page.html").body == page);
+  EXPECT(get(files, "/page.html", {{"Accept-Encoding", "*"}})
+    .field("Content-Encoding") == "gzip");
+  // ranges are of the file itself
+  EXPECT(get(files, "/page.html", {{"Accept-Encoding", "gzip"}, {"Range", "bytes=0-3"}})
+    .body == page.substr(0, 4));
+
+  // precompressed next to the file
+  reply = get(files, "/style.css", {{"Accept-Encoding", "gzip, br"}});
+  EXPECT(reply.field("Content-Encoding") == "br");
+  EXPECT(reply.body == "brotli");
+  EXPECT(get(files, "/style.css", {{"Accept-Encoding", "gzip"}})
+    .field("Content-Encoding") == "gzip");
+
+  // already compressed formats are left alone
+  reply = get(files, "/image.png", {{"Accept-Encoding", "gzip"}});
+  EXPECT(reply.field("Content-Encoding") == "");
+  EXPECT(reply.field("Vary") == "");
+}
+
+CASE("The least recently used files are evicted")
+{
+  Memory_fs disk;
+  disk.add("/a.png", text(400));
+  disk.add("/b.png", text(400));
+  disk.add("/c.png", text(400));
+  disk.add("/big.png", text(2000));
+  Static_files::Options options;
+  options.cache_size = 1000;
+  options.max_cached_file = 1000;
+  Static_files files{disk, options};
+
+  get(files, "/a.png");
+  get(files, "/b.png");
+  get(files, "/a.png");
+  EXPECT(files.cache_used() == 800u);
+  get(files, "/c.png");
+  // b was used the longest ago
+  EXPECT(files.cached_files() == 2u);
+  EXPECT(files.cache_used() == 800u);
+  const auto misses = files.misses();
+  get(files, "/a.png");
+  get(files, "/c.png");
+  EXPECT(files.misses() == misses);
+  get(files, "/b.png");
+  EXPECT(files.misses() == misses + 1);
+
+  // too big to keep, read every time
+  const int reads = disk.reads;
+  EXPECT(get(files, "/big.png").body == text(2000));
+  EXPECT(get(files, "/big.png", {{"Range", "bytes=1990-"}}).body == text(2000).substr(1990));
+  EXPECT(disk.reads == reads + 2);
+  EXPECT(files.cache_used() <= 1000u);
+
+  files.invalidate("/b.png");
+  EXPECT(files.cache_used() == 400u);
+  files.clear();
+  EXPECT(files.cached_files() == 0u);
+  EXPECT(files.cache_used() == 0u);
+}
+
+CASE("Files that aren't cached are sent a chunk at a time")
+{
+  Memory_fs disk;
+  const auto big = text(2000);
+  disk.add("/big.png", big);
+  Static_files::Options options;
+  options.max_cached_file = 1000;
+  options.read_chunk = 500;
+  Static_files files{disk, options};
+
+  const int reads = disk.reads;
+  auto reply = get(files, "/big.png");
+  EXPECT(reply.field("Content-Length") == "2000");
+  EXPECT(reply.body == big);
+  EXPECT(disk.reads == reads + 4);
+
+  reply = get(files, "/big.png", {{"Range", "bytes=300-1299"}});
+  EXPECT(reply.body == big.substr(300, 1000));
+  EXPECT(disk.reads == reads + 6);
+
+  // the next chunk is read when the previous ones are sent
+  std::string out;
+  auto stream = std::make_unique<Capture_stream>(out);
+  auto* capture = stream.get();
+  Connection conn{std::move(stream), false};
+  files.serve(make_request("GET /big.png HTTP/1.1\r\n\r\n"),
+              std::make_unique<Response_writer>(make_response(), conn));
+  EXPECT(out.find(big.substr(0, 500)) != std::string::npos);
+  EXPECT(out.find(big.substr(0, 1000)) == std::string::npos);
+  EXPECT(not capture->closed);
+  capture->send_all();
+  EXPECT(out.substr(out.size() - 2000) == big);
+  // without keep-alive, closed when all is written
+  EXPECT(capture->closed);
+}
+
+CASE("Cached files are loaded again when they change on disk")
+{
+  Memory_fs disk;
+  disk.add("/a.txt", "one");
+  Static_files::Options options;
+  options.revalidate = std::chrono::seconds{0};
+  Static_files files{disk, options};
+
+  EXPECT(get(files, "/a.txt").body == "one");
+  EXPECT(get(files, "/a.txt").body == "one");
+  EXPECT(files.hits() == 1u);
+  disk.add("/a.txt", "three");
+  EXPECT(get(files, "/a.txt").body == "three");
+  EXPECT(files.misses() == 2u);
+  EXPECT(files.cache_used() == 5u);
+
+  // immutable content is kept until purged
+  options.immutable = true;
+  Static_files immutable{disk, options};
+  EXPECT(get(immutable, "/a.txt").body == "three");
+  disk.add("/a.txt", "fourteen");
+  EXPECT(get(immutable, "/a.txt").body == "three");
+  immutable.invalidate("/a.txt");
+  EXPECT(get(immutable, "/a.txt").body == "fourteen");
+}
@@ -0,0 +1,136 @@
+#include <common.cxx>
+#include <nic_mock.hpp>
+#include <net/inet>
+
+using namespace net;
+
+static const ip4::Addr SRC{10,0,0,1};
+static const ip4::Addr DST{10,0,0,2};
+
+// a fragment of a UDP datagram where each byte is its offset
+static IP4::IP_packet_ptr fragment(Inet& inet, uint16_t id, uint32_t offset,
+                                   uint32_t len, bool more)
+{
+  auto pkt = inet.create_ip_packet(Protocol::UDP);
+  pkt->set_ip_src(SRC);
+  pkt->set_ip_dst(DST);
+  pkt->set_ip_id(id);
+  pkt->set_ip_flags(more ? ip4::Flags::MF : ip4::Flags::NONE);
+  pkt->set_ip_frag_offs(offset / 8);
+  pkt->set_ip_data_length(len);
+  pkt->set_ip_total_length(20 + len);
+  auto* data = pkt->layer_begin() + 20;
+  for (uint32_t i = 0; i < len; i++)
+    data[i] = (offset + i) & 0xff;
+  return pkt;
+}
+
+static bool intact(const IP4::IP_packet_ptr& pkt, uint32_t len)
+{
+  if (pkt == nullptr or pkt->ip_total_length() != 20 + len or pkt->size() != (int) (20 + len))
+    return false;
+  if (pkt->ip_flags() != ip4::Flags::NONE or pkt->ip_frag_offs() != 0)
+    return false;
+  if (pkt->compute_ip_checksum() != 0 or pkt->tail() != nullptr)
+    return false;
+  const auto* data = pkt->layer_begin() + 20;
+  for (uint32_t i = 0; i < len; i++)
+    if (data[i] != (i & 0xff)) return false;
+  return true;
+}
+
+CASE("Fragments are reassembled in any order")
+{
+  Nic_mock nic;
+  Inet inet{nic};
+  auto& ip = inet.ip_obj();
+
+  // small enough for the first fragment's buffer
+  EXPECT(ip.reassemble(fragment(inet, 1, 0, 400, true)) == nullptr);
+  auto pkt = ip.reassemble(fragment(inet, 1, 400, 100, false));
+  EXPECT(intact(pkt, 500));
+
+  // too large, and backwards
+  EXPECT(ip.reassemble(fragment(inet, 2, 2960, 500, false)) == nullptr);
+  EXPECT(ip.reassemble(fragment(inet, 2, 1480, 1480, true)) == nullptr);
+  EXPECT(ip.reassembly().pending() == 1u);
+  EXPECT(ip.reassembly().memory_used() > 0u);
+  pkt = ip.reassemble(fragment(inet, 2, 0, 1480, true));
+  EXPECT(intact(pkt, 3460));
+
+  // and in the middle
+  EXPECT(ip.reassemble(fragment(inet, 3, 0, 1480, true)) == nullptr);
+  EXPECT(ip.reassemble(fragment(inet, 3, 2960, 500, false)) == nullptr);
+  pkt = ip.reassemble(fragment(inet, 3, 1480, 1480, true));
+  EXPECT(intact(pkt, 3460));
+  EXPECT(ip.reassembly().pending() == 0u);
+  EXPECT(ip.reassembly().memory_used() == 0u);
+}
+
+CASE("Datagrams with the same ID from different sources are kept apart")
+{
+  Nic_mock nic;
+  Inet inet{nic};
+  auto& ip = inet.ip_obj();
+
+  EXPECT(ip.reassemble(fragment(inet, 7, 0, 1480, true)) == nullptr);
+  auto other = fragment(inet, 7, 0, 1480, true);
+  other->set_ip_src({10,0,0,3});
+  EXPECT(ip.reassemble(std::move(other)) == nullptr);
+  EXPECT(ip.reassembly().pending() == 2u);
+
+  auto pkt = ip.reassemble(fragment(inet, 7, 1480, 20, false));
+  EXPECT(intact(pkt, 1500));
+  EXPECT(pkt->ip_src() == SRC);
+  EXPECT(ip.reassembly().pending() == 1u);
+  ip.reassembly().flush();
+  EXPECT(ip.reassembly().pending() == 0u);
+}
+
+CASE("Duplicates are ignored, overlaps drop the datagram")
+{
+  Nic_mock nic;
+  Inet inet{nic};
+  auto& ip = inet.ip_obj();
+
+  EXPECT(ip.reassemble(fragment(inet, 1, 0, 1480, true)) == nullptr);
+  EXPECT(ip.reassemble(fragment(inet, 1, 0, 1480, true)) == nullptr);
+  EXPECT(intact(ip.reassemble(fragment(inet, 1, 1480, 100, false)), 1580));
+
+  EXPECT(ip.reassemble(fragment(inet, 2, 0, 1480, true)) == nullptr);
+  EXPECT(ip.reassemble(fragment(inet, 2, 1472, 408, true)) == nullptr);
+  EXPECT(ip.reassembly().pending() == 0u);
+
+  // nothing after the last fragment
+  EXPECT(ip.reassemble(fragment(inet, 3, 1480, 1480, true)) == nullptr);
+  EXPECT(ip.reassemble(fragment(inet, 3, 0, 1000, false)) == nullptr);
+  EXPECT(ip.reassembly().pending() == 0u);
+
+  // too large in total
+  EXPECT(ip.reassemble(fragment(inet, 4, 65000, 600, false)) == nullptr);
+  EXPECT(ip.reassembly().pending() == 0u);
+}
+
+CASE("The oldest datagrams are dropped at the memory limit")
+{
+  Nic_mock nic;
+  Inet inet{nic};
+  auto& ip = inet.ip_obj();
+  auto& reassembly = ip.reassembly();
+
+  EXPECT(ip.reassemble(fragment(inet, 1, 0, 1480, true)) == nullptr);
+  const auto per_fragment = reassembly.memory_used();
+  reassembly.set_memory_limit(per_fragment * 2);
+  EXPECT(ip.reassemble(fragment(inet, 2, 0, 1480, true)) == nullptr);
+  EXPECT(reassembly.pending() == 2u);
+  EXPECT(ip.reassemble(fragment(inet, 3, 0, 1480, true)) == nullptr);
+  EXPECT(reassembly.pending() == 2u);
+  EXPECT(reassembly.memory_used() == per_fragment * 2);
+
+  reassembly.set_memory_limit(ip4::Reassembly::MEMORY_LIMIT);
+
+  // the first one is gone
+  EXPECT(ip.reassemble(fragment(inet, 1, 1480, 100, false)) == nullptr);
+  EXPECT(reassembly.pending() == 3u);
+  EXPECT(intact(ip.reassemble(fragment(inet, 3, 1480, 100, false)), 1580));
+}
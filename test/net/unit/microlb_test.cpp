@@ -0,0 +1,245 @@
+#include <common.cxx>
+#include <microLB>
+#include <net/interfaces>
+#include <hw/async_device.hpp>
+#include <map>
+
+using namespace net;
+using microLB::Maglev;
+
+static std::unique_ptr<hw::Async_device<UserNet>> dev1 = nullptr;
+static std::unique_ptr<hw::Async_device<UserNet>> dev2 = nullptr;
+
+static std::vector<Maglev::Backend> backends(int count)
+{
+  std::vector<Maglev::Backend> list;
+  for (int i = 0; i < count; i++)
+    list.push_back({"10.0.0." + std::to_string(i + 1) + ":80", i, 1});
+  return list;
+}
+
+static std::vector<int> snapshot(const Maglev& maglev)
+{
+  std::vector<int> table;
+  for (uint32_t i = 0; i < maglev.size(); i++)
+    table.push_back(maglev.lookup(i));
+  return table;
+}
+
+CASE("Maglev spreads the table evenly over the backends")
+{
+  Maglev maglev;
+  EXPECT(maglev.empty());
+  EXPECT(maglev.lookup(1234) == -1);
+
+  maglev.populate(backends(5));
+  std::map<int, int> count;
+  for (int idx : snapshot(maglev)) count[idx]++;
+  EXPECT(count.size() == 5u);
+  for (auto& it : count)
+  {
+    EXPECT(it.second >= (int) maglev.size() / 5 - 1);
+    EXPECT(it.second <= (int) maglev.size() / 5 + 1);
+  }
+
+  // twice the weight, twice the share
+  auto list = backends(2);
+  list[1].weight = 2;
+  maglev.populate(list);
+  count.clear();
+  for (int idx : snapshot(maglev)) count[idx]++;
+  EXPECT(count[1] > count[0] * 19 / 10);
+  EXPECT(count[1] < count[0] * 21 / 10);
+
+  // nothing with weight 0
+  list[0].weight = 0;
+  maglev.populate(list);
+  for (int idx : snapshot(maglev)) EXPECT(idx == 1);
+  maglev.populate({});
+  EXPECT(maglev.lookup(1234) == -1);
+}
+
+CASE("Maglev moves few flows when a backend goes away")
+{
+  Maglev maglev;
+  auto list = backends(10);
+  maglev.populate(list);
+  const auto before = snapshot(maglev);
+
+  list.erase(list.begin() + 3);
+  maglev.populate(list);
+  const auto after = snapshot(maglev);
+
+  int moved = 0;
+  for (size_t i = 0; i < before.size(); i++)
+  {
+    // the flows of the removed backend must move
+    if (before[i] == 3) EXPECT(after[i] != 3);
+    else if (before[i] != after[i]) moved++;
+  }
+  // and only a few others
+  EXPECT(moved < (int) before.size() / 50);
+}
+
+static void process()
+{
+  for (int i = 0; i < 50; i++)
+    Events::get().process_events();
+}
+
+// backends answer with their port, followed by what they got
+static void listen_backends(Inet& inet, uint16_t first, int count)
+{
+  for (uint16_t port = first; port < first + count; port++)
+  {
+    inet.tcp().listen(port,
+      [port] (tcp::Connection_ptr conn) {
+        conn->on_read(1024,
+          [conn, port] (auto buf) {
+            conn->write(std::to_string(port) + ": " + std::string(buf->begin(), buf->end()));
+          });
+      });
+  }
+}
+
+struct Client {
+  tcp::Connection_ptr conn;
+  std::string data;
+  std::string reply;
+  bool closed = false;
+};
+
+static std::shared_ptr<Client> connect(Inet& inet, Socket lb, const std::string& data)
+{
+  auto client = std::make_shared<Client>();
+  client->data = data;
+  client->conn = inet.tcp().connect(lb);
+  client->conn->on_connect(
+    [client] (tcp::Connection_ptr conn) {
+      if (conn == nullptr) return;
+      conn->on_read(1024,
+        [c = client.get()] (auto buf) {
+          c->reply += std::string(buf->begin(), buf->end());
+        });
+      conn->on_close([c = client.get()] { c->closed = true; });
+      conn->write(client->data);
+    });
+  return client;
+}
+
+CASE("Setup network")
+{
+  Timers::init(
+    [] (Timers::duration_t) {},
+    [] () {}
+  );
+  dev1 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev2 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev1->connect(*dev2);
+  dev2->connect(*dev1);
+
+  // clients and backends on one side, the load balancer on the other
+  Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,43});
+  Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,42});
+  listen_backends(Interfaces::get(0), 6001, 3);
+}
+
+CASE("Sessions are spliced to the node chosen by Maglev")
+{
+  auto& inet = Interfaces::get(0);
+  auto& lb_inet = Interfaces::get(1);
+  microLB::Balancer balancer(false);
+  for (uint16_t port = 6001; port <= 6003; port++)
+  {
+    const Socket socket{{10,0,0,42}, port};
+    balancer.nodes.add_node(socket,
+        microLB::Balancer::connect_with_tcp(lb_inet, socket));
+  }
+  EXPECT(balancer.nodes.active_nodes() == 3);
+  balancer.open_for_tcp(lb_inet, 80);
+
+  int closed = 0;
+  balancer.nodes.on_session_close =
+    [&closed] (int, int, int) { closed++; };
+
+  auto client = connect(inet, {{10,0,0,43}, 80}, "hello");
+  process();
+  EXPECT(client->reply.size() == 11u);
+  EXPECT(client->reply.substr(0, 3) == "600");
+  EXPECT(client->reply.substr(4) == ": hello");
+  EXPECT(balancer.nodes.open_sessions() == 1);
+  EXPECT(balancer.wait_queue() == 0);
+
+  // the same client address goes to the same node
+  auto again = connect(inet, {{10,0,0,43}, 80}, "again");
+  process();
+  EXPECT(again->reply.substr(0, 4) == client->reply.substr(0, 4));
+  EXPECT(balancer.nodes.open_sessions() == 2);
+  EXPECT(balancer.nodes.total_sessions() == 2);
+
+  // closing the client closes the session
+  client->conn->close();
+  again->conn->close();
+  process();
+  EXPECT(closed == 2);
+  EXPECT(balancer.nodes.open_sessions() == 0);
+  EXPECT(balancer.nodes.total_sessions() == 2);
+}
+
+CASE("Clients are moved off nodes that refuse connections")
+{
+  auto& inet = Interfaces::get(0);
+  auto& lb_inet = Interfaces::get(1);
+  microLB::Balancer balancer(false);
+  balancer.nodes.set_algorithm(microLB::Algorithm::ROUND_ROBIN);
+  // nothing listens on the first node
+  for (uint16_t port : {6009, 6002})
+  {
+    const Socket socket{{10,0,0,42}, port};
+    balancer.nodes.add_node(socket,
+        microLB::Balancer::connect_with_tcp(lb_inet, socket));
+  }
+  balancer.open_for_tcp(lb_inet, 81);
+
+  auto client = connect(inet, {{10,0,0,43}, 81}, "hello");
+  process();
+  EXPECT(client->reply == "6002: hello");
+  EXPECT(balancer.nodes.get(0).is_active() == false);
+  EXPECT(balancer.nodes.get(1).is_active());
+  EXPECT(balancer.nodes.active_nodes() == 1);
+  EXPECT(balancer.nodes.open_sessions() == 1);
+
+  // with no nodes left, clients wait for one
+  balancer.nodes.get(1).set_active(false);
+  auto waiting = connect(inet, {{10,0,0,43}, 81}, "later");
+  process();
+  EXPECT(balancer.wait_queue() == 1);
+  EXPECT(waiting->reply.empty());
+  // what it sent is passed on once a node is back
+  balancer.nodes.get(1).set_active(true);
+  process();
+  EXPECT(balancer.wait_queue() == 0);
+  EXPECT(waiting->reply == "6002: later");
+}
+
+CASE("Dropped and waiting clients are closed")
+{
+  auto& inet = Interfaces::get(0);
+  auto& lb_inet = Interfaces::get(1);
+  auto balancer = std::make_unique<microLB::Balancer>(false);
+  balancer->max_queued = 1;
+  balancer->open_for_tcp(lb_inet, 82);
+
+  // without nodes the first client waits, and the queue is full
+  auto waiting = connect(inet, {{10,0,0,43}, 82}, "first");
+  process();
+  auto dropped = connect(inet, {{10,0,0,43}, 82}, "second");
+  process();
+  EXPECT(balancer->wait_queue() == 1);
+  EXPECT(not waiting->closed);
+  EXPECT(dropped->closed);
+
+  balancer = nullptr;
+  process();
+  EXPECT(waiting->closed);
+}
@@ -1,6 +1,7 @@
 
 #include <common.cxx>
 #include <net/port_util.hpp>
+#include <set>
 
 CASE("Binding and unbinding")
 {
@@ -71,3 +72,74 @@ CASE("Simulating random connections")
     EXPECT(util.has_free_ephemeral() == false);
   }
 }
+
+CASE("Ephemeral ports start from a random point")
+{
+  using namespace net;
+  srand(42);
+
+  Port_util util;
+  std::set<uint16_t> ports;
+  for(int i = 0; i < 100; ++i)
+  {
+    const auto port = util.get_next_ephemeral();
+    EXPECT(port_ranges::is_dynamic(port));
+    EXPECT(util.is_bound(port) == false);
+    ports.insert(port);
+  }
+  // not a sequence from one point
+  EXPECT(ports.size() > 90u);
+  EXPECT(*ports.rbegin() - *ports.begin() > 1000);
+
+  // the free one after a bound one
+  Port_util full;
+  for(int p = port_ranges::DYNAMIC_START; p <= port_ranges::DYNAMIC_END; p++)
+    if(p != 50000 and p != 65535)
+      full.bind(p);
+  for(int i = 0; i < 10; ++i)
+  {
+    const auto port = full.get_next_ephemeral();
+    EXPECT((port == 50000 or port == 65535));
+  }
+}
+
+CASE("Ports are reused towards distinct remotes when all are bound")
+{
+  using namespace net;
+  const Socket remote1{ip4::Addr{10,0,0,1}, 80};
+  const Socket remote2{ip4::Addr{10,0,0,2}, 80};
+
+  Port_util util;
+  for(auto i = 0; i < util.size(); ++i)
+  {
+    const auto port = util.get_next_ephemeral(remote1);
+    EXPECT(util.is_bound(port, remote1) == false);
+    util.bind(port, remote1);
+  }
+  EXPECT(util.has_free_ephemeral() == false);
+  EXPECT(util.shared_ports() == (size_t) util.size());
+  EXPECT_THROWS_AS(util.get_next_ephemeral(remote1), net::Port_error);
+
+  // a port in use towards remote1 only
+  const auto port = util.get_next_ephemeral(remote2);
+  EXPECT(util.is_bound(port));
+  EXPECT(util.is_bound(port, remote1));
+  EXPECT(util.is_bound(port, remote2) == false);
+  util.bind(port, remote2);
+  EXPECT(util.is_bound(port, remote2));
+
+  // still bound until unbound from every remote
+  util.unbind(port, remote1);
+  EXPECT(util.is_bound(port));
+  EXPECT(util.has_free_ephemeral() == false);
+  EXPECT(util.get_next_ephemeral(remote1) == port);
+  util.unbind(port, remote2);
+  EXPECT(util.is_bound(port) == false);
+  EXPECT(util.has_free_ephemeral());
+  EXPECT(util.get_next_ephemeral() == port);
+  EXPECT(util.shared_ports() == (size_t) util.size() - 1);
+
+  // unbinding twice does nothing
+  util.unbind(port, remote2);
+  EXPECT(util.is_bound(port) == false);
+}
@@ -0,0 +1,135 @@
+#include <common.cxx>
+#include <net/inet>
+#include <net/interfaces>
+#include <hw/async_device.hpp>
+
+static std::unique_ptr<hw::Async_device<UserNet>> dev1 = nullptr;
+static std::unique_ptr<hw::Async_device<UserNet>> dev2 = nullptr;
+
+CASE("Setup network")
+{
+  Timers::init(
+    [] (Timers::duration_t) {},
+    [] () {}
+  );
+  dev1 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev2 = std::make_unique<hw::Async_device<UserNet>>(UserNet::create(1500));
+  dev1->connect(*dev2);
+  dev2->connect(*dev1);
+
+  net::Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,43});
+  net::Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,42});
+}
+
+CASE("UDP datagrams are sent and received in batches")
+{
+  using namespace net;
+  auto& server = Interfaces::get(0);
+  auto& client = Interfaces::get(1);
+
+  static size_t received = 0;
+  static size_t batches  = 0;
+  static size_t largest  = 0;
+  static bool   in_order = true;
+  auto& rx = server.udp().bind(5353);
+  rx.on_read_batch(
+    [] (udp::Socket::Packet_batch batch) {
+      batches++;
+      largest = std::max(largest, batch.size());
+      for (auto& pkt : batch) {
+        if (pkt->udp_data_length() != sizeof(uint32_t)) in_order = false;
+        uint32_t seq;
+        memcpy(&seq, pkt->udp_data(), sizeof(seq));
+        if (seq != received++) in_order = false;
+      }
+    }, 16);
+
+  auto& tx = client.udp().bind();
+  // resolve the server's MAC address first, as ARP only holds one
+  // packet back while waiting for the reply
+  tx.sendto(server.ip_addr(), 5354, "x", 1);
+  for (int i = 0; i < 10; i++)
+    Events::get().process_events();
+
+  static const int COUNT = 100;
+  std::vector<uint32_t> seqs(COUNT);
+  std::vector<udp::Socket::Datagram> dgrams;
+  for (int i = 0; i < COUNT; i++) {
+    seqs[i] = i;
+    dgrams.push_back({server.ip_addr(), 5353, &seqs[i], sizeof(uint32_t)});
+  }
+  EXPECT(tx.send_batch(dgrams) <= (size_t) COUNT);
+
+  // zero-copy batch
+  udp::Socket::Packet_batch batch;
+  for (uint32_t i = COUNT; i < COUNT + 10; i++) {
+    auto pkt = tx.create_datagram(server.ip_addr(), 5353);
+    EXPECT(pkt != nullptr);
+    pkt->fill((const uint8_t*) &i, sizeof(i));
+    batch.push_back(std::move(pkt));
+  }
+
+  for (int i = 0; i < 100 && received < COUNT; i++)
+    Events::get().process_events();
+  EXPECT(received == (size_t) COUNT);
+  EXPECT(tx.send_batch(std::move(batch)) == 10u);
+  for (int i = 0; i < 100 && received < COUNT + 10; i++)
+    Events::get().process_events();
+
+  EXPECT(received == (size_t) COUNT + 10);
+  EXPECT(in_order);
+  // never more than 16 at a time
+  EXPECT(largest <= 16u);
+  EXPECT(batches >= (size_t) (COUNT + 10) / 16);
+
+  // regular delivery again
+  static size_t single = 0;
+  rx.on_read_batch(nullptr);
+  rx.on_read([] (auto, auto, const char*, size_t) { single++; });
+  tx.sendto(server.ip_addr(), 5353, "x", 1);
+  for (int i = 0; i < 100 && single == 0; i++)
+    Events::get().process_events();
+  EXPECT(single == 1u);
+}
+
+CASE("Zero-copy batches are sent after datagrams already queued")
+{
+  using namespace net;
+  auto& server = Interfaces::get(0);
+  auto& client = Interfaces::get(1);
+
+  static uint32_t next = 0;
+  static bool in_order = true;
+  auto& rx = server.udp().bind(5355);
+  rx.on_read([] (auto, auto, const char* data, size_t len) {
+    uint32_t seq;
+    memcpy(&seq, data, sizeof(seq));
+    if (len != sizeof(seq) or seq != next++) in_order = false;
+  });
+
+  auto& tx = client.udp().bind();
+  // more than the transmit queue has room for
+  const size_t room = client.transmit_queue_available();
+  const uint32_t COUNT = room + 50;
+  std::vector<uint32_t> seqs(COUNT);
+  std::vector<udp::Socket::Datagram> dgrams;
+  for (uint32_t i = 0; i < COUNT; i++) {
+    seqs[i] = i;
+    dgrams.push_back({server.ip_addr(), 5355, &seqs[i], sizeof(uint32_t)});
+  }
+  EXPECT(tx.send_batch(dgrams) < (size_t) COUNT);
+
+  udp::Socket::Packet_batch batch;
+  for (uint32_t i = COUNT; i < COUNT + 10; i++) {
+    auto pkt = tx.create_datagram(server.ip_addr(), 5355);
+    pkt->fill((const uint8_t*) &i, sizeof(i));
+    batch.push_back(std::move(pkt));
+  }
+  // datagrams are still queued, so these are queued behind them
+  EXPECT(tx.send_batch(std::move(batch)) == 0u);
+
+  for (int i = 0; i < 1000 && next < COUNT + 10; i++)
+    Events::get().process_events();
+  EXPECT(next == COUNT + 10);
+  EXPECT(in_order);
+}
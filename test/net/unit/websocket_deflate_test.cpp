@@ -0,0 +1,199 @@
+
+#include <common.cxx>
+#include <net/ws/deflate.hpp>
+#include <net/ws/websocket.hpp>
+#include <string>
+
+using namespace net;
+
+static std::string inflate(WS_deflate& z, const std::vector<uint8_t>& data)
+{
+  std::vector<uint8_t> out;
+  if (not z.decompress(data.data(), data.size(), out)) return "(corrupt)";
+  return {out.begin(), out.end()};
+}
+
+CASE("permessage-deflate decodes the RFC 7692 examples")
+{
+  WS_deflate_options opt;
+  opt.enabled = true;
+  WS_deflate client{opt, true};
+  // "Hello" in a fixed Huffman block, then again using the context
+  EXPECT(inflate(client, {0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00}) == "Hello");
+  EXPECT(inflate(client, {0xf2, 0x00, 0x11, 0x00, 0x00}) == "Hello");
+  // a stored block
+  EXPECT(inflate(client, {0x00, 0x05, 0x00, 0xfa, 0xff, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x00}) == "Hello");
+
+  std::vector<uint8_t> out;
+  const std::vector<uint8_t> junk {0xff, 0xff, 0xff};
+  EXPECT(not client.decompress(junk.data(), junk.size(), out));
+}
+
+CASE("permessage-deflate round trips with context takeover")
+{
+  WS_deflate_options opt;
+  opt.enabled = true;
+  WS_deflate server{opt, false};
+  WS_deflate client{opt, true};
+
+  size_t raw = 0, compressed = 0;
+  for (int i = 0; i < 200; i++)
+  {
+    const std::string msg = "{\"type\":\"quote\",\"symbol\":\"ACME\",\"price\":"
+        + std::to_string(1000 + i * 7) + ",\"volume\":" + std::to_string(i * 31)
+        + ",\"exchange\":\"XOSL\",\"currency\":\"NOK\"}";
+    const auto& z = server.compress((const uint8_t*) msg.data(), msg.size());
+    raw += msg.size();
+    compressed += z.size();
+    EXPECT(inflate(client, z) == msg);
+  }
+  // repeated keys are references into earlier messages
+  EXPECT(compressed * 4 < raw);
+
+  // larger than the window, with long matches
+  std::string big;
+  for (int i = 0; i < 20000; i++) big += std::to_string(i % 97) + ",";
+  const auto& z = client.compress((const uint8_t*) big.data(), big.size());
+  EXPECT(z.size() < big.size() / 4);
+  EXPECT(inflate(server, z) == big);
+}
+
+CASE("permessage-deflate without context takeover and with a dictionary")
+{
+  WS_deflate_options opt;
+  opt.enabled = true;
+  opt.server_no_context_takeover = true;
+  opt.server_max_window_bits = 10;
+  opt.dictionary = std::make_shared<const std::vector<uint8_t>>(
+      std::vector<uint8_t>{'"', 's', 'y', 'm', 'b', 'o', 'l', '"', ':'});
+  WS_deflate server{opt, false};
+  WS_deflate client{opt, true};
+
+  const std::string msg = "{\"symbol\":\"ACME\"}";
+  const std::vector<uint8_t> first = server.compress((const uint8_t*) msg.data(), msg.size());
+  const auto& second = server.compress((const uint8_t*) msg.data(), msg.size());
+  // every message starts over from the dictionary
+  EXPECT(first == second);
+  EXPECT(inflate(client, first) == msg);
+  EXPECT(inflate(client, second) == msg);
+
+  std::vector<uint8_t> out;
+  EXPECT(not client.decompress(first.data(), first.size(), out, 4));
+}
+
+CASE("permessage-deflate negotiation")
+{
+  WS_deflate_options server;
+  server.enabled = true;
+  server.server_max_window_bits = 12;
+
+  auto agreed = server.accept("x-webkit-deflate-frame, permessage-deflate; "
+                              "client_max_window_bits; server_max_window_bits=10");
+  EXPECT(agreed.enabled);
+  EXPECT(agreed.server_max_window_bits == 10);
+  EXPECT(agreed.client_max_window_bits == 15);
+  EXPECT(agreed.response() == "permessage-deflate; server_max_window_bits=10");
+
+  // unknown parameters decline the offer, the next one is used
+  agreed = server.accept("permessage-deflate; foo=1, permessage-deflate; server_no_context_takeover");
+  EXPECT(agreed.enabled);
+  EXPECT(agreed.server_no_context_takeover);
+  EXPECT(not server.accept("permessage-deflate; server_max_window_bits=16").enabled);
+  EXPECT(not server.accept("").enabled);
+
+  WS_deflate_options client;
+  client.enabled = true;
+  client.client_max_window_bits = 11;
+  EXPECT(client.offer() == "permessage-deflate; client_max_window_bits=11");
+  agreed = server.accept(client.offer());
+  EXPECT(agreed.client_max_window_bits == 11);
+
+  WS_deflate_options result;
+  EXPECT(client.agree(agreed.response(), result));
+  EXPECT(result.enabled);
+  EXPECT(result.server_max_window_bits == 12);
+  EXPECT(result.client_max_window_bits == 11);
+  EXPECT(client.agree("", result));
+  EXPECT(not result.enabled);
+  EXPECT(not client.agree("permessage-deflate; foo", result));
+  EXPECT(not WS_deflate_options{}.agree("permessage-deflate", result));
+}
+
+// hands frames straight to the websocket
+class Frame_stream : public net::Stream {
+public:
+  void feed(std::vector<uint8_t> frame)
+  {
+    auto buf = construct_buffer(frame.begin(), frame.end());
+    read_cb(buf);
+  }
+  bool closed = false;
+
+  void on_connect(ConnectCallback) override {}
+  void on_read(size_t, ReadCallback cb) override { read_cb = cb; }
+  void on_data(DataCallback) override {}
+  size_t next_size() override { return 0; }
+  buffer_t read_next() override { return construct_buffer(); }
+  void on_close(CloseCallback) override {}
+  void on_write(WriteCallback) override {}
+  void write(const void*, size_t) override {}
+  void write(buffer_t) override {}
+  void write(const std::string&) override {}
+  void close() override { closed = true; }
+  void reset_callbacks() override {}
+  net::Socket local() const override { return {}; }
+  net::Socket remote() const override { return {}; }
+  std::string to_string() const override { return "Frame"; }
+  bool is_connected() const noexcept override { return not closed; }
+  bool is_writable() const noexcept override { return not closed; }
+  bool is_readable() const noexcept override { return not closed; }
+  bool is_closing() const noexcept override { return false; }
+  bool is_closed() const noexcept override { return closed; }
+  int get_cpuid() const noexcept override { return 0; }
+  Stream* transport() noexcept override { return nullptr; }
+
+private:
+  ReadCallback read_cb;
+};
+
+CASE("RSV1 is only accepted on the first frame of a data message")
+{
+  WS_deflate_options opt;
+  opt.enabled = true;
+  WS_deflate client{opt, true};
+  const std::string hello = "Hello";
+  const std::vector<uint8_t> z = client.compress((const uint8_t*) hello.data(), hello.size());
+
+  static std::string error, read;
+  auto make_server = [&opt] (Frame_stream*& stream) {
+    auto s = std::make_unique<Frame_stream>();
+    stream = s.get();
+    auto ws = std::make_unique<WebSocket>(std::move(s), false);
+    ws->set_compression(opt);
+    ws->on_error = [] (std::string reason) { error = reason; };
+    ws->on_read  = [] (auto msg) { read = msg->to_string(); };
+    return ws;
+  };
+
+  Frame_stream* stream;
+  auto ws = make_server(stream);
+  // FIN, RSV1, TEXT, masked with a zero key
+  std::vector<uint8_t> frame {0xc1, (uint8_t) (0x80 | z.size()), 0, 0, 0, 0};
+  frame.insert(frame.end(), z.begin(), z.end());
+  stream->feed(frame);
+  EXPECT(read == "Hello");
+  EXPECT(error.empty());
+  EXPECT(not stream->closed);
+
+  // PING with RSV1
+  stream->feed({0xc9, 0x80, 0, 0, 0, 0});
+  EXPECT(stream->closed);
+  EXPECT(error == "read: RSV1 set on a control or continuation frame");
+
+  // continuation with RSV1
+  error.clear();
+  ws = make_server(stream);
+  stream->feed({0xc0, 0x80, 0, 0, 0, 0});
+  EXPECT(stream->closed);
+  EXPECT(error == "read: RSV1 set on a control or continuation frame");
+}
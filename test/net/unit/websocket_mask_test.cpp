@@ -0,0 +1,85 @@
+
+#include <common.cxx>
+#include <net/ws/websocket.hpp>
+#include <vector>
+
+using namespace net;
+
+static void reference_mask(uint8_t* data, size_t len, uint32_t key, size_t offset)
+{
+  const auto* kb = (const uint8_t*) &key;
+  for (size_t i = 0; i < len; i++)
+    data[i] ^= kb[(i + offset) & 3];
+}
+
+CASE("ws_mask matches the byte-wise masking algorithm")
+{
+  const uint32_t key = 0xA1B2C3D4;
+  std::vector<uint8_t> input(1031);
+  for (size_t i = 0; i < input.size(); i++) input[i] = i * 7 + 3;
+
+  for (size_t len : {0, 1, 3, 4, 15, 16, 17, 31, 32, 63, 64, 127, 128, 129, 1000})
+  for (size_t offset = 0; offset < 4; offset++)
+  for (size_t align = 0; align < 3; align++)
+  {
+    auto a = input;
+    auto b = input;
+    ws_mask((char*) &a[align], len, key, offset);
+    reference_mask(&b[align], len, key, offset);
+    EXPECT(a == b);
+  }
+  // masking twice restores the data
+  auto c = input;
+  ws_mask((char*) c.data(), c.size(), key);
+  EXPECT(c != input);
+  ws_mask((char*) c.data(), c.size(), key);
+  EXPECT(c == input);
+}
+
+static std::vector<uint8_t> make_frame(const std::string& payload, uint32_t key)
+{
+  std::vector<uint8_t> frame(ws_header::header_length(payload.size(), true));
+  auto& hdr = *(ws_header*) frame.data();
+  hdr.bits = 0;
+  hdr.set_payload(payload.size());
+  hdr.set_final();
+  hdr.set_opcode(op_code::TEXT);
+  hdr.set_masked(key);
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  ((ws_header*) frame.data())->masking_algorithm(
+      (char*) &frame[frame.size() - payload.size()]);
+  return frame;
+}
+
+CASE("WebSocket messages are parsed in place or across buffers")
+{
+  const std::string payload(300, 'x');
+  auto frame = make_frame(payload, 0x11223344);
+
+  // whole frame in one buffer: refers to it
+  auto buf = Stream::construct_buffer(frame.begin(), frame.end());
+  WebSocket::Message view(buf, buf->data());
+  EXPECT(view.is_view());
+  EXPECT(view.is_complete());
+  EXPECT(view.size() == payload.size());
+  view.unmask();
+  EXPECT(view.to_string() == payload);
+  EXPECT(view.extract_vector().size() == payload.size());
+
+  // delivered one byte at a time
+  WebSocket::Message msg(frame.data(), 1);
+  size_t used = 1;
+  while (used < frame.size())
+    used += msg.append(&frame[used], 1);
+  EXPECT(msg.is_complete());
+  EXPECT(not msg.is_view());
+  msg.unmask();
+  EXPECT(msg.to_string() == payload);
+
+  // a second frame after the first is not consumed
+  auto two = frame;
+  two.insert(two.end(), frame.begin(), frame.end());
+  WebSocket::Message first(two.data(), 0);
+  EXPECT(first.append(two.data(), two.size()) == frame.size());
+  EXPECT(first.is_complete());
+}
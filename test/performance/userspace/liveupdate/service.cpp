@@ -0,0 +1,213 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2018 IncludeOS AS, Oslo, Norway
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * LiveUpdate blackout benchmark (userspace platform)
+ *
+ * Measures the time spent storing state during an update, which is when
+ * the service is frozen, against the number of open TCP connections:
+ *  - full:    all connections serialized during the update
+ *  - precopy: connections pre-copied ahead of the update, with one of
+ *             the SHARDS partitions dirty when the update happens
+ *
+ * Prints the results in the same JSON format as netbench, also written to
+ * the file named by $LIUBENCH_OUT if set, so they can be compared against
+ * a baseline with ../netbench/check.py.
+ * Connection counts can be scaled with $LIUBENCH_SCALE (default 1.0).
+**/
+
+#include <os>
+#include <liveupdate>
+#include <hw/async_device.hpp>
+#include <net/inet>
+#include <net/interfaces>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+using namespace net;
+using namespace liu;
+
+static const uint16_t MTU = 1500;
+static const int PAIRS  = 4;
+// ephemeral ports per client address
+static const size_t PER_PAIR = 15000;
+static const int SHARDS = 8;
+static const int ROUNDS = 5;
+static const size_t STORAGE_SIZE = 256 * 1024 * 1024;
+
+using Device = hw::Async_device<UserNet>;
+static std::vector<std::unique_ptr<Device>> devices;
+static char* storage_area = nullptr;
+
+// server side of every connection, by shard
+static std::vector<tcp::Connection_ptr> shards[SHARDS];
+static std::vector<tcp::Connection_ptr> clients;
+static size_t established = 0;
+
+static std::vector<size_t> counts;
+static size_t current = 0;
+static std::string json;
+static double scale = 1.0;
+
+static inline double now() {
+  return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const std::string& name, double millis, size_t conns)
+{
+  printf("%-24s %10.3f ms\n", name.c_str(), millis);
+  char value[64];
+  snprintf(value, sizeof(value), "%.3f", millis);
+  if (not json.empty()) json += ", ";
+  json += "{\"name\": \"" + name + "\", \"value\": " + value
+        + ", \"unit\": \"ms\", \"higher_is_better\": false"
+        + ", \"connections\": " + std::to_string(conns) + "}";
+}
+
+static void register_shards(bool incremental)
+{
+  for (int i = 0; i < SHARDS; i++)
+  {
+    LiveUpdate::storage_func func =
+      [i] (Storage& store) {
+        for (auto& conn : shards[i])
+            store.add_connection(1, conn);
+        store.put_marker(2);
+      };
+    // re-registering replaces the partition on the userspace platform
+    const std::string key = "conns" + std::to_string(i);
+    if (incremental)
+      LiveUpdate::register_incremental_partition(key, func);
+    else
+      LiveUpdate::register_partition(key, func);
+  }
+}
+
+// median time of storing all partitions
+static double measure_store(bool dirty_one)
+{
+  std::vector<double> times;
+  for (int i = 0; i < ROUNDS; i++)
+  {
+    if (dirty_one) LiveUpdate::mark_dirty("conns" + std::to_string(i % SHARDS));
+    const double start = now();
+    LiveUpdate::store({storage_area, STORAGE_SIZE});
+    times.push_back((now() - start) * 1000.0);
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+static void run_benchmark(size_t conns)
+{
+  register_shards(false);
+  report("blackout_full_" + std::to_string(conns), measure_store(false), conns);
+
+  register_shards(true);
+  const double start = now();
+  const size_t bytes = LiveUpdate::precopy();
+  printf("%-24s %10.3f ms (%zu bytes)\n", "precopy", (now() - start) * 1000.0, bytes);
+  report("blackout_precopy_" + std::to_string(conns), measure_store(true), conns);
+}
+
+static void next_count();
+
+// open connections, a window at a time, until @target are established
+static void open_connections(size_t target)
+{
+  static const size_t INFLIGHT = 64;
+  static size_t opened;
+  static size_t wanted;
+  opened = established;
+  wanted = target;
+
+  static delegate<void()> open_one;
+  open_one = [] {
+    if (opened >= wanted) return;
+    const int pair = opened % PAIRS;
+    opened++;
+    auto& server = Interfaces::get(pair * 2);
+    auto& client = Interfaces::get(pair * 2 + 1);
+    client.tcp().connect({server.ip_addr(), 1000},
+      [] (tcp::Connection_ptr conn) {
+        if (conn == nullptr) std::abort();
+        clients.push_back(conn);
+        open_one();
+      });
+  };
+  for (size_t i = 0; i < INFLIGHT; i++) open_one();
+}
+
+static void next_count()
+{
+  if (current < counts.size()) {
+    open_connections(counts[current]);
+    return;
+  }
+  json = "{\"benchmarks\": [" + json + "]}";
+  printf("LIUBENCH_BEGIN\n%s\nLIUBENCH_END\n", json.c_str());
+  if (const char* out = getenv("LIUBENCH_OUT"))
+  {
+    FILE* f = fopen(out, "w");
+    if (f) {
+      fprintf(f, "%s\n", json.c_str());
+      fclose(f);
+    }
+  }
+  delete[] storage_area;
+  os::shutdown();
+}
+
+void Service::start()
+{
+  if (const char* s = getenv("LIUBENCH_SCALE")) scale = atof(s);
+  for (size_t n : {1000, 10000, 50000})
+      counts.push_back(std::min(PAIRS * PER_PAIR, std::max((size_t) 1, (size_t) (n * scale))));
+  storage_area = new char[STORAGE_SIZE];
+
+  for (int pair = 0; pair < PAIRS; pair++)
+  {
+    devices.push_back(std::make_unique<Device>(UserNet::create(MTU)));
+    auto& a = *devices.back();
+    devices.push_back(std::make_unique<Device>(UserNet::create(MTU)));
+    auto& b = *devices.back();
+    a.connect(b);
+    b.connect(a);
+
+    const uint8_t net = 10 + pair;
+    auto& server = Interfaces::get(pair * 2);
+    auto& client = Interfaces::get(pair * 2 + 1);
+    server.network_config({10,net,0,42}, {255,255,255,0}, {10,net,0,1});
+    client.network_config({10,net,0,43}, {255,255,255,0}, {10,net,0,1});
+
+    server.tcp().listen(1000,
+      [] (tcp::Connection_ptr conn) {
+        shards[established % SHARDS].push_back(conn);
+        if (++established == counts[current]) {
+          printf("*** %zu connections\n", established);
+          run_benchmark(established);
+          current++;
+          next_count();
+        }
+      });
+  }
+  printf("*** LiveUpdate blackout benchmark started (scale %.2f) ***\n", scale);
+  next_count();
+}
@@ -0,0 +1,15 @@
+#!/bin/bash
+# Run the benchmark and, if a baseline is given, fail on regressions:
+#   ./test.sh [baseline.json] [tolerance]
+# Create a baseline on the reference machine with:
+#   LIUBENCH_OUT=baseline.json ./test.sh
+set -e
+export CC=gcc-7
+export CXX=g++-7
+export LIUBENCH_OUT=${LIUBENCH_OUT:-results.json}
+$INCLUDEOS_PREFIX/bin/lxp-run
+
+if [ -n "$1" ]; then
+  python3 $(dirname $0)/../netbench/check.py $LIUBENCH_OUT $1 --tolerance ${2:-0.2}
+fi
+echo ">>> Userspace LiveUpdate blackout benchmark done"
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""
+Compare netbench results against a baseline.
+
+Exits with status 1 if any benchmark is worse than the baseline by more
+than the tolerance (a fraction, default 0.2), so it can gate CI.
+"""
+import argparse
+import json
+import sys
+
+def load(path):
+    with open(path) as f:
+        return {b["name"]: b for b in json.load(f)["benchmarks"]}
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("results")
+    parser.add_argument("baseline")
+    parser.add_argument("--tolerance", type=float, default=0.2)
+    args = parser.parse_args()
+
+    results = load(args.results)
+    baseline = load(args.baseline)
+    failed = False
+
+    for name, base in sorted(baseline.items()):
+        if name not in results:
+            print("%-16s missing from results" % name)
+            failed = True
+            continue
+        value = results[name]["value"]
+        ref = base["value"]
+        change = (value - ref) / ref if ref else 0.0
+        if not base.get("higher_is_better", True):
+            change = -change
+        regressed = change < -args.tolerance
+        failed |= regressed
+        print("%-16s %14.2f %-7s baseline %14.2f  %+6.1f%%%s" % (
+            name, value, results[name]["unit"], ref, change * 100,
+            "  REGRESSION" if regressed else ""))
+
+    return 1 if failed else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
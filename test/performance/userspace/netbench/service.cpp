@@ -0,0 +1,356 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2018 IncludeOS AS, Oslo, Norway
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Network stack benchmarks on in-memory NIC pairs (userspace platform)
+ *
+ * Runs each benchmark in turn and prints the results as one JSON object
+ * between NETBENCH_BEGIN / NETBENCH_END markers, also written to the file
+ * named by $NETBENCH_OUT if set. Compare against a baseline with check.py.
+ *
+ * Sizes can be scaled with $NETBENCH_SCALE (default 1.0).
+**/
+
+#include <os>
+#include <statman>
+#include <hw/async_device.hpp>
+#include <net/inet>
+#include <net/interfaces>
+#include <net/router.hpp>
+#include <net/http/server.hpp>
+#include <net/http/basic_client.hpp>
+#include <kernel/timers.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+using namespace net;
+
+static const uint16_t MTU = 1500;
+static double scale = 1.0;
+
+using Device = hw::Async_device<UserNet>;
+static std::vector<std::unique_ptr<Device>> devices;
+static std::unique_ptr<Router<IP4>> router;
+
+struct Result {
+  std::string name;
+  std::string unit;
+  double      value;
+  bool        higher_is_better;
+  std::string extra;
+};
+static std::vector<Result> results;
+
+using bench_func = delegate<void()>;
+static std::vector<std::pair<const char*, bench_func>> benchmarks;
+static size_t current = 0;
+static void next_benchmark();
+
+static inline double now() {
+  return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+static size_t scaled(size_t n) {
+  return std::max((size_t) 1, (size_t) (n * scale));
+}
+static void report(std::string name, double value, std::string unit,
+                   bool higher_is_better = true, std::string extra = "")
+{
+  printf("%-16s %14.2f %s %s\n", name.c_str(), value, unit.c_str(), extra.c_str());
+  results.push_back({std::move(name), std::move(unit), value,
+                     higher_is_better, std::move(extra)});
+}
+// let the stack settle (delayed ACKs, closes) before the next benchmark
+static void finish_benchmark()
+{
+  Timers::oneshot(milliseconds(10), [] (int) { next_benchmark(); });
+}
+
+// two in-memory NICs wired to each other
+static void make_pair()
+{
+  devices.push_back(std::make_unique<Device>(UserNet::create(MTU)));
+  auto& a = *devices.back();
+  devices.push_back(std::make_unique<Device>(UserNet::create(MTU)));
+  auto& b = *devices.back();
+  a.connect(b);
+  b.connect(a);
+}
+
+/// bulk TCP transfer, client -> server
+static void bench_tcp_bulk()
+{
+  static const size_t CHUNK = 1024 * 1024;
+  static size_t total;
+  static size_t received;
+  static double start;
+  total = scaled(256) * CHUNK;
+  received = 0;
+
+  auto& server = Interfaces::get(0);
+  auto& client = Interfaces::get(1);
+  server.tcp().listen(1000,
+    [] (tcp::Connection_ptr conn) {
+      conn->on_read(CHUNK,
+        [conn] (auto buf) {
+          received += buf->size();
+          if (received < total) return;
+          const double secs = now() - start;
+          report("tcp_bulk", (total * 8) / secs / 1e6, "Mbps");
+          conn->close();
+          finish_benchmark();
+        });
+    });
+
+  auto buf = tcp::construct_buffer(CHUNK);
+  start = now();
+  client.tcp().connect({server.ip_addr(), 1000},
+    [buf] (tcp::Connection_ptr conn) {
+      if (conn == nullptr) std::abort();
+      for (size_t i = 0; i < total / CHUNK; i++)
+        conn->write(buf);
+    });
+}
+
+/// many short connections: connect, one request byte, close
+static void bench_tcp_churn()
+{
+  static const int INFLIGHT = 32;
+  static size_t total;
+  static size_t started;
+  static size_t closed;
+  static double start;
+  total = scaled(4000);
+  started = closed = 0;
+
+  auto& server = Interfaces::get(0);
+  server.tcp().listen(1001,
+    [] (tcp::Connection_ptr conn) {
+      conn->on_read(16, [conn] (auto) { conn->close(); });
+    });
+
+  static delegate<void()> open_one;
+  open_one = [] {
+    if (started >= total) return;
+    started++;
+    auto& server = Interfaces::get(0);
+    Interfaces::get(1).tcp().connect({server.ip_addr(), 1001},
+      [] (tcp::Connection_ptr conn) {
+        if (conn == nullptr) std::abort();
+        conn->on_close(
+          [] {
+            if (++closed == total) {
+              report("tcp_churn", total / (now() - start), "conn/s");
+              finish_benchmark();
+              return;
+            }
+            open_one();
+          });
+        conn->write("x");
+        conn->close();
+      });
+  };
+  start = now();
+  for (int i = 0; i < INFLIGHT; i++) open_one();
+}
+
+/// small UDP datagrams over one NIC pair, or through the router
+static void udp_pps(const char* name, Inet& from, Inet& to, uint16_t port)
+{
+  static const size_t WINDOW = 256;
+  static const size_t PAYLOAD = 64;
+  static size_t total;
+  static size_t sent;
+  static size_t received;
+  static double start;
+  static const char* bench_name;
+  static udp::Socket* tx;
+  static ip4::Addr dest;
+  static uint16_t dport;
+  static Timers::id_t watchdog;
+  static size_t last_seen;
+  static bool   finished;
+  total = scaled(200000);
+  sent = received = last_seen = 0;
+  finished = false;
+  bench_name = name;
+  dest  = to.ip_addr();
+  dport = port;
+
+  static auto done = [] {
+    finished = true;
+    Timers::stop(watchdog);
+    const double secs = now() - start;
+    report(bench_name, received / secs, "pps", true,
+           "\"lost\": " + std::to_string(sent - received));
+    finish_benchmark();
+  };
+  static auto send_burst = [] (size_t count) {
+    static const char payload[PAYLOAD] {};
+    for (size_t i = 0; i < count && sent < total; i++, sent++)
+      tx->sendto(dest, dport, payload, sizeof(payload));
+  };
+
+  auto& rx = to.udp().bind(port);
+  rx.on_read(
+    [] (auto, auto, const char*, size_t) {
+      if (finished) return;
+      if (++received == total) return done();
+      // keep WINDOW datagrams in flight
+      if (sent - received <= WINDOW / 2) send_burst(WINDOW / 2);
+    });
+  tx = &from.udp().bind();
+
+  // datagrams can be dropped: finish with whatever arrived
+  watchdog = Timers::periodic(seconds(1), seconds(1),
+    [] (int) {
+      if (received == last_seen) done();
+      last_seen = received;
+    });
+
+  start = now();
+  send_burst(WINDOW);
+}
+static void bench_udp_pps()
+{
+  udp_pps("udp_pps", Interfaces::get(1), Interfaces::get(0), 1002);
+}
+
+/// keep-alive HTTP requests from a number of concurrent clients
+static void bench_http_rps()
+{
+  static const int CLIENTS = 16;
+  static size_t total;
+  static size_t issued;
+  static size_t completed;
+  static double start;
+  static std::unique_ptr<http::Server> server;
+  static std::unique_ptr<http::Basic_client> client;
+  total = scaled(20000);
+  issued = completed = 0;
+
+  auto& sinet = Interfaces::get(0);
+  server = std::make_unique<http::Server>(sinet.tcp());
+  server->on_request(
+    [] (http::Request_ptr, http::Response_writer_ptr writer) {
+      writer->write("Hello, benchmark!");
+    });
+  server->listen(1003);
+
+  client = std::make_unique<http::Basic_client>(Interfaces::get(1).tcp());
+  static delegate<void()> request_one;
+  request_one = [] {
+    if (issued >= total) return;
+    issued++;
+    client->get({Interfaces::get(0).ip_addr(), 1003}, "/", {},
+      [] (http::Error err, http::Response_ptr res, http::Connection&) {
+        if (err or res == nullptr) std::abort();
+        if (++completed == total) {
+          report("http_rps", total / (now() - start), "req/s");
+          finish_benchmark();
+          return;
+        }
+        request_one();
+      });
+  };
+  start = now();
+  for (int i = 0; i < CLIENTS; i++) request_one();
+}
+
+/// UDP through a router between two more NIC pairs
+static void bench_router()
+{
+  udp_pps("router_fwd", Interfaces::get(2), Interfaces::get(5), 1004);
+}
+
+static void next_benchmark()
+{
+  if (current < benchmarks.size()) {
+    auto& bench = benchmarks[current++];
+    printf("*** %s\n", bench.first);
+    bench.second();
+    return;
+  }
+  // machine-readable results
+  std::string json = "{\"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const auto& r = results[i];
+    char value[64];
+    snprintf(value, sizeof(value), "%.3f", r.value);
+    if (i) json += ", ";
+    json += "{\"name\": \"" + r.name + "\", \"value\": " + value
+          + ", \"unit\": \"" + r.unit + "\", \"higher_is_better\": "
+          + (r.higher_is_better ? "true" : "false");
+    if (not r.extra.empty()) json += ", " + r.extra;
+    json += "}";
+  }
+  json += "]}";
+  printf("NETBENCH_BEGIN\n%s\nNETBENCH_END\n", json.c_str());
+
+  if (const char* out = getenv("NETBENCH_OUT"))
+  {
+    FILE* f = fopen(out, "w");
+    if (f) {
+      fprintf(f, "%s\n", json.c_str());
+      fclose(f);
+    }
+  }
+  os::shutdown();
+}
+
+void Service::start()
+{
+  if (const char* s = getenv("NETBENCH_SCALE")) scale = atof(s);
+
+  // 0 <-> 1: server and client
+  make_pair();
+  // 2 <-> 3, 4 <-> 5: client - router - server
+  make_pair();
+  make_pair();
+
+  Interfaces::get(0).network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,1});
+  Interfaces::get(1).network_config({10,0,0,43}, {255,255,255,0}, {10,0,0,1});
+
+  auto& client = Interfaces::get(2);
+  auto& inner  = Interfaces::get(3);
+  auto& outer  = Interfaces::get(4);
+  auto& server = Interfaces::get(5);
+  client.network_config({10,1,0,10}, {255,255,255,0}, {10,1,0,1});
+  inner.network_config ({10,1,0,1},  {255,255,255,0}, {0,0,0,0});
+  outer.network_config ({10,2,0,1},  {255,255,255,0}, {0,0,0,0});
+  server.network_config({10,2,0,10}, {255,255,255,0}, {10,2,0,1});
+
+  Router<IP4>::Routing_table routing_table{
+    {{10,1,0,0}, {255,255,255,0}, {0,0,0,0}, inner, 1},
+    {{10,2,0,0}, {255,255,255,0}, {0,0,0,0}, outer, 1}
+  };
+  router = std::make_unique<Router<IP4>>(routing_table);
+  inner.set_forward_delg(router->forward_delg());
+  outer.set_forward_delg(router->forward_delg());
+
+  benchmarks = {
+    {"TCP bulk transfer",     bench_tcp_bulk},
+    {"TCP connection churn",  bench_tcp_churn},
+    {"UDP packets/sec",       bench_udp_pps},
+    {"HTTP requests/sec",     bench_http_rps},
+    {"Router forwarding",     bench_router},
+  };
+  printf("*** Network benchmarks started (scale %.2f) ***\n", scale);
+  next_benchmark();
+}
@@ -0,0 +1,15 @@
+#!/bin/bash
+# Run the benchmarks and, if a baseline is given, fail on regressions:
+#   ./test.sh [baseline.json] [tolerance]
+# Create a baseline on the reference machine with:
+#   NETBENCH_OUT=baseline.json ./test.sh
+set -e
+export CC=gcc-7
+export CXX=g++-7
+export NETBENCH_OUT=${NETBENCH_OUT:-results.json}
+$INCLUDEOS_PREFIX/bin/lxp-run
+
+if [ -n "$1" ]; then
+  python3 $(dirname $0)/check.py $NETBENCH_OUT $1 --tolerance ${2:-0.2}
+fi
+echo ">>> Userspace network benchmarks done"
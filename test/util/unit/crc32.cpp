@@ -24,3 +24,73 @@ CASE("Various text strings with known CRC32 matches")
   EXPECT(crc32_fast(q2.c_str(), q2.size()) == crc32c(q2.c_str(), q2.size()));
   
 }
+
+#include <util/crc64.hpp>
+#include <vector>
+
+static std::vector<char> test_data(size_t len)
+{
+  std::vector<char> data(len);
+  uint32_t x = 0x12345678;
+  for (auto& c : data) {
+    x = x * 1103515245 + 12345;
+    c = x >> 16;
+  }
+  return data;
+}
+
+CASE("Accelerated CRC32 and CRC32-C match the table-driven versions")
+{
+  const auto data = test_data(5000);
+  // short, exactly folded and unaligned lengths and offsets
+  for (size_t len : {0, 1, 15, 64, 255, 256, 257, 1024, 1031, 4000})
+  for (size_t off : {0, 1, 3, 8})
+  {
+    const char* buf = data.data() + off;
+    EXPECT(crc32(buf, len) == ~crc32(0xFFFFFFFF, buf, len));
+    EXPECT(crc32_fast(buf, len) == crc32c(buf, len));
+  }
+}
+
+CASE("Streaming CRC over split buffers equals the CRC of the whole")
+{
+  const auto data = test_data(3000);
+  const std::string text = "The quick brown fox jumps over the lazy dog";
+
+  util::CRC32 crc;
+  crc.update(data.data(), 1).update(data.data() + 1, 700)
+     .update(data.data() + 701, data.size() - 701);
+  EXPECT(crc.value() == crc32(data.data(), data.size()));
+
+  std::vector<std::string> parts {"The quick brown ", "fox jumps ", "", "over the lazy dog"};
+  util::CRC32C crcc;
+  crcc.update(parts.begin(), parts.end());
+  EXPECT(crcc.value() == crc32c(text.data(), text.size()));
+
+  crcc.reset();
+  crcc.update(text);
+  EXPECT(crcc.value() == crc32_fast(text.data(), text.size()));
+}
+
+CASE("CRC64 with and without carry-less multiplication")
+{
+  // CRC-64/XZ check value
+  const std::string check = "123456789";
+  EXPECT(uint64_t(util::crc64_ecma_checksum(check)) == 0x995DC9BBDF1939FAull);
+  EXPECT(uint64_t(util::crc64_ecma_checksum(check.data(), check.size())) == 0x995DC9BBDF1939FAull);
+
+  const auto data = test_data(5000);
+  for (size_t len : {255, 256, 300, 1024, 4099})
+  for (size_t off : {0, 5})
+  {
+    const char* buf = data.data() + off;
+    EXPECT(util::crc64_ecma_checksum::fast_checksum(0, buf, len)
+        == util::crc64_ecma_checksum::checksum(0, buf, len));
+    EXPECT(util::crc64_iso_checksum::fast_checksum(0, buf, len)
+        == util::crc64_iso_checksum::checksum(0, buf, len));
+    // continued from a previous checksum
+    const auto first = util::crc64_iso_checksum::checksum(0, buf, 100);
+    EXPECT(util::crc64_iso_checksum::fast_checksum(first, buf + 100, len)
+        == util::crc64_iso_checksum::checksum(first, buf + 100, len));
+  }
+}
@@ -116,4 +116,7 @@ namespace os::mem
   size_t min_psize() {
     return 4096;
   }
+  size_t huge_page_size() noexcept {
+    return 0;
+  }
 }
@@ -9,6 +9,14 @@ uint64_t StackSampler::samples_asleep() noexcept {
 }
 void StackSampler::print(int) {}
 void StackSampler::set_mode(mode_t) {}
+std::string StackSampler::folded() {
+  return "";
+}
+std::vector<uint8_t> StackSampler::pprof() {
+  return {};
+}
+void StackSampler::print_folded() {}
+void StackSampler::serve(net::TCP&, uint16_t) {}
 
 std::string HeapDiag::to_string()
 {